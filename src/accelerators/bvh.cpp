@@ -38,6 +38,7 @@
 #include "stats.h"
 #include "parallel.h"
 #include <algorithm>
+#include <array>
 
 namespace pbrt {
 
@@ -45,6 +46,8 @@ STAT_MEMORY_COUNTER("Memory/BVH tree", treeBytes);
 STAT_RATIO("BVH/Primitives per leaf node", totalPrimitives, totalLeafNodes);
 STAT_COUNTER("BVH/Interior nodes", interiorNodes);
 STAT_COUNTER("BVH/Leaf nodes", leafNodes);
+STAT_COUNTER("BVH/Refits", nRefits);
+STAT_COUNTER("BVH/Ray stream traversals", nBatchTraversals);
 
 // BVHAccel Local Declarations
 struct BVHPrimitiveInfo {
@@ -103,7 +106,72 @@ struct LinearBVHNode {
     uint8_t pad[1];        // ensure 32 byte total size
 };
 
+// CompressedBVHNode stores up to four children, with the children's bounds
+// quantized to 8 bits per axis relative to the node's own bounds. The
+// quantization step on each axis is a power of two, 2^exponent[axis].
+struct CompressedBVHNode {
+    Point3f origin;
+    int8_t exponent[3];
+    uint8_t nChildren;
+    uint8_t qMin[3][4], qMax[3][4];
+    int32_t childOffset[4];     // first primitive (leaf) or node (interior)
+    uint16_t nPrimitives[4];    // 0 -> interior child
+};
+
 // BVHAccel Utility Functions
+inline Float QuantizationStep(int exponent) {
+    // Build 2^exponent directly from its IEEE bit pattern
+    return BitsToFloat(uint32_t(exponent + 127) << 23);
+}
+
+inline Float Dequantize(Float origin, uint8_t q, Float step) {
+    return origin + q * step;
+}
+
+static void QuantizeChildBounds(CompressedBVHNode *node, const Bounds3f &bounds,
+                                const Bounds3f childBounds[4]) {
+    node->origin = bounds.pMin;
+    for (int a = 0; a < 3; ++a) {
+        // Find the smallest power-of-two step that spans the node's extent
+        // in 255 steps
+        Float extent = bounds.pMax[a] - bounds.pMin[a];
+        int exponent = -126;
+        if (extent > 0) std::frexp(extent / 255, &exponent);
+        exponent = Clamp(exponent, -126, 127);
+        while (exponent < 127 &&
+               Dequantize(node->origin[a], 255, QuantizationStep(exponent)) <
+                   bounds.pMax[a])
+            ++exponent;
+        node->exponent[a] = exponent;
+        Float step = QuantizationStep(exponent);
+
+        // Round child bounds outward so decoded boxes are conservative
+        for (int c = 0; c < node->nChildren; ++c) {
+            const Bounds3f &cb = childBounds[c];
+            int lo = Clamp((int)std::floor((cb.pMin[a] - node->origin[a]) / step),
+                           0, 255);
+            while (lo > 0 && Dequantize(node->origin[a], lo, step) > cb.pMin[a])
+                --lo;
+            int hi = Clamp((int)std::ceil((cb.pMax[a] - node->origin[a]) / step),
+                           0, 255);
+            while (hi < 255 && Dequantize(node->origin[a], hi, step) < cb.pMax[a])
+                ++hi;
+            node->qMin[a][c] = lo;
+            node->qMax[a][c] = hi;
+        }
+    }
+}
+
+inline Bounds3f DequantizeChildBounds(const CompressedBVHNode &node, int child,
+                                      const Float step[3]) {
+    Bounds3f b;
+    for (int a = 0; a < 3; ++a) {
+        b.pMin[a] = Dequantize(node.origin[a], node.qMin[a][child], step[a]);
+        b.pMax[a] = Dequantize(node.origin[a], node.qMax[a][child], step[a]);
+    }
+    return b;
+}
+
 inline uint32_t LeftShift3(uint32_t x) {
     CHECK_LE(x, (1 << 10));
     if (x == (1 << 10)) --x;
@@ -181,7 +249,8 @@ static void RadixSort(std::vector<MortonPrimitive> *v) {
 
 // BVHAccel Method Definitions
 BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
-                   int maxPrimsInNode, SplitMethod splitMethod)
+                   int maxPrimsInNode, SplitMethod splitMethod,
+                   bool compressNodes)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)),
       splitMethod(splitMethod),
       primitives(std::move(p)) {
@@ -196,7 +265,6 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
 
     // Build BVH tree for primitives using _primitiveInfo_
     MemoryArena arena(1024 * 1024);
-    int totalNodes = 0;
     std::vector<std::shared_ptr<Primitive>> orderedPrims;
     orderedPrims.reserve(primitives.size());
     BVHBuildNode *root;
@@ -215,6 +283,23 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
                               float(arena.TotalAllocated()) /
                               (1024.f * 1024.f));
 
+    bounds = root->bounds;
+    if (compressNodes) {
+        // Collapse the binary tree into quantized 4-wide nodes
+        std::vector<CompressedBVHNode> compressed;
+        compressBVHTree(root, compressed);
+        totalNodes = compressed.size();
+        treeBytes += totalNodes * sizeof(CompressedBVHNode) + sizeof(*this) +
+                     primitives.size() * sizeof(primitives[0]);
+        compressedNodes = AllocAligned<CompressedBVHNode>(totalNodes);
+        std::copy(compressed.begin(), compressed.end(), compressedNodes);
+        LOG(INFO) << StringPrintf("Compressed BVH to %d nodes (%.2f MB)",
+                                  totalNodes,
+                                  float(totalNodes * sizeof(CompressedBVHNode)) /
+                                  (1024.f * 1024.f));
+        return;
+    }
+
     // Compute representation of depth-first traversal of BVH tree
     treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
                  primitives.size() * sizeof(primitives[0]);
@@ -224,8 +309,50 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
     CHECK_EQ(totalNodes, offset);
 }
 
-Bounds3f BVHAccel::WorldBound() const {
-    return nodes ? nodes[0].bounds : Bounds3f();
+Bounds3f BVHAccel::WorldBound() const { return bounds; }
+
+void BVHAccel::Refit() {
+    // Recompute node bounds from the current primitive bounds, keeping the
+    // tree topology. Children are always stored after their parent in the
+    // depth-first node order, so a reverse sweep visits both children of a
+    // node before the node itself.
+    ProfilePhase _(Prof::AccelConstruction);
+    ++nRefits;
+    if (compressedNodes) {
+        bounds = refitCompressed(0);
+        return;
+    }
+    if (!nodes) return;
+    for (int i = totalNodes - 1; i >= 0; --i) {
+        LinearBVHNode *node = &nodes[i];
+        if (node->nPrimitives > 0) {
+            Bounds3f leafBounds;
+            for (int j = 0; j < node->nPrimitives; ++j)
+                leafBounds = Union(leafBounds,
+                                   primitives[node->primitivesOffset + j]->WorldBound());
+            node->bounds = leafBounds;
+        } else
+            node->bounds =
+                Union(nodes[i + 1].bounds, nodes[node->secondChildOffset].bounds);
+    }
+    bounds = nodes[0].bounds;
+}
+
+Bounds3f BVHAccel::refitCompressed(int nodeIndex) {
+    CompressedBVHNode *node = &compressedNodes[nodeIndex];
+    Bounds3f childBounds[4], nodeBounds;
+    for (int c = 0; c < node->nChildren; ++c) {
+        if (node->nPrimitives[c] > 0) {
+            for (int i = 0; i < node->nPrimitives[c]; ++i)
+                childBounds[c] = Union(
+                    childBounds[c],
+                    primitives[node->childOffset[c] + i]->WorldBound());
+        } else
+            childBounds[c] = refitCompressed(node->childOffset[c]);
+        nodeBounds = Union(nodeBounds, childBounds[c]);
+    }
+    QuantizeChildBounds(node, nodeBounds, childBounds);
+    return nodeBounds;
 }
 
 struct BucketInfo {
@@ -657,9 +784,63 @@ int BVHAccel::flattenBVHTree(BVHBuildNode *node, int *offset) {
     return myOffset;
 }
 
-BVHAccel::~BVHAccel() { FreeAligned(nodes); }
+int BVHAccel::compressBVHTree(
+    BVHBuildNode *node, std::vector<CompressedBVHNode> &compressed) const {
+    // Gather up to four children by repeatedly opening the interior child
+    // with the largest surface area
+    BVHBuildNode *children[4];
+    int nChildren;
+    if (node->nPrimitives > 0) {
+        // Only happens for a root that is itself a leaf
+        children[0] = node;
+        nChildren = 1;
+    } else {
+        children[0] = node->children[0];
+        children[1] = node->children[1];
+        nChildren = 2;
+    }
+    while (nChildren < 4) {
+        int best = -1;
+        Float bestArea = -1;
+        for (int c = 0; c < nChildren; ++c)
+            if (children[c]->nPrimitives == 0 &&
+                children[c]->bounds.SurfaceArea() > bestArea) {
+                best = c;
+                bestArea = children[c]->bounds.SurfaceArea();
+            }
+        if (best == -1) break;
+        BVHBuildNode *opened = children[best];
+        children[best] = opened->children[0];
+        children[nChildren++] = opened->children[1];
+    }
+
+    // Emit the node and then its interior children, depth first
+    int myOffset = compressed.size();
+    compressed.push_back(CompressedBVHNode());
+    Bounds3f childBounds[4];
+    for (int c = 0; c < nChildren; ++c) childBounds[c] = children[c]->bounds;
+    compressed[myOffset].nChildren = nChildren;
+    QuantizeChildBounds(&compressed[myOffset], node->bounds, childBounds);
+    for (int c = 0; c < nChildren; ++c) {
+        int childOffset, nPrimitives = children[c]->nPrimitives;
+        if (nPrimitives > 0) {
+            CHECK_LT(nPrimitives, 65536);
+            childOffset = children[c]->firstPrimOffset;
+        } else
+            childOffset = compressBVHTree(children[c], compressed);
+        compressed[myOffset].childOffset[c] = childOffset;
+        compressed[myOffset].nPrimitives[c] = nPrimitives;
+    }
+    return myOffset;
+}
+
+BVHAccel::~BVHAccel() {
+    FreeAligned(nodes);
+    FreeAligned(compressedNodes);
+}
 
 bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
+    if (compressedNodes) return intersectCompressed(ray, isect);
     if (!nodes) return false;
     ProfilePhase p(Prof::AccelIntersect);
     bool hit = false;
@@ -700,6 +881,7 @@ bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
 }
 
 bool BVHAccel::IntersectP(const Ray &ray) const {
+    if (compressedNodes) return intersectPCompressed(ray);
     if (!nodes) return false;
     ProfilePhase p(Prof::AccelIntersectP);
     Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
@@ -737,6 +919,149 @@ bool BVHAccel::IntersectP(const Ray &ray) const {
     return false;
 }
 
+void BVHAccel::IntersectBatch(int nRays, const Ray *const *rays,
+                              SurfaceInteraction *const *isects,
+                              bool *hits) const {
+    if (compressedNodes) {
+        Primitive::IntersectBatch(nRays, rays, isects, hits);
+        return;
+    }
+    for (int i = 0; i < nRays; ++i) hits[i] = false;
+    if (!nodes || nRays == 0) return;
+    ProfilePhase p(Prof::AccelIntersect);
+    ++nBatchTraversals;
+    // Precompute per-ray traversal data and find the majority direction,
+    // which decides the order in which the stream visits children
+    std::vector<Vector3f> invDir(nRays);
+    std::vector<std::array<int, 3>> dirIsNeg(nRays);
+    int nNeg[3] = {0, 0, 0};
+    for (int i = 0; i < nRays; ++i) {
+        const Vector3f &d = rays[i]->d;
+        invDir[i] = Vector3f(1 / d.x, 1 / d.y, 1 / d.z);
+        for (int a = 0; a < 3; ++a) {
+            dirIsNeg[i][a] = invDir[i][a] < 0;
+            nNeg[a] += dirIsNeg[i][a];
+        }
+    }
+    bool streamIsNeg[3] = {2 * nNeg[0] > nRays, 2 * nNeg[1] > nRays,
+                           2 * nNeg[2] > nRays};
+
+    // Follow the ray stream through the BVH. Each stack entry refers to the
+    // span of _rayIndices_ holding the rays that reached its parent; the
+    // rays that also overlap the node itself are appended past the end of
+    // the buffer, so spans of finished subtrees can be discarded on pop.
+    struct StreamEntry {
+        int nodeIndex, begin, end;
+    };
+    std::vector<int> rayIndices(nRays);
+    for (int i = 0; i < nRays; ++i) rayIndices[i] = i;
+    std::vector<StreamEntry> toVisit;
+    toVisit.push_back({0, 0, nRays});
+    while (!toVisit.empty()) {
+        StreamEntry entry = toVisit.back();
+        toVisit.pop_back();
+        rayIndices.resize(entry.end);
+        const LinearBVHNode *node = &nodes[entry.nodeIndex];
+
+        // Filter the entry's rays against the node's bounds
+        int begin = rayIndices.size();
+        for (int j = entry.begin; j < entry.end; ++j) {
+            int r = rayIndices[j];
+            if (node->bounds.IntersectP(*rays[r], invDir[r], &dirIsNeg[r][0]))
+                rayIndices.push_back(r);
+        }
+        int end = rayIndices.size();
+        if (begin == end) continue;
+
+        if (node->nPrimitives > 0) {
+            // Intersect active rays with primitives in leaf BVH node
+            for (int i = 0; i < node->nPrimitives; ++i) {
+                const Primitive &prim = *primitives[node->primitivesOffset + i];
+                for (int j = begin; j < end; ++j) {
+                    int r = rayIndices[j];
+                    if (prim.Intersect(*rays[r], isects[r])) hits[r] = true;
+                }
+            }
+        } else {
+            // Push far child first so that the near one is visited next
+            int first = entry.nodeIndex + 1, second = node->secondChildOffset;
+            if (streamIsNeg[node->axis]) std::swap(first, second);
+            toVisit.push_back({second, begin, end});
+            toVisit.push_back({first, begin, end});
+        }
+    }
+}
+
+bool BVHAccel::intersectCompressed(const Ray &ray,
+                                   SurfaceInteraction *isect) const {
+    ProfilePhase p(Prof::AccelIntersect);
+    bool hit = false;
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+    // Follow ray through quantized nodes; leaf children are intersected as
+    // soon as their boxes are hit, interior children are visited nearest
+    // first
+    int toVisitOffset = 0, nodesToVisit[256];
+    nodesToVisit[toVisitOffset++] = 0;
+    while (toVisitOffset > 0) {
+        const CompressedBVHNode &node = compressedNodes[nodesToVisit[--toVisitOffset]];
+        Float step[3] = {QuantizationStep(node.exponent[0]),
+                         QuantizationStep(node.exponent[1]),
+                         QuantizationStep(node.exponent[2])};
+        int interior[4], nInterior = 0;
+        Float distance[4];
+        for (int c = 0; c < node.nChildren; ++c) {
+            Bounds3f b = DequantizeChildBounds(node, c, step);
+            if (!b.IntersectP(ray, invDir, dirIsNeg)) continue;
+            if (node.nPrimitives[c] > 0) {
+                for (int i = 0; i < node.nPrimitives[c]; ++i)
+                    if (primitives[node.childOffset[c] + i]->Intersect(ray,
+                                                                       isect))
+                        hit = true;
+            } else {
+                // Insert child by distance of its center along the ray
+                Float d = Dot(b.pMin + b.pMax - 2 * ray.o, ray.d);
+                int j = nInterior++;
+                for (; j > 0 && distance[j - 1] < d; --j) {
+                    interior[j] = interior[j - 1];
+                    distance[j] = distance[j - 1];
+                }
+                interior[j] = node.childOffset[c];
+                distance[j] = d;
+            }
+        }
+        for (int j = 0; j < nInterior; ++j)
+            nodesToVisit[toVisitOffset++] = interior[j];
+    }
+    return hit;
+}
+
+bool BVHAccel::intersectPCompressed(const Ray &ray) const {
+    ProfilePhase p(Prof::AccelIntersectP);
+    Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    int dirIsNeg[3] = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+    int toVisitOffset = 0, nodesToVisit[256];
+    nodesToVisit[toVisitOffset++] = 0;
+    while (toVisitOffset > 0) {
+        const CompressedBVHNode &node = compressedNodes[nodesToVisit[--toVisitOffset]];
+        Float step[3] = {QuantizationStep(node.exponent[0]),
+                         QuantizationStep(node.exponent[1]),
+                         QuantizationStep(node.exponent[2])};
+        for (int c = 0; c < node.nChildren; ++c) {
+            if (!DequantizeChildBounds(node, c, step)
+                     .IntersectP(ray, invDir, dirIsNeg))
+                continue;
+            if (node.nPrimitives[c] > 0) {
+                for (int i = 0; i < node.nPrimitives[c]; ++i)
+                    if (primitives[node.childOffset[c] + i]->IntersectP(ray))
+                        return true;
+            } else
+                nodesToVisit[toVisitOffset++] = node.childOffset[c];
+        }
+    }
+    return false;
+}
+
 std::shared_ptr<BVHAccel> CreateBVHAccelerator(
     std::vector<std::shared_ptr<Primitive>> prims, const ParamSet &ps) {
     std::string splitMethodName = ps.FindOneString("splitmethod", "sah");
@@ -756,7 +1081,9 @@ std::shared_ptr<BVHAccel> CreateBVHAccelerator(
     }
 
     int maxPrimsInNode = ps.FindOneInt("maxnodeprims", 4);
-    return std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode, splitMethod);
+    bool compressNodes = ps.FindOneBool("compressnodes", false);
+    return std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode,
+                                      splitMethod, compressNodes);
 }
 
 }  // namespace pbrt
@@ -50,6 +50,7 @@ struct BVHBuildNode;
 struct BVHPrimitiveInfo;
 struct MortonPrimitive;
 struct LinearBVHNode;
+struct CompressedBVHNode;
 
 // BVHAccel Declarations
 class BVHAccel : public Aggregate {
@@ -60,11 +61,15 @@ class BVHAccel : public Aggregate {
     // BVHAccel Public Methods
     BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
              int maxPrimsInNode = 1,
-             SplitMethod splitMethod = SplitMethod::SAH);
+             SplitMethod splitMethod = SplitMethod::SAH,
+             bool compressNodes = false);
     Bounds3f WorldBound() const;
     ~BVHAccel();
     bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
     bool IntersectP(const Ray &ray) const;
+    void IntersectBatch(int nRays, const Ray *const *rays,
+                        SurfaceInteraction *const *isects, bool *hits) const;
+    void Refit();
 
   private:
     // BVHAccel Private Methods
@@ -86,12 +91,21 @@ class BVHAccel : public Aggregate {
                                 std::vector<BVHBuildNode *> &treeletRoots,
                                 int start, int end, int *totalNodes) const;
     int flattenBVHTree(BVHBuildNode *node, int *offset);
+    int compressBVHTree(BVHBuildNode *node,
+                        std::vector<CompressedBVHNode> &compressed) const;
+    Bounds3f refitCompressed(int nodeIndex);
+    bool intersectCompressed(const Ray &ray, SurfaceInteraction *isect) const;
+    bool intersectPCompressed(const Ray &ray) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
     std::vector<std::shared_ptr<Primitive>> primitives;
     LinearBVHNode *nodes = nullptr;
+    int totalNodes = 0;
+    // Set instead of _nodes_ when the BVH uses the quantized 4-wide layout
+    CompressedBVHNode *compressedNodes = nullptr;
+    Bounds3f bounds;
 };
 
 std::shared_ptr<BVHAccel> CreateBVHAccelerator(
@@ -36,10 +36,13 @@
 #include "paramset.h"
 #include "interaction.h"
 #include "stats.h"
+#include "parallel.h"
 #include <algorithm>
 
 namespace pbrt {
 
+STAT_COUNTER("Kd-Tree/Subtrees built in parallel", nParallelSubtrees);
+
 // KdTreeAccel Local Declarations
 struct KdAccelNode {
     // KdAccelNode Methods
@@ -80,10 +83,33 @@ struct BoundEdge {
     EdgeType type;
 };
 
+// Intermediate tree used by the binned builder; subtrees are built
+// independently and then flattened into the depth-first _nodes_ array.
+struct KdBuildNode {
+    int axis = 3;  // 3 marks a leaf, as in _KdAccelNode_
+    Float split = 0;
+    std::vector<int> primNums;
+    std::unique_ptr<KdBuildNode> children[2];
+};
+
+// Subtree whose construction was deferred to the parallel phase
+struct KdBuildTask {
+    KdBuildNode *node;
+    Bounds3f bounds;
+    std::vector<int> primNums;
+    int depth, badRefines;
+};
+
+static PBRT_CONSTEXPR int nKdBins = 32;
+// Subtrees with fewer primitives are built right away rather than handed
+// to a worker thread, where they wouldn't be worth the task's overhead.
+static PBRT_CONSTEXPR size_t minKdDeferSize = 256;
+
 // KdTreeAccel Method Definitions
 KdTreeAccel::KdTreeAccel(std::vector<std::shared_ptr<Primitive>> p,
                          int isectCost, int traversalCost, Float emptyBonus,
-                         int maxPrims, int maxDepth)
+                         int maxPrims, int maxDepth,
+                         BuildMethod buildMethod)
     : isectCost(isectCost),
       traversalCost(traversalCost),
       maxPrims(maxPrims),
@@ -103,6 +129,10 @@ KdTreeAccel::KdTreeAccel(std::vector<std::shared_ptr<Primitive>> p,
         bounds = Union(bounds, b);
         primBounds.push_back(b);
     }
+    if (buildMethod == BuildMethod::Binned) {
+        buildTreeBinned(maxDepth, primBounds);
+        return;
+    }
 
     // Allocate working memory for kd-tree construction
     std::unique_ptr<BoundEdge[]> edges[3];
@@ -262,6 +292,167 @@ retrySplit:
               prims0, prims1 + nPrimitives, badRefines);
 }
 
+void KdTreeAccel::buildTreeBinned(int maxDepth,
+                                  const std::vector<Bounds3f> &primBounds) {
+    // Build the top of the tree serially, deferring subtrees that are small
+    // enough to be worth handing to a worker thread
+    size_t nPrimitives = primitives.size();
+    size_t deferSize = 0;
+    if (nPrimitives >= 4096)
+        deferSize = std::max<size_t>(
+            1024, nPrimitives / (8 * size_t(NumWorkerThreads())));
+    std::vector<int> primNums(nPrimitives);
+    for (size_t i = 0; i < nPrimitives; ++i) primNums[i] = i;
+    std::unique_ptr<KdBuildNode> root(new KdBuildNode);
+    std::vector<KdBuildTask> deferred;
+    buildBinned(root.get(), bounds, primBounds, std::move(primNums), maxDepth,
+                0, deferSize, deferSize > 0 ? &deferred : nullptr);
+
+    // Build deferred subtrees in parallel, largest first
+    std::sort(deferred.begin(), deferred.end(),
+              [](const KdBuildTask &a, const KdBuildTask &b) {
+                  return a.primNums.size() > b.primNums.size();
+              });
+    ParallelFor([&](int64_t i) {
+        KdBuildTask &task = deferred[i];
+        buildBinned(task.node, task.bounds, primBounds,
+                    std::move(task.primNums), task.depth, task.badRefines, 0,
+                    nullptr);
+    }, deferred.size());
+
+    // Flatten the build tree into _nodes_ in depth-first order
+    std::function<int(const KdBuildNode *)> countNodes =
+        [&](const KdBuildNode *node) -> int {
+        if (node->axis == 3) return 1;
+        return 1 + countNodes(node->children[0].get()) +
+               countNodes(node->children[1].get());
+    };
+    nAllocedNodes = countNodes(root.get());
+    nodes = AllocAligned<KdAccelNode>(nAllocedNodes);
+    flattenBinned(root.get());
+    CHECK_EQ(nextFreeNode, nAllocedNodes);
+}
+
+void KdTreeAccel::buildBinned(KdBuildNode *node, const Bounds3f &nodeBounds,
+                              const std::vector<Bounds3f> &allPrimBounds,
+                              std::vector<int> primNums, int depth,
+                              int badRefines, size_t deferSize,
+                              std::vector<KdBuildTask> *deferred) const {
+    int nPrimitives = primNums.size();
+    if (deferred && nPrimitives > maxPrims && depth > 0 &&
+        primNums.size() >= minKdDeferSize && primNums.size() <= deferSize) {
+        ++nParallelSubtrees;
+        deferred->push_back(
+            {node, nodeBounds, std::move(primNums), depth, badRefines});
+        return;
+    }
+
+    // Initialize leaf node if termination criteria met
+    if (nPrimitives <= maxPrims || depth == 0) {
+        node->primNums = std::move(primNums);
+        return;
+    }
+
+    // Count primitive bound starts and ends in bins along all three axes
+    int startCount[3][nKdBins] = {}, endCount[3][nKdBins] = {};
+    Vector3f d = nodeBounds.pMax - nodeBounds.pMin;
+    auto binIndex = [&](Float t, int axis) {
+        int b = int(nKdBins * (t - nodeBounds.pMin[axis]) / d[axis]);
+        return Clamp(b, 0, nKdBins - 1);
+    };
+    for (int pn : primNums) {
+        const Bounds3f &b = allPrimBounds[pn];
+        for (int axis = 0; axis < 3; ++axis) {
+            if (d[axis] <= 0) continue;
+            ++startCount[axis][binIndex(b.pMin[axis], axis)];
+            ++endCount[axis][binIndex(b.pMax[axis], axis)];
+        }
+    }
+
+    // Sweep the bin boundaries of each axis to find the best split
+    int bestAxis = -1;
+    Float bestCost = Infinity, bestSplit = 0;
+    Float oldCost = isectCost * Float(nPrimitives);
+    Float invTotalSA = 1 / nodeBounds.SurfaceArea();
+    for (int axis = 0; axis < 3; ++axis) {
+        if (d[axis] <= 0) continue;
+        int otherAxis0 = (axis + 1) % 3, otherAxis1 = (axis + 2) % 3;
+        int nBelow = 0, nAbove = nPrimitives;
+        for (int i = 1; i < nKdBins; ++i) {
+            // Consider the plane between bins _i-1_ and _i_
+            nBelow += startCount[axis][i - 1];
+            nAbove -= endCount[axis][i - 1];
+            Float t = nodeBounds.pMin[axis] + d[axis] * i / nKdBins;
+            Float belowSA = 2 * (d[otherAxis0] * d[otherAxis1] +
+                                 (t - nodeBounds.pMin[axis]) *
+                                     (d[otherAxis0] + d[otherAxis1]));
+            Float aboveSA = 2 * (d[otherAxis0] * d[otherAxis1] +
+                                 (nodeBounds.pMax[axis] - t) *
+                                     (d[otherAxis0] + d[otherAxis1]));
+            Float pBelow = belowSA * invTotalSA;
+            Float pAbove = aboveSA * invTotalSA;
+            Float eb = (nAbove == 0 || nBelow == 0) ? emptyBonus : 0;
+            Float cost =
+                traversalCost +
+                isectCost * (1 - eb) * (pBelow * nBelow + pAbove * nAbove);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = t;
+            }
+        }
+    }
+
+    // Create leaf if no good splits were found
+    if (bestCost > oldCost) ++badRefines;
+    if ((bestCost > 4 * oldCost && nPrimitives < 16) || bestAxis == -1 ||
+        badRefines == 3) {
+        node->primNums = std::move(primNums);
+        return;
+    }
+
+    // Classify primitives with respect to split; primitives lying flat in
+    // the split plane go to both children
+    std::vector<int> prims0, prims1;
+    for (int pn : primNums) {
+        const Bounds3f &b = allPrimBounds[pn];
+        bool below = b.pMin[bestAxis] < bestSplit;
+        bool above = b.pMax[bestAxis] > bestSplit;
+        if (below || !above) prims0.push_back(pn);
+        if (above || !below) prims1.push_back(pn);
+    }
+    // Release the parent's list before recursing to bound scratch memory
+    std::vector<int>().swap(primNums);
+
+    // Recursively initialize children nodes
+    node->axis = bestAxis;
+    node->split = bestSplit;
+    Bounds3f bounds0 = nodeBounds, bounds1 = nodeBounds;
+    bounds0.pMax[bestAxis] = bounds1.pMin[bestAxis] = bestSplit;
+    node->children[0].reset(new KdBuildNode);
+    node->children[1].reset(new KdBuildNode);
+    buildBinned(node->children[0].get(), bounds0, allPrimBounds,
+                std::move(prims0), depth - 1, badRefines, deferSize, deferred);
+    buildBinned(node->children[1].get(), bounds1, allPrimBounds,
+                std::move(prims1), depth - 1, badRefines, deferSize, deferred);
+}
+
+void KdTreeAccel::flattenBinned(KdBuildNode *node) {
+    int nodeNum = nextFreeNode++;
+    if (node->axis == 3) {
+        nodes[nodeNum].InitLeaf(node->primNums.data(), node->primNums.size(),
+                                &primitiveIndices);
+        return;
+    }
+    // Free each subtree as soon as it has been emitted
+    flattenBinned(node->children[0].get());
+    node->children[0].reset();
+    int aboveChild = nextFreeNode;
+    nodes[nodeNum].InitInterior(node->axis, aboveChild, node->split);
+    flattenBinned(node->children[1].get());
+    node->children[1].reset();
+}
+
 bool KdTreeAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
     ProfilePhase p(Prof::AccelIntersect);
     // Compute initial parametric range of ray inside kd-tree extent
@@ -437,8 +628,19 @@ std::shared_ptr<KdTreeAccel> CreateKdTreeAccelerator(
     Float emptyBonus = ps.FindOneFloat("emptybonus", 0.5f);
     int maxPrims = ps.FindOneInt("maxprims", 1);
     int maxDepth = ps.FindOneInt("maxdepth", -1);
+    std::string buildMethodName = ps.FindOneString("buildmethod", "sweep");
+    KdTreeAccel::BuildMethod buildMethod;
+    if (buildMethodName == "sweep")
+        buildMethod = KdTreeAccel::BuildMethod::Sweep;
+    else if (buildMethodName == "binned")
+        buildMethod = KdTreeAccel::BuildMethod::Binned;
+    else {
+        Warning("Kd-tree build method \"%s\" unknown.  Using \"sweep\".",
+                buildMethodName.c_str());
+        buildMethod = KdTreeAccel::BuildMethod::Sweep;
+    }
     return std::make_shared<KdTreeAccel>(std::move(prims), isectCost, travCost, emptyBonus,
-                                         maxPrims, maxDepth);
+                                         maxPrims, maxDepth, buildMethod);
 }
 
 }  // namespace pbrt
@@ -47,12 +47,18 @@ namespace pbrt {
 // KdTreeAccel Declarations
 struct KdAccelNode;
 struct BoundEdge;
+struct KdBuildNode;
+struct KdBuildTask;
 class KdTreeAccel : public Aggregate {
   public:
+    // KdTreeAccel Public Types
+    enum class BuildMethod { Sweep, Binned };
+
     // KdTreeAccel Public Methods
     KdTreeAccel(std::vector<std::shared_ptr<Primitive>> p,
                 int isectCost = 80, int traversalCost = 1,
-                Float emptyBonus = 0.5, int maxPrims = 1, int maxDepth = -1);
+                Float emptyBonus = 0.5, int maxPrims = 1, int maxDepth = -1,
+                BuildMethod buildMethod = BuildMethod::Sweep);
     Bounds3f WorldBound() const { return bounds; }
     ~KdTreeAccel();
     bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
@@ -65,6 +71,13 @@ class KdTreeAccel : public Aggregate {
                    int nprims, int depth,
                    const std::unique_ptr<BoundEdge[]> edges[3], int *prims0,
                    int *prims1, int badRefines = 0);
+    void buildTreeBinned(int maxDepth, const std::vector<Bounds3f> &primBounds);
+    void buildBinned(KdBuildNode *node, const Bounds3f &nodeBounds,
+                     const std::vector<Bounds3f> &allPrimBounds,
+                     std::vector<int> primNums, int depth, int badRefines,
+                     size_t deferSize,
+                     std::vector<KdBuildTask> *deferred) const;
+    void flattenBinned(KdBuildNode *node);
 
     // KdTreeAccel Private Data
     const int isectCost, traversalCost, maxPrims;
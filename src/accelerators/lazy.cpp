@@ -0,0 +1,75 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// accelerators/lazy.cpp*
+#include "accelerators/lazy.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_PERCENT("Scene/Deferred shapes created", nLazyCreated, nLazyPrimitives);
+
+// LazyPrimitive Method Definitions
+LazyPrimitive::LazyPrimitive(
+    const Bounds3f &bounds, std::function<std::shared_ptr<Primitive>()> create)
+    : bounds(bounds), create(std::move(create)) {
+    ++nLazyPrimitives;
+}
+
+const Primitive *LazyPrimitive::get() const {
+    std::call_once(createOnce, [this]() {
+        ProfilePhase _(Prof::AccelConstruction);
+        primitive = create();
+        // Release whatever the creation function captured.
+        create = nullptr;
+        created = true;
+        ++nLazyCreated;
+    });
+    return primitive.get();
+}
+
+bool LazyPrimitive::Intersect(const Ray &r, SurfaceInteraction *isect) const {
+    if (!bounds.IntersectP(r)) return false;
+    const Primitive *prim = get();
+    return prim && prim->Intersect(r, isect);
+}
+
+bool LazyPrimitive::IntersectP(const Ray &r) const {
+    if (!bounds.IntersectP(r)) return false;
+    const Primitive *prim = get();
+    return prim && prim->IntersectP(r);
+}
+
+bool LazyPrimitive::IsCreated() const { return created; }
+
+}  // namespace pbrt
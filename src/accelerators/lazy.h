@@ -0,0 +1,79 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_LAZY_H
+#define PBRT_ACCELERATORS_LAZY_H
+
+// accelerators/lazy.h*
+#include "pbrt.h"
+#include "primitive.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace pbrt {
+
+// LazyPrimitive Declarations
+
+// Stands in for geometry whose creation is deferred until a ray first
+// reaches its bounds. The first thread to get there runs the creation
+// function; any others that arrive meanwhile wait for it to finish.
+class LazyPrimitive : public Aggregate {
+  public:
+    // LazyPrimitive Public Methods
+    LazyPrimitive(const Bounds3f &bounds,
+                  std::function<std::shared_ptr<Primitive>()> create);
+    Bounds3f WorldBound() const { return bounds; }
+    bool Intersect(const Ray &r, SurfaceInteraction *) const;
+    bool IntersectP(const Ray &r) const;
+    bool IsCreated() const;
+
+  private:
+    // LazyPrimitive Private Methods
+    const Primitive *get() const;
+
+    // LazyPrimitive Private Data
+    const Bounds3f bounds;
+    mutable std::function<std::shared_ptr<Primitive>()> create;
+    mutable std::once_flag createOnce;
+    mutable std::shared_ptr<Primitive> primitive;
+    mutable std::atomic<bool> created{false};
+};
+
+}  // namespace pbrt
+
+#endif  // PBRT_ACCELERATORS_LAZY_H
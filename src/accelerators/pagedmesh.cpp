@@ -0,0 +1,330 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// accelerators/pagedmesh.cpp*
+#include "accelerators/pagedmesh.h"
+#include "accelerators/bvh.h"
+#include "fileutil.h"
+#include "interaction.h"
+#include "shapes/triangle.h"
+#include "stats.h"
+#include <stdio.h>
+
+namespace pbrt {
+
+STAT_COUNTER("Geometry paging/Meshes paged", nPagedMeshes);
+STAT_COUNTER("Geometry paging/Mesh loads", nMeshLoads);
+STAT_COUNTER("Geometry paging/Mesh evictions", nMeshEvictions);
+STAT_MEMORY_COUNTER("Memory/Geometry cache files", cacheFileBytes);
+
+// PagedMesh Local Declarations
+static const char pagedMeshMagic[8] = {'P', 'B', 'R', 'T', 'M', 'S', 'H', '1'};
+enum PagedMeshFlags { HasN = 1, HasS = 2, HasUV = 4, HasFaceIndices = 8 };
+
+struct PagedMeshHeader {
+    char magic[8];
+    int32_t nTriangles, nVertices;
+    int32_t flags;
+    int32_t floatSize;
+};
+
+// Estimate of the memory used by a loaded mesh: its vertex data plus a
+// _Triangle_, _GeometricPrimitive_ and two BVH nodes per triangle.
+static size_t ResidentMeshBytes(const TriangleMesh &mesh) {
+    size_t bytes = sizeof(TriangleMesh) + 3 * mesh.nTriangles * sizeof(int) +
+                   mesh.nVertices * sizeof(Point3f);
+    if (mesh.n) bytes += mesh.nVertices * sizeof(Normal3f);
+    if (mesh.s) bytes += mesh.nVertices * sizeof(Vector3f);
+    if (mesh.uv) bytes += mesh.nVertices * sizeof(Point2f);
+    bytes += mesh.faceIndices.size() * sizeof(int);
+    bytes += size_t(mesh.nTriangles) *
+             (sizeof(Triangle) + sizeof(GeometricPrimitive) + 64 + 2 * 32);
+    return bytes;
+}
+
+// Small per-thread cache of recently used meshes, like _TileLookupCache_
+// for texture tiles. Lookups that hit it take no locks and don't touch
+// shared reference counts; its entries keep their meshes alive for the
+// thread even after the MeshPageCache evicts them.
+struct MeshLookupCache {
+    static PBRT_CONSTEXPR int Size = 16;
+    struct Entry {
+        uint64_t owner = 0;
+        std::shared_ptr<Primitive> prim;
+    };
+    Entry entries[Size];
+    static MeshLookupCache &ForThread() {
+        static thread_local MeshLookupCache cache;
+        return cache;
+    }
+};
+
+static uint64_t NewPagedMeshId() {
+    // Ids are never reused, so stale per-thread cache entries can't match
+    static std::atomic<uint64_t> nextId(1);
+    return nextId++;
+}
+
+template <typename T>
+static bool WriteArray(FILE *f, const T *data, size_t count) {
+    return fwrite(data, sizeof(T), count, f) == count;
+}
+
+// PagedMeshPrimitive Method Definitions
+PagedMeshPrimitive::PagedMeshPrimitive(
+    std::shared_ptr<MeshPageCache> cache, const std::string &filename,
+    const Bounds3f &bounds, size_t residentBytes,
+    const Transform *ObjectToWorld, const Transform *WorldToObject,
+    bool reverseOrientation, const std::shared_ptr<Material> &material,
+    const MediumInterface &mediumInterface)
+    : cache(std::move(cache)),
+      id(NewPagedMeshId()),
+      filename(filename),
+      bounds(bounds),
+      residentBytes(residentBytes),
+      ObjectToWorld(ObjectToWorld),
+      WorldToObject(WorldToObject),
+      reverseOrientation(reverseOrientation),
+      material(material),
+      mediumInterface(mediumInterface),
+      referenced(false) {}
+
+PagedMeshPrimitive::~PagedMeshPrimitive() {
+    cache->remove(this);
+    remove(filename.c_str());
+}
+
+bool PagedMeshPrimitive::IsResident() const {
+    return std::atomic_load(&resident) != nullptr;
+}
+
+const Primitive *PagedMeshPrimitive::acquire() const {
+    if (!referenced.load(std::memory_order_relaxed))
+        referenced.store(true, std::memory_order_relaxed);
+
+    // The thread's lookup cache entry keeps the mesh alive for the caller
+    // even if the cache evicts it in the meantime.
+    MeshLookupCache::Entry &entry =
+        MeshLookupCache::ForThread().entries[id % MeshLookupCache::Size];
+    if (entry.owner != id) {
+        std::shared_ptr<Primitive> prim = std::atomic_load(&resident);
+        if (!prim) {
+            std::lock_guard<std::mutex> lock(loadMutex);
+            prim = std::atomic_load(&resident);
+            if (!prim) {
+                prim = load();
+                if (!prim) return nullptr;
+                cache->makeResident(this, prim);
+            }
+        }
+        entry.owner = id;
+        entry.prim = std::move(prim);
+    }
+    return entry.prim.get();
+}
+
+std::shared_ptr<Primitive> PagedMeshPrimitive::load() const {
+    ProfilePhase _(Prof::AccelConstruction);
+    std::unique_ptr<MappedFile> file = MappedFile::Open(filename);
+    if (!file) return nullptr;
+    PagedMeshHeader header;
+    if (file->Size() < sizeof(header)) {
+        Error("%s: truncated geometry cache file", filename.c_str());
+        return nullptr;
+    }
+    memcpy(&header, file->Data(), sizeof(header));
+    if (memcmp(header.magic, pagedMeshMagic, sizeof(pagedMeshMagic)) != 0 ||
+        header.floatSize != sizeof(Float)) {
+        Error("%s: not a geometry cache file", filename.c_str());
+        return nullptr;
+    }
+
+    // Find the arrays in the mapped file; they are stored back to back
+    // after the header in the order they were written.
+    const char *ptr = file->Data() + sizeof(header);
+    int nt = header.nTriangles, nv = header.nVertices;
+    auto next = [&ptr](size_t bytes) {
+        const char *p = ptr;
+        ptr += bytes;
+        return p;
+    };
+    const int *indices = (const int *)next(3 * nt * sizeof(int));
+    const Point3f *P = (const Point3f *)next(nv * sizeof(Point3f));
+    const Normal3f *N = nullptr;
+    const Vector3f *S = nullptr;
+    const Point2f *UV = nullptr;
+    const int *faceIndices = nullptr;
+    if (header.flags & HasN) N = (const Normal3f *)next(nv * sizeof(Normal3f));
+    if (header.flags & HasS) S = (const Vector3f *)next(nv * sizeof(Vector3f));
+    if (header.flags & HasUV) UV = (const Point2f *)next(nv * sizeof(Point2f));
+    if (header.flags & HasFaceIndices)
+        faceIndices = (const int *)next(nt * sizeof(int));
+    if (ptr > file->Data() + file->Size()) {
+        Error("%s: truncated geometry cache file", filename.c_str());
+        return nullptr;
+    }
+
+    // Vertex data was written in world space, so the mesh is created with
+    // the identity transform; the triangles still use the original
+    // transforms so that orientation is unchanged.
+    static const Transform identity;
+    std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(
+        identity, nt, indices, nv, P, S, N, UV, nullptr, nullptr, faceIndices);
+    std::vector<std::shared_ptr<Primitive>> prims;
+    prims.reserve(nt);
+    for (int i = 0; i < nt; ++i) {
+        std::shared_ptr<Shape> tri = std::make_shared<Triangle>(
+            ObjectToWorld, WorldToObject, reverseOrientation, mesh, i);
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            tri, material, nullptr, mediumInterface));
+    }
+    ++nMeshLoads;
+    return std::make_shared<BVHAccel>(std::move(prims));
+}
+
+bool PagedMeshPrimitive::Intersect(const Ray &r,
+                                   SurfaceInteraction *isect) const {
+    if (!bounds.IntersectP(r)) return false;
+    const Primitive *prim = acquire();
+    return prim && prim->Intersect(r, isect);
+}
+
+bool PagedMeshPrimitive::IntersectP(const Ray &r) const {
+    if (!bounds.IntersectP(r)) return false;
+    const Primitive *prim = acquire();
+    return prim && prim->IntersectP(r);
+}
+
+// MeshPageCache Method Definitions
+MeshPageCache::MeshPageCache(const std::string &directory, size_t budgetBytes)
+    : directory(directory), budgetBytes(budgetBytes) {}
+
+size_t MeshPageCache::ResidentBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return residentBytes;
+}
+
+void MeshPageCache::makeResident(const PagedMeshPrimitive *mesh,
+                                 std::shared_ptr<Primitive> prim) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Sweep the clock hand over the resident meshes, giving recently used
+    // ones a second chance, until the new mesh fits in the budget
+    while (!residentMeshes.empty() &&
+           residentBytes + mesh->residentBytes > budgetBytes) {
+        if (clockHand >= residentMeshes.size()) clockHand = 0;
+        const PagedMeshPrimitive *victim = residentMeshes[clockHand];
+        if (victim->referenced.exchange(false, std::memory_order_relaxed)) {
+            ++clockHand;
+            continue;
+        }
+        // Threads that still have the mesh in their lookup caches keep it
+        // alive until they replace it.
+        std::atomic_store(&victim->resident, std::shared_ptr<Primitive>());
+        residentBytes -= victim->residentBytes;
+        residentMeshes[clockHand] = residentMeshes.back();
+        residentMeshes.pop_back();
+        ++nMeshEvictions;
+    }
+    // The store happens under the cache lock so that the mesh can't be
+    // evicted before it has been recorded as resident.
+    std::atomic_store(&mesh->resident, std::move(prim));
+    residentMeshes.push_back(mesh);
+    residentBytes += mesh->residentBytes;
+}
+
+void MeshPageCache::remove(const PagedMeshPrimitive *mesh) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = std::find(residentMeshes.begin(), residentMeshes.end(), mesh);
+    if (iter != residentMeshes.end()) {
+        residentBytes -= mesh->residentBytes;
+        *iter = residentMeshes.back();
+        residentMeshes.pop_back();
+    }
+}
+
+std::shared_ptr<Primitive> CreatePagedMesh(
+    const std::shared_ptr<MeshPageCache> &cache, const TriangleMesh &mesh,
+    const Transform *ObjectToWorld, const Transform *WorldToObject,
+    bool reverseOrientation, const std::shared_ptr<Material> &material,
+    const MediumInterface &mediumInterface) {
+    // Meshes with alpha textures are left in memory
+    if (mesh.alphaMask || mesh.shadowAlphaMask) return nullptr;
+
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        filename = StringPrintf("%s/mesh%06d.pbrtmesh",
+                                cache->directory.c_str(),
+                                cache->nextFileIndex++);
+    }
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    // Write the header followed by the mesh's world-space vertex data
+    PagedMeshHeader header;
+    memcpy(header.magic, pagedMeshMagic, sizeof(pagedMeshMagic));
+    header.nTriangles = mesh.nTriangles;
+    header.nVertices = mesh.nVertices;
+    header.flags = (mesh.n ? HasN : 0) | (mesh.s ? HasS : 0) |
+                   (mesh.uv ? HasUV : 0) |
+                   (!mesh.faceIndices.empty() ? HasFaceIndices : 0);
+    header.floatSize = sizeof(Float);
+    bool ok = WriteArray(f, &header, 1) &&
+              WriteArray(f, mesh.vertexIndices.data(),
+                         mesh.vertexIndices.size()) &&
+              WriteArray(f, mesh.p.get(), mesh.nVertices);
+    if (ok && mesh.n) ok = WriteArray(f, mesh.n.get(), mesh.nVertices);
+    if (ok && mesh.s) ok = WriteArray(f, mesh.s.get(), mesh.nVertices);
+    if (ok && mesh.uv) ok = WriteArray(f, mesh.uv.get(), mesh.nVertices);
+    if (ok && !mesh.faceIndices.empty())
+        ok = WriteArray(f, mesh.faceIndices.data(), mesh.faceIndices.size());
+    cacheFileBytes += ftell(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        Error("%s: unable to write geometry cache file", filename.c_str());
+        remove(filename.c_str());
+        return nullptr;
+    }
+
+    Bounds3f bounds;
+    for (int i = 0; i < mesh.nVertices; ++i) bounds = Union(bounds, mesh.p[i]);
+    ++nPagedMeshes;
+    return std::make_shared<PagedMeshPrimitive>(
+        cache, filename, bounds, ResidentMeshBytes(mesh), ObjectToWorld,
+        WorldToObject, reverseOrientation, material, mediumInterface);
+}
+
+}  // namespace pbrt
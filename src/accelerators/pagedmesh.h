@@ -0,0 +1,135 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_PAGEDMESH_H
+#define PBRT_ACCELERATORS_PAGEDMESH_H
+
+// accelerators/pagedmesh.h*
+#include "pbrt.h"
+#include "primitive.h"
+#include <atomic>
+#include <mutex>
+
+namespace pbrt {
+
+// PagedMesh Declarations
+struct TriangleMesh;
+class MeshPageCache;
+
+// Stands in for a triangle mesh whose vertex data lives in a binary cache
+// file. Only the mesh bounds are kept in memory until a ray reaches them;
+// the triangles and a BVH over them are then built from the mapped file
+// and stay resident until the MeshPageCache evicts them.
+class PagedMeshPrimitive : public Aggregate {
+  public:
+    // PagedMeshPrimitive Public Methods
+    PagedMeshPrimitive(std::shared_ptr<MeshPageCache> cache,
+                       const std::string &filename, const Bounds3f &bounds,
+                       size_t residentBytes, const Transform *ObjectToWorld,
+                       const Transform *WorldToObject, bool reverseOrientation,
+                       const std::shared_ptr<Material> &material,
+                       const MediumInterface &mediumInterface);
+    ~PagedMeshPrimitive();
+    Bounds3f WorldBound() const { return bounds; }
+    bool Intersect(const Ray &r, SurfaceInteraction *) const;
+    bool IntersectP(const Ray &r) const;
+    bool IsResident() const;
+
+  private:
+    friend class MeshPageCache;
+    // PagedMeshPrimitive Private Methods
+    const Primitive *acquire() const;
+    std::shared_ptr<Primitive> load() const;
+
+    // PagedMeshPrimitive Private Data
+    const std::shared_ptr<MeshPageCache> cache;
+    const uint64_t id;
+    const std::string filename;
+    const Bounds3f bounds;
+    const size_t residentBytes;
+    const Transform *ObjectToWorld, *WorldToObject;
+    const bool reverseOrientation;
+    std::shared_ptr<Material> material;
+    MediumInterface mediumInterface;
+    mutable std::mutex loadMutex;
+    // Accessed with std::atomic_load() and std::atomic_store()
+    mutable std::shared_ptr<Primitive> resident;
+    // Set on every access and cleared by the cache's clock sweep
+    mutable std::atomic<bool> referenced;
+};
+
+// Tracks which paged meshes are resident and evicts the least recently
+// used ones (using the clock approximation of LRU) to stay within the
+// memory budget.
+class MeshPageCache {
+  public:
+    // MeshPageCache Public Methods
+    MeshPageCache(const std::string &directory, size_t budgetBytes);
+    size_t ResidentBytes() const;
+
+  private:
+    friend class PagedMeshPrimitive;
+    friend std::shared_ptr<Primitive> CreatePagedMesh(
+        const std::shared_ptr<MeshPageCache> &cache, const TriangleMesh &mesh,
+        const Transform *ObjectToWorld, const Transform *WorldToObject,
+        bool reverseOrientation, const std::shared_ptr<Material> &material,
+        const MediumInterface &mediumInterface);
+    // MeshPageCache Private Methods
+    void makeResident(const PagedMeshPrimitive *mesh,
+                      std::shared_ptr<Primitive> prim);
+    void remove(const PagedMeshPrimitive *mesh);
+
+    // MeshPageCache Private Data
+    const std::string directory;
+    const size_t budgetBytes;
+    mutable std::mutex mutex;
+    std::vector<const PagedMeshPrimitive *> residentMeshes;
+    size_t clockHand = 0, residentBytes = 0;
+    int nextFileIndex = 0;
+};
+
+// Writes _mesh_ to the cache's directory and returns a proxy for it, or
+// nullptr if the mesh can't be paged.
+std::shared_ptr<Primitive> CreatePagedMesh(
+    const std::shared_ptr<MeshPageCache> &cache, const TriangleMesh &mesh,
+    const Transform *ObjectToWorld, const Transform *WorldToObject,
+    bool reverseOrientation, const std::shared_ptr<Material> &material,
+    const MediumInterface &mediumInterface);
+
+}  // namespace pbrt
+
+#endif  // PBRT_ACCELERATORS_PAGEDMESH_H
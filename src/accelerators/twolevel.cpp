@@ -0,0 +1,114 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// accelerators/twolevel.cpp*
+#include "accelerators/twolevel.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_COUNTER("Two-level accelerator/Instances", nTopLevelInstances);
+
+// TwoLevelAccel Method Definitions
+TwoLevelAccel::TwoLevelAccel(
+    std::shared_ptr<Primitive> staticGeometry,
+    std::vector<std::shared_ptr<TransformedPrimitive>> instances)
+    : staticGeometry(std::move(staticGeometry)),
+      instances(std::move(instances)) {
+    nTopLevelInstances += this->instances.size();
+    build();
+}
+
+Bounds3f TwoLevelAccel::WorldBound() const { return topLevel->WorldBound(); }
+
+bool TwoLevelAccel::Intersect(const Ray &ray,
+                              SurfaceInteraction *isect) const {
+    return topLevel->Intersect(ray, isect);
+}
+
+bool TwoLevelAccel::IntersectP(const Ray &ray) const {
+    return topLevel->IntersectP(ray);
+}
+
+void TwoLevelAccel::IntersectBatch(int nRays, const Ray *const *rays,
+                                   SurfaceInteraction *const *isects,
+                                   bool *hits) const {
+    topLevel->IntersectBatch(nRays, rays, isects, hits);
+}
+
+bool TwoLevelAccel::SetInstanceTransform(uint32_t instanceId,
+                                         const AnimatedTransform &p2w) {
+    for (const auto &instance : instances)
+        if (instance->InstanceId() == instanceId) {
+            instance->SetPrimitiveToWorld(p2w);
+            return true;
+        }
+    return false;
+}
+
+void TwoLevelAccel::Refit() { topLevel->Refit(); }
+
+void TwoLevelAccel::build() {
+    std::vector<std::shared_ptr<Primitive>> topPrims(instances.begin(),
+                                                     instances.end());
+    if (staticGeometry) topPrims.push_back(staticGeometry);
+    // Instance intersection pays for a matrix inversion, so keep a single
+    // primitive per top-level leaf.
+    topLevel.reset(
+        new BVHAccel(std::move(topPrims), 1, BVHAccel::SplitMethod::SAH));
+}
+
+std::shared_ptr<TwoLevelAccel> CreateTwoLevelAccelerator(
+    std::vector<std::shared_ptr<Primitive>> prims, const ParamSet &ps) {
+    // Separate object instances from the rest of the scene's geometry
+    std::vector<std::shared_ptr<TransformedPrimitive>> instances;
+    std::vector<std::shared_ptr<Primitive>> staticPrims;
+    for (std::shared_ptr<Primitive> &prim : prims) {
+        std::shared_ptr<TransformedPrimitive> instance =
+            std::dynamic_pointer_cast<TransformedPrimitive>(prim);
+        if (instance)
+            instances.push_back(std::move(instance));
+        else
+            staticPrims.push_back(std::move(prim));
+    }
+
+    // Build bottom-level BVH for the non-instanced geometry
+    std::shared_ptr<Primitive> staticGeometry;
+    if (!staticPrims.empty())
+        staticGeometry = CreateBVHAccelerator(std::move(staticPrims), ps);
+    return std::make_shared<TwoLevelAccel>(std::move(staticGeometry),
+                                           std::move(instances));
+}
+
+}  // namespace pbrt
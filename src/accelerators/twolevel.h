@@ -0,0 +1,86 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_TWOLEVEL_H
+#define PBRT_ACCELERATORS_TWOLEVEL_H
+
+// accelerators/twolevel.h*
+#include "pbrt.h"
+#include "primitive.h"
+#include "accelerators/bvh.h"
+
+namespace pbrt {
+
+// TwoLevelAccel Declarations
+// TwoLevelAccel keeps object instances out of the scene's bottom-level
+// hierarchy: non-instanced geometry is built once into its own BVH, each
+// instance's shared BVH is built once in pbrtObjectInstance(), and only a
+// small top-level BVH over the instance bounds has to be refit when
+// instance transforms change.
+class TwoLevelAccel : public Aggregate {
+  public:
+    // TwoLevelAccel Public Methods
+    TwoLevelAccel(std::shared_ptr<Primitive> staticGeometry,
+                  std::vector<std::shared_ptr<TransformedPrimitive>> instances);
+    Bounds3f WorldBound() const;
+    bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
+    bool IntersectP(const Ray &ray) const;
+    void IntersectBatch(int nRays, const Ray *const *rays,
+                        SurfaceInteraction *const *isects, bool *hits) const;
+    int NumInstances() const { return instances.size(); }
+    // Moves the instance with the given ID; returns false if there is
+    // none. Refit() must be called before tracing rays again.
+    bool SetInstanceTransform(uint32_t instanceId,
+                              const AnimatedTransform &p2w);
+    void Refit();
+
+  private:
+    // TwoLevelAccel Private Methods
+    void build();
+
+    // TwoLevelAccel Private Data
+    std::shared_ptr<Primitive> staticGeometry;
+    std::vector<std::shared_ptr<TransformedPrimitive>> instances;
+    std::unique_ptr<BVHAccel> topLevel;
+};
+
+std::shared_ptr<TwoLevelAccel> CreateTwoLevelAccelerator(
+    std::vector<std::shared_ptr<Primitive>> prims, const ParamSet &ps);
+
+}  // namespace pbrt
+
+#endif  // PBRT_ACCELERATORS_TWOLEVEL_H
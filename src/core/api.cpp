@@ -42,12 +42,16 @@
 #include "spectrum.h"
 #include "scene.h"
 #include "film.h"
+#include "imageio.h"
 #include "medium.h"
 #include "stats.h"
 
 // API Additional Headers
 #include "accelerators/bvh.h"
 #include "accelerators/kdtreeaccel.h"
+#include "accelerators/lazy.h"
+#include "accelerators/pagedmesh.h"
+#include "accelerators/twolevel.h"
 #include "cameras/environment.h"
 #include "cameras/omni.h" // Added by MMara
 #include "cameras/orthographic.h"
@@ -67,6 +71,7 @@
 #include "integrators/path.h"
 #include "integrators/sppm.h"
 #include "integrators/volpath.h"
+#include "integrators/wavefront.h"
 #include "integrators/whitted.h"
 #include "integrators/metadata.h"
 #include "lights/diffuse.h"
@@ -109,6 +114,7 @@
 #include "shapes/sphere.h"
 #include "shapes/triangle.h"
 #include "shapes/plymesh.h"
+#include "textures/baked.h"
 #include "textures/bilerp.h"
 #include "textures/checkerboard.h"
 #include "textures/constant.h"
@@ -126,7 +132,9 @@
 #include "media/homogeneous.h"
 
 #include <map>
+#include <set>
 #include <stdio.h>
+#include <tuple>
 
 namespace pbrt {
 
@@ -165,27 +173,36 @@ struct TransformSet {
     Transform t[MaxTransforms];
 };
 
-struct RenderOptions {
-    // RenderOptions Public Methods
-    Integrator *MakeIntegrator() const;
-    Scene *MakeScene();
-    Camera *MakeCamera() const;
-
-    // RenderOptions Public Data
-    Float transformStartTime = 0, transformEndTime = 1;
+// The options that describe how a scene is viewed and rendered, as opposed
+// to what is in it. A scene file may specify several cameras; each one is
+// rendered with the options that follow its Camera statement.
+struct CameraOptions {
     std::string FilterName = "box";
     ParamSet FilterParams;
     std::string FilmName = "image";
     ParamSet FilmParams;
     std::string SamplerName = "halton";
     ParamSet SamplerParams;
-    std::string AcceleratorName = "bvh";
-    ParamSet AcceleratorParams;
     std::string IntegratorName = "path";
     ParamSet IntegratorParams;
     std::string CameraName = "perspective";
     ParamSet CameraParams;
     TransformSet CameraToWorld;
+};
+
+struct RenderOptions : public CameraOptions {
+    // RenderOptions Public Methods
+    Integrator *MakeIntegrator(std::shared_ptr<const Camera> camera) const;
+    Scene *MakeScene();
+    Camera *MakeCamera() const;
+
+    // RenderOptions Public Data
+    Float transformStartTime = 0, transformEndTime = 1;
+    std::string AcceleratorName = "bvh";
+    ParamSet AcceleratorParams;
+    // Earlier cameras to render before the current one
+    std::vector<CameraOptions> cameraJobs;
+    bool haveCamera = false;
     std::map<std::string, std::shared_ptr<Medium>> namedMedia;
     std::vector<std::shared_ptr<Light>> lights;
     std::vector<std::shared_ptr<Primitive>> primitives;
@@ -193,6 +210,7 @@ struct RenderOptions {
     std::map<std::string, std::vector<std::shared_ptr<Primitive>>> instances;
     std::vector<std::shared_ptr<Primitive>> *currentInstance = nullptr;
     bool haveScatteringMedia = false;
+    std::shared_ptr<MeshPageCache> meshPageCache;
 };
 
 // MaterialInstance represents both an instance of a material as well as
@@ -371,6 +389,67 @@ void TransformCache::Grow() {
     std::swap(hashTable, newTable);
 }
 
+STAT_COUNTER("Scene/Repeated triangle meshes shared", nSharedMeshes);
+STAT_MEMORY_COUNTER("Memory/Triangle mesh bytes saved by sharing",
+                    sharedMeshBytesSaved);
+
+// MeshCache lets triangle meshes that are specified more than once with
+// the same geometry and transformation--typically the same PLY file
+// included repeatedly outside of an object instance--share a single
+// world-space _TriangleMesh_ rather than each getting its own copy. PLY
+// meshes are identified by their filename. Inline meshes are found by a
+// hash of their vertex and index data and then compared against the cached
+// mesh, so that a hash collision can't hand back the wrong geometry. Only
+// weak references to the meshes are kept, so that meshes that are paged
+// out or otherwise released after shape creation are freed as usual.
+class MeshCache {
+  public:
+    std::vector<std::shared_ptr<Shape>> Lookup(const std::string &name,
+                                               const Transform *ObjectToWorld,
+                                               const Transform *WorldToObject,
+                                               bool reverseOrientation,
+                                               const ParamSet &paramSet);
+    void Clear() { meshes.clear(); }
+
+  private:
+    struct Key {
+        std::string name, filename;
+        uint64_t contentHash;
+        int nIndices, nVertices;
+        const Transform *ObjectToWorld;
+        bool reverseOrientation;
+        const Texture<Float> *alphaTex, *shadowAlphaTex;
+        Float alpha, shadowAlpha;
+
+        bool operator<(const Key &k) const {
+            return std::tie(name, filename, contentHash, nIndices, nVertices,
+                            ObjectToWorld, reverseOrientation, alphaTex,
+                            shadowAlphaTex, alpha, shadowAlpha) <
+                   std::tie(k.name, k.filename, k.contentHash, k.nIndices,
+                            k.nVertices, k.ObjectToWorld,
+                            k.reverseOrientation, k.alphaTex,
+                            k.shadowAlphaTex, k.alpha, k.shadowAlpha);
+        }
+    };
+
+    static bool SameMesh(const TriangleMesh &mesh,
+                         const Transform &ObjectToWorld,
+                         const ParamSet &paramSet);
+    static void HashBytes(const void *data, size_t size, uint64_t *hash) {
+        const char *ptr = (const char *)data;
+        for (; size >= sizeof(uint64_t);
+             size -= sizeof(uint64_t), ptr += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, ptr, sizeof(uint64_t));
+            *hash = (*hash ^ word) * 1099511628211ull;
+        }
+        for (; size > 0; --size, ++ptr)
+            *hash = (*hash ^ uint8_t(*ptr)) * 1099511628211ull;
+    }
+
+    std::map<Key, std::weak_ptr<TriangleMesh>> meshes;
+};
+
 
 // API Static Data
 enum class APIState { Uninitialized, OptionsBlock, WorldBlock };
@@ -384,6 +463,17 @@ static std::vector<GraphicsState> pushedGraphicsStates;
 static std::vector<TransformSet> pushedTransforms;
 static std::vector<uint32_t> pushedActiveTransformBits;
 static TransformCache transformCache;
+static MeshCache meshCache;
+// Kept after WorldEnd in server mode
+static std::unique_ptr<Scene> residentScene;
+// The resident scene's two-level accelerator, if it uses one, and whether
+// pbrtInstanceTransform() has moved instances since it was last refit
+static std::shared_ptr<TwoLevelAccel> residentInstances;
+static bool residentInstancesMoved = false;
+// The scene's instance and material IDs, for the metadata integrator's ID
+// tables; gathered at WorldEnd so that they outlive the graphics state.
+static std::vector<std::pair<uint32_t, std::string>> instanceIdTable,
+    materialIdTable;
 int catIndentCount = 0;
 
 // API Forward Declarations
@@ -391,7 +481,9 @@ std::vector<std::shared_ptr<Shape>> MakeShapes(const std::string &name,
                                                const Transform *ObjectToWorld,
                                                const Transform *WorldToObject,
                                                bool reverseOrientation,
-                                               const ParamSet &paramSet);
+                                               const ParamSet &paramSet,
+                                               GraphicsState::FloatTextureMap
+                                                   *floatTextures);
 
 // API Macros
 #define VERIFY_INITIALIZED(func)                           \
@@ -442,7 +534,9 @@ std::vector<std::shared_ptr<Shape>> MakeShapes(const std::string &name,
                                                const Transform *object2world,
                                                const Transform *world2object,
                                                bool reverseOrientation,
-                                               const ParamSet &paramSet) {
+                                               const ParamSet &paramSet,
+                                               GraphicsState::FloatTextureMap
+                                                   *floatTextures) {
     std::vector<std::shared_ptr<Shape>> shapes;
     std::shared_ptr<Shape> s;
     if (name == "sphere")
@@ -529,10 +623,10 @@ std::vector<std::shared_ptr<Shape>> MakeShapes(const std::string &name,
         } else
             shapes = CreateTriangleMeshShape(object2world, world2object,
                                              reverseOrientation, paramSet,
-                                             &*graphicsState.floatTextures);
+                                             floatTextures);
     } else if (name == "plymesh")
         shapes = CreatePLYMesh(object2world, world2object, reverseOrientation,
-                               paramSet, &*graphicsState.floatTextures);
+                               paramSet, floatTextures);
     else if (name == "heightfield")
         shapes = CreateHeightfield(object2world, world2object,
                                    reverseOrientation, paramSet);
@@ -547,6 +641,133 @@ std::vector<std::shared_ptr<Shape>> MakeShapes(const std::string &name,
     return shapes;
 }
 
+std::vector<std::shared_ptr<Shape>> MeshCache::Lookup(
+    const std::string &name, const Transform *ObjectToWorld,
+    const Transform *WorldToObject, bool reverseOrientation,
+    const ParamSet &paramSet) {
+    if ((name != "trianglemesh" && name != "plymesh") || PbrtOptions.toPly)
+        return MakeShapes(name, ObjectToWorld, WorldToObject,
+                          reverseOrientation, paramSet,
+                          &*graphicsState.floatTextures);
+
+    Key key;
+    key.name = name;
+    key.contentHash = 14695981039346656037ull;
+    key.nIndices = key.nVertices = 0;
+    key.ObjectToWorld = ObjectToWorld;
+    key.reverseOrientation = reverseOrientation;
+    if (name == "plymesh")
+        key.filename = paramSet.FindOneFilename("filename", "");
+    else {
+        // Hash everything that CreateTriangleMeshShape() reads.
+        int n;
+        const int *indices = paramSet.FindInt("indices", &key.nIndices);
+        HashBytes(indices, key.nIndices * sizeof(int), &key.contentHash);
+        const Point3f *P = paramSet.FindPoint3f("P", &key.nVertices);
+        HashBytes(P, key.nVertices * sizeof(Point3f), &key.contentHash);
+        for (const char *uvName : {"uv", "st"}) {
+            if (const Point2f *uv = paramSet.FindPoint2f(uvName, &n))
+                HashBytes(uv, n * sizeof(Point2f), &key.contentHash);
+            if (const Float *uv = paramSet.FindFloat(uvName, &n))
+                HashBytes(uv, n * sizeof(Float), &key.contentHash);
+        }
+        if (const Vector3f *S = paramSet.FindVector3f("S", &n))
+            HashBytes(S, n * sizeof(Vector3f), &key.contentHash);
+        if (const Normal3f *N = paramSet.FindNormal3f("N", &n))
+            HashBytes(N, n * sizeof(Normal3f), &key.contentHash);
+        if (const int *faceIndices = paramSet.FindInt("faceIndices", &n))
+            HashBytes(faceIndices, n * sizeof(int), &key.contentHash);
+    }
+    auto findAlphaTex = [&](const char *param) -> const Texture<Float> * {
+        auto iter = graphicsState.floatTextures->find(paramSet.FindTexture(param));
+        return iter == graphicsState.floatTextures->end() ? nullptr
+                                                          : iter->second.get();
+    };
+    key.alphaTex = findAlphaTex("alpha");
+    key.shadowAlphaTex = findAlphaTex("shadowalpha");
+    key.alpha = paramSet.FindOneFloat("alpha", 1.f);
+    key.shadowAlpha = paramSet.FindOneFloat("shadowalpha", 1.f);
+
+    auto iter = meshes.find(key);
+    std::shared_ptr<TriangleMesh> mesh;
+    if (iter != meshes.end()) mesh = iter->second.lock();
+    if (mesh &&
+        (name == "plymesh" || SameMesh(*mesh, *ObjectToWorld, paramSet))) {
+        ++nSharedMeshes;
+        sharedMeshBytesSaved +=
+            sizeof(TriangleMesh) +
+            mesh->nVertices * (sizeof(Point3f) +
+                               (mesh->n ? sizeof(Normal3f) : 0) +
+                               (mesh->s ? sizeof(Vector3f) : 0) +
+                               (mesh->uv ? sizeof(Point2f) : 0)) +
+            (mesh->vertexIndices.size() + mesh->faceIndices.size()) *
+                sizeof(int);
+        std::vector<std::shared_ptr<Shape>> shapes;
+        shapes.reserve(mesh->nTriangles);
+        for (int i = 0; i < mesh->nTriangles; ++i)
+            shapes.push_back(std::make_shared<Triangle>(
+                ObjectToWorld, WorldToObject, reverseOrientation, mesh, i));
+        return shapes;
+    }
+    std::vector<std::shared_ptr<Shape>> shapes =
+        MakeShapes(name, ObjectToWorld, WorldToObject, reverseOrientation,
+                   paramSet, &*graphicsState.floatTextures);
+    // Remember the mesh if all of the shapes are triangles from one mesh
+    const Triangle *tri =
+        shapes.empty() ? nullptr
+                       : dynamic_cast<const Triangle *>(shapes[0].get());
+    if (tri && tri->GetMesh()->nTriangles == int(shapes.size()))
+        meshes[key] = tri->GetMesh();
+    return shapes;
+}
+
+// Returns true if _mesh_ is the mesh that CreateTriangleMeshShape() would
+// create for _paramSet_ under the transformation _ObjectToWorld_.
+bool MeshCache::SameMesh(const TriangleMesh &mesh,
+                         const Transform &ObjectToWorld,
+                         const ParamSet &paramSet) {
+    int nIndices, nP, n;
+    const int *indices = paramSet.FindInt("indices", &nIndices);
+    const Point3f *P = paramSet.FindPoint3f("P", &nP);
+    if (!indices || !P || mesh.nVertices != nP ||
+        mesh.nTriangles != nIndices / 3 ||
+        !std::equal(mesh.vertexIndices.begin(), mesh.vertexIndices.end(),
+                    indices))
+        return false;
+    for (int i = 0; i < nP; ++i)
+        if (mesh.p[i] != ObjectToWorld(P[i])) return false;
+
+    // Compare the optional per-vertex data; any data that the mesh dropped
+    // or that is missing from one of them counts as a mismatch.
+    const Point2f *uv = paramSet.FindPoint2f("uv", &n);
+    if (!uv) uv = paramSet.FindPoint2f("st", &n);
+    const Float *fuv = nullptr;
+    if (!uv) {
+        fuv = paramSet.FindFloat("uv", &n);
+        if (!fuv) fuv = paramSet.FindFloat("st", &n);
+        n /= 2;
+    }
+    if (bool(mesh.uv) != (uv || fuv) || ((uv || fuv) && n < nP)) return false;
+    for (int i = 0; mesh.uv && i < nP; ++i)
+        if (mesh.uv[i] != (uv ? uv[i] : Point2f(fuv[2 * i], fuv[2 * i + 1])))
+            return false;
+    const Normal3f *N = paramSet.FindNormal3f("N", &n);
+    if (bool(mesh.n) != bool(N) || (N && n != nP)) return false;
+    for (int i = 0; N && i < nP; ++i)
+        if (mesh.n[i] != ObjectToWorld(N[i])) return false;
+    const Vector3f *S = paramSet.FindVector3f("S", &n);
+    if (bool(mesh.s) != bool(S) || (S && n != nP)) return false;
+    for (int i = 0; S && i < nP; ++i)
+        if (mesh.s[i] != ObjectToWorld(S[i])) return false;
+    const int *faceIndices = paramSet.FindInt("faceIndices", &n);
+    if (mesh.faceIndices.empty() != !faceIndices ||
+        (faceIndices && (n != int(mesh.faceIndices.size()) ||
+                         !std::equal(mesh.faceIndices.begin(),
+                                     mesh.faceIndices.end(), faceIndices))))
+        return false;
+    return true;
+}
+
 STAT_COUNTER("Scene/Materials created", nMaterialsCreated);
 
 std::shared_ptr<Material> MakeMaterial(const std::string &name,
@@ -656,6 +877,11 @@ std::shared_ptr<Texture<Float>> MakeFloatTexture(const std::string &name,
         tex = CreatePtexFloatTexture(tex2world, tp);
     else
         Warning("Float texture \"%s\" unknown.", name.c_str());
+    // Procedural textures can be baked so that they're only evaluated
+    // while baking
+    if (tex && name != "imagemap" && name != "ptex" &&
+        tp.FindString("bake", "") != "")
+        tex = CreateBakedFloatTexture(name, tex, tex2world, tp);
     tp.ReportUnused();
     return std::shared_ptr<Texture<Float>>(tex);
 }
@@ -692,6 +918,11 @@ std::shared_ptr<Texture<Spectrum>> MakeSpectrumTexture(
         tex = CreatePtexSpectrumTexture(tex2world, tp);
     else
         Warning("Spectrum texture \"%s\" unknown.", name.c_str());
+    // Procedural textures can be baked so that they're only evaluated
+    // while baking
+    if (tex && name != "imagemap" && name != "ptex" &&
+        tp.FindString("bake", "") != "")
+        tex = CreateBakedSpectrumTexture(name, tex, tex2world, tp);
     tp.ReportUnused();
     return std::shared_ptr<Texture<Spectrum>>(tex);
 }
@@ -794,6 +1025,8 @@ std::shared_ptr<Primitive> MakeAccelerator(
         accel = CreateBVHAccelerator(std::move(prims), paramSet);
     else if (name == "kdtree")
         accel = CreateKdTreeAccelerator(std::move(prims), paramSet);
+    else if (name == "twolevel")
+        accel = CreateTwoLevelAccelerator(std::move(prims), paramSet);
     else
         Warning("Accelerator \"%s\" unknown.", name.c_str());
     paramSet.ReportUnused();
@@ -916,6 +1149,14 @@ void pbrtCleanup() {
     else if (currentApiState == APIState::WorldBlock)
         Error("pbrtCleanup() called while inside world block.");
     currentApiState = APIState::Uninitialized;
+    if (residentScene) {
+        residentScene.reset();
+        residentInstances.reset();
+        transformCache.Clear();
+        meshCache.Clear();
+        ImageTexture<Float, Float>::ClearCache();
+        ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    }
     ParallelCleanup();
     CleanupProfiler();
 }
@@ -1099,6 +1340,11 @@ void pbrtIntegrator(const std::string &name, const ParamSet &params) {
 
 void pbrtCamera(const std::string &name, const ParamSet &params) {
     VERIFY_OPTIONS("Camera");
+    // Another camera: save the previous one, along with the options that
+    // followed it, to be rendered as well.
+    if (renderOptions->haveCamera && !PbrtOptions.cat && !PbrtOptions.toPly)
+        renderOptions->cameraJobs.push_back(*renderOptions);
+    renderOptions->haveCamera = true;
     renderOptions->CameraName = name;
     renderOptions->CameraParams = params;
     renderOptions->CameraToWorld = Inverse(curTransform);
@@ -1350,6 +1596,64 @@ void pbrtAreaLightSource(const std::string &name, const ParamSet &params) {
     }
 }
 
+// Returns a _LazyPrimitive_ that creates the shape named _name_ when a ray
+// first reaches its bounds. Its material is created right away, so that
+// materials are made on the parsing thread in scene file order. Returns
+// nullptr for shapes whose bounds can't be found without creating them.
+static std::shared_ptr<Primitive> MakeLazyShape(const std::string &name,
+                                                const ParamSet &params) {
+    Bounds3f objectBounds;
+    if (name == "plymesh") {
+        if (!PLYMeshBounds(params.FindOneFilename("filename", ""),
+                           &objectBounds))
+            return nullptr;
+    } else if (name == "trianglemesh" || name == "loopsubdiv") {
+        // Loop subdivision stays within the convex hull of the control mesh.
+        int nPoints;
+        const Point3f *P = params.FindPoint3f("P", &nPoints);
+        if (!P) return nullptr;
+        for (int i = 0; i < nPoints; ++i)
+            objectBounds = Union(objectBounds, P[i]);
+    } else if (name == "heightfield") {
+        int nz;
+        const Float *Pz = params.FindFloat("Pz", &nz);
+        if (!Pz || nz == 0) return nullptr;
+        auto zRange = std::minmax_element(Pz, Pz + nz);
+        objectBounds = Bounds3f(Point3f(0, 0, *zRange.first),
+                                Point3f(1, 1, *zRange.second));
+    } else
+        return nullptr;
+
+    const Transform *ObjToWorld = transformCache.Lookup(curTransform[0]);
+    const Transform *WorldToObj =
+        transformCache.Lookup(Inverse(curTransform[0]));
+    std::shared_ptr<Material> mtl = graphicsState.GetMaterialForShape(params);
+    // Keep the float textures for creating the shape later; marking them as
+    // shared ensures that subsequent Texture statements don't modify them.
+    graphicsState.floatTexturesShared = true;
+    std::shared_ptr<GraphicsState::FloatTextureMap> floatTextures =
+        graphicsState.floatTextures;
+    bool reverseOrientation = graphicsState.reverseOrientation;
+    MediumInterface mi = graphicsState.CreateMediumInterface();
+    ParamSet shapeParams = params;
+    return std::make_shared<LazyPrimitive>(
+        (*ObjToWorld)(objectBounds),
+        [=]() mutable -> std::shared_ptr<Primitive> {
+            std::vector<std::shared_ptr<Shape>> shapes =
+                MakeShapes(name, ObjToWorld, WorldToObj, reverseOrientation,
+                           shapeParams, &*floatTextures);
+            if (shapes.empty()) return nullptr;
+            shapeParams.ReportUnused();
+            std::vector<std::shared_ptr<Primitive>> prims;
+            prims.reserve(shapes.size());
+            for (auto s : shapes)
+                prims.push_back(
+                    std::make_shared<GeometricPrimitive>(s, mtl, nullptr, mi));
+            if (prims.size() == 1) return prims[0];
+            return std::make_shared<BVHAccel>(std::move(prims));
+        });
+}
+
 void pbrtShape(const std::string &name, const ParamSet &params) {
     VERIFY_WORLD("Shape");
     std::vector<std::shared_ptr<Primitive>> prims;
@@ -1360,30 +1664,62 @@ void pbrtShape(const std::string &name, const ParamSet &params) {
         printf("\n");
     }
 
-    if (!curTransform.IsAnimated()) {
+    // Possibly defer creating the shape until a ray reaches it
+    std::shared_ptr<Primitive> lazy;
+    if (PbrtOptions.lazyShapes && !PbrtOptions.cat && !PbrtOptions.toPly &&
+        !curTransform.IsAnimated() && graphicsState.areaLight == "")
+        lazy = MakeLazyShape(name, params);
+
+    if (lazy)
+        prims.push_back(lazy);
+    else if (!curTransform.IsAnimated()) {
         // Initialize _prims_ and _areaLights_ for static shape
 
         // Create shapes for shape _name_
         Transform *ObjToWorld = transformCache.Lookup(curTransform[0]);
         Transform *WorldToObj = transformCache.Lookup(Inverse(curTransform[0]));
         std::vector<std::shared_ptr<Shape>> shapes =
-            MakeShapes(name, ObjToWorld, WorldToObj,
-                       graphicsState.reverseOrientation, params);
+            meshCache.Lookup(name, ObjToWorld, WorldToObj,
+                             graphicsState.reverseOrientation, params);
         if (shapes.empty()) return;
         std::shared_ptr<Material> mtl = graphicsState.GetMaterialForShape(params);
         params.ReportUnused();
         MediumInterface mi = graphicsState.CreateMediumInterface();
-        prims.reserve(shapes.size());
-        for (auto s : shapes) {
-            // Possibly create area light for shape
-            std::shared_ptr<AreaLight> area;
-            if (graphicsState.areaLight != "") {
-                area = MakeAreaLight(graphicsState.areaLight, curTransform[0],
-                                     mi, graphicsState.areaLightParams, s);
-                if (area) areaLights.push_back(area);
+
+        // Page triangle meshes out to the geometry cache if requested
+        std::shared_ptr<Primitive> paged;
+        if (!PbrtOptions.geometryCacheDir.empty() &&
+            graphicsState.areaLight == "") {
+            const Triangle *tri = dynamic_cast<const Triangle *>(shapes[0].get());
+            if (tri && tri->GetMesh()->nTriangles == int(shapes.size())) {
+                if (!renderOptions->meshPageCache)
+                    renderOptions->meshPageCache =
+                        std::make_shared<MeshPageCache>(
+                            PbrtOptions.geometryCacheDir,
+                            size_t(PbrtOptions.geometryBudgetMB) << 20);
+                paged = CreatePagedMesh(renderOptions->meshPageCache,
+                                        *tri->GetMesh(), ObjToWorld,
+                                        WorldToObj,
+                                        graphicsState.reverseOrientation,
+                                        mtl, mi);
+            }
+        }
+        if (paged)
+            prims.push_back(paged);
+        else {
+            prims.reserve(shapes.size());
+            for (auto s : shapes) {
+                // Possibly create area light for shape
+                std::shared_ptr<AreaLight> area;
+                if (graphicsState.areaLight != "") {
+                    area = MakeAreaLight(graphicsState.areaLight,
+                                         curTransform[0], mi,
+                                         graphicsState.areaLightParams, s);
+                    if (area) areaLights.push_back(area);
+                }
+                prims.push_back(
+                    std::make_shared<GeometricPrimitive>(s, mtl, area, mi));
             }
-            prims.push_back(
-                std::make_shared<GeometricPrimitive>(s, mtl, area, mi));
         }
     } else {
         // Initialize _prims_ and _areaLights_ for animated shape
@@ -1394,7 +1730,7 @@ void pbrtShape(const std::string &name, const ParamSet &params) {
                 "Ignoring currently set area light when creating "
                 "animated shape");
         Transform *identity = transformCache.Lookup(Transform());
-        std::vector<std::shared_ptr<Shape>> shapes = MakeShapes(
+        std::vector<std::shared_ptr<Shape>> shapes = meshCache.Lookup(
             name, identity, identity, graphicsState.reverseOrientation, params);
         if (shapes.empty()) return;
 
@@ -1588,9 +1924,13 @@ void pbrtObjectInstance(const std::string &name) {
     if (in.empty()) return;
     ++nObjectInstancesUsed;
     if (in.size() > 1) {
-        // Create aggregate for instance _Primitive_s
+        // Create aggregate for instance _Primitive_s; with the two-level
+        // accelerator, this is the instance's shared bottom-level BVH
+        std::string accelName =
+            renderOptions->AcceleratorName == "twolevel"
+                ? "bvh" : renderOptions->AcceleratorName;
         std::shared_ptr<Primitive> accel(
-            MakeAccelerator(renderOptions->AcceleratorName, std::move(in),
+            MakeAccelerator(accelName, std::move(in),
                             renderOptions->AcceleratorParams));
         if (!accel) accel = std::make_shared<BVHAccel>(in);
         in.clear();
@@ -1614,111 +1954,128 @@ void pbrtObjectInstance(const std::string &name) {
     renderOptions->instanceNames.push_back(name); // MM
 }
 
-void pbrtWorldEnd() {
-    VERIFY_WORLD("WorldEnd");
-    // Ensure there are no pushed graphics states
-    while (pushedGraphicsStates.size()) {
-        Warning("Missing end to pbrtAttributeBegin()");
-        pushedGraphicsStates.pop_back();
-        pushedTransforms.pop_back();
-    }
-    while (pushedTransforms.size()) {
-        Warning("Missing end to pbrtTransformBegin()");
-        pushedTransforms.pop_back();
-    }
-    
-    // ------------------------------------------------------------
-    // ----- Write out metadata information (Added by Trisha) ----
-    
-    // Get filename from metadataIntegrator
+// Renders _scene_ using _integrator_.
+static void renderScene(Integrator *integrator, const Scene &scene) {
+    // This is kind of ugly; we directly override the current profiler
+    // state to switch from parsing/scene construction related stuff to
+    // rendering stuff and then switch it back below. The underlying
+    // issue is that all the rest of the profiling system assumes
+    // hierarchical inheritance of profiling state; this is the only
+    // place where that isn't the case.
+    CHECK_EQ(CurrentProfilerState(), ProfToBits(Prof::SceneConstruction));
+    ProfilerState = ProfToBits(Prof::IntegratorRender);
+
+    integrator->Render(scene);
+
+    CHECK_EQ(CurrentProfilerState(), ProfToBits(Prof::IntegratorRender));
+    ProfilerState = ProfToBits(Prof::SceneConstruction);
+}
+
+// Writes the table that maps the IDs in the metadata integrator's output
+// to instance or material names, if the current camera uses it. It is
+// named after _film_'s output file, like the metadata images.
+static void writeMetadataTable(const Film &film) {
     const ParamSet &paramSet = renderOptions->IntegratorParams;
-    
-    // Filename will be the same as the output image filename
-    std::string filename = PbrtOptions.imageFile;
-    
-    // If no filename, we default to pbrt
-    if (filename == "")
-#ifdef PBRT_HAS_OPENEXR
-        filename = "pbrt.exr";
-#else
-    filename = "pbrt.tga";
-#endif
-    
+    if (renderOptions->IntegratorName != "metadata") return;
+
+    const std::string &filename = film.filename;
     // Find type of metadata
     std::string st = paramSet.FindOneString("strategy", "");
-    
-    std::ofstream metadataFile;
+    bool binary = paramSet.FindOneString("format", "image") == "binary";
+
     int lastPos = filename.find_last_of(".");
     std::string newFileName;
+    const std::vector<std::pair<uint32_t, std::string>> *entries = nullptr;
     
     if(st == "mesh"){
-        
-        newFileName = filename.substr(0, lastPos) + "_mesh.txt";
-        metadataFile.open(newFileName.c_str());
-        
-        std::vector<std::string>::iterator itInner;
-        int count = 0;
-        for (auto itInner = renderOptions->instanceNames.begin(); itInner != renderOptions->instanceNames.end(); itInner++,count++) {
-            std::string instanceName = *itInner;
-            // InstanceIDs start at 1
-            metadataFile << count+1 << " ";
-            metadataFile << instanceName << "\n";
-        }
-        std::cout << "Mesh metadata file written out." << std::endl;
+        newFileName = filename.substr(0, lastPos) +
+                      (binary ? "_mesh.bin" : "_mesh.txt");
+        entries = &instanceIdTable;
     }
     else if (st == "material"){
-        newFileName = filename.substr(0, lastPos) + "_materials.txt";
-        metadataFile.open(newFileName.c_str());
-        
-        // Write out materials
-        std::map<std::string, std::shared_ptr<MaterialInstance>>::iterator it;
-        for(it = graphicsState.namedMaterials->begin(); it != graphicsState.namedMaterials->end(); it++) {
-            std::shared_ptr<MaterialInstance> currMaterial = it->second;
-            metadataFile << currMaterial->material->materialId << " ";
-            metadataFile << it->first << "\n";
-        }
-        std::cout << "Material metadata file written out." << std::endl;
+        newFileName = filename.substr(0, lastPos) +
+                      (binary ? "_materials.bin" : "_materials.txt");
+        entries = &materialIdTable;
     }
-    else{
+
+    if (newFileName.empty())
         std::cout << "Warning: No metadata written out." << std::endl;
-    }
-    
-    metadataFile.close();
-    
-    // ------------------------------------------------------------
-    // ------------------------------------------------------------
-    
-    // Create scene and render
-    if (PbrtOptions.cat || PbrtOptions.toPly) {
-        printf("%*sWorldEnd\n", catIndentCount, "");
+    else if (binary) {
+        if (WriteMetadataTable(newFileName, *entries))
+            std::cout << "Binary metadata table written out." << std::endl;
     } else {
-        std::unique_ptr<Integrator> integrator(renderOptions->MakeIntegrator());
-        std::unique_ptr<Scene> scene(renderOptions->MakeScene());
-
-        // This is kind of ugly; we directly override the current profiler
-        // state to switch from parsing/scene construction related stuff to
-        // rendering stuff and then switch it back below. The underlying
-        // issue is that all the rest of the profiling system assumes
-        // hierarchical inheritance of profiling state; this is the only
-        // place where that isn't the case.
-        CHECK_EQ(CurrentProfilerState(), ProfToBits(Prof::SceneConstruction));
-        ProfilerState = ProfToBits(Prof::IntegratorRender);
-
-        if (scene && integrator) integrator->Render(*scene);
+        std::ofstream metadataFile(newFileName.c_str());
+        for (const auto &entry : *entries)
+            metadataFile << entry.first << " " << entry.second << "\n";
+        std::cout << (st == "mesh" ? "Mesh" : "Material")
+                  << " metadata file written out." << std::endl;
+    }
+}
 
-        CHECK_EQ(CurrentProfilerState(), ProfToBits(Prof::IntegratorRender));
-        ProfilerState = ProfToBits(Prof::SceneConstruction);
+// Renders _scene_ once for each camera that was specified: first those
+// saved in _cameraJobs_ and then the current one.
+static void renderCameraJobs(const Scene &scene) {
+    // Warn if no light sources are defined
+    if (scene.lights.empty())
+        Warning(
+            "No light sources defined in scene; "
+            "rendering a black image.");
+    std::vector<CameraOptions> jobs = std::move(renderOptions->cameraJobs);
+    renderOptions->cameraJobs.clear();
+    jobs.push_back(*renderOptions);
+    const std::string imageFile = PbrtOptions.imageFile;
+    std::set<std::string> outputFiles;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        static_cast<CameraOptions &>(*renderOptions) = jobs[i];
+        // With several cameras, those without their own output filename
+        // get the camera's index added to the command-line (or default)
+        // one, so that they don't overwrite each other's images.
+        if (jobs.size() > 1 &&
+            jobs[i].FilmParams.FindOneString("filename", "") == "") {
+            std::string base = imageFile == "" ? "pbrt.exr" : imageFile;
+            size_t extPos = base.find_last_of('.');
+            if (extPos == std::string::npos) extPos = base.size();
+            PbrtOptions.imageFile = base.substr(0, extPos) + "_camera" +
+                                    std::to_string(i) + base.substr(extPos);
+        }
+        std::shared_ptr<const Camera> camera(renderOptions->MakeCamera());
+        if (!camera)
+            Error("Unable to create camera");
+        else if (!outputFiles.insert(camera->film->filename).second)
+            Error("Camera %d writes to \"%s\", as an earlier camera does. "
+                  "Not rendering it.", int(i),
+                  camera->film->filename.c_str());
+        else {
+            writeMetadataTable(*camera->film);
+            std::unique_ptr<Integrator> integrator(
+                renderOptions->MakeIntegrator(camera));
+            if (integrator) renderScene(integrator.get(), scene);
+        }
+        PbrtOptions.imageFile = imageFile;
     }
+}
 
-    // Clean up after rendering. Do this before reporting stats so that
-    // destructors can run and update stats as needed.
-    graphicsState = GraphicsState();
-    transformCache.Clear();
-    currentApiState = APIState::OptionsBlock;
-    ImageTexture<Float, Float>::ClearCache();
-    ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+// Returns the camera, film, sampler and integrator options and the CTM to
+// their defaults after a render. Named media are kept while there is a
+// resident scene, since its primitives refer to them.
+static void resetRenderOptions() {
+    std::map<std::string, std::shared_ptr<Medium>> namedMedia;
+    bool haveScatteringMedia = false;
+    if (residentScene) {
+        namedMedia = std::move(renderOptions->namedMedia);
+        haveScatteringMedia = renderOptions->haveScatteringMedia;
+    }
     renderOptions.reset(new RenderOptions);
+    renderOptions->namedMedia = std::move(namedMedia);
+    renderOptions->haveScatteringMedia = haveScatteringMedia;
+
+    for (int i = 0; i < MaxTransforms; ++i) curTransform[i] = Transform();
+    activeTransformBits = AllTransformsBits;
+    namedCoordinateSystems.erase(namedCoordinateSystems.begin(),
+                                 namedCoordinateSystems.end());
+}
 
+static void reportRenderStats() {
     if (!PbrtOptions.cat && !PbrtOptions.toPly) {
         MergeWorkerThreadStats();
         ReportThreadStats();
@@ -1729,17 +2086,116 @@ void pbrtWorldEnd() {
             ClearProfiler();
         }
     }
+}
 
-    for (int i = 0; i < MaxTransforms; ++i) curTransform[i] = Transform();
-    activeTransformBits = AllTransformsBits;
-    namedCoordinateSystems.erase(namedCoordinateSystems.begin(),
-                                 namedCoordinateSystems.end());
+void pbrtWorldEnd() {
+    VERIFY_WORLD("WorldEnd");
+    // Ensure there are no pushed graphics states
+    while (pushedGraphicsStates.size()) {
+        Warning("Missing end to pbrtAttributeBegin()");
+        pushedGraphicsStates.pop_back();
+        pushedTransforms.pop_back();
+    }
+    while (pushedTransforms.size()) {
+        Warning("Missing end to pbrtTransformBegin()");
+        pushedTransforms.pop_back();
+    }
+
+    // Gather the ID tables that metadata cameras write out (Added by Trisha)
+    instanceIdTable.clear();
+    materialIdTable.clear();
+    // InstanceIDs start at 1
+    uint32_t count = 1;
+    for (const std::string &instanceName : renderOptions->instanceNames)
+        instanceIdTable.push_back(std::make_pair(count++, instanceName));
+    for (const auto &mtl : *graphicsState.namedMaterials)
+        if (mtl.second->material)
+            materialIdTable.push_back(
+                std::make_pair(mtl.second->material->materialId, mtl.first));
+
+    // Create scene and render
+    if (PbrtOptions.cat || PbrtOptions.toPly) {
+        printf("%*sWorldEnd\n", catIndentCount, "");
+    } else {
+        // Image textures are loaded in the background while the scene is
+        // parsed; wait for any that are still in flight
+        ImageTexture<Float, Float>::FinishLoading();
+        ImageTexture<RGBSpectrum, Spectrum>::FinishLoading();
+        std::unique_ptr<Scene> scene(renderOptions->MakeScene());
+        renderCameraJobs(*scene);
+
+        // In server mode, keep the scene around for pbrtRenderResidentScene()
+        if (PbrtOptions.server) residentScene = std::move(scene);
+    }
+
+    // Clean up after rendering. Do this before reporting stats so that
+    // destructors can run and update stats as needed.
+    graphicsState = GraphicsState();
+    currentApiState = APIState::OptionsBlock;
+    // The resident scene's shapes and instances point into the transform
+    // cache's arena, and its image textures refer to the cached MIPMaps,
+    // so those are only freed once it is gone.
+    if (!residentScene) {
+        transformCache.Clear();
+        meshCache.Clear();
+        ImageTexture<Float, Float>::ClearCache();
+        ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    }
+    resetRenderOptions();
+    reportRenderStats();
+}
+
+void pbrtInstanceTransform(int instanceId) {
+    VERIFY_OPTIONS("InstanceTransform");
+    if (!residentScene) {
+        Error("InstanceTransform can only move the instances of a scene "
+              "kept after WorldEnd when running with --server.");
+        return;
+    }
+    if (!residentInstances) {
+        Error("InstanceTransform requires the \"twolevel\" accelerator.");
+        return;
+    }
+    Transform *InstanceToWorld[2] = {
+        transformCache.Lookup(curTransform[0]),
+        transformCache.Lookup(curTransform[1])
+    };
+    AnimatedTransform animatedInstanceToWorld(
+        InstanceToWorld[0], renderOptions->transformStartTime,
+        InstanceToWorld[1], renderOptions->transformEndTime);
+    if (!residentInstances->SetInstanceTransform(instanceId,
+                                                 animatedInstanceToWorld)) {
+        Error("No object instance with ID %d.", instanceId);
+        return;
+    }
+    residentInstancesMoved = true;
+}
+
+void pbrtRenderResidentScene() {
+    VERIFY_OPTIONS("Render");
+    if (!residentScene) {
+        Error("No resident scene to render; it is only kept after WorldEnd "
+              "when running with --server.");
+        return;
+    }
+    if (residentInstancesMoved) {
+        // Only the top-level BVH over the instances needs updating
+        residentInstances->Refit();
+        residentScene->UpdateWorldBound();
+        residentInstancesMoved = false;
+    }
+    renderCameraJobs(*residentScene);
+    resetRenderOptions();
+    reportRenderStats();
 }
 
 Scene *RenderOptions::MakeScene() {
     std::shared_ptr<Primitive> accelerator =
         MakeAccelerator(AcceleratorName, std::move(primitives), AcceleratorParams);
     if (!accelerator) accelerator = std::make_shared<BVHAccel>(primitives);
+    if (PbrtOptions.server)
+        residentInstances =
+            std::dynamic_pointer_cast<TwoLevelAccel>(accelerator);
     Scene *scene = new Scene(accelerator, lights);
     // Erase primitives and lights from _RenderOptions_
     primitives.clear();
@@ -1747,13 +2203,8 @@ Scene *RenderOptions::MakeScene() {
     return scene;
 }
 
-Integrator *RenderOptions::MakeIntegrator() const {
-    std::shared_ptr<const Camera> camera(MakeCamera());
-    if (!camera) {
-        Error("Unable to create camera");
-        return nullptr;
-    }
-
+Integrator *RenderOptions::MakeIntegrator(
+    std::shared_ptr<const Camera> camera) const {
     std::shared_ptr<Sampler> sampler =
         MakeSampler(SamplerName, SamplerParams, camera->film);
     if (!sampler) {
@@ -1769,6 +2220,9 @@ Integrator *RenderOptions::MakeIntegrator() const {
             CreateDirectLightingIntegrator(IntegratorParams, sampler, camera);
     else if (IntegratorName == "path")
         integrator = CreatePathIntegrator(IntegratorParams, sampler, camera);
+    else if (IntegratorName == "wavefrontpath")
+        integrator =
+            CreateWavefrontPathIntegrator(IntegratorParams, sampler, camera);
     else if (IntegratorName == "spectralpath")
         integrator = CreateSpectralPathIntegrator(IntegratorParams, sampler, camera);
     else if (IntegratorName == "volpath")
@@ -1797,11 +2251,6 @@ Integrator *RenderOptions::MakeIntegrator() const {
     }
 
     IntegratorParams.ReportUnused();
-    // Warn if no light sources are defined
-    if (lights.empty())
-        Warning(
-            "No light sources defined in scene; "
-            "rendering a black image.");
     return integrator;
 }
 
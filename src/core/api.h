@@ -87,6 +87,8 @@ void pbrtObjectBegin(const std::string &name);
 void pbrtObjectEnd();
 void pbrtObjectInstance(const std::string &name);
 void pbrtWorldEnd();
+void pbrtInstanceTransform(int instanceId);
+void pbrtRenderResidentScene();
 
 void pbrtParseFile(std::string filename);
 void pbrtParseString(std::string str);
@@ -59,7 +59,15 @@ static std::string StringVaprintf(const std::string &fmt, va_list args) {
     return str;
 }
 
-static void processError(Loc *loc, const char *format, va_list args,
+// Set by _ErrorLocation_ to override _parserLoc_ for the current thread
+static thread_local bool threadLocOverride = false;
+static thread_local const Loc *threadLoc = nullptr;
+
+static const Loc *errorLoc() {
+    return threadLocOverride ? threadLoc : parserLoc;
+}
+
+static void processError(const Loc *loc, const char *format, va_list args,
                          const char *errorType) {
     // Build up an entire formatted error string and print it all at once;
     // this way, if multiple threads are printing messages at once, they
@@ -90,15 +98,31 @@ void Warning(const char *format, ...) {
     if (PbrtOptions.quiet) return;
     va_list args;
     va_start(args, format);
-    processError(parserLoc, format, args, "Warning");
+    processError(errorLoc(), format, args, "Warning");
     va_end(args);
 }
 
 void Error(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    processError(parserLoc, format, args, "Error");
+    processError(errorLoc(), format, args, "Error");
     va_end(args);
 }
 
+std::shared_ptr<const Loc> CurrentErrorLoc() {
+    const Loc *loc = errorLoc();
+    return loc ? std::make_shared<Loc>(*loc) : nullptr;
+}
+
+ErrorLocation::ErrorLocation(const Loc *loc)
+    : prevOverride(threadLocOverride), prevLoc(threadLoc) {
+    threadLocOverride = true;
+    threadLoc = loc;
+}
+
+ErrorLocation::~ErrorLocation() {
+    threadLocOverride = prevOverride;
+    threadLoc = prevLoc;
+}
+
 }  // namespace pbrt
@@ -54,6 +54,25 @@ namespace pbrt {
 void Warning(const char *, ...) PRINTF_FUNC;
 void Error(const char *, ...) PRINTF_FUNC;
 
+struct Loc;
+// Returns a copy of the file location that errors reported by the calling
+// thread currently refer to, or nullptr if there is none.
+std::shared_ptr<const Loc> CurrentErrorLoc();
+
+// While it is in scope, errors reported by the calling thread refer to
+// _loc_, which may be nullptr, rather than to the parser's position.
+// Background tasks use it with the location captured when they were
+// started, since the parser moves on while they run.
+class ErrorLocation {
+  public:
+    ErrorLocation(const Loc *loc);
+    ~ErrorLocation();
+
+  private:
+    bool prevOverride;
+    const Loc *prevLoc;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_ERROR_H
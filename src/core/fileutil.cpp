@@ -35,9 +35,20 @@
 #include "fileutil.h"
 #include <cstdlib>
 #include <climits>
+#include <errno.h>
+#include <stdio.h>
 #ifndef PBRT_IS_WINDOWS
 #include <libgen.h>
 #endif
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#elif defined(PBRT_IS_WINDOWS)
+#include <windows.h>  // Windows file mapping API
+#endif
 
 namespace pbrt {
 
@@ -126,4 +137,94 @@ void SetSearchDirectory(const std::string &dirname) {
     searchDirectory = dirname;
 }
 
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string &filename) {
+    std::unique_ptr<MappedFile> file(new MappedFile);
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return nullptr;
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) != 0) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    file->size = stat.st_size;
+    if (file->size > 0) {
+        void *ptr =
+            mmap(0, file->size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED) {
+            Error("%s: %s", filename.c_str(), strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+        file->unmapPtr = ptr;
+        file->data = (const char *)ptr;
+    }
+    close(fd);
+#elif defined(PBRT_IS_WINDOWS)
+    HANDLE fileHandle =
+        CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        Error("%s: unable to open file", filename.c_str());
+        return nullptr;
+    }
+    LARGE_INTEGER liLen;
+    if (!GetFileSizeEx(fileHandle, &liLen)) {
+        Error("%s: unable to determine file size", filename.c_str());
+        CloseHandle(fileHandle);
+        return nullptr;
+    }
+    file->size = liLen.QuadPart;
+    if (file->size > 0) {
+        HANDLE mapping =
+            CreateFileMapping(fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+        CloseHandle(fileHandle);
+        if (mapping == 0) {
+            Error("%s: unable to map file", filename.c_str());
+            return nullptr;
+        }
+        LPVOID ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (ptr == nullptr) {
+            Error("%s: unable to map file", filename.c_str());
+            return nullptr;
+        }
+        file->unmapPtr = ptr;
+        file->data = (const char *)ptr;
+    } else
+        CloseHandle(fileHandle);
+#else
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return nullptr;
+    }
+    fseek(f, 0, SEEK_END);
+    file->size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->buffer.reset(new char[file->size]);
+    if (fread(file->buffer.get(), 1, file->size, f) != file->size) {
+        Error("%s: short read", filename.c_str());
+        fclose(f);
+        return nullptr;
+    }
+    fclose(f);
+    file->data = file->buffer.get();
+#endif
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef PBRT_HAVE_MMAP
+    if (unmapPtr && munmap(unmapPtr, size) != 0)
+        Error("munmap: %s", strerror(errno));
+#elif defined(PBRT_IS_WINDOWS)
+    if (unmapPtr) UnmapViewOfFile(unmapPtr);
+#endif
+}
+
 }  // namespace pbrt
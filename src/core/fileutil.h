@@ -42,6 +42,7 @@
 #include "pbrt.h"
 #include <string>
 #include <cctype>
+#include <memory>
 #include <string.h>
 
 namespace pbrt {
@@ -60,6 +61,26 @@ inline bool HasExtension(const std::string &value, const std::string &ending) {
         [](char a, char b) { return std::tolower(a) == std::tolower(b); });
 }
 
+// Read-only view of a file's contents. The file is memory-mapped where the
+// platform supports it and read into memory otherwise.
+class MappedFile {
+  public:
+    // Returns nullptr (after reporting an error) if the file can't be read.
+    static std::unique_ptr<MappedFile> Open(const std::string &filename);
+    ~MappedFile();
+
+    const char *Data() const { return data; }
+    size_t Size() const { return size; }
+
+  private:
+    MappedFile() = default;
+
+    const char *data = nullptr;
+    size_t size = 0;
+    void *unmapPtr = nullptr;
+    std::unique_ptr<char[]> buffer;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_FILEUTIL_H
@@ -36,6 +36,7 @@
 #include "paramset.h"
 #include "imageio.h"
 #include "stats.h"
+#include "fileutil.h"
 
 // We need this for writing out an appropriate .dat file for the spectral image:
 #include <sstream>
@@ -49,14 +50,16 @@ STAT_MEMORY_COUNTER("Memory/Film pixels", filmPixelMemory);
 // Film Method Definitions
 Film::Film(const Point2i &resolution, const Bounds2f &cropWindow,
                std::unique_ptr<Filter> filt, Float diagonal,
-               const std::string &filename, Float scale, bool sf, Float maxSampleLuminance)
+               const std::string &filename, Float scale, bool sf, Float maxSampleLuminance,
+               const std::vector<AOV> &aovs)
     : fullResolution(resolution),
       diagonal(diagonal * .001),
       filter(std::move(filt)),
       filename(filename),
       scale(scale),
       maxSampleLuminance(maxSampleLuminance),
-      spectralFlag(sf){
+      spectralFlag(sf),
+      aovs(aovs) {
     // Compute film image bounds
     croppedPixelBounds =
         Bounds2i(Point2i(std::ceil(fullResolution.x * cropWindow.pMin.x),
@@ -70,6 +73,10 @@ Film::Film(const Point2i &resolution, const Bounds2f &cropWindow,
     // Allocate film image storage
     pixels = std::unique_ptr<Pixel[]>(new Pixel[croppedPixelBounds.Area()]);
     filmPixelMemory += croppedPixelBounds.Area() * sizeof(Pixel);
+    if (!aovs.empty()) {
+        aovPixels.reset(new AOVPixel[croppedPixelBounds.Area()]);
+        filmPixelMemory += croppedPixelBounds.Area() * sizeof(AOVPixel);
+    }
 
     // Precompute filter weight table
     int offset = 0;
@@ -108,7 +115,7 @@ std::unique_ptr<FilmTile> Film::GetFilmTile(const Bounds2i &sampleBounds) {
     Bounds2i tilePixelBounds = Intersect(Bounds2i(p0, p1), croppedPixelBounds);
     return std::unique_ptr<FilmTile>(new FilmTile(
                                                     tilePixelBounds, filter->radius, filterTable, filterTableWidth,
-                                                    maxSampleLuminance));
+                                                    maxSampleLuminance, HasAOVs()));
 }
     
 void Film::Clear() {
@@ -119,6 +126,9 @@ void Film::Clear() {
         pixel.filterWeightSum = 0;
         pixel.L = 0;
     }
+    if (aovPixels)
+        for (int i = 0; i < croppedPixelBounds.Area(); ++i)
+            aovPixels[i] = AOVPixel();
 }
     
 void Film::MergeFilmTile(std::unique_ptr<FilmTile> tile) {
@@ -139,6 +149,30 @@ void Film::MergeFilmTile(std::unique_ptr<FilmTile> tile) {
         }
             
     }
+    if (!tile->aovPixels.empty()) {
+        int tileWidth = tile->pixelBounds.pMax.x - tile->pixelBounds.pMin.x;
+        int width = croppedPixelBounds.pMax.x - croppedPixelBounds.pMin.x;
+        for (Point2i pixel : tile->GetPixelBounds()) {
+            const AOVPixel &tilePixel =
+                tile->aovPixels[(pixel.x - tile->pixelBounds.pMin.x) +
+                                (pixel.y - tile->pixelBounds.pMin.y) * tileWidth];
+            AOVPixel &mergePixel =
+                aovPixels[(pixel.x - croppedPixelBounds.pMin.x) +
+                          (pixel.y - croppedPixelBounds.pMin.y) * width];
+            mergePixel.depth += tilePixel.depth;
+            for (int c = 0; c < 3; ++c) {
+                mergePixel.p[c] += tilePixel.p[c];
+                mergePixel.n[c] += tilePixel.n[c];
+                mergePixel.albedo[c] += tilePixel.albedo[c];
+            }
+            mergePixel.weightSum += tilePixel.weightSum;
+            if (tilePixel.idDistance < mergePixel.idDistance) {
+                mergePixel.idDistance = tilePixel.idDistance;
+                mergePixel.materialId = tilePixel.materialId;
+                mergePixel.instanceId = tilePixel.instanceId;
+            }
+        }
+    }
 }
     
 void Film::SetImage(const Spectrum *img) const {
@@ -307,9 +341,81 @@ void Film::WriteImage(Float splatScale) {
             
     }
             
+    if (HasAOVs()) writeAOVs();
 }
     
     
+static const char *AOVName(AOV aov) {
+    switch (aov) {
+    case AOV::Depth: return "depth";
+    case AOV::Position: return "position";
+    case AOV::Normal: return "normal";
+    case AOV::MaterialId: return "materialId";
+    case AOV::InstanceId: return "instanceId";
+    case AOV::Albedo: return "albedo";
+    }
+    return "unknown";
+}
+
+void Film::writeAOVs() const {
+    // AOVs go next to the main image, e.g. "foo_depth.exr" for "foo.exr".
+    // Formats that can't store floating-point values are replaced with PFM.
+    // IDs are written as uint32 binary metadata images, e.g.
+    // "foo_materialId.bin", since floats can't represent all of them.
+    size_t extPos = filename.find_last_of('.');
+    std::string base = filename.substr(0, extPos), ext = ".exr";
+    if (extPos != std::string::npos) ext = filename.substr(extPos);
+    if (!HasExtension(ext, ".exr") && !HasExtension(ext, ".pfm")) ext = ".pfm";
+
+    int nPixels = croppedPixelBounds.Area();
+    Vector2i extent = croppedPixelBounds.Diagonal();
+    std::unique_ptr<Float[]> rgb(new Float[3 * nPixels]);
+    for (AOV aov : aovs) {
+        if (aov == AOV::MaterialId || aov == AOV::InstanceId) {
+            std::vector<uint32_t> ids(nPixels);
+            for (int i = 0; i < nPixels; ++i)
+                ids[i] = aov == AOV::MaterialId ? aovPixels[i].materialId
+                                                : aovPixels[i].instanceId;
+            std::string idFilename = base + "_" + AOVName(aov) + ".bin";
+            LOG(INFO) << "Writing AOV image " << idFilename;
+            WriteMetadataImage(idFilename, extent.x, extent.y, 1, true,
+                               ids.data());
+            continue;
+        }
+        for (int i = 0; i < nPixels; ++i) {
+            const AOVPixel &pixel = aovPixels[i];
+            Float invWt = pixel.weightSum > 0 ? 1 / pixel.weightSum : 0;
+            Float *v = &rgb[3 * i];
+            switch (aov) {
+            case AOV::Depth:
+                v[0] = v[1] = v[2] = pixel.depth * invWt;
+                break;
+            case AOV::Position:
+                for (int c = 0; c < 3; ++c) v[c] = pixel.p[c] * invWt;
+                break;
+            case AOV::Normal: {
+                Normal3f n(pixel.n[0], pixel.n[1], pixel.n[2]);
+                if (n != Normal3f(0, 0, 0)) n = Normalize(n);
+                v[0] = n.x;
+                v[1] = n.y;
+                v[2] = n.z;
+                break;
+            }
+            case AOV::MaterialId:
+            case AOV::InstanceId:
+                break;
+            case AOV::Albedo:
+                for (int c = 0; c < 3; ++c) v[c] = pixel.albedo[c] * invWt;
+                break;
+            }
+        }
+        std::string aovFilename = base + "_" + AOVName(aov) + ext;
+        LOG(INFO) << "Writing AOV image " << aovFilename;
+        pbrt::WriteImage(aovFilename, &rgb[0], croppedPixelBounds,
+                         fullResolution);
+    }
+}
+
 Film *CreateFilm(const ParamSet &params, std::unique_ptr<Filter> filter) {
     // Intentionally use FindOneString() rather than FindOneFilename() here
     // so that the rendered image is left in the working directory, rather
@@ -346,9 +452,23 @@ Film *CreateFilm(const ParamSet &params, std::unique_ptr<Filter> filter) {
     Float maxSampleLuminance = params.FindOneFloat("maxsampleluminance",
                                                     Infinity);
     bool spectralFlag = params.FindOneBool("spectralFlag", true);
+
+    std::vector<AOV> aovs;
+    int nAOVs = 0;
+    const std::string *aovNames = params.FindString("aovs", &nAOVs);
+    for (int i = 0; i < nAOVs; ++i) {
+        const AOV allAOVs[] = {AOV::Depth, AOV::Position, AOV::Normal,
+                               AOV::MaterialId, AOV::InstanceId, AOV::Albedo};
+        auto iter = std::find_if(std::begin(allAOVs), std::end(allAOVs),
+                                 [&](AOV aov) { return aovNames[i] == AOVName(aov); });
+        if (iter == std::end(allAOVs))
+            Warning("AOV \"%s\" unknown. Ignoring.", aovNames[i].c_str());
+        else if (std::find(aovs.begin(), aovs.end(), *iter) == aovs.end())
+            aovs.push_back(*iter);
+    }
         
     return new Film(Point2i(xres, yres), crop, std::move(filter), diagonal,
-                    filename, scale, spectralFlag, maxSampleLuminance);
+                    filename, scale, spectralFlag, maxSampleLuminance, aovs);
 }
     
 }  // namespace pbrt
@@ -54,6 +54,33 @@ struct FilmTilePixel {
     Float filterWeightSum = 0.f;
 };
 
+// AOV Declarations
+
+// Arbitrary output variables: values from each camera ray's first
+// intersection that the film records alongside the rendered image.
+enum class AOV { Depth, Position, Normal, MaterialId, InstanceId, Albedo };
+
+struct AOVSample {
+    // Whether the camera ray hit anything; the rest is only valid if so
+    bool hit = false;
+    Float depth = 0;
+    Point3f p;
+    Normal3f n;
+    uint32_t materialId = 0, instanceId = 0;
+    Spectrum albedo = 0.f;
+};
+
+// Per-pixel AOV accumulation. Continuous values are averaged over the
+// samples that hit something; IDs are taken from the hit sample closest to
+// the pixel center, since averaging them would be meaningless.
+struct AOVPixel {
+    Float depth = 0;
+    Float p[3] = {0, 0, 0}, n[3] = {0, 0, 0}, albedo[3] = {0, 0, 0};
+    Float weightSum = 0;
+    uint32_t materialId = 0, instanceId = 0;
+    Float idDistance = Infinity;
+};
+
 // Film Declarations
 class Film {
   public:
@@ -61,7 +88,8 @@ class Film {
     Film(const Point2i &resolution, const Bounds2f &cropWindow,
          std::unique_ptr<Filter> filter, Float diagonal,
          const std::string &filename, Float scale, bool spectralFlag,
-         Float maxSampleLuminance = Infinity);
+         Float maxSampleLuminance = Infinity,
+         const std::vector<AOV> &aovs = std::vector<AOV>());
     Bounds2i GetSampleBounds() const;
     Bounds2f GetPhysicalExtent() const;
     std::unique_ptr<FilmTile> GetFilmTile(const Bounds2i &sampleBounds);
@@ -70,6 +98,10 @@ class Film {
     void AddSplat(const Point2f &p, Spectrum v);
     void WriteImage(Float splatScale = 1);
     void Clear();
+    bool HasAOVs() const { return !aovs.empty(); }
+    bool HasAOV(AOV aov) const {
+        return std::find(aovs.begin(), aovs.end(), aov) != aovs.end();
+    }
 
     // Film Public Data
     const Point2i fullResolution;
@@ -95,8 +127,11 @@ class Film {
     const Float scale;
     const Float maxSampleLuminance;
     bool spectralFlag;
+    const std::vector<AOV> aovs;
+    std::unique_ptr<AOVPixel[]> aovPixels;
     
     // Film Private Methods
+    void writeAOVs() const;
     Pixel &GetPixel(const Point2i &p) {
         CHECK(InsideExclusive(p, croppedPixelBounds));
         int width = croppedPixelBounds.pMax.x - croppedPixelBounds.pMin.x;
@@ -111,7 +146,7 @@ class FilmTile {
     // FilmTile Public Methods
     FilmTile(const Bounds2i &pixelBounds, const Vector2f &filterRadius,
              const Float *filterTable, int filterTableSize,
-             Float maxSampleLuminance)
+             Float maxSampleLuminance, bool recordAOVs = false)
         : pixelBounds(pixelBounds),
           filterRadius(filterRadius),
           invFilterRadius(1 / filterRadius.x, 1 / filterRadius.y),
@@ -119,6 +154,8 @@ class FilmTile {
           filterTableSize(filterTableSize),
           maxSampleLuminance(maxSampleLuminance) {
         pixels = std::vector<FilmTilePixel>(std::max(0, pixelBounds.Area()));
+        if (recordAOVs)
+            aovPixels = std::vector<AOVPixel>(std::max(0, pixelBounds.Area()));
     }
     void AddSample(const Point2f &pFilm, Spectrum L,
                    Float sampleWeight = 1.) {
@@ -176,6 +213,29 @@ class FilmTile {
         return pixels[offset];
     }
     Bounds2i GetPixelBounds() const { return pixelBounds; }
+    void AddAOVSample(const Point2f &pFilm, const AOVSample &sample) {
+        // Record the sample in the pixel that contains it
+        Point2i pi = (Point2i)Floor(pFilm);
+        if (aovPixels.empty() || !InsideExclusive(pi, pixelBounds)) return;
+        int width = pixelBounds.pMax.x - pixelBounds.pMin.x;
+        AOVPixel &pixel = aovPixels[(pi.x - pixelBounds.pMin.x) +
+                                    (pi.y - pixelBounds.pMin.y) * width];
+        pixel.depth += sample.depth;
+        Float rgb[3];
+        sample.albedo.ToRGB(rgb);
+        for (int c = 0; c < 3; ++c) {
+            pixel.p[c] += sample.p[c];
+            pixel.n[c] += sample.n[c];
+            pixel.albedo[c] += rgb[c];
+        }
+        pixel.weightSum += 1;
+        Float distance = DistanceSquared(pFilm, Point2f(pi) + Vector2f(.5f, .5f));
+        if (distance < pixel.idDistance) {
+            pixel.idDistance = distance;
+            pixel.materialId = sample.materialId;
+            pixel.instanceId = sample.instanceId;
+        }
+    }
 
   private:
     // FilmTile Private Data
@@ -184,6 +244,7 @@ class FilmTile {
     const Float *filterTable;
     const int filterTableSize;
     std::vector<FilmTilePixel> pixels;
+    std::vector<AOVPixel> aovPixels;
     const Float maxSampleLuminance;
     friend class Film;
 };
@@ -35,10 +35,14 @@
 #include "ext/lodepng.h"
 #include "ext/targa.h"
 #include "fileutil.h"
+#include "parallel.h"
 #include "spectrum.h"
 
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
+#include <ImfThreading.h>
+#include <zlib.h>
+#include <mutex>
 
 namespace pbrt {
 
@@ -51,11 +55,24 @@ static void WriteImageTGA(const std::string &name, const uint8_t *pixels,
                           int xOffset, int yOffset);
 static RGBSpectrum *ReadImageTGA(const std::string &name, int *w, int *h);
 static RGBSpectrum *ReadImagePNG(const std::string &name, int *w, int *h);
+static void WriteImagePNG(const std::string &name, const uint8_t *pixels,
+                          int xRes, int yRes);
 static bool WriteImagePFM(const std::string &filename, const Float *rgb,
                           int xres, int yres);
 static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
                                  int *yres);
 
+// Runs _func_ over _count_ items with _ParallelFor()_ if the worker
+// threads are running and serially otherwise; the image I/O routines are
+// also called from tools and tests that never start them.
+static void ImageParallelFor(std::function<void(int64_t)> func, int64_t count,
+                             int chunkSize) {
+    if (ParallelInitialized())
+        ParallelFor(std::move(func), count, chunkSize);
+    else
+        for (int64_t i = 0; i < count; ++i) func(i);
+}
+
 // ImageIO Function Definitions
 std::unique_ptr<RGBSpectrum[]> ReadImage(const std::string &name,
                                          Point2i *resolution) {
@@ -92,8 +109,8 @@ void WriteImage(const std::string &name, const Float *rgb,
         Vector2i resolution = outputBounds.Diagonal();
         std::unique_ptr<uint8_t[]> rgb8(
             new uint8_t[3 * resolution.x * resolution.y]);
-        uint8_t *dst = rgb8.get();
-        for (int y = 0; y < resolution.y; ++y) {
+        ImageParallelFor([&](int64_t y) {
+            uint8_t *dst = &rgb8[3 * y * resolution.x];
             for (int x = 0; x < resolution.x; ++x) {
 #define TO_BYTE(v) (uint8_t) Clamp(255.f * GammaCorrect(v) + 0.5f, 0.f, 255.f)
                 dst[0] = TO_BYTE(rgb[3 * (y * resolution.x + x) + 0]);
@@ -102,29 +119,33 @@ void WriteImage(const std::string &name, const Float *rgb,
 #undef TO_BYTE
                 dst += 3;
             }
-        }
+        }, resolution.y, 32);
 
         if (HasExtension(name, ".tga"))
             WriteImageTGA(name, rgb8.get(), resolution.x, resolution.y,
                           totalResolution.x, totalResolution.y,
                           outputBounds.pMin.x, outputBounds.pMin.y);
-        else {
-            unsigned int error = lodepng_encode24_file(
-                name.c_str(), rgb8.get(), resolution.x, resolution.y);
-            if (error != 0)
-                Error("Error writing PNG \"%s\": %s", name.c_str(),
-                      lodepng_error_text(error));
-        }
+        else
+            WriteImagePNG(name, rgb8.get(), resolution.x, resolution.y);
     } else {
         Error("Can't determine image file type from suffix of filename \"%s\"",
               name.c_str());
     }
 }
 
+// OpenEXR decompresses and compresses scanline blocks on its own global
+// thread pool, which is empty unless it's given a size.
+static void InitEXRThreads() {
+    static std::once_flag flag;
+    std::call_once(flag,
+                   []() { Imf::setGlobalThreadCount(NumWorkerThreads()); });
+}
+
 RGBSpectrum *ReadImageEXR(const std::string &name, int *width, int *height,
                           Bounds2i *dataWindow, Bounds2i *displayWindow) {
     using namespace Imf;
     using namespace Imath;
+    InitEXRThreads();
     try {
         RgbaInputFile file(name.c_str());
         Box2i dw = file.dataWindow();
@@ -147,10 +168,13 @@ RGBSpectrum *ReadImageEXR(const std::string &name, int *width, int *height,
         file.readPixels(dw.min.y, dw.max.y);
 
         RGBSpectrum *ret = new RGBSpectrum[*width * *height];
-        for (int i = 0; i < *width * *height; ++i) {
-            Float frgb[3] = {pixels[i].r, pixels[i].g, pixels[i].b};
-            ret[i] = RGBSpectrum::FromRGB(frgb);
-        }
+        int xRes = *width;
+        ImageParallelFor([&](int64_t y) {
+            for (int i = y * xRes; i < (y + 1) * xRes; ++i) {
+                Float frgb[3] = {pixels[i].r, pixels[i].g, pixels[i].b};
+                ret[i] = RGBSpectrum::FromRGB(frgb);
+            }
+        }, *height, 32);
         LOG(INFO) << StringPrintf("Read EXR image %s (%d x %d)",
                                   name.c_str(), *width, *height);
         return ret;
@@ -166,10 +190,14 @@ static void WriteImageEXR(const std::string &name, const Float *pixels,
                           int xOffset, int yOffset) {
     using namespace Imf;
     using namespace Imath;
+    InitEXRThreads();
 
     Rgba *hrgba = new Rgba[xRes * yRes];
-    for (int i = 0; i < xRes * yRes; ++i)
-        hrgba[i] = Rgba(pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2]);
+    ImageParallelFor([&](int64_t y) {
+        for (int i = y * xRes; i < (y + 1) * xRes; ++i)
+            hrgba[i] =
+                Rgba(pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2]);
+    }, yRes, 32);
 
     // OpenEXR uses inclusive pixel bounds.
     Box2i displayWindow(V2i(0, 0), V2i(totalXRes - 1, totalYRes - 1));
@@ -255,30 +283,88 @@ static RGBSpectrum *ReadImageTGA(const std::string &name, int *width,
     return ret;
 }
 
+// PNG Function Definitions
+
+// Inflates PNG image data with zlib, which is considerably faster than
+// lodepng's own decoder. _*out_ holds a buffer that lodepng has already
+// allocated with malloc(); it's grown with realloc() as needed.
+static unsigned InflatePNG(unsigned char **out, size_t *outsize,
+                           const unsigned char *in, size_t insize,
+                           const LodePNGDecompressSettings *) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) return 83;
+    stream.next_in = const_cast<unsigned char *>(in);
+    stream.avail_in = insize;
+
+    size_t capacity = std::max<size_t>(4 * insize, 65536);
+    unsigned char *buf = (unsigned char *)realloc(*out, capacity);
+    unsigned error = 0;
+    if (!buf) error = 83;
+    while (!error) {
+        stream.next_out = buf + stream.total_out;
+        stream.avail_out = capacity - stream.total_out;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) break;
+        if (result == Z_MEM_ERROR)
+            error = 83;
+        else if (result == Z_BUF_ERROR && stream.avail_out > 0)
+            // Ran out of input before the end of the stream
+            error = 10;
+        else if (result != Z_OK && result != Z_BUF_ERROR)
+            error = 13;
+        else if (stream.avail_out == 0) {
+            unsigned char *grown =
+                (unsigned char *)realloc(buf, 2 * capacity);
+            if (grown) {
+                buf = grown;
+                capacity *= 2;
+            } else
+                error = 83;
+        }
+    }
+    *out = buf;
+    *outsize = stream.total_out;
+    inflateEnd(&stream);
+    return error;
+}
+
 static RGBSpectrum *ReadImagePNG(const std::string &name, int *width,
                                  int *height) {
-    unsigned char *rgb;
+    unsigned char *png = nullptr, *rgb = nullptr;
+    size_t pngSize;
     unsigned w, h;
-    unsigned int error = lodepng_decode24_file(&rgb, &w, &h, name.c_str());
+    unsigned int error = lodepng_load_file(&png, &pngSize, name.c_str());
+    if (error == 0) {
+        LodePNGState state;
+        lodepng_state_init(&state);
+        state.info_raw.colortype = LCT_RGB;
+        state.info_raw.bitdepth = 8;
+        state.decoder.zlibsettings.custom_zlib = InflatePNG;
+        error = lodepng_decode(&rgb, &w, &h, &state, png, pngSize);
+        lodepng_state_cleanup(&state);
+    }
+    free(png);
     if (error != 0) {
         Error("Error reading PNG \"%s\": %s", name.c_str(),
               lodepng_error_text(error));
+        free(rgb);
         return nullptr;
     }
     *width = w;
     *height = h;
 
     RGBSpectrum *ret = new RGBSpectrum[*width * *height];
-    unsigned char *src = rgb;
-    for (unsigned int y = 0; y < h; ++y) {
+    ImageParallelFor([&](int64_t y) {
+        const unsigned char *src = rgb + 3 * y * w;
         for (unsigned int x = 0; x < w; ++x, src += 3) {
             Float c[3];
             c[0] = src[0] / 255.f;
             c[1] = src[1] / 255.f;
             c[2] = src[2] / 255.f;
-            ret[y * *width + x] = RGBSpectrum::FromRGB(c);
+            ret[y * w + x] = RGBSpectrum::FromRGB(c);
         }
-    }
+    }, h, 32);
 
     free(rgb);
     LOG(INFO) << StringPrintf("Read PNG image %s (%d x %d)",
@@ -286,6 +372,144 @@ static RGBSpectrum *ReadImagePNG(const std::string &name, int *width,
     return ret;
 }
 
+static inline uint8_t Paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// Applies the PNG filter that minimizes the sum of absolute differences
+// (the heuristic recommended by the PNG specification) to the given RGB
+// scanline, writing the filter type followed by the filtered bytes to
+// _out_; _prev_ is the previous scanline or _nullptr_ for the first one.
+static void FilterPNGScanline(const uint8_t *row, const uint8_t *prev,
+                              int rowBytes, uint8_t *out, uint8_t *scratch) {
+    const int bpp = 3;
+    long bestSum = std::numeric_limits<long>::max();
+    for (int type = 0; type < 5; ++type) {
+        long sum = 0;
+        for (int i = 0; i < rowBytes; ++i) {
+            int a = i >= bpp ? row[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (prev && i >= bpp) ? prev[i - bpp] : 0;
+            uint8_t predicted;
+            switch (type) {
+            case 0: predicted = 0; break;
+            case 1: predicted = a; break;
+            case 2: predicted = b; break;
+            case 3: predicted = (a + b) / 2; break;
+            default: predicted = Paeth(a, b, c); break;
+            }
+            scratch[i] = row[i] - predicted;
+            sum += std::abs((int8_t)scratch[i]);
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            out[0] = type;
+            memcpy(out + 1, scratch, rowBytes);
+        }
+    }
+}
+
+static void WritePNGChunk(FILE *fp, const char *type, const uint8_t *data,
+                          size_t length) {
+    uint8_t header[8] = {uint8_t(length >> 24), uint8_t(length >> 16),
+                         uint8_t(length >> 8), uint8_t(length)};
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(crc32(0, nullptr, 0), header + 4, 4);
+    if (length > 0) crc = crc32(crc, data, length);
+    uint8_t crcBytes[4] = {uint8_t(crc >> 24), uint8_t(crc >> 16),
+                           uint8_t(crc >> 8), uint8_t(crc)};
+    fwrite(header, 1, 8, fp);
+    if (length > 0) fwrite(data, 1, length, fp);
+    fwrite(crcBytes, 1, 4, fp);
+}
+
+// Writes an 8-bit RGB PNG. Bands of scanlines are filtered and deflated
+// independently in parallel; each band but the last ends with a sync flush
+// so that the compressed bands can be concatenated into a single zlib
+// stream, whose Adler-32 checksum is combined from the bands' checksums.
+static void WriteImagePNG(const std::string &name, const uint8_t *pixels,
+                          int xRes, int yRes) {
+    int rowBytes = 3 * xRes;
+    int bandRows = std::max(1, (256 * 1024) / (rowBytes + 1));
+    int nBands = (yRes + bandRows - 1) / bandRows;
+    struct Band {
+        std::vector<uint8_t> compressed;
+        uLong adler;
+        size_t length;
+        bool ok = false;
+    };
+    std::vector<Band> bands(nBands);
+    ImageParallelFor([&](int64_t b) {
+        int y0 = b * bandRows, y1 = std::min(y0 + bandRows, yRes);
+        Band &band = bands[b];
+        band.length = size_t(y1 - y0) * (rowBytes + 1);
+        std::vector<uint8_t> filtered(band.length), scratch(rowBytes);
+        for (int y = y0; y < y1; ++y)
+            FilterPNGScanline(
+                pixels + size_t(y) * rowBytes,
+                y > 0 ? pixels + size_t(y - 1) * rowBytes : nullptr,
+                rowBytes, &filtered[(y - y0) * (rowBytes + 1)], &scratch[0]);
+        band.adler = adler32(adler32(0, nullptr, 0), &filtered[0],
+                             band.length);
+
+        // Compress the band as raw deflate data
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            return;
+        // Leave room for the empty stored block that a sync flush adds.
+        band.compressed.resize(deflateBound(&stream, band.length) + 16);
+        stream.next_in = &filtered[0];
+        stream.avail_in = band.length;
+        stream.next_out = &band.compressed[0];
+        stream.avail_out = band.compressed.size();
+        bool last = (b == nBands - 1);
+        int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        band.ok = last ? (result == Z_STREAM_END)
+                       : (result == Z_OK && stream.avail_in == 0);
+        band.compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+    }, nBands, 1);
+
+    // Assemble the zlib stream: header, deflate data, and checksum
+    std::vector<uint8_t> idat = {0x78, 0x9c};
+    uLong adler = adler32(0, nullptr, 0);
+    for (const Band &band : bands) {
+        if (!band.ok) {
+            Error("Error compressing PNG \"%s\"", name.c_str());
+            return;
+        }
+        idat.insert(idat.end(), band.compressed.begin(),
+                    band.compressed.end());
+        adler = adler32_combine(adler, band.adler, band.length);
+    }
+    for (int shift = 24; shift >= 0; shift -= 8)
+        idat.push_back(uint8_t(adler >> shift));
+
+    FILE *fp = fopen(name.c_str(), "wb");
+    if (!fp) {
+        Error("Unable to open output PNG file \"%s\"", name.c_str());
+        return;
+    }
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    // 8-bit truecolor, default compression and filtering, not interlaced
+    uint8_t ihdr[13] = {uint8_t(xRes >> 24), uint8_t(xRes >> 16),
+                        uint8_t(xRes >> 8),  uint8_t(xRes),
+                        uint8_t(yRes >> 24), uint8_t(yRes >> 16),
+                        uint8_t(yRes >> 8),  uint8_t(yRes),
+                        8, 2, 0, 0, 0};
+    fwrite(signature, 1, 8, fp);
+    WritePNGChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    WritePNGChunk(fp, "IDAT", &idat[0], idat.size());
+    WritePNGChunk(fp, "IEND", nullptr, 0);
+    if (ferror(fp)) Error("Error writing PNG \"%s\"", name.c_str());
+    fclose(fp);
+}
+
 // PFM Function Definitions
 /*
  * PFM reader/writer code courtesy Jiawen "Kevin" Chen
@@ -315,44 +539,31 @@ static PBRT_CONSTEXPR bool hostLittleEndian =
 #endif
     ;
 
-#define BUFFER_SIZE 80
-
 static inline int isWhitespace(char c) {
     return c == ' ' || c == '\n' || c == '\t';
 }
 
-// Reads a "word" from the fp and puts it into buffer and adds a null
-// terminator.  i.e. it keeps reading until whitespace is reached.  Returns
-// the number of characters read *not* including the whitespace, and
-// returns -1 on an error.
-static int readWord(FILE *fp, char *buffer, int bufferLength) {
-    int n;
-    int c;
-
-    if (bufferLength < 1) return -1;
-
-    n = 0;
-    c = fgetc(fp);
-    while (c != EOF && !isWhitespace(c) && n < bufferLength) {
-        buffer[n] = c;
-        ++n;
-        c = fgetc(fp);
-    }
-
-    if (n < bufferLength) {
-        buffer[n] = '\0';
-        return n;
-    }
-
-    return -1;
+// Reads a whitespace-terminated "word" starting at _*pos_ in the _size_
+// bytes of _buffer_ and advances _*pos_ past it and the single whitespace
+// character that follows. Returns false if the buffer ends first.
+static bool readWord(const char *buffer, size_t size, size_t *pos,
+                     std::string *word) {
+    size_t start = *pos;
+    while (*pos < size && !isWhitespace(buffer[*pos])) ++*pos;
+    if (*pos == size || *pos == start) return false;
+    word->assign(buffer + start, *pos - start);
+    ++*pos;
+    return true;
 }
 
 static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
                                  int *yres) {
-    float *data = nullptr;
+    std::unique_ptr<float[]> data;
     RGBSpectrum *rgb = nullptr;
-    char buffer[BUFFER_SIZE];
-    unsigned int nFloats;
+    char header[256];
+    size_t headerSize, pos = 0;
+    std::string word;
+    size_t nFloats, rowFloats;
     int nChannels, width, height;
     float scale;
     bool fileLittleEndian;
@@ -360,67 +571,66 @@ static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
     FILE *fp = fopen(filename.c_str(), "rb");
     if (!fp) goto fail;
 
-    // read either "Pf" or "PF"
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
-
-    if (strcmp(buffer, "Pf") == 0)
+    // Read the header from the start of the file in one block: either "Pf"
+    // or "PF", then the width, height, and scale.
+    headerSize = fread(header, 1, sizeof(header), fp);
+    if (!readWord(header, headerSize, &pos, &word)) goto fail;
+    if (word == "Pf")
         nChannels = 1;
-    else if (strcmp(buffer, "PF") == 0)
+    else if (word == "PF")
         nChannels = 3;
     else
         goto fail;
 
-    // read the rest of the header
-    // read width
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
-    width = atoi(buffer);
+    if (!readWord(header, headerSize, &pos, &word)) goto fail;
+    width = atoi(word.c_str());
     *xres = width;
-
-    // read height
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
-    height = atoi(buffer);
+    if (!readWord(header, headerSize, &pos, &word)) goto fail;
+    height = atoi(word.c_str());
     *yres = height;
+    if (!readWord(header, headerSize, &pos, &word)) goto fail;
+    if (sscanf(word.c_str(), "%f", &scale) != 1) goto fail;
+    if (width <= 0 || height <= 0) goto fail;
+
+    // Read the data in a single chunk; the rows are flipped in Y below, as
+    // P*M has the origin at the lower left.
+    rowFloats = size_t(nChannels) * width;
+    nFloats = rowFloats * height;
+    data.reset(new float[nFloats]);
+    if (fseek(fp, pos, SEEK_SET) != 0 ||
+        fread(data.get(), sizeof(float), nFloats, fp) != nFloats)
+        goto fail;
 
-    // read scale
-    if (readWord(fp, buffer, BUFFER_SIZE) == -1) goto fail;
-    sscanf(buffer, "%f", &scale);
-
-    // read the data
-    nFloats = nChannels * width * height;
-    data = new float[nFloats];
-    // Flip in Y, as P*M has the origin at the lower left.
-    for (int y = height - 1; y >= 0; --y) {
-        if (fread(&data[y * nChannels * width], sizeof(float),
-                  nChannels * width, fp) != nChannels * width)
-            goto fail;
-    }
-
-    // apply endian conversian and scale if appropriate
+    // Apply endian conversion and scale and create RGBs, a band of rows at
+    // a time
     fileLittleEndian = (scale < 0.f);
-    if (hostLittleEndian ^ fileLittleEndian) {
-        uint8_t bytes[4];
-        for (unsigned int i = 0; i < nFloats; ++i) {
-            memcpy(bytes, &data[i], 4);
-            std::swap(bytes[0], bytes[3]);
-            std::swap(bytes[1], bytes[2]);
-            memcpy(&data[i], bytes, 4);
+    scale = std::abs(scale);
+    rgb = new RGBSpectrum[size_t(width) * height];
+    ImageParallelFor([&](int64_t y) {
+        float *row = &data[(height - 1 - y) * rowFloats];
+        if (hostLittleEndian ^ fileLittleEndian) {
+            uint8_t bytes[4];
+            for (size_t i = 0; i < rowFloats; ++i) {
+                memcpy(bytes, &row[i], 4);
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+                memcpy(&row[i], bytes, 4);
+            }
         }
-    }
-    if (std::abs(scale) != 1.f)
-        for (unsigned int i = 0; i < nFloats; ++i) data[i] *= std::abs(scale);
-
-    // create RGBs...
-    rgb = new RGBSpectrum[width * height];
-    if (nChannels == 1) {
-        for (int i = 0; i < width * height; ++i) rgb[i] = RGBSpectrum(data[i]);
-    } else {
-        for (int i = 0; i < width * height; ++i) {
-            Float frgb[3] = {data[3 * i], data[3 * i + 1], data[3 * i + 2]};
-            rgb[i] = RGBSpectrum::FromRGB(frgb);
+        if (scale != 1.f)
+            for (size_t i = 0; i < rowFloats; ++i) row[i] *= scale;
+
+        RGBSpectrum *dst = &rgb[y * width];
+        if (nChannels == 1) {
+            for (int x = 0; x < width; ++x) dst[x] = RGBSpectrum(row[x]);
+        } else {
+            for (int x = 0; x < width; ++x) {
+                Float frgb[3] = {row[3 * x], row[3 * x + 1], row[3 * x + 2]};
+                dst[x] = RGBSpectrum::FromRGB(frgb);
+            }
         }
-    }
+    }, height, 32);
 
-    delete[] data;
     fclose(fp);
     LOG(INFO) << StringPrintf("Read PFM image %s (%d x %d)",
                               filename.c_str(), *xres, *yres);
@@ -429,7 +639,6 @@ static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
 fail:
     Error("Error reading PFM file \"%s\"", filename.c_str());
     if (fp) fclose(fp);
-    delete[] data;
     delete[] rgb;
     return nullptr;
 }
@@ -481,4 +690,48 @@ fail:
     return false;
 }
 
+// Metadata Function Definitions
+static bool WriteUint32s(FILE *f, const uint32_t *v, size_t count) {
+    return fwrite(v, sizeof(uint32_t), count, f) == count;
+}
+
+bool WriteMetadataImage(const std::string &filename, int width, int height,
+                        int nChannels, bool isInteger, const void *data) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("Unable to open metadata file \"%s\"", filename.c_str());
+        return false;
+    }
+    const uint32_t header[5] = {1, (uint32_t)width, (uint32_t)height,
+                                (uint32_t)nChannels, isInteger ? 0u : 1u};
+    size_t count = (size_t)width * (size_t)height * (size_t)nChannels;
+    bool ok = fwrite("PBMD", 1, 4, f) == 4 && WriteUint32s(f, header, 5) &&
+              fwrite(data, 4, count, f) == count;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) Error("Error writing metadata file \"%s\"", filename.c_str());
+    return ok;
+}
+
+bool WriteMetadataTable(
+    const std::string &filename,
+    const std::vector<std::pair<uint32_t, std::string>> &entries) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("Unable to open metadata file \"%s\"", filename.c_str());
+        return false;
+    }
+    const uint32_t header[2] = {1, (uint32_t)entries.size()};
+    bool ok = fwrite("PBMT", 1, 4, f) == 4 && WriteUint32s(f, header, 2);
+    for (const auto &entry : entries) {
+        if (!ok) break;
+        const uint32_t e[2] = {entry.first, (uint32_t)entry.second.size()};
+        ok = WriteUint32s(f, e, 2) &&
+             fwrite(entry.second.data(), 1, entry.second.size(), f) ==
+                 entry.second.size();
+    }
+    if (fclose(f) != 0) ok = false;
+    if (!ok) Error("Error writing metadata file \"%s\"", filename.c_str());
+    return ok;
+}
+
 }  // namespace pbrt
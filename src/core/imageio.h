@@ -42,6 +42,7 @@
 #include "pbrt.h"
 #include "geometry.h"
 #include <cctype>
+#include <utility>
 
 namespace pbrt {
 
@@ -55,6 +56,17 @@ RGBSpectrum *ReadImageEXR(const std::string &name, int *width,
 void WriteImage(const std::string &name, const Float *rgb,
                 const Bounds2i &outputBounds, const Point2i &totalResolution);
 
+// Binary metadata files are little-endian. Images start with the magic
+// "PBMD", then uint32 version, width, height, channel count and channel
+// type (0: uint32, 1: float32), followed by the pixels in scanline order.
+// ID tables start with "PBMT", then uint32 version and entry count,
+// followed by (uint32 id, uint32 name length, name bytes) per entry.
+bool WriteMetadataImage(const std::string &filename, int width, int height,
+                        int nChannels, bool isInteger, const void *data);
+bool WriteMetadataTable(
+    const std::string &filename,
+    const std::vector<std::pair<uint32_t, std::string>> &entries);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_IMAGEIO_H
@@ -42,6 +42,8 @@
 #include "progressreporter.h"
 #include "camera.h"
 #include "stats.h"
+#include "lowdiscrepancy.h"
+#include "reflection.h"
 
 namespace pbrt {
 
@@ -214,6 +216,34 @@ Spectrum EstimateDirect(const Interaction &it, const Point2f &uScattering,
     return Ld;
 }
 
+// Fills in _sample_ with the film's AOVs at _isect_, a camera ray's first
+// intersection.
+void ComputeAOVSample(const RayDifferential &ray,
+                      const SurfaceInteraction &isect, const Film &film,
+                      MemoryArena &arena, AOVSample *sample) {
+    sample->hit = true;
+    sample->depth = Distance(ray.o, isect.p);
+    sample->p = isect.p;
+    sample->n = isect.shading.n;
+    sample->materialId = isect.materialId;
+    sample->instanceId = isect.instanceId;
+    if (film.HasAOV(AOV::Albedo)) {
+        // Estimate the hemispherical-directional reflectance with a fixed
+        // set of samples so that the albedo image is noise-free. Work on a
+        // copy, since bump mapping modifies the shading geometry and the
+        // integrator computes the scattering functions itself.
+        SurfaceInteraction si = isect;
+        si.ComputeScatteringFunctions(ray, arena, true);
+        if (si.bsdf) {
+            const int nAlbedoSamples = 16;
+            Point2f u[nAlbedoSamples];
+            for (int i = 0; i < nAlbedoSamples; ++i)
+                u[i] = Point2f((i + 0.5f) / nAlbedoSamples, RadicalInverse(0, i));
+            sample->albedo = si.bsdf->rho(si.wo, nAlbedoSamples, u);
+        }
+    }
+}
+
 std::unique_ptr<Distribution1D> ComputeLightPowerDistribution(
     const Scene &scene) {
     if (scene.lights.empty()) return nullptr;
@@ -236,6 +266,7 @@ void SamplerIntegrator::Render(const Scene &scene) {
     Point2i nTiles((sampleExtent.x + tileSize - 1) / tileSize,
                    (sampleExtent.y + tileSize - 1) / tileSize);
     const bool ignoreRayWeight = IgnoreRayWeight();
+    const bool recordAOVs = camera->film->HasAOVs();
     ProgressReporter reporter(nTiles.x * nTiles.y, "Rendering");
     {
         ParallelFor2D([&](Point2i tile) {
@@ -287,9 +318,15 @@ void SamplerIntegrator::Render(const Scene &scene) {
                         1 / std::sqrt((Float)tileSampler->samplesPerPixel));
                     ++nCameraRays;
 
-                    // Evaluate radiance along camera ray
+                    // Evaluate radiance along camera ray, recording AOVs
+                    // from its first intersection
                     Spectrum L(0.f);
-                    if (rayWeight > 0) L = Li(ray, scene, *tileSampler, arena);
+                    AOVSample aovSample;
+                    if (rayWeight > 0)
+                        L = Li(ray, scene, *tileSampler, arena, 0,
+                               recordAOVs ? &aovSample : nullptr);
+                    if (aovSample.hit)
+                        filmTile->AddAOVSample(cameraSample.pFilm, aovSample);
 
                     // Issue warning if unexpected radiance value returned
                     if (L.HasNaNs()) {
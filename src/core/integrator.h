@@ -72,6 +72,10 @@ Spectrum EstimateDirect(const Interaction &it, const Point2f &uShading,
                         bool specular = false);
 std::unique_ptr<Distribution1D> ComputeLightPowerDistribution(
     const Scene &scene);
+struct AOVSample;
+void ComputeAOVSample(const RayDifferential &ray,
+                      const SurfaceInteraction &isect, const Film &film,
+                      MemoryArena &arena, AOVSample *sample);
 
 // SamplerIntegrator Declarations
 class SamplerIntegrator : public Integrator {
@@ -83,9 +87,13 @@ class SamplerIntegrator : public Integrator {
         : camera(camera), sampler(sampler), pixelBounds(pixelBounds) {}
     virtual void Preprocess(const Scene &scene, Sampler &sampler) {}
     virtual void Render(const Scene &scene);
+    // If _aovSample_ is non-null, implementations fill it in with
+    // ComputeAOVSample() at the camera ray's first intersection, even if
+    // that is a medium boundary without a BSDF.
     virtual Spectrum Li(const RayDifferential &ray, const Scene &scene,
                         Sampler &sampler, MemoryArena &arena,
-                        int depth = 0) const = 0;
+                        int depth = 0,
+                        AOVSample *aovSample = nullptr) const = 0;
     Spectrum SpecularReflect(const RayDifferential &ray,
                              const SurfaceInteraction &isect,
                              const Scene &scene, Sampler &sampler,
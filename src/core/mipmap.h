@@ -44,11 +44,14 @@
 #include "texture.h"
 #include "stats.h"
 #include "parallel.h"
+#include "texcache.h"
+#include "texelformat.h"
 
 namespace pbrt {
 
 STAT_COUNTER("Texture/EWA lookups", nEWALookups);
 STAT_COUNTER("Texture/Trilinear lookups", nTrilerpLookups);
+STAT_COUNTER("Texture/Anisotropic probe lookups", nProbeLookups);
 STAT_MEMORY_COUNTER("Memory/Texture MIP maps", mipMapMemory);
 
 // MIPMap Helper Declarations
@@ -65,12 +68,28 @@ class MIPMap {
     // MIPMap Public Methods
     MIPMap(const Point2i &resolution, const T *data, bool doTri = false, bool noFilt = false,
            Float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat);
+    MIPMap(const TiledMIPFile &file,
+           const std::function<T(const RGBSpectrum &)> &convert,
+           bool doTri = false, bool noFilt = false, Float maxAniso = 8.f,
+           ImageWrap wrapMode = ImageWrap::Repeat);
+    MIPMap(std::unique_ptr<PagedTexels<T>> paged, bool doTri = false,
+           bool noFilt = false, Float maxAniso = 8.f,
+           ImageWrap wrapMode = ImageWrap::Repeat);
     int Width() const { return resolution[0]; }
     int Height() const { return resolution[1]; }
-    int Levels() const { return pyramid.size(); }
-    const T &Texel(int level, int s, int t) const;
+    int Levels() const {
+        if (paged) return paged->Levels();
+        return compact ? compact->Levels() : pyramid.size();
+    }
+    T Texel(int level, int s, int t) const;
+    // Re-encodes the in-memory pyramid in a more compact format; texels
+    // are then decoded as they're looked up
+    void Compact(TexelFormat format);
     T Lookup(const Point2f &st, Float width = 0.f) const;
     T Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
+    // Approximates the EWA filter with a few trilinear lookups spaced along
+    // the footprint's major axis
+    T LookupProbes(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
 
   private:
     // MIPMap Private Methods
@@ -94,11 +113,44 @@ class MIPMap {
         }
         return wt;
     }
+    // Resampling weights with the wrap mode already applied to the texel
+    // indices; taps that fall outside the image under _ImageWrap::Black_
+    // get zero weight.
+    struct ResampleTaps {
+        int texel[4];
+        Float weight[4];
+    };
+    std::unique_ptr<ResampleTaps[]> resampleTaps(int oldRes, int newRes) {
+        std::unique_ptr<ResampleWeight[]> wt = resampleWeights(oldRes, newRes);
+        std::unique_ptr<ResampleTaps[]> taps(new ResampleTaps[newRes]);
+        for (int i = 0; i < newRes; ++i)
+            for (int j = 0; j < 4; ++j) {
+                int texel = wt[i].firstTexel + j;
+                Float weight = wt[i].weight[j];
+                if (wrapMode == ImageWrap::Repeat)
+                    texel = Mod(texel, oldRes);
+                else if (wrapMode == ImageWrap::Clamp)
+                    texel = Clamp(texel, 0, oldRes - 1);
+                if (texel < 0 || texel >= oldRes) {
+                    texel = 0;
+                    weight = 0;
+                }
+                taps[i].texel[j] = texel;
+                taps[i].weight[j] = weight;
+            }
+        return taps;
+    }
     Float clamp(Float v) { return Clamp(v, 0.f, Infinity); }
     RGBSpectrum clamp(const RGBSpectrum &v) { return v.Clamp(0.f, Infinity); }
     SampledSpectrum clamp(const SampledSpectrum &v) {
         return v.Clamp(0.f, Infinity);
     }
+    Point2i levelResolution(int level) const {
+        if (paged) return paged->LevelResolution(level);
+        if (compact) return compact->LevelResolution(level);
+        return Point2i(pyramid[level]->uSize(), pyramid[level]->vSize());
+    }
+    static void initWeightLut();
     T triangle(int level, const Point2f &st) const;
     T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
 
@@ -109,7 +161,12 @@ class MIPMap {
     const ImageWrap wrapMode;
     Point2i resolution;
     std::vector<std::unique_ptr<BlockedArray<T>>> pyramid;
+    // Set instead of _pyramid_ for textures read on demand from a tiled file
+    std::unique_ptr<PagedTexels<T>> paged;
+    // Set instead of _pyramid_ once the texels have been compacted
+    std::unique_ptr<CompactTexels<T>> compact;
     static PBRT_CONSTEXPR int WeightLUTSize = 128;
+    static PBRT_CONSTEXPR int EWARunLength = 16;
     static Float weightLut[WeightLUTSize];
 };
 
@@ -124,90 +181,145 @@ MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,bool noFilt
       resolution(res) {
     ProfilePhase _(Prof::MIPMapCreation);
 
-    std::unique_ptr<T[]> resampledImage = nullptr;
-    if (!IsPowerOf2(resolution[0]) || !IsPowerOf2(resolution[1])) {
+    Point2i resPow2(RoundUpPow2(resolution[0]), RoundUpPow2(resolution[1]));
+    int nLevels = 1 + Log2Int(std::max(resPow2[0], resPow2[1]));
+    pyramid.resize(nLevels);
+    pyramid[0].reset(new BlockedArray<T>(resPow2[0], resPow2[1]));
+    BlockedArray<T> &level0 = *pyramid[0];
+    if (resPow2 != resolution) {
         // Resample image to power-of-two resolution
-        Point2i resPow2(RoundUpPow2(resolution[0]), RoundUpPow2(resolution[1]));
         LOG(INFO) << "Resampling MIPMap from " << resolution << " to " <<
             resPow2 << ". Ratio= " << (Float(resPow2.x * resPow2.y) /
                                        Float(resolution.x * resolution.y));
         // Resample image in $s$ direction
-        std::unique_ptr<ResampleWeight[]> sWeights =
-            resampleWeights(resolution[0], resPow2[0]);
-        resampledImage.reset(new T[resPow2[0] * resPow2[1]]);
-
-        // Apply _sWeights_ to zoom in $s$ direction
-        ParallelFor([&](int t) {
+        std::unique_ptr<ResampleTaps[]> sTaps =
+            resampleTaps(resolution[0], resPow2[0]);
+        std::unique_ptr<T[]> sZoomed(new T[resPow2[0] * resolution[1]]);
+        ParallelFor([&](int64_t t) {
+            const T *in = &img[t * resolution[0]];
+            T *out = &sZoomed[t * resPow2[0]];
             for (int s = 0; s < resPow2[0]; ++s) {
-                // Compute texel $(s,t)$ in $s$-zoomed image
-                resampledImage[t * resPow2[0] + s] = 0.f;
-                for (int j = 0; j < 4; ++j) {
-                    int origS = sWeights[s].firstTexel + j;
-                    if (wrapMode == ImageWrap::Repeat)
-                        origS = Mod(origS, resolution[0]);
-                    else if (wrapMode == ImageWrap::Clamp)
-                        origS = Clamp(origS, 0, resolution[0] - 1);
-                    if (origS >= 0 && origS < (int)resolution[0])
-                        resampledImage[t * resPow2[0] + s] +=
-                            sWeights[s].weight[j] *
-                            img[t * resolution[0] + origS];
-                }
+                const ResampleTaps &w = sTaps[s];
+                out[s] = w.weight[0] * in[w.texel[0]] +
+                         w.weight[1] * in[w.texel[1]] +
+                         w.weight[2] * in[w.texel[2]] +
+                         w.weight[3] * in[w.texel[3]];
             }
         }, resolution[1], 16);
 
-        // Resample image in $t$ direction
-        std::unique_ptr<ResampleWeight[]> tWeights =
-            resampleWeights(resolution[1], resPow2[1]);
-        std::vector<T *> resampleBufs;
-        int nThreads = MaxThreadIndex();
-        for (int i = 0; i < nThreads; ++i)
-            resampleBufs.push_back(new T[resPow2[1]]);
-        ParallelFor([&](int s) {
-            T *workData = resampleBufs[ThreadIndex];
-            for (int t = 0; t < resPow2[1]; ++t) {
-                workData[t] = 0.f;
-                for (int j = 0; j < 4; ++j) {
-                    int offset = tWeights[t].firstTexel + j;
-                    if (wrapMode == ImageWrap::Repeat)
-                        offset = Mod(offset, resolution[1]);
-                    else if (wrapMode == ImageWrap::Clamp)
-                        offset = Clamp(offset, 0, (int)resolution[1] - 1);
-                    if (offset >= 0 && offset < (int)resolution[1])
-                        workData[t] += tWeights[t].weight[j] *
-                                       resampledImage[offset * resPow2[0] + s];
-                }
-            }
-            for (int t = 0; t < resPow2[1]; ++t)
-                resampledImage[t * resPow2[0] + s] = clamp(workData[t]);
-        }, resPow2[0], 32);
-        for (auto ptr : resampleBufs) delete[] ptr;
+        // Resample image in $t$ direction, a row at a time so that the
+        // inner loop runs over contiguous texels
+        std::unique_ptr<ResampleTaps[]> tTaps =
+            resampleTaps(resolution[1], resPow2[1]);
+        ParallelFor([&](int64_t t) {
+            const ResampleTaps &w = tTaps[t];
+            const T *in[4];
+            for (int j = 0; j < 4; ++j)
+                in[j] = &sZoomed[w.texel[j] * resPow2[0]];
+            for (int s = 0; s < resPow2[0]; ++s)
+                level0(s, t) = clamp(w.weight[0] * in[0][s] +
+                                     w.weight[1] * in[1][s] +
+                                     w.weight[2] * in[2][s] +
+                                     w.weight[3] * in[3][s]);
+        }, resPow2[1], 16);
         resolution = resPow2;
-    }
-    // Initialize levels of MIPMap from image
-    int nLevels = 1 + Log2Int(std::max(resolution[0], resolution[1]));
-    pyramid.resize(nLevels);
+    } else
+        // Initialize most detailed level of MIPMap
+        ParallelFor([&](int64_t t) {
+            for (int s = 0; s < resolution[0]; ++s)
+                level0(s, t) = img[t * resolution[0] + s];
+        }, resolution[1], 32);
 
-    // Initialize most detailed level of MIPMap
-    pyramid[0].reset(
-        new BlockedArray<T>(resolution[0], resolution[1],
-                            resampledImage ? resampledImage.get() : img));
+    // Initialize levels of MIPMap from image
     for (int i = 1; i < nLevels; ++i) {
         // Initialize $i$th MIPMap level from $i-1$st level
-        int sRes = std::max(1, pyramid[i - 1]->uSize() / 2);
-        int tRes = std::max(1, pyramid[i - 1]->vSize() / 2);
+        const BlockedArray<T> &finer = *pyramid[i - 1];
+        int sRes = std::max(1, finer.uSize() / 2);
+        int tRes = std::max(1, finer.vSize() / 2);
         pyramid[i].reset(new BlockedArray<T>(sRes, tRes));
+        BlockedArray<T> &level = *pyramid[i];
+
+        // Filter four texels from finer level of pyramid. Once the finer
+        // level is a single texel wide or high, go through _Texel()_ so
+        // that the wrap mode is applied.
+        bool interior = finer.uSize() > 1 && finer.vSize() > 1;
+        auto filterRow = [&](int64_t t) {
+            if (interior)
+                for (int s = 0; s < sRes; ++s)
+                    level(s, t) = .25f * (finer(2 * s, 2 * t) +
+                                          finer(2 * s + 1, 2 * t) +
+                                          finer(2 * s, 2 * t + 1) +
+                                          finer(2 * s + 1, 2 * t + 1));
+            else
+                for (int s = 0; s < sRes; ++s)
+                    level(s, t) = .25f * (Texel(i - 1, 2 * s, 2 * t) +
+                                          Texel(i - 1, 2 * s + 1, 2 * t) +
+                                          Texel(i - 1, 2 * s, 2 * t + 1) +
+                                          Texel(i - 1, 2 * s + 1, 2 * t + 1));
+        };
+        // Small levels aren't worth handing out to other threads
+        if (sRes * tRes < 4096)
+            for (int t = 0; t < tRes; ++t) filterRow(t);
+        else
+            ParallelFor(filterRow, tRes, std::max(1, 16384 / sRes));
+    }
+    initWeightLut();
+    mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
+}
 
-        // Filter four texels from finer level of pyramid
-        ParallelFor([&](int t) {
-            for (int s = 0; s < sRes; ++s)
-                (*pyramid[i])(s, t) =
-                    .25f * (Texel(i - 1, 2 * s, 2 * t) +
-                            Texel(i - 1, 2 * s + 1, 2 * t) +
-                            Texel(i - 1, 2 * s, 2 * t + 1) +
-                            Texel(i - 1, 2 * s + 1, 2 * t + 1));
-        }, tRes, 16);
+template <typename T>
+MIPMap<T>::MIPMap(const TiledMIPFile &file,
+                  const std::function<T(const RGBSpectrum &)> &convert,
+                  bool doTrilinear, bool noFilt, Float maxAnisotropy,
+                  ImageWrap wrapMode)
+    : doTrilinear(doTrilinear),
+      noFiltering(noFilt),
+      maxAnisotropy(maxAnisotropy),
+      wrapMode(wrapMode),
+      resolution(file.LevelResolution(0)) {
+    ProfilePhase _(Prof::MIPMapCreation);
+    // The pyramid was already filtered when the file was written, so its
+    // levels only need to be converted, one tile per task
+    int tileSize = file.TileSize();
+    pyramid.resize(file.Levels());
+    for (int i = 0; i < file.Levels(); ++i) {
+        Point2i res = file.LevelResolution(i), nTiles = file.TileCount(i);
+        pyramid[i].reset(new BlockedArray<T>(res.x, res.y));
+        BlockedArray<T> &level = *pyramid[i];
+        ParallelFor([&](int64_t index) {
+            int tx = index % nTiles.x, ty = index / nTiles.x;
+            const float *tile = file.Tile(i, tx, ty);
+            for (int t = 0; t < tileSize; ++t) {
+                int tt = ty * tileSize + t;
+                for (int s = 0; s < tileSize; ++s) {
+                    int ss = tx * tileSize + s;
+                    if (ss >= res.x || tt >= res.y) continue;
+                    const float *v = &tile[3 * (t * tileSize + s)];
+                    RGBSpectrum rgb;
+                    for (int c = 0; c < 3; ++c) rgb[c] = v[c];
+                    level(ss, tt) = convert(rgb);
+                }
+            }
+        }, nTiles.x * nTiles.y);
     }
+    initWeightLut();
+    mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
+}
 
+template <typename T>
+MIPMap<T>::MIPMap(std::unique_ptr<PagedTexels<T>> paged, bool doTrilinear,
+                  bool noFilt, Float maxAnisotropy, ImageWrap wrapMode)
+    : doTrilinear(doTrilinear),
+      noFiltering(noFilt),
+      maxAnisotropy(maxAnisotropy),
+      wrapMode(wrapMode),
+      resolution(paged->LevelResolution(0)),
+      paged(std::move(paged)) {
+    initWeightLut();
+}
+
+template <typename T>
+void MIPMap<T>::initWeightLut() {
     // Initialize EWA filter weights if needed
     if (weightLut[0] == 0.) {
         for (int i = 0; i < WeightLUTSize; ++i) {
@@ -216,31 +328,40 @@ MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,bool noFilt
             weightLut[i] = std::exp(-alpha * r2) - std::exp(-alpha);
         }
     }
-    mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
 }
 
 template <typename T>
-const T &MIPMap<T>::Texel(int level, int s, int t) const {
-    CHECK_LT(level, pyramid.size());
-    const BlockedArray<T> &l = *pyramid[level];
+T MIPMap<T>::Texel(int level, int s, int t) const {
+    CHECK_LT(level, Levels());
+    Point2i res = levelResolution(level);
     // Compute texel $(s,t)$ accounting for boundary conditions
     switch (wrapMode) {
     case ImageWrap::Repeat:
-        s = Mod(s, l.uSize());
-        t = Mod(t, l.vSize());
+        s = Mod(s, res.x);
+        t = Mod(t, res.y);
         break;
     case ImageWrap::Clamp:
-        s = Clamp(s, 0, l.uSize() - 1);
-        t = Clamp(t, 0, l.vSize() - 1);
+        s = Clamp(s, 0, res.x - 1);
+        t = Clamp(t, 0, res.y - 1);
         break;
     case ImageWrap::Black: {
-        static const T black = 0.f;
-        if (s < 0 || s >= (int)l.uSize() || t < 0 || t >= (int)l.vSize())
-            return black;
+        if (s < 0 || s >= res.x || t < 0 || t >= res.y) return T(0.f);
         break;
     }
     }
-    return l(s, t);
+    if (paged) return paged->Texel(level, s, t);
+    if (compact) return compact->Texel(level, s, t);
+    return (*pyramid[level])(s, t);
+}
+
+template <typename T>
+void MIPMap<T>::Compact(TexelFormat format) {
+    if (format == TexelFormat::Float || pyramid.empty()) return;
+    ProfilePhase _(Prof::MIPMapCreation);
+    compact.reset(new CompactTexels<T>(pyramid, format));
+    mipMapMemory -= (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
+    mipMapMemory += compact->BytesUsed();
+    pyramid.clear();
 }
 
 template <typename T>
@@ -252,8 +373,8 @@ T MIPMap<T>::Lookup(const Point2f &st, Float width) const {
     // If we ask for no filtering, just return the value at (s,t)
     // We choose the lowest level, since that is just the original image.
     if(noFiltering){
-        Float s = st[0] * pyramid[0]->uSize() - 0.5f;
-        Float t = st[1] * pyramid[0]->vSize() - 0.5f;
+        Float s = st[0] * resolution[0] - 0.5f;
+        Float t = st[1] * resolution[1] - 0.5f;
         int s0 = (int)std::round(s), t0 = (int)std::round(t);
         return Texel(0, s0, t0);
     }
@@ -276,8 +397,9 @@ T MIPMap<T>::Lookup(const Point2f &st, Float width) const {
 template <typename T>
 T MIPMap<T>::triangle(int level, const Point2f &st) const {
     level = Clamp(level, 0, Levels() - 1);
-    Float s = st[0] * pyramid[level]->uSize() - 0.5f;
-    Float t = st[1] * pyramid[level]->vSize() - 0.5f;
+    Point2i res = levelResolution(level);
+    Float s = st[0] * res.x - 0.5f;
+    Float t = st[1] * res.y - 0.5f;
     int s0 = std::floor(s), t0 = std::floor(t);
     Float ds = s - s0, dt = t - t0;
     return (1 - ds) * (1 - dt) * Texel(level, s0, t0) +
@@ -315,16 +437,60 @@ T MIPMap<T>::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const {
                 EWA(ilod + 1, st, dst0, dst1));
 }
 
+template <typename T>
+T MIPMap<T>::LookupProbes(const Point2f &st, Vector2f dst0,
+                          Vector2f dst1) const {
+    if (doTrilinear || noFiltering) return Lookup(st, dst0, dst1);
+    ++nProbeLookups;
+    ProfilePhase p(Prof::TexFiltTrilerp);
+    // Compute ellipse minor and major axes
+    if (dst0.LengthSquared() < dst1.LengthSquared()) std::swap(dst0, dst1);
+    Float majorLength = dst0.Length();
+    Float minorLength = dst1.Length();
+
+    // Clamp ellipse eccentricity if too large
+    if (minorLength * maxAnisotropy < majorLength && minorLength > 0)
+        minorLength = majorLength / maxAnisotropy;
+    if (minorLength == 0) return triangle(0, st);
+
+    // Choose the level for probes as wide as the minor axis
+    Float level = Levels() - 1 + Log2(2 * minorLength);
+    int iLevel = std::floor(level);
+    Float delta = level - iLevel;
+    if (level < 0) {
+        iLevel = 0;
+        delta = 0;
+    } else if (iLevel >= Levels() - 1)
+        return Texel(Levels() - 1, 0, 0);
+
+    // Space one probe per minor axis length along the major axis and weight
+    // them with the same Gaussian as the EWA filter
+    int nProbes = std::max(1, (int)std::ceil(majorLength / minorLength));
+    T sum(0.f);
+    Float sumWts = 0;
+    for (int i = 0; i < nProbes; ++i) {
+        Float u = 2 * (i + .5f) / nProbes - 1;
+        Float weight = std::exp(-2 * u * u) - std::exp((Float)-2);
+        Point2f p = st + u * dst0;
+        T value = triangle(iLevel, p);
+        if (delta > 0) value = Lerp(delta, value, triangle(iLevel + 1, p));
+        sum += value * weight;
+        sumWts += weight;
+    }
+    return sum / sumWts;
+}
+
 template <typename T>
 T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     if (level >= Levels()) return Texel(Levels() - 1, 0, 0);
     // Convert EWA coordinates to appropriate scale for level
-    st[0] = st[0] * pyramid[level]->uSize() - 0.5f;
-    st[1] = st[1] * pyramid[level]->vSize() - 0.5f;
-    dst0[0] *= pyramid[level]->uSize();
-    dst0[1] *= pyramid[level]->vSize();
-    dst1[0] *= pyramid[level]->uSize();
-    dst1[1] *= pyramid[level]->vSize();
+    Point2i res = levelResolution(level);
+    st[0] = st[0] * res.x - 0.5f;
+    st[1] = st[1] * res.y - 0.5f;
+    dst0[0] *= res.x;
+    dst0[1] *= res.y;
+    dst1[0] *= res.x;
+    dst1[1] *= res.y;
 
     // Compute ellipse coefficients to bound EWA filter region
     Float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1;
@@ -344,21 +510,51 @@ T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     int t0 = std::ceil(st[1] - 2 * invDet * vSqrt);
     int t1 = std::floor(st[1] + 2 * invDet * vSqrt);
 
+    // Texels can be read without applying the wrap mode when the whole
+    // bound is inside the level
+    Point2i levelRes = levelResolution(level);
+    const BlockedArray<T> *texels =
+        (!pyramid.empty() && s0 >= 0 && t0 >= 0 && s1 < levelRes.x &&
+         t1 < levelRes.y)
+            ? pyramid[level].get()
+            : nullptr;
+
     // Scan over ellipse bound and compute quadratic equation
     T sum(0.f);
     Float sumWts = 0;
     for (int it = t0; it <= t1; ++it) {
         Float tt = it - st[1];
-        for (int is = s0; is <= s1; ++is) {
-            Float ss = is - st[0];
-            // Compute squared radius and filter texel if inside ellipse
-            Float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
-            if (r2 < 1) {
-                int index =
-                    std::min((int)(r2 * WeightLUTSize), WeightLUTSize - 1);
-                Float weight = weightLut[index];
-                sum += Texel(level, is, it) * weight;
-                sumWts += weight;
+        // Restrict the row to where the ellipse crosses it by solving
+        // $A s^2 + B t s + C t^2 = 1$ for $s$; the span is padded by a
+        // texel so that rounding can't drop texels inside the ellipse.
+        Float b = B * tt, c = C * tt * tt - 1;
+        Float root = std::sqrt(std::max((Float)0, b * b - 4 * A * c));
+        int rs0 =
+            std::max(s0, (int)std::floor(st[0] + (-b - root) / (2 * A)) - 1);
+        int rs1 =
+            std::min(s1, (int)std::ceil(st[0] + (-b + root) / (2 * A)) + 1);
+
+        // Compute the filter weights for runs of texels at a time, without
+        // data-dependent branches, and then accumulate the texels that are
+        // inside the ellipse
+        for (int runStart = rs0; runStart <= rs1; runStart += EWARunLength) {
+            int n = std::min((int)EWARunLength, rs1 - runStart + 1);
+            Float weights[EWARunLength];
+            for (int j = 0; j < n; ++j) {
+                Float ss = runStart + j - st[0];
+                // Compute squared radius and filter texel if inside ellipse
+                Float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+                int index = std::min(
+                    (int)(std::min(r2, (Float)1) * WeightLUTSize),
+                    WeightLUTSize - 1);
+                weights[j] = r2 < 1 ? weightLut[index] : 0;
+            }
+            for (int j = 0; j < n; ++j) {
+                if (weights[j] == 0) continue;
+                int is = runStart + j;
+                sum += (texels ? (*texels)(is, it) : Texel(level, is, it)) *
+                       weights[j];
+                sumWts += weights[j];
             }
         }
     }
@@ -48,6 +48,13 @@ class ParallelForLoop;
 static ParallelForLoop *workList = nullptr;
 static std::mutex workListMutex;
 
+// Background threads and queue for tasks started with _RunAsync()_
+static std::vector<std::thread> asyncThreads;
+static std::list<std::function<void()>> asyncQueue;
+static bool shutdownAsyncThreads = false;
+static std::mutex asyncQueueMutex;
+static std::condition_variable asyncQueueCondition;
+
 // Bookkeeping variables to help with the implementation of
 // MergeWorkerThreadStats().
 static std::atomic<bool> reportWorkerStats{false};
@@ -66,13 +73,15 @@ class ParallelForLoop {
         : func1D(std::move(func1D)),
           maxIndex(maxIndex),
           chunkSize(chunkSize),
-          profilerState(profilerState) {}
+          profilerState(profilerState),
+          errorLoc(CurrentErrorLoc()) {}
     ParallelForLoop(const std::function<void(Point2i)> &f, const Point2i &count,
                     uint64_t profilerState)
         : func2D(f),
           maxIndex(count.x * count.y),
           chunkSize(1),
-          profilerState(profilerState) {
+          profilerState(profilerState),
+          errorLoc(CurrentErrorLoc()) {
         nX = count.x;
     }
 
@@ -83,6 +92,8 @@ class ParallelForLoop {
     const int64_t maxIndex;
     const int chunkSize;
     uint64_t profilerState;
+    // Errors reported by the loop's iterations refer to where it started
+    std::shared_ptr<const Loc> errorLoc;
     int64_t nextIndex = 0;
     int activeWorkers = 0;
     ParallelForLoop *next = nullptr;
@@ -94,6 +105,15 @@ class ParallelForLoop {
     }
 };
 
+// Unlinks _loop_ from _workList_; it isn't necessarily at the head, since
+// loops may be started concurrently from the background task threads.
+// _workListMutex_ must be held.
+static void removeFromWorkList(ParallelForLoop *loop) {
+    ParallelForLoop **prev = &workList;
+    while (*prev && *prev != loop) prev = &(*prev)->next;
+    if (*prev) *prev = loop->next;
+}
+
 void Barrier::Wait() {
     std::unique_lock<std::mutex> lock(mutex);
     CHECK_GT(count, 0);
@@ -157,6 +177,7 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
 
             // Run loop indices in _[indexStart, indexEnd)_
             lock.unlock();
+            ErrorLocation errorLoc(loop.errorLoc.get());
             for (int64_t index = indexStart; index < indexEnd; ++index) {
                 uint64_t oldState = ProfilerState;
                 ProfilerState = loop.profilerState;
@@ -180,10 +201,33 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     LOG(INFO) << "Exiting worker thread " << tIndex;
 }
 
+static void asyncThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
+    ThreadIndex = tIndex;
+    ProfilerWorkerThreadInit();
+    barrier->Wait();
+    barrier.reset();
+
+    std::unique_lock<std::mutex> lock(asyncQueueMutex);
+    while (true) {
+        asyncQueueCondition.wait(lock, [] {
+            return shutdownAsyncThreads || !asyncQueue.empty();
+        });
+        if (asyncQueue.empty()) break;
+        std::function<void()> task = std::move(asyncQueue.front());
+        asyncQueue.pop_front();
+        lock.unlock();
+        task();
+        // These threads aren't woken by MergeWorkerThreadStats(), so their
+        // stats are merged as each task finishes.
+        ReportThreadStats();
+        lock.lock();
+    }
+}
+
 // Parallel Definitions
 void ParallelFor(std::function<void(int64_t)> func, int64_t count,
                  int chunkSize) {
-    CHECK(threads.size() > 0 || MaxThreadIndex() == 1);
+    CHECK(threads.size() > 0 || NumWorkerThreads() == 1);
 
     // Run iterations immediately if not using threads or if _count_ is small
     if (threads.empty() || count < chunkSize) {
@@ -213,7 +257,7 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
 
         // Update _loop_ to reflect iterations this thread will run
         loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
+        if (loop.nextIndex == loop.maxIndex) removeFromWorkList(&loop);
         loop.activeWorkers++;
 
         // Run loop indices in _[indexStart, indexEnd)_
@@ -240,12 +284,18 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
 
 PBRT_THREAD_LOCAL int ThreadIndex;
 
-int MaxThreadIndex() {
+int NumWorkerThreads() {
     return PbrtOptions.nThreads == 0 ? NumSystemCores() : PbrtOptions.nThreads;
 }
 
+int MaxThreadIndex() {
+    // The background task threads follow the _ParallelFor()_ workers
+    int nThreads = NumWorkerThreads();
+    return nThreads + (nThreads - 1);
+}
+
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
-    CHECK(threads.size() > 0 || MaxThreadIndex() == 1);
+    CHECK(threads.size() > 0 || NumWorkerThreads() == 1);
 
     if (threads.empty() || count.x * count.y <= 1) {
         for (int y = 0; y < count.y; ++y)
@@ -273,7 +323,7 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
 
         // Update _loop_ to reflect iterations this thread will run
         loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
+        if (loop.nextIndex == loop.maxIndex) removeFromWorkList(&loop);
         loop.activeWorkers++;
 
         // Run loop indices in _[indexStart, indexEnd)_
@@ -304,19 +354,26 @@ int NumSystemCores() {
 
 void ParallelInit() {
     CHECK_EQ(threads.size(), 0);
-    int nThreads = MaxThreadIndex();
+    int nThreads = NumWorkerThreads();
     ThreadIndex = 0;
 
     // Create a barrier so that we can be sure all worker threads get past
     // their call to ProfilerWorkerThreadInit() before we return from this
     // function.  In turn, we can be sure that the profiling system isn't
     // started until after all worker threads have done that.
-    std::shared_ptr<Barrier> barrier = std::make_shared<Barrier>(nThreads);
+    std::shared_ptr<Barrier> barrier =
+        std::make_shared<Barrier>(2 * nThreads - 1);
 
     // Launch one fewer worker thread than the total number we want doing
     // work, since the main thread helps out, too.
     for (int i = 0; i < nThreads - 1; ++i)
         threads.push_back(std::thread(workerThreadFunc, i + 1, barrier));
+    // The same number of background task threads are launched; the main
+    // thread is typically busy parsing while they run. They get their own
+    // _ThreadIndex_ values, since they may run _ParallelFor()_ iterations.
+    for (int i = 0; i < nThreads - 1; ++i)
+        asyncThreads.push_back(
+            std::thread(asyncThreadFunc, nThreads + i, barrier));
 
     barrier->Wait();
 }
@@ -324,6 +381,17 @@ void ParallelInit() {
 void ParallelCleanup() {
     if (threads.empty()) return;
 
+    // Let the background task threads drain their queue before the
+    // _ParallelFor()_ workers, which those tasks may use, are shut down.
+    {
+        std::lock_guard<std::mutex> lock(asyncQueueMutex);
+        shutdownAsyncThreads = true;
+        asyncQueueCondition.notify_all();
+    }
+    for (std::thread &thread : asyncThreads) thread.join();
+    asyncThreads.erase(asyncThreads.begin(), asyncThreads.end());
+    shutdownAsyncThreads = false;
+
     {
         std::lock_guard<std::mutex> lock(workListMutex);
         shutdownThreads = true;
@@ -335,6 +403,11 @@ void ParallelCleanup() {
     shutdownThreads = false;
 }
 
+// Returns true if _ParallelInit()_ has launched the worker threads; code
+// that may also run before then (e.g., image I/O from the tools and tests)
+// uses this to decide whether it can call _ParallelFor()_.
+bool ParallelInitialized() { return !threads.empty(); }
+
 void MergeWorkerThreadStats() {
     std::unique_lock<std::mutex> lock(workListMutex);
     std::unique_lock<std::mutex> doneLock(reportDoneMutex);
@@ -352,4 +425,21 @@ void MergeWorkerThreadStats() {
     reportWorkerStats = false;
 }
 
+void EnqueueAsyncTask(std::function<void()> task) {
+    if (asyncThreads.empty()) {
+        task();
+        return;
+    }
+    // The task's errors refer to where it was started; reading the
+    // parser's location from the background thread would race with the
+    // parser moving on.
+    std::shared_ptr<const Loc> loc = CurrentErrorLoc();
+    std::lock_guard<std::mutex> lock(asyncQueueMutex);
+    asyncQueue.push_back([task, loc]() {
+        ErrorLocation errorLoc(loc.get());
+        task();
+    });
+    asyncQueueCondition.notify_one();
+}
+
 }  // namespace pbrt
@@ -45,6 +45,8 @@
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <future>
+#include <memory>
 
 namespace pbrt {
 
@@ -102,12 +104,32 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
                  int chunkSize = 1);
 extern PBRT_THREAD_LOCAL int ThreadIndex;
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count);
+// Number of threads that run _ParallelFor()_ loops, including the main
+// thread.
+int NumWorkerThreads();
+// Upper bound on _ThreadIndex_, which also covers the background task
+// threads.
 int MaxThreadIndex();
 int NumSystemCores();
 
 void ParallelInit();
 void ParallelCleanup();
+bool ParallelInitialized();
 void MergeWorkerThreadStats();
+void EnqueueAsyncTask(std::function<void()> task);
+
+// Runs _func_ on one of the background task threads, which are separate
+// from the _ParallelFor()_ workers so that long-running tasks can be
+// started while the main thread keeps going; when pbrt is running
+// single-threaded, _func_ is run immediately instead.
+template <typename F>
+std::future<typename std::result_of<F()>::type> RunAsync(F func) {
+    using R = typename std::result_of<F()>::type;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::move(func));
+    std::future<R> result = task->get_future();
+    EnqueueAsyncTask([task]() { (*task)(); });
+    return result;
+}
 
 }  // namespace pbrt
 
@@ -35,12 +35,16 @@
 #include "api.h"
 #include "fileutil.h"
 #include "memory.h"
+#include "parallel.h"
 #include "paramset.h"
 #include "stats.h"
 
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 #ifdef PBRT_HAVE_MMAP
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -52,7 +56,9 @@
 #endif
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -66,6 +72,8 @@ static std::string toString(string_view s) {
 }
 
 STAT_MEMORY_COUNTER("Memory/Tokenizer buffers", tokenizerMemory);
+STAT_COUNTER("Scene/Include files converted in parallel",
+             nPreconvertedIncludes);
 
 static char decodeEscaped(int ch) {
     switch (ch) {
@@ -105,7 +113,7 @@ std::unique_ptr<Tokenizer> Tokenizer::CreateFromFile(
         while ((ch = getchar()) != EOF) str.push_back((char)ch);
         // std::make_unique...
         return std::unique_ptr<Tokenizer>(
-            new Tokenizer(std::move(str), std::move(errorCallback)));
+            new Tokenizer(std::move(str), std::move(errorCallback), "<stdin>"));
     }
 
 #ifdef PBRT_HAVE_MMAP
@@ -193,25 +201,28 @@ std::unique_ptr<Tokenizer> Tokenizer::CreateFromFile(
 
     // std::make_unique...
     return std::unique_ptr<Tokenizer>(
-        new Tokenizer(std::move(str), std::move(errorCallback)));
+        new Tokenizer(std::move(str), std::move(errorCallback), filename));
 #endif
 }
 
 std::unique_ptr<Tokenizer> Tokenizer::CreateFromString(
-    std::string str, std::function<void(const char *)> errorCallback) {
+    std::string str, std::function<void(const char *)> errorCallback,
+    const std::string &filename) {
     // return std::make_unique<Tokenizer>(std::move(str));
     return std::unique_ptr<Tokenizer>(
-        new Tokenizer(std::move(str), std::move(errorCallback)));
+        new Tokenizer(std::move(str), std::move(errorCallback), filename));
 }
 
 Tokenizer::Tokenizer(std::string str,
-                     std::function<void(const char *)> errorCallback)
-    : loc("<stdin>"),
+                     std::function<void(const char *)> errorCallback,
+                     const std::string &filename)
+    : loc(filename),
       errorCallback(std::move(errorCallback)),
       contents(std::move(str)) {
     pos = contents.data();
     end = pos + contents.size();
     tokenizerMemory += contents.size();
+    checkForBinary();
 }
 
 #if defined(PBRT_HAVE_MMAP) || defined(PBRT_IS_WINDOWS)
@@ -223,6 +234,7 @@ Tokenizer::Tokenizer(void *ptr, size_t len, std::string filename,
       unmapLength(len) {
     pos = (const char *)ptr;
     end = pos + len;
+    checkForBinary();
 }
 #endif
 
@@ -249,7 +261,104 @@ Tokenizer::~Tokenizer() {
 #endif
 }
 
-string_view Tokenizer::Next() {
+// Binary scene file token kinds
+enum : uint8_t {
+    BinaryText,
+    BinaryNumber,
+    BinaryInt32Array,
+    BinaryFloat32Array,
+    BinaryFloat64Array
+};
+
+static PBRT_CONSTEXPR uint32_t BinaryByteOrderMark = 0x01020304;
+
+void Tokenizer::checkForBinary() {
+    if (end - pos < 12 || memcmp(pos, BinarySceneMagic, 8) != 0) return;
+    binary = true;
+    uint32_t bom;
+    memcpy(&bom, pos + 8, sizeof(bom));
+    pos += 12;
+    if (bom != BinaryByteOrderMark) {
+        errorCallback("binary scene file was written with a different "
+                      "byte order");
+        pos = end;
+    }
+}
+
+Token Tokenizer::nextBinary() {
+    if (pos == end) return {};
+    const char *tokenStart = pos;
+    auto read = [&](void *dest, size_t size) {
+        if (size_t(end - pos) < size) {
+            errorCallback("premature EOF");
+            pos = end;
+            return false;
+        }
+        memcpy(dest, pos, size);
+        pos += size;
+        return true;
+    };
+
+    // Binary files have no lines; count tokens instead so that error
+    // messages still give some indication of where the problem is.
+    ++loc.line;
+    uint8_t kind = *pos++;
+    if (kind == BinaryNumber) {
+        double number;
+        if (!read(&number, sizeof(number))) return {};
+        Token tok(string_view(tokenStart, size_t(pos - tokenStart)));
+        tok.numeric = Token::Numeric::Number;
+        tok.number = number;
+        return tok;
+    }
+
+    uint32_t count;
+    if (!read(&count, sizeof(count))) return {};
+    size_t elementSize;
+    Token::Numeric numeric;
+    switch (kind) {
+    case BinaryText:
+        elementSize = 1;
+        numeric = Token::Numeric::None;
+        break;
+    case BinaryInt32Array:
+        elementSize = sizeof(int32_t);
+        numeric = Token::Numeric::Int32Array;
+        break;
+    case BinaryFloat32Array:
+        elementSize = sizeof(float);
+        numeric = Token::Numeric::Float32Array;
+        break;
+    case BinaryFloat64Array:
+        elementSize = sizeof(double);
+        numeric = Token::Numeric::Float64Array;
+        break;
+    default:
+        errorCallback(StringPrintf("unknown binary token kind %d", int(kind))
+                          .c_str());
+        pos = end;
+        return {};
+    }
+    if (size_t(end - pos) < count * elementSize) {
+        errorCallback("premature EOF");
+        pos = end;
+        return {};
+    }
+    const char *data = pos;
+    pos += count * elementSize;
+    if (kind == BinaryText) return Token(string_view(data, count));
+
+    // Array tokens' text spans the kind and count too, so that it's
+    // never empty and never mistaken for a bracket or a quoted string.
+    Token tok(string_view(tokenStart, size_t(pos - tokenStart)));
+    tok.numeric = numeric;
+    tok.array = data;
+    tok.arraySize = count;
+    return tok;
+}
+
+Token Tokenizer::Next() {
+    if (binary) return nextBinary();
     while (true) {
         const char *tokenStart = pos;
         int ch = getChar();
@@ -319,14 +428,77 @@ string_view Tokenizer::Next() {
     }
 }
 
-static double parseNumber(string_view str) {
+// Decimal-to-binary conversion using Clinger's fast path: when the
+// decimal significand and the power of ten are both exactly representable
+// in _T_, a single correctly rounded multiply or divide gives the same
+// result as strtof()/strtod(). Returns false for the (rare) inputs that
+// need the general algorithm.
+template <typename T>
+static bool fastParseFloat(const char *p, const char *end, T *value) {
+    // Largest exactly representable significand and power of ten
+    PBRT_CONSTEXPR uint64_t maxMantissa =
+        uint64_t(1) << std::numeric_limits<T>::digits;
+    PBRT_CONSTEXPR int maxExponent = sizeof(T) == sizeof(float) ? 10 : 22;
+    static const T powersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                    1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                    1e18, 1e19, 1e20, 1e21, 1e22};
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+    // Accumulate up to 19 significant digits; more can't fit in 64 bits
+    uint64_t mantissa = 0;
+    int nDigits = 0, exponent = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++nDigits)
+        mantissa = 10 * mantissa + (*p - '0');
+    if (p < end && *p == '.') {
+        ++p;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, ++nDigits, --exponent)
+            mantissa = 10 * mantissa + (*p - '0');
+    }
+    if (nDigits == 0 || nDigits > 19) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negativeExponent = (*p++ == '-');
+        if (p == end) return false;
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            if (e < 10000) e = 10 * e + (*p - '0');
+        exponent += negativeExponent ? -e : e;
+    }
+    if (p != end) return false;
+
+    if (mantissa > maxMantissa || exponent < -maxExponent ||
+        exponent > maxExponent)
+        return false;
+    T v = T(mantissa);
+    if (exponent < 0)
+        v /= powersOfTen[-exponent];
+    else
+        v *= powersOfTen[exponent];
+    *value = negative ? -v : v;
+    return true;
+}
+
+// Converts _str_ to a number, returning false if it doesn't start with
+// one. Trailing characters after the number are ignored unless
+// _requireAll_ is true, in which case they also cause a failure.
+static bool parseNumber(string_view str, double *value, bool requireAll) {
     // Fast path for a single digit
     if (str.size() == 1) {
-        if (!(str[0] >= '0' && str[0] <= '9')) {
-            Error("\"%c\": expected a number", str[0]);
-            exit(1);
-        }
-        return str[0] - '0';
+        if (!(str[0] >= '0' && str[0] <= '9')) return false;
+        *value = str[0] - '0';
+        return true;
+    }
+
+    // Fast path for numbers that can be converted exactly
+    Float fastValue;
+    if (fastParseFloat(str.begin(), str.end(), &fastValue)) {
+        *value = fastValue;
+        return true;
     }
 
     // Copy to a buffer so we can NUL-terminate it, as strto[idf]() expect.
@@ -359,12 +531,77 @@ static double parseNumber(string_view str) {
     else
         val = strtod(bufp, &endptr);
 
-    if (val == 0 && endptr == bufp) {
+    if ((val == 0 && endptr == bufp) ||
+        (requireAll && endptr != bufp + str.size()))
+        return false;
+    *value = val;
+    return true;
+}
+
+static double parseNumber(string_view str) {
+    double value;
+    if (!parseNumber(str, &value, false)) {
         Error("%s: expected a number", toString(str).c_str());
         exit(1);
     }
+    return value;
+}
+
+static double parseNumber(const Token &tok) {
+    if (tok.numeric == Token::Numeric::Number) return tok.number;
+    if (tok.numeric != Token::Numeric::None) {
+        Error("unexpected numeric array");
+        exit(1);
+    }
+    return parseNumber(static_cast<const string_view &>(tok));
+}
+
+// Returns true if [p, end) contains a character that ends a run of
+// numeric tokens other than whitespace: a quote, comment or bracket.
+static bool hasNonNumericDelimiter(const char *p, const char *end) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i quote = _mm_set1_epi8('"'), hash = _mm_set1_epi8('#'),
+                  bracket = _mm_set1_epi8('[');
+    for (; end - p >= 16; p += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)p);
+        __m128i match = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chars, quote),
+                         _mm_cmpeq_epi8(chars, hash)),
+            _mm_cmpeq_epi8(chars, bracket));
+        if (_mm_movemask_epi8(match) != 0) return true;
+    }
+#endif
+    for (; p < end; ++p)
+        if (*p == '"' || *p == '#' || *p == '[') return true;
+    return false;
+}
+
+bool Tokenizer::ScanNumberArray(std::vector<double> *values) {
+    if (binary) return false;
+    // Find the closing bracket (memchr() is vectorized by the C library)
+    // and make sure that only numbers and whitespace come before it.
+    const char *close = (const char *)memchr(pos, ']', end - pos);
+    if (!close || hasNonNumericDelimiter(pos, close)) return false;
+
+    values->clear();
+    auto isSpace = [](char ch) {
+        return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+    };
+    for (const char *p = pos; p < close;) {
+        if (isSpace(*p)) {
+            ++p;
+            continue;
+        }
+        const char *tokenEnd = p + 1;
+        while (tokenEnd < close && !isSpace(*tokenEnd)) ++tokenEnd;
+        values->push_back(parseNumber(string_view(p, tokenEnd - p)));
+        p = tokenEnd;
+    }
 
-    return val;
+    loc.line += std::count(pos, close, '\n');
+    loc.column = 0;
+    pos = close + 1;
+    return true;
 }
 
 inline bool isQuotedString(string_view str) {
@@ -386,10 +623,49 @@ struct ParamListItem {
     std::string name;
     double *doubleValues = nullptr;
     const char **stringValues = nullptr;
+    // Values of a packed numeric array from a binary scene file
+    const void *packedValues = nullptr;
+    Token::Numeric packedType = Token::Numeric::None;
     size_t size = 0;
     bool isString = false;
 };
 
+// Returns the _i_th numeric value of _item_, whichever form it was read in.
+static double itemValue(const ParamListItem &item, int i) {
+    switch (item.packedType) {
+    case Token::Numeric::Int32Array: {
+        int32_t v;
+        memcpy(&v, (const int32_t *)item.packedValues + i, sizeof(v));
+        return v;
+    }
+    case Token::Numeric::Float32Array: {
+        float v;
+        memcpy(&v, (const float *)item.packedValues + i, sizeof(v));
+        return v;
+    }
+    case Token::Numeric::Float64Array: {
+        double v;
+        memcpy(&v, (const double *)item.packedValues + i, sizeof(v));
+        return v;
+    }
+    default:
+        return item.doubleValues[i];
+    }
+}
+
+// Copies the first _n_ numeric values of _item_ to _dest_, directly from
+// the mapped file when they were stored with the same type.
+static void copyFloats(const ParamListItem &item, Float *dest, int n) {
+    if (item.packedType == Token::Numeric::Float32Array &&
+        sizeof(Float) == sizeof(float))
+        memcpy(dest, item.packedValues, n * sizeof(Float));
+    else if (item.packedType == Token::Numeric::Float64Array &&
+             sizeof(Float) == sizeof(double))
+        memcpy(dest, item.packedValues, n * sizeof(Float));
+    else
+        for (int i = 0; i < n; ++i) dest[i] = itemValue(item, i);
+}
+
 PBRT_CONSTEXPR int TokenOptional = 0;
 PBRT_CONSTEXPR int TokenRequired = 1;
 
@@ -550,8 +826,11 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
             // parser doesn't handle ints, so convert from doubles here....
             int nAlloc = nItems;
             std::unique_ptr<int[]> idata(new int[nAlloc]);
-            for (int j = 0; j < nAlloc; ++j)
-                idata[j] = int(item.doubleValues[j]);
+            if (item.packedType == Token::Numeric::Int32Array)
+                memcpy(idata.get(), item.packedValues, nAlloc * sizeof(int));
+            else
+                for (int j = 0; j < nAlloc; ++j)
+                    idata[j] = int(itemValue(item, j));
             ps.AddInt(name, std::move(idata), nItems);
         } else if (type == PARAM_TYPE_BOOL) {
             // strings -> bools
@@ -574,7 +853,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
             ps.AddBool(name, std::move(bdata), nItems);
         } else if (type == PARAM_TYPE_FLOAT) {
             std::unique_ptr<Float[]> floats(new Float[nItems]);
-            for (int i = 0; i < nItems; ++i) floats[i] = item.doubleValues[i];
+            copyFloats(item, floats.get(), nItems);
             ps.AddFloat(name, std::move(floats), nItems);
         } else if (type == PARAM_TYPE_POINT2) {
             if ((nItems % 2) != 0)
@@ -583,10 +862,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                     "Ignoring last one of them.",
                     item.name.c_str());
             std::unique_ptr<Point2f[]> pts(new Point2f[nItems / 2]);
-            for (int i = 0; i < nItems / 2; ++i) {
-                pts[i].x = item.doubleValues[2 * i];
-                pts[i].y = item.doubleValues[2 * i + 1];
-            }
+            copyFloats(item, &pts[0].x, 2 * (nItems / 2));
             ps.AddPoint2f(name, std::move(pts), nItems / 2);
         } else if (type == PARAM_TYPE_VECTOR2) {
             if ((nItems % 2) != 0)
@@ -595,10 +871,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                     "Ignoring last one of them.",
                     item.name.c_str());
             std::unique_ptr<Vector2f[]> vecs(new Vector2f[nItems / 2]);
-            for (int i = 0; i < nItems / 2; ++i) {
-                vecs[i].x = item.doubleValues[2 * i];
-                vecs[i].y = item.doubleValues[2 * i + 1];
-            }
+            copyFloats(item, &vecs[0].x, 2 * (nItems / 2));
             ps.AddVector2f(name, std::move(vecs), nItems / 2);
         } else if (type == PARAM_TYPE_POINT3) {
             if ((nItems % 3) != 0)
@@ -607,11 +880,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                     "Ignoring last %d of them.",
                     item.name.c_str(), nItems % 3);
             std::unique_ptr<Point3f[]> pts(new Point3f[nItems / 3]);
-            for (int i = 0; i < nItems / 3; ++i) {
-                pts[i].x = item.doubleValues[3 * i];
-                pts[i].y = item.doubleValues[3 * i + 1];
-                pts[i].z = item.doubleValues[3 * i + 2];
-            }
+            copyFloats(item, &pts[0].x, 3 * (nItems / 3));
             ps.AddPoint3f(name, std::move(pts), nItems / 3);
         } else if (type == PARAM_TYPE_VECTOR3) {
             if ((nItems % 3) != 0)
@@ -620,11 +889,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                     "Ignoring last %d of them.",
                     item.name.c_str(), nItems % 3);
             std::unique_ptr<Vector3f[]> vecs(new Vector3f[nItems / 3]);
-            for (int j = 0; j < nItems / 3; ++j) {
-                vecs[j].x = item.doubleValues[3 * j];
-                vecs[j].y = item.doubleValues[3 * j + 1];
-                vecs[j].z = item.doubleValues[3 * j + 2];
-            }
+            copyFloats(item, &vecs[0].x, 3 * (nItems / 3));
             ps.AddVector3f(name, std::move(vecs), nItems / 3);
         } else if (type == PARAM_TYPE_NORMAL) {
             if ((nItems % 3) != 0)
@@ -633,11 +898,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                     "Ignoring last %d of them.",
                     item.name.c_str(), nItems % 3);
             std::unique_ptr<Normal3f[]> normals(new Normal3f[nItems / 3]);
-            for (int j = 0; j < nItems / 3; ++j) {
-                normals[j].x = item.doubleValues[3 * j];
-                normals[j].y = item.doubleValues[3 * j + 1];
-                normals[j].z = item.doubleValues[3 * j + 2];
-            }
+            copyFloats(item, &normals[0].x, 3 * (nItems / 3));
             ps.AddNormal3f(name, std::move(normals), nItems / 3);
         } else if (type == PARAM_TYPE_RGB) {
             if ((nItems % 3) != 0) {
@@ -648,7 +909,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                 nItems -= nItems % 3;
             }
             std::unique_ptr<Float[]> floats(new Float[nItems]);
-            for (int j = 0; j < nItems; ++j) floats[j] = item.doubleValues[j];
+            copyFloats(item, floats.get(), nItems);
             ps.AddRGBSpectrum(name, std::move(floats), nItems);
         } else if (type == PARAM_TYPE_XYZ) {
             if ((nItems % 3) != 0) {
@@ -659,7 +920,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                 nItems -= nItems % 3;
             }
             std::unique_ptr<Float[]> floats(new Float[nItems]);
-            for (int j = 0; j < nItems; ++j) floats[j] = item.doubleValues[j];
+            copyFloats(item, floats.get(), nItems);
             ps.AddXYZSpectrum(name, std::move(floats), nItems);
         } else if (type == PARAM_TYPE_BLACKBODY) {
             if ((nItems % 2) != 0) {
@@ -670,7 +931,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                 nItems -= nItems % 2;
             }
             std::unique_ptr<Float[]> floats(new Float[nItems]);
-            for (int j = 0; j < nItems; ++j) floats[j] = item.doubleValues[j];
+            copyFloats(item, floats.get(), nItems);
             ps.AddBlackbodySpectrum(name, std::move(floats), nItems);
         } else if (type == PARAM_TYPE_SPECTRUM) {
             if (item.stringValues) {
@@ -685,8 +946,7 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
                     nItems -= nItems % 2;
                 }
                 std::unique_ptr<Float[]> floats(new Float[nItems]);
-                for (int j = 0; j < nItems; ++j)
-                    floats[j] = item.doubleValues[j];
+                copyFloats(item, floats.get(), nItems);
                 ps.AddSampledSpectrum(name, std::move(floats), nItems);
             }
         } else if (type == PARAM_TYPE_STRING) {
@@ -708,12 +968,13 @@ static void AddParam(ParamSet &ps, const ParamListItem &item,
         Warning("Type of parameter \"%s\" is unknown", item.name.c_str());
 }
 
-template <typename Next, typename Unget>
-ParamSet parseParams(Next nextToken, Unget ungetToken, MemoryArena &arena,
-                     SpectrumType spectrumType) {
+template <typename Next, typename Unget, typename ScanNumbers>
+ParamSet parseParams(Next nextToken, Unget ungetToken, ScanNumbers scanNumbers,
+                     MemoryArena &arena, SpectrumType spectrumType) {
     ParamSet ps;
+    std::vector<double> numbers;
     while (true) {
-        string_view decl = nextToken(TokenOptional);
+        Token decl = nextToken(TokenOptional);
         if (decl.empty()) return ps;
 
         if (!isQuotedString(decl)) {
@@ -725,7 +986,8 @@ ParamSet parseParams(Next nextToken, Unget ungetToken, MemoryArena &arena,
         item.name = toString(dequoteString(decl));
         size_t nAlloc = 0;
 
-        auto addVal = [&](string_view val) {
+        auto addVal = [&](const Token &tok) {
+            string_view val = tok;
             if (isQuotedString(val)) {
                 if (item.doubleValues) {
                     Error("mixed string and numeric parameters");
@@ -757,13 +1019,23 @@ ParamSet parseParams(Next nextToken, Unget ungetToken, MemoryArena &arena,
                               newData);
                     item.doubleValues = newData;
                 }
-                item.doubleValues[item.size++] = parseNumber(val);
+                item.doubleValues[item.size++] = parseNumber(tok);
             }
         };
 
-        string_view val = nextToken(TokenRequired);
-
-        if (val == "[") {
+        Token val = nextToken(TokenRequired);
+
+        if (val.numeric != Token::Numeric::None &&
+            val.numeric != Token::Numeric::Number) {
+            // Packed array from a binary scene file
+            item.packedValues = val.array;
+            item.packedType = val.numeric;
+            item.size = val.arraySize;
+        } else if (val == "[" && scanNumbers(&numbers)) {
+            // Bulk path for arrays of numbers
+            item.doubleValues = numbers.data();
+            item.size = numbers.size();
+        } else if (val == "[") {
             while (true) {
                 val = nextToken(TokenRequired);
                 if (val == "]") break;
@@ -780,6 +1052,244 @@ ParamSet parseParams(Next nextToken, Unget ungetToken, MemoryArena &arena,
     return ps;
 }
 
+static bool isNumberToken(string_view tok) {
+    if (tok.empty() || isQuotedString(tok)) return false;
+    char ch = tok[0];
+    return (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.';
+}
+
+static bool isIntegerToken(string_view tok) {
+    // Longer values may not fit in 32 bits
+    if (tok.empty() || tok.size() > (tok[0] == '-' ? 10 : 9)) return false;
+    for (size_t i = 0; i < tok.size(); ++i)
+        if (!((tok[i] >= '0' && tok[i] <= '9') || (i == 0 && tok[i] == '-')))
+            return false;
+    return true;
+}
+
+// Converts _filename_ and the files it includes to the binary scene
+// format, passing the encoded bytes to _write_. Worker threads call this
+// with _reportErrors_ false; it then neither reports errors nor touches
+// _parserLoc_, and the caller falls back to parsing the text file.
+static bool convertToBinary(
+    const std::string &filename, bool reportErrors,
+    const std::function<bool(const void *, size_t)> &writeBytes) {
+    bool ok = true;
+    auto reportError = [&](const char *msg) {
+        if (reportErrors) Error("%s", msg);
+        ok = false;
+    };
+    std::vector<std::unique_ptr<Tokenizer>> fileStack;
+    auto setLoc = [&]() {
+        if (reportErrors)
+            parserLoc = fileStack.empty() ? nullptr : &fileStack.back()->loc;
+    };
+    auto pushFile = [&](const std::string &fn) {
+        std::unique_ptr<Tokenizer> t =
+            Tokenizer::CreateFromFile(fn, reportError);
+        if (!t) return false;
+        if (t->IsBinary()) {
+            reportError(StringPrintf("%s: file is already in binary format",
+                                     fn.c_str()).c_str());
+            return false;
+        }
+        fileStack.push_back(std::move(t));
+        setLoc();
+        return true;
+    };
+    if (!pushFile(filename)) return false;
+
+    // Returns the next non-comment token, following Includes
+    std::function<string_view()> nextToken = [&]() -> string_view {
+        while (!fileStack.empty()) {
+            string_view tok = fileStack.back()->Next();
+            if (tok.empty()) {
+                fileStack.pop_back();
+                setLoc();
+            } else if (tok[0] != '#')
+                return tok;
+        }
+        return {};
+    };
+
+    auto write = [&](const void *data, size_t size) {
+        if (!writeBytes(data, size)) ok = false;
+    };
+    auto writeText = [&](string_view tok) {
+        uint8_t kind = BinaryText;
+        uint32_t length = tok.size();
+        write(&kind, 1);
+        write(&length, sizeof(length));
+        write(tok.data(), tok.size());
+    };
+    // Numbers that don't convert cleanly are reported as errors rather
+    // than exiting as the text parser does, so that the caller can fall
+    // back to parsing the text.
+    auto numberError = [&](string_view tok) {
+        reportError(StringPrintf("%s: expected a number",
+                                 toString(tok).c_str()).c_str());
+    };
+    auto writeNumber = [&](string_view tok) {
+        uint8_t kind = BinaryNumber;
+        double value;
+        if (!parseNumber(tok, &value, true)) {
+            numberError(tok);
+            return;
+        }
+        write(&kind, 1);
+        write(&value, sizeof(value));
+    };
+    auto writeArray = [&](uint8_t kind, const void *data, uint32_t count,
+                          size_t elementSize) {
+        write(&kind, 1);
+        write(&count, sizeof(count));
+        write(data, count * elementSize);
+    };
+
+    write(BinarySceneMagic, sizeof(BinarySceneMagic));
+    write(&BinaryByteOrderMark, sizeof(BinaryByteOrderMark));
+
+    bool afterQuotedString = false;
+    while (ok) {
+        string_view tok = nextToken();
+        if (tok.empty()) break;
+
+        if (tok == "Include") {
+            // Inline the included file
+            tok = nextToken();
+            if (tok.empty()) {
+                reportError("premature EOF");
+                return false;
+            }
+            std::string fn = toString(dequoteString(tok));
+            if (!pushFile(AbsolutePath(ResolveFilename(fn)))) return false;
+            afterQuotedString = false;
+            continue;
+        }
+
+        if (tok == "[" && afterQuotedString) {
+            // Parameter values: pack them into a typed array if they are
+            // all numbers.
+            std::vector<std::string> values;
+            bool allNumbers = true, allIntegers = true;
+            while (true) {
+                tok = nextToken();
+                if (tok.empty()) {
+                    reportError("premature EOF");
+                    return false;
+                }
+                if (tok == "]") break;
+                allNumbers &= isNumberToken(tok);
+                allIntegers &= isIntegerToken(tok);
+                values.push_back(toString(tok));
+            }
+
+            if (!allNumbers || values.empty()) {
+                writeText(string_view("[", 1));
+                for (const std::string &v : values) {
+                    string_view vs(v.data(), v.size());
+                    if (isNumberToken(vs))
+                        writeNumber(vs);
+                    else
+                        writeText(vs);
+                }
+                writeText(string_view("]", 1));
+            } else if (allIntegers) {
+                std::vector<int32_t> ints;
+                ints.reserve(values.size());
+                for (const std::string &v : values)
+                    ints.push_back(int32_t(strtol(v.c_str(), nullptr, 10)));
+                writeArray(BinaryInt32Array, ints.data(), ints.size(),
+                           sizeof(int32_t));
+            } else {
+                // Store floats when that loses nothing relative to the
+                // value that the text parser would compute.
+                std::vector<double> doubles;
+                doubles.reserve(values.size());
+                bool allFloats = true;
+                for (const std::string &v : values) {
+                    string_view vs(v.data(), v.size());
+                    double d;
+                    if (!parseNumber(vs, &d, true)) {
+                        numberError(vs);
+                        return false;
+                    }
+                    allFloats &= (double(float(d)) == d);
+                    doubles.push_back(d);
+                }
+                if (allFloats) {
+                    std::vector<float> floats(doubles.begin(), doubles.end());
+                    writeArray(BinaryFloat32Array, floats.data(),
+                               floats.size(), sizeof(float));
+                } else
+                    writeArray(BinaryFloat64Array, doubles.data(),
+                               doubles.size(), sizeof(double));
+            }
+            afterQuotedString = false;
+            continue;
+        }
+
+        afterQuotedString = isQuotedString(tok);
+        if (isNumberToken(tok))
+            writeNumber(tok);
+        else
+            writeText(tok);
+    }
+    if (reportErrors) parserLoc = nullptr;
+    return ok;
+}
+
+bool ConvertSceneToBinary(const std::string &filename, FILE *out) {
+    if (filename != "-") SetSearchDirectory(DirectoryContaining(filename));
+    return convertToBinary(
+        filename, true, [out](const void *data, size_t size) {
+            return fwrite(data, 1, size, out) == size;
+        });
+}
+
+// Binary conversions of the files included by the scene file being
+// parsed, keyed by absolute path.
+static std::map<std::string, std::string> preconvertedIncludes;
+
+// Converts the files that _filename_ includes to the binary format in
+// parallel, so that parse() only has to replay their already-decoded
+// tokens in order.
+static void preconvertIncludes(const std::string &filename) {
+    std::unique_ptr<Tokenizer> t =
+        Tokenizer::CreateFromFile(filename, [](const char *) {});
+    if (!t) return;
+    std::vector<std::string> includes;
+    std::set<std::string> seen;
+    bool afterInclude = false;
+    while (true) {
+        string_view tok = t->Next();
+        if (tok.empty()) break;
+        if (afterInclude && isQuotedString(tok)) {
+            std::string fn =
+                AbsolutePath(ResolveFilename(toString(dequoteString(tok))));
+            if (seen.insert(fn).second) includes.push_back(fn);
+        }
+        afterInclude = (tok == "Include");
+    }
+    t.reset();
+
+    std::vector<std::string> converted(includes.size());
+    std::unique_ptr<bool[]> ok(new bool[includes.size()]);
+    ParallelFor([&](int64_t i) {
+        std::string &buf = converted[i];
+        ok[i] = convertToBinary(includes[i], false,
+                                [&buf](const void *data, size_t size) {
+                                    buf.append((const char *)data, size);
+                                    return true;
+                                });
+    }, includes.size());
+    for (size_t i = 0; i < includes.size(); ++i)
+        if (ok[i]) {
+            preconvertedIncludes[includes[i]] = std::move(converted[i]);
+            ++nPreconvertedIncludes;
+        }
+}
+
 extern int catIndentCount;
 
 // Parsing Global Interface
@@ -794,8 +1304,8 @@ static void parse(std::unique_ptr<Tokenizer> t) {
     // nextToken is a little helper function that handles the file stack,
     // returning the next token from the current file until reaching EOF,
     // at which point it switches to the next file (if any).
-    std::function<string_view(int)> nextToken;
-    nextToken = [&](int flags) -> string_view {
+    std::function<Token(int)> nextToken;
+    nextToken = [&](int flags) -> Token {
         if (ungetTokenSet) {
             ungetTokenSet = false;
             return string_view(ungetTokenValue.data(), ungetTokenValue.size());
@@ -810,7 +1320,7 @@ static void parse(std::unique_ptr<Tokenizer> t) {
             return {};
         }
 
-        string_view tok = fileStack.back()->Next();
+        Token tok = fileStack.back()->Next();
 
         if (tok.empty()) {
             // We've reached EOF in the current file. Anything more to parse?
@@ -834,6 +1344,13 @@ static void parse(std::unique_ptr<Tokenizer> t) {
         ungetTokenSet = true;
     };
 
+    // Parses the rest of a bracketed numeric array directly from the
+    // current file, if possible.
+    auto scanNumbers = [&](std::vector<double> *values) {
+        return !ungetTokenSet && !fileStack.empty() &&
+               fileStack.back()->ScanNumberArray(values);
+    };
+
     MemoryArena arena;
 
     // Helper function for pbrt API entrypoints that take a single string
@@ -844,8 +1361,8 @@ static void parse(std::unique_ptr<Tokenizer> t) {
         string_view token = nextToken(TokenRequired);
         string_view dequoted = dequoteString(token);
         std::string n = toString(dequoted);
-        ParamSet params =
-            parseParams(nextToken, ungetToken, arena, spectrumType);
+        ParamSet params = parseParams(nextToken, ungetToken, scanNumbers,
+                                      arena, spectrumType);
         apiFunc(n, std::move(params));
     };
 
@@ -924,8 +1441,14 @@ static void parse(std::unique_ptr<Tokenizer> t) {
                 else {
                     filename = AbsolutePath(ResolveFilename(filename));
                     auto tokError = [](const char *msg) { Error("%s", msg); };
-                    std::unique_ptr<Tokenizer> tinc =
-                        Tokenizer::CreateFromFile(filename, tokError);
+                    std::unique_ptr<Tokenizer> tinc;
+                    auto iter = preconvertedIncludes.find(filename);
+                    if (iter != preconvertedIncludes.end()) {
+                        tinc = Tokenizer::CreateFromString(
+                            std::move(iter->second), tokError, filename);
+                        preconvertedIncludes.erase(iter);
+                    } else
+                        tinc = Tokenizer::CreateFromFile(filename, tokError);
                     if (tinc) {
                         fileStack.push_back(std::move(tinc));
                         parserLoc = &fileStack.back()->loc;
@@ -933,6 +1456,9 @@ static void parse(std::unique_ptr<Tokenizer> t) {
                 }
             } else if (tok == "Identity")
                 pbrtIdentity();
+            else if (tok == "InstanceTransform")
+                pbrtInstanceTransform(
+                    (int)parseNumber(nextToken(TokenRequired)));
             else
                 syntaxError(tok);
             break;
@@ -1098,7 +1624,11 @@ void pbrtParseFile(std::string filename) {
     std::unique_ptr<Tokenizer> t =
         Tokenizer::CreateFromFile(filename, tokError);
     if (!t) return;
+    if (PbrtOptions.parallelInclude && filename != "-" && !PbrtOptions.cat &&
+        !PbrtOptions.toPly)
+        preconvertIncludes(filename);
     parse(std::move(t));
+    preconvertedIncludes.clear();
 }
 
 void pbrtParseString(std::string str) {
@@ -41,6 +41,7 @@
 // core/parser.h*
 #include "pbrt.h"
 
+#include <stdio.h>
 #include <functional>
 #include <memory>
 #include <string>
@@ -99,6 +100,30 @@ class string_view {
     size_t length;
 };
 
+// Token is the text of a single token. Tokens read from binary scene files
+// may instead hold numbers that were already decoded when the file was
+// written; their text then refers to the raw encoded bytes.
+struct Token : public string_view {
+    enum class Numeric { None, Number, Int32Array, Float32Array, Float64Array };
+
+    Token() = default;
+    Token(string_view s) : string_view(s) {}
+    Token(const char *start, size_t size) : string_view(start, size) {}
+
+    Numeric numeric = Numeric::None;
+    double number = 0;  // Numeric::Number
+    // The *Array kinds point at _arraySize_ values in the mapped file
+    const void *array = nullptr;
+    size_t arraySize = 0;
+};
+
+// Binary scene files start with this magic string; the rest of the file is
+// the token stream of a text scene file with comments removed, numbers
+// stored in binary and bracketed numeric parameter values packed into
+// typed arrays. See ConvertSceneToBinary().
+static PBRT_CONSTEXPR char BinarySceneMagic[8] = {'P', 'B', 'R', 'T', 'B',
+                                                   'I', 'N', '1'};
+
 // Tokenizer converts a single pbrt scene file into a series of tokens.
 class Tokenizer {
   public:
@@ -106,22 +131,32 @@ class Tokenizer {
         const std::string &filename,
         std::function<void(const char *)> errorCallback);
     static std::unique_ptr<Tokenizer> CreateFromString(
-        std::string str, std::function<void(const char *)> errorCallback);
+        std::string str, std::function<void(const char *)> errorCallback,
+        const std::string &filename = "<stdin>");
 
     ~Tokenizer();
 
-    // Returns an empty string_view at EOF. Note that the returned
-    // string_view is not guaranteed to be valid after next call to Next().
-    string_view Next();
+    // Returns an empty token at EOF. Note that the returned token's text
+    // is not guaranteed to be valid after next call to Next().
+    Token Next();
+    bool IsBinary() const { return binary; }
+
+    // Called after a '[' token: if everything up to the matching ']' is
+    // numbers, converts them all in one pass, consumes the ']' and
+    // returns true. Otherwise returns false without consuming anything.
+    bool ScanNumberArray(std::vector<double> *values);
 
     Loc loc;
 
   private:
-    Tokenizer(std::string str, std::function<void(const char *)> errorCallback);
+    Tokenizer(std::string str, std::function<void(const char *)> errorCallback,
+              const std::string &filename);
 #if defined(PBRT_HAVE_MMAP) || defined(PBRT_IS_WINDOWS)
     Tokenizer(void *ptr, size_t len, std::string filename,
               std::function<void(const char *)> errorCallback);
 #endif
+    void checkForBinary();
+    Token nextBinary();
 
     int getChar() {
         if (pos == end) return EOF;
@@ -162,6 +197,9 @@ class Tokenizer {
     // the file.
     const char *pos, *end;
 
+    // Set if the contents are a binary scene file
+    bool binary = false;
+
     // If there are escaped characters in the string, we can't just return
     // a string_view into the mapped file. In that case, we handle the
     // escaped characters and return a string_view to sEscaped.  (And
@@ -170,6 +208,10 @@ class Tokenizer {
     std::string sEscaped;
 };
 
+// Writes the text scene file _filename_, with any files it Includes
+// inlined, to _out_ in the binary scene format. Returns false on error.
+bool ConvertSceneToBinary(const std::string &filename, FILE *out);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_PARSER_H
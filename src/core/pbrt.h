@@ -181,8 +181,20 @@ struct Options {
     int nThreads = 0;
     bool quickRender = false;
     bool quiet = false;
-    bool cat = false, toPly = false;
+    bool cat = false, toPly = false, toBinary = false;
+    bool parallelInclude = false;
+    // Keep the scene resident after WorldEnd for further render jobs
+    bool server = false;
+    // Defer creating shapes until a ray reaches their bounds
+    bool lazyShapes = false;
     std::string imageFile;
+    // Triangle meshes are paged out to this directory when it is set
+    std::string geometryCacheDir;
+    int geometryBudgetMB = 4096;
+    // Maximum memory for the tiles of paged (.txp) image textures
+    int textureBudgetMB = 1024;
+    // Maximum memory for the Ptex cache, unless the scene sets it
+    int ptexBudgetMB = 4096;
     // x0, x1, y0, y1
     Float cropWindow[2][2];
 };
@@ -44,6 +44,12 @@ STAT_MEMORY_COUNTER("Memory/Primitives", primitiveMemory);
 // Primitive Method Definitions
 Primitive::~Primitive() {}
     
+void Primitive::IntersectBatch(int nRays, const Ray *const *rays,
+                               SurfaceInteraction *const *isects,
+                               bool *hits) const {
+    for (int i = 0; i < nRays; ++i) hits[i] = Intersect(*rays[i], isects[i]);
+}
+
 const AreaLight *Aggregate::GetAreaLight() const {
     LOG(FATAL) <<
         "Aggregate::GetAreaLight() method"
@@ -122,7 +128,8 @@ bool GeometricPrimitive::Intersect(const Ray &r,
     if (!shape->Intersect(r, &tHit, isect)) return false;
     r.tMax = tHit;
     isect->primitive = this;
-    isect->materialId = material->materialId; // Added by Trisha
+    // Medium boundaries have no material; they get ID 0 (Added by Trisha)
+    isect->materialId = material ? material->materialId : 0;
     CHECK_GE(Dot(isect->n, isect->shading.n), 0.);
     // Initialize _SurfaceInteraction::mediumInterface_ after _Shape_
     // intersection
@@ -56,6 +56,12 @@ class Primitive {
     virtual Bounds3f WorldBound() const = 0;
     virtual bool Intersect(const Ray &r, SurfaceInteraction *) const = 0;
     virtual bool IntersectP(const Ray &r) const = 0;
+    // Intersects _nRays_ rays, setting _hits[i]_ and _isects[i]_ as
+    // Intersect() would; aggregates may override this to traverse the
+    // rays as a stream.
+    virtual void IntersectBatch(int nRays, const Ray *const *rays,
+                                SurfaceInteraction *const *isects,
+                                bool *hits) const;
     virtual const AreaLight *GetAreaLight() const = 0;
     virtual const Material *GetMaterial() const = 0;
     virtual void ComputeScatteringFunctions(SurfaceInteraction *isect,
@@ -97,6 +103,13 @@ class TransformedPrimitive : public Primitive {
                          uint32_t instanceId = 0);
     bool Intersect(const Ray &r, SurfaceInteraction *in) const;
     bool IntersectP(const Ray &r) const;
+    // Replaces the instance's placement; not safe to call while rays are
+    // being traced. Any enclosing aggregate must be refit afterwards.
+    void SetPrimitiveToWorld(const AnimatedTransform &p2w) {
+        PrimitiveToWorld = p2w;
+    }
+    const std::shared_ptr<Primitive> &GetPrimitive() const { return primitive; }
+    uint32_t InstanceId() const { return instanceId; }
     const AreaLight *GetAreaLight() const { return nullptr; }
     const Material *GetMaterial() const { return nullptr; }
     void ComputeScatteringFunctions(SurfaceInteraction *isect,
@@ -112,7 +125,7 @@ class TransformedPrimitive : public Primitive {
   private:
     // TransformedPrimitive Private Data
     std::shared_ptr<Primitive> primitive;
-    const AnimatedTransform PrimitiveToWorld;
+    AnimatedTransform PrimitiveToWorld;
     uint32_t instanceId;
 };
 
@@ -54,6 +54,13 @@ bool Scene::IntersectP(const Ray &ray) const {
     return aggregate->IntersectP(ray);
 }
 
+void Scene::IntersectBatch(int nRays, const Ray *const *rays,
+                           SurfaceInteraction *const *isects,
+                           bool *hits) const {
+    nIntersectionTests += nRays;
+    aggregate->IntersectBatch(nRays, rays, isects, hits);
+}
+
 bool Scene::IntersectTr(Ray ray, Sampler &sampler, SurfaceInteraction *isect,
                         Spectrum *Tr) const {
     *Tr = Spectrum(1.f);
@@ -62,8 +62,16 @@ class Scene {
         }
     }
     const Bounds3f &WorldBound() const { return worldBound; }
+    // Picks up new bounds after the aggregate has been refit, letting the
+    // lights that depend on them update too.
+    void UpdateWorldBound() {
+        worldBound = aggregate->WorldBound();
+        for (const auto &light : lights) light->Preprocess(*this);
+    }
     bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
     bool IntersectP(const Ray &ray) const;
+    void IntersectBatch(int nRays, const Ray *const *rays,
+                        SurfaceInteraction *const *isects, bool *hits) const;
     bool IntersectTr(Ray ray, Sampler &sampler, SurfaceInteraction *isect,
                      Spectrum *transmittance) const;
 
@@ -143,6 +143,7 @@ enum class Prof {
     AccelConstruction,
     TextureLoading,
     MIPMapCreation,
+    TextureBaking,
 
     IntegratorRender,
     SamplerIntegratorLi,
@@ -198,6 +199,7 @@ static const char *ProfNames[] = {
     "Acceleration structure creation",
     "Texture loading",
     "MIP map generation",
+    "Procedural texture baking",
 
     "Integrator::Render()",
     "SamplerIntegrator::Li()",
@@ -0,0 +1,210 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/texcache.cpp*
+#include "texcache.h"
+#include "fileutil.h"
+#include "stats.h"
+#include <errno.h>
+#include <stdio.h>
+
+namespace pbrt {
+
+STAT_COUNTER("Texture/Tiles loaded", nTileLoads);
+STAT_COUNTER("Texture/Tile evictions", nTileEvictions);
+
+// TiledMIPFile Local Declarations
+static const char tiledMIPMagic[8] = {'P', 'B', 'R', 'T', 'T', 'E', 'X', '1'};
+
+struct TiledMIPHeader {
+    char magic[8];
+    int32_t tileSize;
+    int32_t nLevels;
+};
+
+// TiledMIPFile Method Definitions
+std::shared_ptr<TiledMIPFile> TiledMIPFile::Open(const std::string &filename) {
+    std::unique_ptr<MappedFile> file = MappedFile::Open(filename);
+    if (!file) return nullptr;
+    TiledMIPHeader header;
+    if (file->Size() < sizeof(header)) {
+        Error("%s: truncated tiled texture file", filename.c_str());
+        return nullptr;
+    }
+    memcpy(&header, file->Data(), sizeof(header));
+    if (memcmp(header.magic, tiledMIPMagic, sizeof(tiledMIPMagic)) != 0 ||
+        header.tileSize <= 0 || header.nLevels <= 0) {
+        Error("%s: not a tiled texture file", filename.c_str());
+        return nullptr;
+    }
+
+    // Read the level resolutions and find where each level's tiles start
+    std::shared_ptr<TiledMIPFile> tiled(new TiledMIPFile);
+    tiled->tileSize = header.tileSize;
+    size_t offset = sizeof(header) + 2 * sizeof(int32_t) * header.nLevels;
+    if (file->Size() < offset) {
+        Error("%s: truncated tiled texture file", filename.c_str());
+        return nullptr;
+    }
+    const char *res = file->Data() + sizeof(header);
+    size_t tileBytes = 3 * sizeof(float) * header.tileSize * header.tileSize;
+    for (int level = 0; level < header.nLevels; ++level) {
+        int32_t r[2];
+        memcpy(r, res + 2 * sizeof(int32_t) * level, sizeof(r));
+        tiled->levelResolution.push_back(Point2i(r[0], r[1]));
+        tiled->levelOffset.push_back(offset);
+        Point2i count = tiled->TileCount(level);
+        offset += tileBytes * count.x * count.y;
+    }
+    if (file->Size() < offset) {
+        Error("%s: truncated tiled texture file", filename.c_str());
+        return nullptr;
+    }
+    tiled->file = std::move(file);
+    return tiled;
+}
+
+TiledMIPFile::~TiledMIPFile() {}
+
+const float *TiledMIPFile::Tile(int level, int tx, int ty) const {
+    size_t tileBytes = 3 * sizeof(float) * tileSize * tileSize;
+    size_t index = size_t(ty) * TileCount(level).x + tx;
+    return (const float *)(file->Data() + levelOffset[level] +
+                           index * tileBytes);
+}
+
+bool WriteTiledMIPFile(
+    const std::string &filename, int tileSize,
+    const std::vector<Point2i> &levelResolution,
+    const std::function<RGBSpectrum(int level, int s, int t)> &texel) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    TiledMIPHeader header;
+    memcpy(header.magic, tiledMIPMagic, sizeof(tiledMIPMagic));
+    header.tileSize = tileSize;
+    header.nLevels = levelResolution.size();
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (const Point2i &res : levelResolution) {
+        int32_t r[2] = {res.x, res.y};
+        if (ok) ok = fwrite(r, sizeof(r), 1, f) == 1;
+    }
+
+    // Write each level's tiles in scanline order, padding the tiles at the
+    // right and top edges with zeros
+    std::vector<float> tile(3 * tileSize * tileSize);
+    for (size_t level = 0; ok && level < levelResolution.size(); ++level) {
+        Point2i res = levelResolution[level];
+        for (int ty = 0; ok && ty * tileSize < res.y; ++ty)
+            for (int tx = 0; ok && tx * tileSize < res.x; ++tx) {
+                for (int t = 0; t < tileSize; ++t)
+                    for (int s = 0; s < tileSize; ++s) {
+                        int ss = tx * tileSize + s, tt = ty * tileSize + t;
+                        RGBSpectrum v = (ss < res.x && tt < res.y)
+                                            ? texel(level, ss, tt)
+                                            : RGBSpectrum(0.f);
+                        for (int c = 0; c < 3; ++c)
+                            tile[3 * (t * tileSize + s) + c] = v[c];
+                    }
+                ok = fwrite(tile.data(), sizeof(float), tile.size(), f) ==
+                     tile.size();
+            }
+    }
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        Error("%s: unable to write tiled texture file", filename.c_str());
+        remove(filename.c_str());
+    }
+    return ok;
+}
+
+// TextureTileCache Method Definitions
+size_t TextureTileCache::ResidentBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return residentBytes;
+}
+
+void TextureTileCache::MakeResident(TextureTile *tile,
+                                    std::shared_ptr<const void> texels,
+                                    size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Sweep the clock hand over the resident tiles, giving recently used
+    // ones a second chance, until the new tile fits in the budget
+    while (!residentTiles.empty() && residentBytes + bytes > budgetBytes) {
+        if (clockHand >= residentTiles.size()) clockHand = 0;
+        TextureTile *victim = residentTiles[clockHand].first;
+        if (victim->referenced.exchange(false, std::memory_order_relaxed)) {
+            ++clockHand;
+            continue;
+        }
+        // Threads that still have the tile in their lookup caches keep it
+        // alive until they replace it.
+        std::atomic_store(&victim->texels, std::shared_ptr<const void>());
+        residentBytes -= residentTiles[clockHand].second;
+        residentTiles[clockHand] = residentTiles.back();
+        residentTiles.pop_back();
+        ++nTileEvictions;
+    }
+    std::atomic_store(&tile->texels, std::move(texels));
+    residentTiles.push_back(std::make_pair(tile, bytes));
+    residentBytes += bytes;
+    ++nTileLoads;
+}
+
+void TextureTileCache::Remove(const TextureTile *begin,
+                              const TextureTile *end) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < residentTiles.size();) {
+        if (residentTiles[i].first >= begin && residentTiles[i].first < end) {
+            residentBytes -= residentTiles[i].second;
+            residentTiles[i] = residentTiles.back();
+            residentTiles.pop_back();
+        } else
+            ++i;
+    }
+}
+
+TileLookupCache &TileLookupCache::ForThread() {
+    static thread_local TileLookupCache cache;
+    return cache;
+}
+
+uint64_t NewPagedTexelsId() {
+    // Ids are never reused, so stale per-thread cache entries can't match
+    static std::atomic<uint64_t> nextId(1);
+    return nextId++;
+}
+
+}  // namespace pbrt
@@ -0,0 +1,237 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_TEXCACHE_H
+#define PBRT_CORE_TEXCACHE_H
+
+// core/texcache.h*
+#include "pbrt.h"
+#include "geometry.h"
+#include "spectrum.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace pbrt {
+
+class MappedFile;
+
+// TiledMIPFile Declarations
+
+// Read-only view of a MIP pyramid that is stored as fixed-size tiles of
+// float RGB texels, as written by WriteTiledMIPFile() (and by imgtool's
+// "maketiled" command). Texels are in texture space, with $t=0$ at the
+// bottom of the image. The file is memory-mapped, so only the tiles that
+// are actually read are brought into memory.
+class TiledMIPFile {
+  public:
+    // TiledMIPFile Public Methods
+    static std::shared_ptr<TiledMIPFile> Open(const std::string &filename);
+    ~TiledMIPFile();
+    int Levels() const { return levelResolution.size(); }
+    Point2i LevelResolution(int level) const { return levelResolution[level]; }
+    int TileSize() const { return tileSize; }
+    Point2i TileCount(int level) const {
+        return Point2i((levelResolution[level].x + tileSize - 1) / tileSize,
+                       (levelResolution[level].y + tileSize - 1) / tileSize);
+    }
+    // Returns the tile's TileSize() * TileSize() RGB triples in scanline
+    // order; texels past the edge of the level are zero.
+    const float *Tile(int level, int tx, int ty) const;
+
+  private:
+    // TiledMIPFile Private Data
+    std::unique_ptr<MappedFile> file;
+    int tileSize;
+    std::vector<Point2i> levelResolution;
+    std::vector<size_t> levelOffset;
+};
+
+bool WriteTiledMIPFile(
+    const std::string &filename, int tileSize,
+    const std::vector<Point2i> &levelResolution,
+    const std::function<RGBSpectrum(int level, int s, int t)> &texel);
+
+// TextureTileCache Declarations
+struct TextureTile {
+    // Accessed with std::atomic_load() and std::atomic_store()
+    std::shared_ptr<const void> texels;
+    // Set on every access and cleared by the cache's clock sweep
+    std::atomic<bool> referenced{false};
+};
+
+// Tracks the texture tiles that are resident and evicts the least
+// recently used ones (using the clock approximation of LRU) to keep all
+// paged textures within a single memory budget.
+class TextureTileCache {
+  public:
+    // TextureTileCache Public Methods
+    TextureTileCache(size_t budgetBytes) : budgetBytes(budgetBytes) {}
+    size_t ResidentBytes() const;
+    void MakeResident(TextureTile *tile, std::shared_ptr<const void> texels,
+                      size_t bytes);
+    void Remove(const TextureTile *begin, const TextureTile *end);
+
+  private:
+    // TextureTileCache Private Data
+    const size_t budgetBytes;
+    mutable std::mutex mutex;
+    std::vector<std::pair<TextureTile *, size_t>> residentTiles;
+    size_t clockHand = 0, residentBytes = 0;
+};
+
+// Small per-thread cache of recently used tiles. Lookups that hit it take
+// no locks and don't touch shared reference counts; its entries keep their
+// tiles alive for the thread even after the TextureTileCache evicts them.
+struct TileLookupCache {
+    static PBRT_CONSTEXPR int Size = 32;
+    struct Entry {
+        uint64_t owner = 0;
+        int tile = -1;
+        std::shared_ptr<const void> texels;
+    };
+    Entry entries[Size];
+    static TileLookupCache &ForThread();
+};
+
+uint64_t NewPagedTexelsId();
+
+// PagedTexels Declarations
+
+// Texel storage for a _MIPMap_ whose pyramid lives in a _TiledMIPFile_.
+// Each tile is converted to _T_ when it is first used and stays resident
+// until the _TextureTileCache_ evicts it.
+template <typename T>
+class PagedTexels {
+  public:
+    // PagedTexels Public Methods
+    PagedTexels(std::shared_ptr<TiledMIPFile> file,
+                std::shared_ptr<TextureTileCache> cache,
+                std::function<T(const RGBSpectrum &)> convert);
+    ~PagedTexels() { cache->Remove(tiles.get(), tiles.get() + nTiles); }
+    int Levels() const { return file->Levels(); }
+    Point2i LevelResolution(int level) const {
+        return file->LevelResolution(level);
+    }
+    // _s_ and _t_ must be inside the level
+    T Texel(int level, int s, int t) const {
+        int tileSize = file->TileSize();
+        int index = firstTile[level] +
+                    (t / tileSize) * tilesPerRow[level] + s / tileSize;
+        return tile(index)[(t % tileSize) * tileSize + s % tileSize];
+    }
+
+  private:
+    // PagedTexels Private Methods
+    const T *tile(int index) const;
+    std::shared_ptr<const void> load(int index) const;
+
+    // PagedTexels Private Data
+    const std::shared_ptr<TiledMIPFile> file;
+    const std::shared_ptr<TextureTileCache> cache;
+    const std::function<T(const RGBSpectrum &)> convert;
+    const uint64_t id;
+    std::vector<int> firstTile, tilesPerRow;
+    int nTiles = 0;
+    std::unique_ptr<TextureTile[]> tiles;
+    mutable std::mutex loadMutex;
+};
+
+// PagedTexels Method Definitions
+template <typename T>
+PagedTexels<T>::PagedTexels(std::shared_ptr<TiledMIPFile> file,
+                            std::shared_ptr<TextureTileCache> cache,
+                            std::function<T(const RGBSpectrum &)> convert)
+    : file(std::move(file)),
+      cache(std::move(cache)),
+      convert(std::move(convert)),
+      id(NewPagedTexelsId()) {
+    for (int level = 0; level < Levels(); ++level) {
+        Point2i count = this->file->TileCount(level);
+        firstTile.push_back(nTiles);
+        tilesPerRow.push_back(count.x);
+        nTiles += count.x * count.y;
+    }
+    tiles.reset(new TextureTile[nTiles]);
+}
+
+template <typename T>
+const T *PagedTexels<T>::tile(int index) const {
+    TextureTile &tile = tiles[index];
+    if (!tile.referenced.load(std::memory_order_relaxed))
+        tile.referenced.store(true, std::memory_order_relaxed);
+
+    TileLookupCache::Entry &entry =
+        TileLookupCache::ForThread()
+            .entries[(id * 61 + index) % TileLookupCache::Size];
+    if (entry.owner != id || entry.tile != index) {
+        std::shared_ptr<const void> texels = std::atomic_load(&tile.texels);
+        if (!texels) texels = load(index);
+        entry.owner = id;
+        entry.tile = index;
+        entry.texels = std::move(texels);
+    }
+    return (const T *)entry.texels.get();
+}
+
+template <typename T>
+std::shared_ptr<const void> PagedTexels<T>::load(int index) const {
+    std::lock_guard<std::mutex> lock(loadMutex);
+    std::shared_ptr<const void> texels = std::atomic_load(&tiles[index].texels);
+    if (texels) return texels;
+
+    // Find the tile's level and position and convert its texels
+    int level = std::upper_bound(firstTile.begin(), firstTile.end(), index) -
+                firstTile.begin() - 1;
+    int tx = (index - firstTile[level]) % tilesPerRow[level];
+    int ty = (index - firstTile[level]) / tilesPerRow[level];
+    const float *src = file->Tile(level, tx, ty);
+    int n = file->TileSize() * file->TileSize();
+    T *dst = new T[n];
+    for (int i = 0; i < n; ++i) {
+        RGBSpectrum rgb;
+        for (int c = 0; c < 3; ++c) rgb[c] = src[3 * i + c];
+        dst[i] = convert(rgb);
+    }
+    texels = std::shared_ptr<const void>(dst, std::default_delete<T[]>());
+    cache->MakeResident(&tiles[index], texels, n * sizeof(T));
+    return texels;
+}
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_TEXCACHE_H
@@ -0,0 +1,345 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/texelformat.cpp*
+#include "texelformat.h"
+#include <string.h>
+
+namespace pbrt {
+
+// TexelFormat Local Definitions
+static Float srgb8ToLinear[256];
+
+static bool initSRGB8Table() {
+    for (int i = 0; i < 256; ++i)
+        srgb8ToLinear[i] = InverseGammaCorrect(i / 255.f);
+    return true;
+}
+
+static bool srgb8TableInitialized = initSRGB8Table();
+
+// Returns _v_, which is in $[0,1]$ after scaling, on the sRGB curve and in
+// $[0,255]$
+static Float toSRGB(Float v, Float scale) {
+    return 255 * GammaCorrect(Clamp(v / scale, 0, 1));
+}
+
+static uint16_t toRGB565(const Float *c) {
+    int r = Clamp(int(c[0] * 31 / 255 + .5f), 0, 31);
+    int g = Clamp(int(c[1] * 63 / 255 + .5f), 0, 63);
+    int b = Clamp(int(c[2] * 31 / 255 + .5f), 0, 31);
+    return (r << 11) | (g << 5) | b;
+}
+
+static void fromRGB565(uint16_t v, int *c) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+    fromRGB565(c0, palette[0]);
+    fromRGB565(c1, palette[1]);
+    for (int i = 0; i < 3; ++i)
+        if (c0 > c1) {
+            palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+            palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+        } else {
+            palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+            palette[3][i] = 0;
+        }
+}
+
+static void bc4Palette(int r0, int r1, int palette[8]) {
+    palette[0] = r0;
+    palette[1] = r1;
+    if (r0 > r1)
+        for (int k = 1; k < 7; ++k)
+            palette[k + 1] = ((7 - k) * r0 + k * r1) / 7;
+    else {
+        for (int k = 1; k < 5; ++k)
+            palette[k + 1] = ((5 - k) * r0 + k * r1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Encodes 16 sRGB colors in $[0,255]$ with endpoints at the extent of the
+// colors along their principal axis
+static void encodeBC1(const Float *rgb, uint8_t *block) {
+    Float mean[3] = {0, 0, 0};
+    for (int j = 0; j < 16; ++j)
+        for (int i = 0; i < 3; ++i) mean[i] += rgb[3 * j + i] / 16;
+    Float cov[3][3] = {};
+    for (int j = 0; j < 16; ++j)
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b)
+                cov[a][b] += (rgb[3 * j + a] - mean[a]) *
+                             (rgb[3 * j + b] - mean[b]);
+
+    // Find the principal axis with a few power iterations, starting from
+    // the covariance row with the largest variance
+    int start = 0;
+    for (int i = 1; i < 3; ++i)
+        if (cov[i][i] > cov[start][start]) start = i;
+    Float axis[3] = {cov[start][0], cov[start][1], cov[start][2]};
+    for (int iter = 0; iter < 4; ++iter) {
+        Float next[3], len = 0;
+        for (int a = 0; a < 3; ++a) {
+            next[a] = cov[a][0] * axis[0] + cov[a][1] * axis[1] +
+                      cov[a][2] * axis[2];
+            len = std::max(len, std::abs(next[a]));
+        }
+        if (len == 0) break;
+        for (int a = 0; a < 3; ++a) axis[a] = next[a] / len;
+    }
+    Float len = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] +
+                          axis[2] * axis[2]);
+    Float tMin = 0, tMax = 0;
+    if (len > 0) {
+        for (int a = 0; a < 3; ++a) axis[a] /= len;
+        tMin = Infinity;
+        tMax = -Infinity;
+        for (int j = 0; j < 16; ++j) {
+            Float t = 0;
+            for (int a = 0; a < 3; ++a)
+                t += (rgb[3 * j + a] - mean[a]) * axis[a];
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+    }
+    Float e0[3], e1[3];
+    for (int a = 0; a < 3; ++a) {
+        e0[a] = mean[a] + tMax * axis[a];
+        e1[a] = mean[a] + tMin * axis[a];
+    }
+
+    // Use the four-color mode, which requires $c_0 > c_1$, and pick the
+    // closest palette entry for each texel
+    uint16_t c0 = toRGB565(e0), c1 = toRGB565(e1);
+    if (c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        bc1Palette(c0, c1, palette);
+        for (int j = 0; j < 16; ++j) {
+            int best = 0;
+            Float bestDist = Infinity;
+            for (int k = 0; k < 4; ++k) {
+                Float dist = 0;
+                for (int a = 0; a < 3; ++a)
+                    dist += (rgb[3 * j + a] - palette[k][a]) *
+                            (rgb[3 * j + a] - palette[k][a]);
+                if (dist < bestDist) {
+                    bestDist = dist;
+                    best = k;
+                }
+            }
+            indices |= uint32_t(best) << (2 * j);
+        }
+    }
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i) block[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// Encodes 16 values in $[0,255]$ with endpoints at their extremes
+static void encodeBC4(const Float *v, uint8_t *block) {
+    Float vMin = v[0], vMax = v[0];
+    for (int j = 1; j < 16; ++j) {
+        vMin = std::min(vMin, v[j]);
+        vMax = std::max(vMax, v[j]);
+    }
+    int r0 = Clamp(int(vMax + .5f), 0, 255);
+    int r1 = Clamp(int(vMin + .5f), 0, 255);
+    uint64_t indices = 0;
+    if (r0 != r1) {
+        int palette[8];
+        bc4Palette(r0, r1, palette);
+        for (int j = 0; j < 16; ++j) {
+            int best = 0;
+            for (int k = 1; k < 8; ++k)
+                if (std::abs(v[j] - palette[k]) <
+                    std::abs(v[j] - palette[best]))
+                    best = k;
+            indices |= uint64_t(best) << (3 * j);
+        }
+    }
+    block[0] = r0;
+    block[1] = r1;
+    for (int i = 0; i < 6; ++i) block[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// TexelFormat Function Definitions
+bool ParseTexelFormat(const std::string &name, TexelFormat *format) {
+    if (name == "float")
+        *format = TexelFormat::Float;
+    else if (name == "srgb8")
+        *format = TexelFormat::SRGB8;
+    else if (name == "half")
+        *format = TexelFormat::Half;
+    else if (name == "bc1")
+        *format = TexelFormat::BC1;
+    else
+        return false;
+    return true;
+}
+
+uint16_t FloatToHalf(float f) {
+    uint32_t bits = FloatToBits(f);
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    // Infinity and NaN
+    if (((bits >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31) return sign | 0x7c00;
+    if (exponent <= 0) {
+        // Denormalized half, or zero if it's too small even for that
+        if (exponent < -10) return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rest > half || (rest == half && (h & 1))) ++h;
+        return sign | h;
+    }
+    // Round to nearest even; a carry out of the mantissa correctly bumps
+    // the exponent (and overflows to infinity)
+    uint32_t h = (uint32_t(exponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) ++h;
+    return sign | h;
+}
+
+float HalfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+    if (exponent == 0) {
+        float v = mantissa * (1.f / (1 << 24));
+        return sign ? -v : v;
+    }
+    if (exponent == 31)
+        return BitsToFloat(sign | 0x7f800000 | (mantissa << 13));
+    return BitsToFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+int TexelBlockBytes(TexelFormat format, int nChannels) {
+    switch (format) {
+    case TexelFormat::Float:
+        return 16 * nChannels * sizeof(Float);
+    case TexelFormat::SRGB8:
+        return 16 * nChannels;
+    case TexelFormat::Half:
+        return 16 * nChannels * sizeof(uint16_t);
+    case TexelFormat::BC1:
+        CHECK(nChannels == 1 || nChannels == 3);
+        return 8;
+    }
+    return 0;
+}
+
+void EncodeTexelBlock(TexelFormat format, int nChannels, Float scale,
+                      const Float *texels, uint8_t *block) {
+    int n = 16 * nChannels;
+    switch (format) {
+    case TexelFormat::Float:
+        memcpy(block, texels, n * sizeof(Float));
+        break;
+    case TexelFormat::SRGB8:
+        for (int i = 0; i < n; ++i)
+            block[i] = uint8_t(toSRGB(texels[i], scale) + .5f);
+        break;
+    case TexelFormat::Half:
+        for (int i = 0; i < n; ++i) {
+            uint16_t h = FloatToHalf(texels[i]);
+            memcpy(&block[2 * i], &h, sizeof(h));
+        }
+        break;
+    case TexelFormat::BC1: {
+        Float srgb[48];
+        for (int i = 0; i < n; ++i) srgb[i] = toSRGB(texels[i], scale);
+        if (nChannels == 3)
+            encodeBC1(srgb, block);
+        else
+            encodeBC4(srgb, block);
+        break;
+    }
+    }
+}
+
+void DecodeTexel(TexelFormat format, int nChannels, Float scale,
+                 const uint8_t *block, int index, Float *texel) {
+    switch (format) {
+    case TexelFormat::Float:
+        memcpy(texel, &block[index * nChannels * sizeof(Float)],
+               nChannels * sizeof(Float));
+        break;
+    case TexelFormat::SRGB8:
+        for (int i = 0; i < nChannels; ++i)
+            texel[i] = scale * srgb8ToLinear[block[index * nChannels + i]];
+        break;
+    case TexelFormat::Half:
+        for (int i = 0; i < nChannels; ++i) {
+            uint16_t h;
+            memcpy(&h, &block[2 * (index * nChannels + i)], sizeof(h));
+            texel[i] = HalfToFloat(h);
+        }
+        break;
+    case TexelFormat::BC1:
+        if (nChannels == 3) {
+            uint16_t c0 = block[0] | (block[1] << 8);
+            uint16_t c1 = block[2] | (block[3] << 8);
+            int k = (block[4 + index / 4] >> (2 * (index & 3))) & 3;
+            int palette[4][3];
+            bc1Palette(c0, c1, palette);
+            for (int i = 0; i < 3; ++i)
+                texel[i] = scale * srgb8ToLinear[palette[k][i]];
+        } else {
+            uint64_t indices = 0;
+            for (int i = 0; i < 6; ++i)
+                indices |= uint64_t(block[2 + i]) << (8 * i);
+            int palette[8];
+            bc4Palette(block[0], block[1], palette);
+            int k = (indices >> (3 * index)) & 7;
+            texel[0] = scale * srgb8ToLinear[palette[k]];
+        }
+        break;
+    }
+}
+
+}  // namespace pbrt
@@ -0,0 +1,190 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_TEXELFORMAT_H
+#define PBRT_CORE_TEXELFORMAT_H
+
+// core/texelformat.h*
+#include "pbrt.h"
+#include "geometry.h"
+#include "memory.h"
+#include "parallel.h"
+#include "spectrum.h"
+
+namespace pbrt {
+
+// TexelFormat Declarations
+
+// Storage formats for MIPMap texels. _Float_ keeps full precision. _SRGB8_
+// stores 8 bits per channel on the sRGB curve, decoded through a lookup
+// table. _Half_ stores 16-bit floats. _BC1_ stores each 4x4 block in 8
+// bytes, as two RGB565 endpoints plus 2-bit indices; one-channel textures
+// use the BC4 layout instead (two 8-bit endpoints plus 3-bit indices).
+// The 8-bit and block-compressed formats work in sRGB space.
+enum class TexelFormat { Float, SRGB8, Half, BC1 };
+
+bool ParseTexelFormat(const std::string &name, TexelFormat *format);
+uint16_t FloatToHalf(float f);
+float HalfToFloat(uint16_t h);
+
+// Texels are encoded and decoded in 4x4 blocks, whatever the format.
+// Channel values passed in are divided by _scale_ for the 8-bit and
+// block-compressed formats, which only represent $[0,1]$, and are
+// multiplied by it when decoded.
+int TexelBlockBytes(TexelFormat format, int nChannels);
+void EncodeTexelBlock(TexelFormat format, int nChannels, Float scale,
+                      const Float *texels, uint8_t *block);
+void DecodeTexel(TexelFormat format, int nChannels, Float scale,
+                 const uint8_t *block, int index, Float *texel);
+
+// CompactTexels Declarations
+inline void TexelToChannels(Float v, Float *c) { c[0] = v; }
+template <int nSamples>
+inline void TexelToChannels(const CoefficientSpectrum<nSamples> &v,
+                            Float *c) {
+    for (int i = 0; i < nSamples; ++i) c[i] = v[i];
+}
+inline void ChannelsToTexel(const Float *c, Float *v) { *v = c[0]; }
+template <int nSamples>
+inline void ChannelsToTexel(const Float *c, CoefficientSpectrum<nSamples> *v) {
+    for (int i = 0; i < nSamples; ++i) (*v)[i] = c[i];
+}
+template <typename T>
+struct TexelChannels {
+    enum { count = T::nSamples };
+};
+template <>
+struct TexelChannels<Float> {
+    enum { count = 1 };
+};
+
+// A MIP pyramid re-encoded in one of the compact _TexelFormat_s; texels
+// are decoded one at a time as they're looked up.
+template <typename T>
+class CompactTexels {
+  public:
+    // CompactTexels Public Methods
+    CompactTexels(const std::vector<std::unique_ptr<BlockedArray<T>>> &pyramid,
+                  TexelFormat format);
+    int Levels() const { return levels.size(); }
+    Point2i LevelResolution(int level) const {
+        return levels[level].resolution;
+    }
+    T Texel(int level, int s, int t) const {
+        const Level &l = levels[level];
+        int block = (t >> 2) * l.blocksPerRow + (s >> 2);
+        Float c[nChannels];
+        DecodeTexel(format, nChannels, scale, &l.data[block * blockBytes],
+                    ((t & 3) << 2) | (s & 3), c);
+        T value;
+        ChannelsToTexel(c, &value);
+        return value;
+    }
+    size_t BytesUsed() const {
+        size_t bytes = 0;
+        for (const Level &l : levels) bytes += l.data.size();
+        return bytes;
+    }
+
+  private:
+    // CompactTexels Private Data
+    enum { nChannels = TexelChannels<T>::count };
+    struct Level {
+        Point2i resolution;
+        int blocksPerRow;
+        std::vector<uint8_t> data;
+    };
+    const TexelFormat format;
+    const int blockBytes;
+    Float scale = 1;
+    std::vector<Level> levels;
+};
+
+// CompactTexels Method Definitions
+template <typename T>
+CompactTexels<T>::CompactTexels(
+    const std::vector<std::unique_ptr<BlockedArray<T>>> &pyramid,
+    TexelFormat format)
+    : format(format), blockBytes(TexelBlockBytes(format, nChannels)) {
+    CHECK(format != TexelFormat::Float);
+    // The 8-bit formats cover $[0,1]$; brighter textures are normalized
+    // by their largest value
+    if (format != TexelFormat::Half)
+        for (const auto &level : pyramid)
+            for (int t = 0; t < level->vSize(); ++t)
+                for (int s = 0; s < level->uSize(); ++s) {
+                    Float c[nChannels];
+                    TexelToChannels((*level)(s, t), c);
+                    for (int i = 0; i < nChannels; ++i)
+                        scale = std::max(scale, c[i]);
+                }
+
+    levels.resize(pyramid.size());
+    for (size_t i = 0; i < pyramid.size(); ++i) {
+        const BlockedArray<T> &texels = *pyramid[i];
+        Level &level = levels[i];
+        level.resolution = Point2i(texels.uSize(), texels.vSize());
+        level.blocksPerRow = (texels.uSize() + 3) / 4;
+        int blockRows = (texels.vSize() + 3) / 4;
+        level.data.resize(size_t(level.blocksPerRow) * blockRows * blockBytes);
+        // Blocks that hang over the edge of the level repeat its last
+        // texels, so that those don't skew the block's encoding
+        auto encodeRow = [&](int64_t by) {
+            for (int bx = 0; bx < level.blocksPerRow; ++bx) {
+                Float c[16 * nChannels];
+                for (int j = 0; j < 16; ++j) {
+                    int s = std::min(4 * bx + (j & 3), texels.uSize() - 1);
+                    int t =
+                        std::min(4 * int(by) + (j >> 2), texels.vSize() - 1);
+                    TexelToChannels(texels(s, t), &c[j * nChannels]);
+                }
+                EncodeTexelBlock(
+                    format, nChannels, scale, c,
+                    &level.data[(by * level.blocksPerRow + bx) * blockBytes]);
+            }
+        };
+        if (level.blocksPerRow * blockRows < 256)
+            for (int by = 0; by < blockRows; ++by) encodeRow(by);
+        else
+            ParallelFor(encodeRow, blockRows,
+                        std::max(1, 1024 / level.blocksPerRow));
+    }
+}
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_TEXELFORMAT_H
@@ -45,6 +45,7 @@ inline Float SmoothStep(Float min, Float max, Float value) {
 
 // Texture Forward Declarations
 inline Float Grad(int x, int y, int z, Float dx, Float dy, Float dz);
+inline Float GradWeight(int h, Float dx, Float dy, Float dz);
 inline Float NoiseWeight(Float t);
 
 // Perlin Noise Data
@@ -191,8 +192,64 @@ Float Noise(Float x, Float y, Float z) {
 }
 
 Float Noise(const Point3f &p) { return Noise(p.x, p.y, p.z); }
+
+// Noise is evaluated for up to _NoiseBatchSize_ points at a time; the loops
+// over the points in a batch are branch-free so that they vectorize.
+static PBRT_CONSTEXPR int NoiseBatchSize = 8;
+
+static void NoiseBatch(const Point3f *p, int count, Float *noise) {
+    DCHECK_LE(count, NoiseBatchSize);
+    // Compute noise cell coordinates and offsets
+    int ix[NoiseBatchSize], iy[NoiseBatchSize], iz[NoiseBatchSize];
+    Float dx[NoiseBatchSize], dy[NoiseBatchSize], dz[NoiseBatchSize];
+    for (int i = 0; i < count; ++i) {
+        ix[i] = std::floor(p[i].x);
+        iy[i] = std::floor(p[i].y);
+        iz[i] = std::floor(p[i].z);
+        dx[i] = p[i].x - ix[i];
+        dy[i] = p[i].y - iy[i];
+        dz[i] = p[i].z - iz[i];
+        ix[i] &= NoisePermSize - 1;
+        iy[i] &= NoisePermSize - 1;
+        iz[i] &= NoisePermSize - 1;
+    }
+
+    // Compute gradient weights at all eight corners of the cells
+    Float w[8][NoiseBatchSize];
+    for (int c = 0; c < 8; ++c) {
+        int cx = c & 1, cy = (c >> 1) & 1, cz = c >> 2;
+        for (int i = 0; i < count; ++i) {
+            int h = NoisePerm[NoisePerm[NoisePerm[ix[i] + cx] + iy[i] + cy] +
+                              iz[i] + cz];
+            w[c][i] = GradWeight(h, dx[i] - cx, dy[i] - cy, dz[i] - cz);
+        }
+    }
+
+    // Compute trilinear interpolation of weights
+    for (int i = 0; i < count; ++i) {
+        Float wx = NoiseWeight(dx[i]), wy = NoiseWeight(dy[i]),
+              wz = NoiseWeight(dz[i]);
+        Float x00 = Lerp(wx, w[0][i], w[1][i]);
+        Float x10 = Lerp(wx, w[2][i], w[3][i]);
+        Float x01 = Lerp(wx, w[4][i], w[5][i]);
+        Float x11 = Lerp(wx, w[6][i], w[7][i]);
+        Float y0 = Lerp(wy, x00, x10);
+        Float y1 = Lerp(wy, x01, x11);
+        noise[i] = Lerp(wz, y0, y1);
+    }
+}
+
+void Noise(const Point3f *p, int count, Float *noise) {
+    for (int i = 0; i < count; i += NoiseBatchSize)
+        NoiseBatch(p + i, std::min(NoiseBatchSize, count - i), noise + i);
+}
+
 inline Float Grad(int x, int y, int z, Float dx, Float dy, Float dz) {
     int h = NoisePerm[NoisePerm[NoisePerm[x] + y] + z];
+    return GradWeight(h, dx, dy, dz);
+}
+
+inline Float GradWeight(int h, Float dx, Float dy, Float dz) {
     h &= 15;
     Float u = h < 8 || h == 12 || h == 13 ? dx : dy;
     Float v = h < 4 || h == 12 || h == 13 ? dy : dz;
@@ -205,48 +262,95 @@ inline Float NoiseWeight(Float t) {
     return 6 * t4 * t - 15 * t4 + 10 * t3;
 }
 
+// Evaluates the octaves of noise that FBm() and Turbulence() sum at each
+// of the given points; noise for all of the octaves at a group of points is
+// computed in batches. _sumOctaves_ is given each point's noise values,
+// its number of whole octaves, and the weight of its last, partial octave.
+template <typename SumOctaves>
+static void OctaveNoise(const Point3f *p, const Vector3f *dpdx,
+                        const Vector3f *dpdy, int count, int maxOctaves,
+                        Float *result, SumOctaves sumOctaves) {
+    int nGroup = std::min(count, NoiseBatchSize);
+    Point3f *pNoise = ALLOCA(Point3f, nGroup * (std::max(maxOctaves, 0) + 1));
+    Float *noise = ALLOCA(Float, nGroup * (std::max(maxOctaves, 0) + 1));
+    for (int j0 = 0; j0 < count; j0 += nGroup) {
+        int nInt[NoiseBatchSize], start[NoiseBatchSize + 1];
+        Float partial[NoiseBatchSize];
+        start[0] = 0;
+        int n = std::min(nGroup, count - j0);
+        for (int j = 0; j < n; ++j) {
+            // Compute number of octaves for antialiased FBm
+            Float len2 = std::max(dpdx[j0 + j].LengthSquared(),
+                                  dpdy[j0 + j].LengthSquared());
+            Float nOctaves = Clamp(-1 - .5f * Log2(len2), 0, maxOctaves);
+            nInt[j] = std::floor(nOctaves);
+            partial[j] = SmoothStep(.3f, .7f, nOctaves - nInt[j]);
+
+            // Add the points to evaluate noise at, skipping the partial
+            // octave if it has no weight
+            int end = start[j] + nInt[j] + (partial[j] > 0 ? 1 : 0);
+            Float lambda = 1;
+            for (int i = start[j]; i < end; ++i) {
+                pNoise[i] = lambda * p[j0 + j];
+                lambda *= 1.99f;
+            }
+            start[j + 1] = end;
+        }
+        Noise(pNoise, start[n], noise);
+        for (int j = 0; j < n; ++j)
+            result[j0 + j] = sumOctaves(noise + start[j], nInt[j], partial[j]);
+    }
+}
+
+void FBm(const Point3f *p, const Vector3f *dpdx, const Vector3f *dpdy,
+         int count, Float omega, int maxOctaves, Float *result) {
+    OctaveNoise(p, dpdx, dpdy, count, maxOctaves, result,
+                [omega](const Float *noise, int nInt, Float partial) {
+                    // Compute sum of octaves of noise for FBm
+                    Float sum = 0, o = 1;
+                    for (int i = 0; i < nInt; ++i) {
+                        sum += o * noise[i];
+                        o *= omega;
+                    }
+                    if (partial > 0) sum += o * partial * noise[nInt];
+                    return sum;
+                });
+}
+
+void Turbulence(const Point3f *p, const Vector3f *dpdx, const Vector3f *dpdy,
+                int count, Float omega, int maxOctaves, Float *result) {
+    OctaveNoise(
+        p, dpdx, dpdy, count, maxOctaves, result,
+        [omega, maxOctaves](const Float *noise, int nInt, Float partial) {
+            // Compute sum of octaves of noise for turbulence
+            Float sum = 0, o = 1;
+            for (int i = 0; i < nInt; ++i) {
+                sum += o * std::abs(noise[i]);
+                o *= omega;
+            }
+
+            // Account for contributions of clamped octaves in turbulence
+            sum += o * (partial > 0 ? Lerp(partial, 0.2, std::abs(noise[nInt]))
+                                    : 0.2f);
+            for (int i = nInt; i < maxOctaves; ++i) {
+                sum += o * 0.2f;
+                o *= omega;
+            }
+            return sum;
+        });
+}
+
 Float FBm(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy,
           Float omega, int maxOctaves) {
-    // Compute number of octaves for antialiased FBm
-    Float len2 = std::max(dpdx.LengthSquared(), dpdy.LengthSquared());
-    Float n = Clamp(-1 - .5f * Log2(len2), 0, maxOctaves);
-    int nInt = std::floor(n);
-
-    // Compute sum of octaves of noise for FBm
-    Float sum = 0, lambda = 1, o = 1;
-    for (int i = 0; i < nInt; ++i) {
-        sum += o * Noise(lambda * p);
-        lambda *= 1.99f;
-        o *= omega;
-    }
-    Float nPartial = n - nInt;
-    sum += o * SmoothStep(.3f, .7f, nPartial) * Noise(lambda * p);
+    Float sum;
+    FBm(&p, &dpdx, &dpdy, 1, omega, maxOctaves, &sum);
     return sum;
 }
 
 Float Turbulence(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy,
                  Float omega, int maxOctaves) {
-    // Compute number of octaves for antialiased FBm
-    Float len2 = std::max(dpdx.LengthSquared(), dpdy.LengthSquared());
-    Float n = Clamp(-1 - .5f * Log2(len2), 0, maxOctaves);
-    int nInt = std::floor(n);
-
-    // Compute sum of octaves of noise for turbulence
-    Float sum = 0, lambda = 1, o = 1;
-    for (int i = 0; i < nInt; ++i) {
-        sum += o * std::abs(Noise(lambda * p));
-        lambda *= 1.99f;
-        o *= omega;
-    }
-
-    // Account for contributions of clamped octaves in turbulence
-    Float nPartial = n - nInt;
-    sum += o * Lerp(SmoothStep(.3f, .7f, nPartial), 0.2,
-                    std::abs(Noise(lambda * p)));
-    for (int i = nInt; i < maxOctaves; ++i) {
-        sum += o * 0.2f;
-        o *= omega;
-    }
+    Float sum;
+    Turbulence(&p, &dpdx, &dpdy, 1, omega, maxOctaves, &sum);
     return sum;
 }
 
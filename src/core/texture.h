@@ -48,12 +48,26 @@
 namespace pbrt {
 
 // Texture Declarations
+
+// What a texture's value is a function of, which determines how it can be
+// baked: nothing, only the shading point's $(u,v)$, only its position, or
+// something else, such as the face index, or a combination of these.
+enum class TextureDomain { Constant, UV, Position, Other };
+
+// Returns the domain of a texture that combines values from _a_ and _b_.
+inline TextureDomain Combine(TextureDomain a, TextureDomain b) {
+    if (a == TextureDomain::Constant) return b;
+    if (b == TextureDomain::Constant || a == b) return a;
+    return TextureDomain::Other;
+}
+
 class TextureMapping2D {
   public:
     // TextureMapping2D Interface
     virtual ~TextureMapping2D();
     virtual Point2f Map(const SurfaceInteraction &si, Vector2f *dstdx,
                         Vector2f *dstdy) const = 0;
+    virtual TextureDomain Domain() const { return TextureDomain::Position; }
 };
 
 class UVMapping2D : public TextureMapping2D {
@@ -62,6 +76,7 @@ class UVMapping2D : public TextureMapping2D {
     UVMapping2D(Float su = 1, Float sv = 1, Float du = 0, Float dv = 0);
     Point2f Map(const SurfaceInteraction &si, Vector2f *dstdx,
                 Vector2f *dstdy) const;
+    TextureDomain Domain() const { return TextureDomain::UV; }
 
   private:
     const Float su, sv, du, dv;
@@ -117,6 +132,7 @@ class TextureMapping3D {
     virtual ~TextureMapping3D();
     virtual Point3f Map(const SurfaceInteraction &si, Vector3f *dpdx,
                         Vector3f *dpdy) const = 0;
+    virtual TextureDomain Domain() const { return TextureDomain::Position; }
 };
 
 class IdentityMapping3D : public TextureMapping3D {
@@ -136,6 +152,7 @@ class Texture {
   public:
     // Texture Interface
     virtual T Evaluate(const SurfaceInteraction &) const = 0;
+    virtual TextureDomain Domain() const { return TextureDomain::Other; }
     virtual ~Texture() {}
 };
 
@@ -147,6 +164,15 @@ Float FBm(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy,
 Float Turbulence(const Point3f &p, const Vector3f &dpdx, const Vector3f &dpdy,
                  Float omega, int octaves);
 
+// Batch versions of the noise functions, which evaluate them at _count_
+// points and store the results in the corresponding entries of the last
+// argument.
+void Noise(const Point3f *p, int count, Float *noise);
+void FBm(const Point3f *p, const Vector3f *dpdx, const Vector3f *dpdy,
+         int count, Float omega, int octaves, Float *result);
+void Turbulence(const Point3f *p, const Vector3f *dpdx, const Vector3f *dpdy,
+                int count, Float omega, int octaves, Float *result);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_TEXTURE_H
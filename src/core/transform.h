@@ -432,8 +432,8 @@ class AnimatedTransform {
   private:
     // AnimatedTransform Private Data
     const Transform *startTransform, *endTransform;
-    const Float startTime, endTime;
-    const bool actuallyAnimated;
+    Float startTime, endTime;
+    bool actuallyAnimated;
     Vector3f T[2];
     Quaternion R[2];
     Matrix4x4 S[2];
@@ -55,8 +55,8 @@ AOIntegrator::AOIntegrator(bool cosSample, int ns,
 }
 
 Spectrum AOIntegrator::Li(const RayDifferential &r, const Scene &scene,
-                          Sampler &sampler, MemoryArena &arena,
-                          int depth) const {
+                          Sampler &sampler, MemoryArena &arena, int depth,
+                          AOVSample *aovSample) const {
     ProfilePhase p(Prof::SamplerIntegratorLi);
     Spectrum L(0.f);
     RayDifferential ray(r);
@@ -65,6 +65,8 @@ Spectrum AOIntegrator::Li(const RayDifferential &r, const Scene &scene,
     SurfaceInteraction isect;
  retry:
     if (scene.Intersect(ray, &isect)) {
+        if (aovSample && !aovSample->hit)
+            ComputeAOVSample(r, isect, *camera->film, arena, aovSample);
         isect.ComputeScatteringFunctions(ray, arena, true);
         if (!isect.bsdf) {
             VLOG(2) << "Skipping intersection due to null bsdf";
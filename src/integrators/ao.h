@@ -53,7 +53,8 @@ class AOIntegrator : public SamplerIntegrator {
                  std::shared_ptr<Sampler> sampler,
                  const Bounds2i &pixelBounds);
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, MemoryArena &arena, int depth) const;
+                Sampler &sampler, MemoryArena &arena, int depth,
+                AOVSample *aovSample) const;
  private:
     bool cosSample;
     int nSamples;
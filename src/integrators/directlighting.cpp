@@ -61,7 +61,8 @@ void DirectLightingIntegrator::Preprocess(const Scene &scene,
 
 Spectrum DirectLightingIntegrator::Li(const RayDifferential &ray,
                                       const Scene &scene, Sampler &sampler,
-                                      MemoryArena &arena, int depth) const {
+                                      MemoryArena &arena, int depth,
+                                      AOVSample *aovSample) const {
     ProfilePhase p(Prof::SamplerIntegratorLi);
     Spectrum L(0.f);
     // Find closest ray intersection or return background radiance
@@ -70,11 +71,14 @@ Spectrum DirectLightingIntegrator::Li(const RayDifferential &ray,
         for (const auto &light : scene.lights) L += light->Le(ray);
         return L;
     }
+    if (aovSample)
+        ComputeAOVSample(ray, isect, *camera->film, arena, aovSample);
 
     // Compute scattering functions for surface interaction
     isect.ComputeScatteringFunctions(ray, arena);
     if (!isect.bsdf)
-        return Li(isect.SpawnRay(ray.d), scene, sampler, arena, depth);
+        return Li(isect.SpawnRay(ray.d), scene, sampler, arena, depth,
+                  nullptr);
     Vector3f wo = isect.wo;
     // Compute emitted light if ray hit an area light source
     L += isect.Le(wo);
@@ -60,7 +60,8 @@ class DirectLightingIntegrator : public SamplerIntegrator {
           strategy(strategy),
           maxDepth(maxDepth) {}
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, MemoryArena &arena, int depth) const;
+                Sampler &sampler, MemoryArena &arena, int depth,
+                AOVSample *aovSample) const;
     void Preprocess(const Scene &scene, Sampler &sampler);
 
   private:
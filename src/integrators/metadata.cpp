@@ -35,11 +35,15 @@
 
 // integrators/metadata.cpp*
 #include "integrators/metadata.h"
+#include "imageio.h"
 #include "interaction.h"
 #include "paramset.h"
 #include "camera.h"
 #include "film.h"
 #include "stats.h"
+#include "parallel.h"
+#include "progressreporter.h"
+#include <cstdio>
 
 namespace pbrt {
 
@@ -51,7 +55,8 @@ void MetadataIntegrator::Preprocess(const Scene &scene,
 
 Spectrum MetadataIntegrator::Li(const RayDifferential &ray,
                                       const Scene &scene, Sampler &sampler,
-                                      MemoryArena &arena, int depth) const {
+                                      MemoryArena &arena, int depth,
+                                      AOVSample *aovSample) const {
     
     ProfilePhase p(Prof::SamplerIntegratorLi);
     Spectrum L(0.f);
@@ -62,6 +67,8 @@ Spectrum MetadataIntegrator::Li(const RayDifferential &ray,
         // Did not hit anything. Return 0.
         return L;
     }
+    if (aovSample)
+        ComputeAOVSample(ray, isect, *camera->film, arena, aovSample);
     
     // Depending on the strategy, return a different value
     if(strategy == MetadataStrategy::depth){
@@ -88,6 +95,69 @@ Spectrum MetadataIntegrator::Li(const RayDifferential &ray,
     return L;
 }
 
+void MetadataIntegrator::Render(const Scene &scene) {
+    if (!binaryOutput) {
+        SamplerIntegrator::Render(scene);
+        return;
+    }
+    Preprocess(scene, *sampler);
+
+    // Trace a single ray through the center of each pixel; metadata values
+    // are not meaningfully filtered, so there is no reconstruction step.
+    const Film &film = *camera->film;
+    Bounds2i bounds = film.croppedPixelBounds;
+    Bounds2i traceBounds = Intersect(bounds, pixelBounds);
+    int width = bounds.pMax.x - bounds.pMin.x;
+    int height = bounds.pMax.y - bounds.pMin.y;
+    const bool isInteger = strategy == MetadataStrategy::material ||
+                           strategy == MetadataStrategy::mesh;
+    const int nChannels = strategy == MetadataStrategy::coordinates ? 3 : 1;
+    std::vector<uint32_t> ids(isInteger ? width * height : 0, 0);
+    std::vector<float> values(isInteger ? 0 : width * height * nChannels, 0.f);
+
+    ProgressReporter reporter(height, "Rendering");
+    ParallelFor([&](int64_t row) {
+        int y = bounds.pMin.y + (int)row;
+        if (y < traceBounds.pMin.y || y >= traceBounds.pMax.y) {
+            reporter.Update();
+            return;
+        }
+        for (int x = traceBounds.pMin.x; x < traceBounds.pMax.x; ++x) {
+            CameraSample cameraSample;
+            cameraSample.pFilm = Point2f(x + 0.5f, y + 0.5f);
+            cameraSample.pLens = Point2f(0.5f, 0.5f);
+            cameraSample.time = 0.5f;
+            Ray ray;
+            if (camera->GenerateRay(cameraSample, &ray) == 0) continue;
+            SurfaceInteraction isect;
+            if (!scene.Intersect(ray, &isect)) continue;
+
+            int offset = (x - bounds.pMin.x) + (int)row * width;
+            if (strategy == MetadataStrategy::material)
+                ids[offset] = isect.materialId;
+            else if (strategy == MetadataStrategy::mesh)
+                ids[offset] = isect.instanceId;
+            else if (strategy == MetadataStrategy::depth)
+                values[offset] = Distance(isect.p, ray.o);
+            else
+                for (int c = 0; c < 3; ++c)
+                    values[3 * offset + c] = isect.p[c];
+        }
+        reporter.Update();
+    }, height, 8);
+    reporter.Done();
+    LOG(INFO) << "Rendering finished";
+
+    std::string filename = film.filename;
+    filename = filename.substr(0, filename.find_last_of('.')) + ".bin";
+    if (isInteger)
+        WriteMetadataImage(filename, width, height, nChannels, true,
+                           ids.data());
+    else
+        WriteMetadataImage(filename, width, height, nChannels, false,
+                           values.data());
+}
+
 MetadataIntegrator *CreateMetadataIntegrator(
     const ParamSet &params, std::shared_ptr<Sampler> sampler,
     std::shared_ptr<const Camera> camera) {
@@ -109,6 +179,16 @@ MetadataIntegrator *CreateMetadataIntegrator(
             st.c_str());
         strategy = MetadataStrategy::depth;
     }
+    std::string format = params.FindOneString("format", "image");
+    if (format != "image" && format != "binary") {
+        Warning("Metadata format \"%s\" unknown. Using \"image\".",
+                format.c_str());
+        format = "image";
+    }
+    // The binary format bypasses the film, so it never writes its AOVs
+    if (format == "binary" && camera->film->HasAOVs())
+        Warning("Film AOVs aren't supported with the \"binary\" metadata "
+                "format. Ignoring them.");
     
     int np;
     const int *pb = params.FindInt("pixelbounds", &np);
@@ -126,7 +206,7 @@ MetadataIntegrator *CreateMetadataIntegrator(
     }
     
     return new MetadataIntegrator(strategy, camera, sampler,
-                                        pixelBounds);
+                                        pixelBounds, format == "binary");
 }
 
 }  // namespace pbrt
@@ -55,16 +55,20 @@ class MetadataIntegrator : public SamplerIntegrator {
     MetadataIntegrator(MetadataStrategy strategy,
                              std::shared_ptr<const Camera> camera,
                              std::shared_ptr<Sampler> sampler,
-                             const Bounds2i &pixelBounds)
+                             const Bounds2i &pixelBounds,
+                             bool binaryOutput = false)
         : SamplerIntegrator(camera, sampler, pixelBounds),
-          strategy(strategy){}
+          strategy(strategy), binaryOutput(binaryOutput) {}
+    void Render(const Scene &scene);
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, MemoryArena &arena, int depth) const;
+                Sampler &sampler, MemoryArena &arena, int depth,
+                AOVSample *aovSample) const;
     void Preprocess(const Scene &scene, Sampler &sampler);
     virtual bool IgnoreRayWeight() const override { return true; }
   private:
     // MetadataIntegrator Private Data
     const MetadataStrategy strategy;
+    const bool binaryOutput;
     std::vector<int> nLightSamples;
 };
 
@@ -63,7 +63,7 @@ void PathIntegrator::Preprocess(const Scene &scene, Sampler &sampler) {
 
 Spectrum PathIntegrator::Li(const RayDifferential &r, const Scene &scene,
                             Sampler &sampler, MemoryArena &arena,
-                            int depth) const {
+                            int depth, AOVSample *aovSample) const {
     ProfilePhase p(Prof::SamplerIntegratorLi);
     Spectrum L(0.f), beta(1.f);
     RayDifferential ray(r);
@@ -86,6 +86,10 @@ Spectrum PathIntegrator::Li(const RayDifferential &r, const Scene &scene,
         // Intersect _ray_ with scene and store intersection in _isect_
         SurfaceInteraction isect;
         bool foundIntersection = scene.Intersect(ray, &isect);
+        // Skipping a medium boundary leaves _bounces_ at zero; the AOVs keep
+        // describing the boundary itself, as with the other integrators.
+        if (bounces == 0 && foundIntersection && aovSample && !aovSample->hit)
+            ComputeAOVSample(r, isect, *camera->film, arena, aovSample);
 
         // Possibly add emitted light at intersection
         if (bounces == 0 || specularBounce) {
@@ -56,10 +56,11 @@ class PathIntegrator : public SamplerIntegrator {
 
     void Preprocess(const Scene &scene, Sampler &sampler);
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, MemoryArena &arena, int depth) const;
+                Sampler &sampler, MemoryArena &arena, int depth,
+                AOVSample *aovSample) const;
 
-  private:
-    // PathIntegrator Private Data
+  protected:
+    // PathIntegrator Protected Data
     const int maxDepth;
     const Float rrThreshold;
     const std::string lightSampleStrategy;
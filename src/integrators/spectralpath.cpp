@@ -70,7 +70,7 @@ namespace pbrt {
     
     Spectrum SpectralPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
                                         Sampler &sampler, MemoryArena &arena,
-                                        int depth) const {
+                                        int depth, AOVSample *aovSample) const {
         ProfilePhase p(Prof::SamplerIntegratorLi);
         Spectrum L(0.f), beta(1.f);
         RayDifferential ray(r);
@@ -93,6 +93,10 @@ namespace pbrt {
             // Intersect _ray_ with scene and store intersection in _isect_
             SurfaceInteraction isect;
             bool foundIntersection = scene.Intersect(ray, &isect);
+            // Skipping a medium boundary leaves _bounces_ at zero; the AOVs keep
+            // describing the boundary itself, as with the other integrators.
+            if (bounces == 0 && foundIntersection && aovSample && !aovSample->hit)
+                ComputeAOVSample(r, isect, *camera->film, arena, aovSample);
             
             // Possibly add emitted light at intersection
             if (bounces == 0 || specularBounce) {
@@ -206,6 +210,7 @@ namespace pbrt {
         const int tileSize = 16;
         Point2i nTiles((sampleExtent.x + tileSize - 1) / tileSize,
                        (sampleExtent.y + tileSize - 1) / tileSize);
+        const bool recordAOVs = camera->film->HasAOVs();
         ProgressReporter reporter(nTiles.x * nTiles.y, "Rendering");
         {
             ParallelFor2D([&](Point2i tile) {
@@ -256,6 +261,8 @@ namespace pbrt {
                         
                         Spectrum L(0.f); // This will be the final radiance for this bundle of rays of different wavelength.
                         Float rayWeight;
+                        // AOVs are taken from the first band's camera ray
+                        AOVSample aovSample;
                         
                         // For each sample, we loop through  all the CA bands and trace a new ray per wavelength. We then put all the returned values in a spectrum for the original sample.
                         for(int s = 0; s < numCABands; s++){
@@ -279,7 +286,9 @@ namespace pbrt {
                             // reflecting off objects, and finally hitting a light source. The radiance is returned here. 
                             // The radiance is returned as a full spectrum, but we only care about the value associated with the ray's assigned 
                             // wavelength. This is because the direction the ray exited the lens is dependent on the wavelength.
-                            if (rayWeight > 0) Ls = Li(ray, scene, *tileSampler, arena, 0);
+                            if (rayWeight > 0)
+                                Ls = Li(ray, scene, *tileSampler, arena, 0,
+                                        (s == 0 && recordAOVs) ? &aovSample : nullptr);
                             
                             // Issue warning if unexpected radiance value returned
                             if (Ls.HasNaNs()) {
@@ -319,6 +328,8 @@ namespace pbrt {
                         
                         // Add camera ray's contribution to image
                         filmTile->AddSample(cameraSample.pFilm, L, rayWeight);
+                        if (aovSample.hit)
+                            filmTile->AddAOVSample(cameraSample.pFilm, aovSample);
                         
                         // Free _MemoryArena_ memory from computing image sample
                         // value
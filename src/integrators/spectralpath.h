@@ -57,7 +57,8 @@ class SpectralPathIntegrator : public SamplerIntegrator {
 
     void Preprocess(const Scene &scene, Sampler &sampler);
     Spectrum Li(const RayDifferential &ray, const Scene &scene,
-                Sampler &sampler, MemoryArena &arena, int depth) const;
+                Sampler &sampler, MemoryArena &arena, int depth,
+                AOVSample *aovSample) const;
     void Render(const Scene &scene);
 
   private:
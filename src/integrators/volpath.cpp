@@ -54,7 +54,7 @@ void VolPathIntegrator::Preprocess(const Scene &scene, Sampler &sampler) {
 
 Spectrum VolPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
                                Sampler &sampler, MemoryArena &arena,
-                               int depth) const {
+                               int depth, AOVSample *aovSample) const {
     ProfilePhase p(Prof::SamplerIntegratorLi);
     Spectrum L(0.f), beta(1.f);
     RayDifferential ray(r);
@@ -73,6 +73,10 @@ Spectrum VolPathIntegrator::Li(const RayDifferential &r, const Scene &scene,
         // Intersect _ray_ with scene and store intersection in _isect_
         SurfaceInteraction isect;
         bool foundIntersection = scene.Intersect(ray, &isect);
+        // Skipping a medium boundary leaves _bounces_ at zero; the AOVs keep
+        // describing the boundary itself, as with the other integrators.
+        if (bounces == 0 && foundIntersection && aovSample && !aovSample->hit)
+            ComputeAOVSample(r, isect, *camera->film, arena, aovSample);
 
         // Sample the participating medium, if present
         MediumInteraction mi;
@@ -0,0 +1,343 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+// integrators/wavefront.cpp*
+#include "integrators/wavefront.h"
+#include "bssrdf.h"
+#include "camera.h"
+#include "film.h"
+#include "interaction.h"
+#include "paramset.h"
+#include "parallel.h"
+#include "progressreporter.h"
+#include "scene.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_COUNTER("Integrator/Wavefront camera rays traced", nWavefrontCameraRays);
+STAT_INT_DISTRIBUTION("Integrator/Rays per wavefront batch", raysPerBatch);
+
+// WavefrontPath Declarations
+struct WavefrontPath {
+    CameraSample cameraSample;
+    Float rayWeight;
+    RayDifferential ray;
+    SurfaceInteraction isect;
+    Spectrum L, beta;
+    Float etaScale;
+    int bounces;
+    bool specularBounce, active;
+    // AOVs from the camera ray's intersection, if the film records them
+    AOVSample aovSample;
+    bool haveAOVSample;
+};
+
+// WavefrontPathIntegrator Method Definitions
+WavefrontPathIntegrator::WavefrontPathIntegrator(
+    int maxDepth, std::shared_ptr<const Camera> camera,
+    std::shared_ptr<Sampler> sampler, const Bounds2i &pixelBounds,
+    Float rrThreshold, const std::string &lightSampleStrategy, int tileSize,
+    bool sortByMaterial)
+    : PathIntegrator(maxDepth, camera, sampler, pixelBounds, rrThreshold,
+                     lightSampleStrategy),
+      tileSize(tileSize),
+      sortByMaterial(sortByMaterial) {}
+
+void WavefrontPathIntegrator::Render(const Scene &scene) {
+    Preprocess(scene, *sampler);
+    // Compute number of tiles, _nTiles_, to use for parallel rendering
+    Bounds2i sampleBounds = camera->film->GetSampleBounds();
+    Vector2i sampleExtent = sampleBounds.Diagonal();
+    Point2i nTiles((sampleExtent.x + tileSize - 1) / tileSize,
+                   (sampleExtent.y + tileSize - 1) / tileSize);
+    const bool ignoreRayWeight = IgnoreRayWeight();
+    ProgressReporter reporter(nTiles.x * nTiles.y, "Rendering");
+    {
+        ParallelFor2D([&](Point2i tile) {
+            // Render section of image corresponding to _tile_
+            MemoryArena arena;
+            int x0 = sampleBounds.pMin.x + tile.x * tileSize;
+            int x1 = std::min(x0 + tileSize, sampleBounds.pMax.x);
+            int y0 = sampleBounds.pMin.y + tile.y * tileSize;
+            int y1 = std::min(y0 + tileSize, sampleBounds.pMax.y);
+            Bounds2i tileBounds(Point2i(x0, y0), Point2i(x1, y1));
+            LOG(INFO) << "Starting wavefront tile " << tileBounds;
+            std::unique_ptr<FilmTile> filmTile =
+                camera->film->GetFilmTile(tileBounds);
+
+            // Get a sampler instance for each pixel in the tile; every path
+            // then consumes sample dimensions in the same order as it would
+            // in PathIntegrator::Li()
+            std::vector<Point2i> pixels;
+            std::vector<std::unique_ptr<Sampler>> pixelSamplers;
+            for (Point2i pixel : tileBounds) {
+                int seed = (pixel.y - sampleBounds.pMin.y) * sampleExtent.x +
+                           (pixel.x - sampleBounds.pMin.x);
+                std::unique_ptr<Sampler> pixelSampler = sampler->Clone(seed);
+                {
+                    ProfilePhase pp(Prof::StartPixel);
+                    pixelSampler->StartPixel(pixel);
+                }
+                if (!InsideExclusive(pixel, pixelBounds)) continue;
+                pixels.push_back(pixel);
+                pixelSamplers.push_back(std::move(pixelSampler));
+            }
+
+            std::vector<WavefrontPath> paths(pixels.size());
+            bool moreSamples = !pixels.empty();
+            while (moreSamples) {
+                // Generate a wave of camera rays, one for each pixel
+                for (size_t i = 0; i < paths.size(); ++i) {
+                    WavefrontPath &path = paths[i];
+                    path.cameraSample =
+                        pixelSamplers[i]->GetCameraSample(pixels[i]);
+                    path.rayWeight = camera->GenerateRayDifferential(
+                        path.cameraSample, &path.ray);
+                    path.ray.ScaleDifferentials(
+                        1 / std::sqrt((Float)sampler->samplesPerPixel));
+                    path.L = Spectrum(0.f);
+                    path.beta = Spectrum(1.f);
+                    path.etaScale = 1;
+                    path.bounces = 0;
+                    path.specularBounce = false;
+                    path.active = path.rayWeight > 0;
+                    path.haveAOVSample = false;
+                    ++nWavefrontCameraRays;
+                }
+
+                TraceWave(scene, paths, pixelSamplers, arena);
+
+                // Add the wave's contributions to the image
+                for (size_t i = 0; i < paths.size(); ++i) {
+                    WavefrontPath &path = paths[i];
+                    Spectrum L = path.L;
+                    if (L.HasNaNs() || L.y() < -1e-5 || std::isinf(L.y())) {
+                        LOG(ERROR) << StringPrintf(
+                            "Bad radiance value returned for pixel (%d, %d), "
+                            "sample %d. Setting to black.", pixels[i].x,
+                            pixels[i].y,
+                            (int)pixelSamplers[i]->CurrentSampleNumber());
+                        L = Spectrum(0.f);
+                    }
+                    Float rayWeight = ignoreRayWeight ? 1 : path.rayWeight;
+                    filmTile->AddSample(path.cameraSample.pFilm, L, rayWeight);
+                    if (path.haveAOVSample)
+                        filmTile->AddAOVSample(path.cameraSample.pFilm,
+                                               path.aovSample);
+                }
+
+                // All pixels share _samplesPerPixel_, so they finish together
+                for (std::unique_ptr<Sampler> &pixelSampler : pixelSamplers)
+                    moreSamples = pixelSampler->StartNextSample();
+            }
+            LOG(INFO) << "Finished wavefront tile " << tileBounds;
+
+            // Merge image tile into _Film_
+            camera->film->MergeFilmTile(std::move(filmTile));
+            reporter.Update();
+        }, nTiles);
+        reporter.Done();
+    }
+    LOG(INFO) << "Rendering finished";
+
+    // Save final image after rendering
+    camera->film->WriteImage();
+}
+
+void WavefrontPathIntegrator::TraceWave(
+    const Scene &scene, std::vector<WavefrontPath> &paths,
+    std::vector<std::unique_ptr<Sampler>> &samplers,
+    MemoryArena &arena) const {
+    ProfilePhase p(Prof::SamplerIntegratorLi);
+    std::vector<int> active, shade;
+    std::vector<const Ray *> rays;
+    std::vector<SurfaceInteraction *> isects;
+    std::unique_ptr<bool[]> hits(new bool[paths.size()]);
+    while (true) {
+        // Gather the rays of the paths that are still active
+        active.clear();
+        rays.clear();
+        isects.clear();
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (!paths[i].active) continue;
+            paths[i].isect = SurfaceInteraction();
+            active.push_back(i);
+            rays.push_back(&paths[i].ray);
+            isects.push_back(&paths[i].isect);
+        }
+        if (active.empty()) break;
+
+        // Intersect the wave's rays with the scene as one stream
+        scene.IntersectBatch(active.size(), &rays[0], &isects[0], hits.get());
+        ReportValue(raysPerBatch, active.size());
+
+        // Add emitted light and retire paths that escaped or are too long
+        shade.clear();
+        for (size_t j = 0; j < active.size(); ++j) {
+            WavefrontPath &path = paths[active[j]];
+            bool foundIntersection = hits[j];
+            if (path.bounces == 0 && foundIntersection &&
+                !path.haveAOVSample && camera->film->HasAOVs()) {
+                ComputeAOVSample(path.ray, path.isect, *camera->film, arena,
+                                 &path.aovSample);
+                path.haveAOVSample = true;
+            }
+            if (path.bounces == 0 || path.specularBounce) {
+                if (foundIntersection)
+                    path.L += path.beta * path.isect.Le(-path.ray.d);
+                else
+                    for (const auto &light : scene.infiniteLights)
+                        path.L += path.beta * light->Le(path.ray);
+            }
+            if (!foundIntersection || path.bounces >= maxDepth)
+                path.active = false;
+            else
+                shade.push_back(active[j]);
+        }
+
+        // Shade hits grouped by material and by outgoing direction octant
+        if (sortByMaterial) {
+            auto octant = [](const Vector3f &d) {
+                return (d.x < 0) | ((d.y < 0) << 1) | ((d.z < 0) << 2);
+            };
+            std::sort(shade.begin(), shade.end(), [&](int a, int b) {
+                const Material *ma = paths[a].isect.primitive->GetMaterial();
+                const Material *mb = paths[b].isect.primitive->GetMaterial();
+                if (ma != mb) return ma < mb;
+                return octant(paths[a].ray.d) < octant(paths[b].ray.d);
+            });
+        }
+        for (int i : shade)
+            paths[i].active = Shade(paths[i], scene, *samplers[i], arena);
+
+        // All BSDFs of this bounce are dead once the next rays are spawned
+        arena.Reset();
+    }
+}
+
+bool WavefrontPathIntegrator::Shade(WavefrontPath &path, const Scene &scene,
+                                    Sampler &sampler,
+                                    MemoryArena &arena) const {
+    // This is the body of PathIntegrator::Li()'s bounce loop following
+    // intersection; it returns false when the path terminates.
+    SurfaceInteraction &isect = path.isect;
+    RayDifferential &ray = path.ray;
+    Spectrum &beta = path.beta;
+
+    // Compute scattering functions and skip over medium boundaries
+    isect.ComputeScatteringFunctions(ray, arena, true);
+    if (!isect.bsdf) {
+        ray = isect.SpawnRay(ray.d);
+        return true;
+    }
+    const Distribution1D *distrib = lightDistribution->Lookup(isect.p);
+
+    // Sample illumination from lights to find path contribution
+    if (isect.bsdf->NumComponents(BxDFType(BSDF_ALL & ~BSDF_SPECULAR)) > 0)
+        path.L += beta * UniformSampleOneLight(isect, scene, arena, sampler,
+                                               false, distrib);
+
+    // Sample BSDF to get new path direction
+    Vector3f wo = -ray.d, wi;
+    Float pdf;
+    BxDFType flags;
+    Spectrum f = isect.bsdf->Sample_f(wo, &wi, sampler.Get2D(), &pdf,
+                                      BSDF_ALL, &flags);
+    if (f.IsBlack() || pdf == 0.f) return false;
+    beta *= f * AbsDot(wi, isect.shading.n) / pdf;
+    path.specularBounce = (flags & BSDF_SPECULAR) != 0;
+    if ((flags & BSDF_SPECULAR) && (flags & BSDF_TRANSMISSION)) {
+        Float eta = isect.bsdf->eta;
+        path.etaScale *=
+            (Dot(wo, isect.n) > 0) ? (eta * eta) : 1 / (eta * eta);
+    }
+    ray = isect.SpawnRay(wi);
+
+    // Account for subsurface scattering, if applicable
+    if (isect.bssrdf && (flags & BSDF_TRANSMISSION)) {
+        SurfaceInteraction pi;
+        Spectrum S = isect.bssrdf->Sample_S(
+            scene, sampler.Get1D(), sampler.Get2D(), arena, &pi, &pdf);
+        if (S.IsBlack() || pdf == 0) return false;
+        beta *= S / pdf;
+        path.L += beta * UniformSampleOneLight(pi, scene, arena, sampler,
+                                               false,
+                                               lightDistribution->Lookup(pi.p));
+        Spectrum f = pi.bsdf->Sample_f(pi.wo, &wi, sampler.Get2D(), &pdf,
+                                       BSDF_ALL, &flags);
+        if (f.IsBlack() || pdf == 0) return false;
+        beta *= f * AbsDot(wi, pi.shading.n) / pdf;
+        path.specularBounce = (flags & BSDF_SPECULAR) != 0;
+        ray = pi.SpawnRay(wi);
+    }
+
+    // Possibly terminate the path with Russian roulette
+    Spectrum rrBeta = beta * path.etaScale;
+    if (rrBeta.MaxComponentValue() < rrThreshold && path.bounces > 3) {
+        Float q = std::max((Float).05, 1 - rrBeta.MaxComponentValue());
+        if (sampler.Get1D() < q) return false;
+        beta /= 1 - q;
+    }
+    ++path.bounces;
+    return true;
+}
+
+WavefrontPathIntegrator *CreateWavefrontPathIntegrator(
+    const ParamSet &params, std::shared_ptr<Sampler> sampler,
+    std::shared_ptr<const Camera> camera) {
+    int maxDepth = params.FindOneInt("maxdepth", 5);
+    int np;
+    const int *pb = params.FindInt("pixelbounds", &np);
+    Bounds2i pixelBounds = camera->film->GetSampleBounds();
+    if (pb) {
+        if (np != 4)
+            Error("Expected four values for \"pixelbounds\" parameter. Got %d.",
+                  np);
+        else {
+            pixelBounds = Intersect(pixelBounds,
+                                    Bounds2i{{pb[0], pb[2]}, {pb[1], pb[3]}});
+            if (pixelBounds.Area() == 0)
+                Error("Degenerate \"pixelbounds\" specified.");
+        }
+    }
+    Float rrThreshold = params.FindOneFloat("rrthreshold", 1.);
+    std::string lightStrategy =
+        params.FindOneString("lightsamplestrategy", "spatial");
+    int tileSize = std::max(1, params.FindOneInt("tilesize", 32));
+    bool sortByMaterial = params.FindOneBool("sortbymaterial", true);
+    return new WavefrontPathIntegrator(maxDepth, camera, sampler, pixelBounds,
+                                       rrThreshold, lightStrategy, tileSize,
+                                       sortByMaterial);
+}
+
+}  // namespace pbrt
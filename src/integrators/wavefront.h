@@ -0,0 +1,85 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_INTEGRATORS_WAVEFRONT_H
+#define PBRT_INTEGRATORS_WAVEFRONT_H
+
+// integrators/wavefront.h*
+#include "pbrt.h"
+#include "integrators/path.h"
+
+namespace pbrt {
+
+// WavefrontPathIntegrator Forward Declarations
+struct WavefrontPath;
+
+// WavefrontPathIntegrator Declarations
+// WavefrontPathIntegrator computes the same estimate as PathIntegrator, but
+// advances all of a tile's paths one bounce at a time: each bounce's rays
+// are intersected as a single stream and the hits are shaded in material
+// order, rather than following each path to completion before starting
+// the next.
+class WavefrontPathIntegrator : public PathIntegrator {
+  public:
+    // WavefrontPathIntegrator Public Methods
+    WavefrontPathIntegrator(int maxDepth, std::shared_ptr<const Camera> camera,
+                            std::shared_ptr<Sampler> sampler,
+                            const Bounds2i &pixelBounds, Float rrThreshold,
+                            const std::string &lightSampleStrategy,
+                            int tileSize, bool sortByMaterial);
+    void Render(const Scene &scene);
+
+  private:
+    // WavefrontPathIntegrator Private Methods
+    void TraceWave(const Scene &scene, std::vector<WavefrontPath> &paths,
+                   std::vector<std::unique_ptr<Sampler>> &samplers,
+                   MemoryArena &arena) const;
+    bool Shade(WavefrontPath &path, const Scene &scene, Sampler &sampler,
+               MemoryArena &arena) const;
+
+    // WavefrontPathIntegrator Private Data
+    const int tileSize;
+    const bool sortByMaterial;
+};
+
+WavefrontPathIntegrator *CreateWavefrontPathIntegrator(
+    const ParamSet &params, std::shared_ptr<Sampler> sampler,
+    std::shared_ptr<const Camera> camera);
+
+}  // namespace pbrt
+
+#endif  // PBRT_INTEGRATORS_WAVEFRONT_H
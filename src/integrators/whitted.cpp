@@ -43,7 +43,7 @@ namespace pbrt {
 // WhittedIntegrator Method Definitions
 Spectrum WhittedIntegrator::Li(const RayDifferential &ray, const Scene &scene,
                                Sampler &sampler, MemoryArena &arena,
-                               int depth) const {
+                               int depth, AOVSample *aovSample) const {
     Spectrum L(0.);
     // Find closest ray intersection or return background radiance
     SurfaceInteraction isect;
@@ -51,6 +51,8 @@ Spectrum WhittedIntegrator::Li(const RayDifferential &ray, const Scene &scene,
         for (const auto &light : scene.lights) L += light->Le(ray);
         return L;
     }
+    if (aovSample)
+        ComputeAOVSample(ray, isect, *camera->film, arena, aovSample);
 
     // Compute emitted and reflected light at ray intersection point
 
@@ -61,7 +63,8 @@ Spectrum WhittedIntegrator::Li(const RayDifferential &ray, const Scene &scene,
     // Compute scattering functions for surface interaction
     isect.ComputeScatteringFunctions(ray, arena);
     if (!isect.bsdf)
-        return Li(isect.SpawnRay(ray.d), scene, sampler, arena, depth);
+        return Li(isect.SpawnRay(ray.d), scene, sampler, arena, depth,
+                  nullptr);
 
     // Compute emitted light if ray hit an area light source
     L += isect.Le(wo);
@@ -37,6 +37,11 @@
 #include "parser.h"
 #include "parallel.h"
 #include <glog/logging.h>
+#include <iostream>
+#ifdef PBRT_IS_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 using namespace pbrt;
 
@@ -47,12 +52,34 @@ static void usage(const char *msg = nullptr) {
     fprintf(stderr, R"(usage: pbrt [<options>] <filename.pbrt...>
 Rendering options:
   --cropwindow <x0,x1,y0,y1> Specify an image crop window.
+  --geometrybudget <MB> Maximum memory for paged triangle meshes that are
+                       resident at once. Default: 4096.
   --help               Print this help text.
+  --lazyshapes         Create triangle meshes, PLY meshes, subdivision
+                       surfaces and heightfields only once a ray reaches
+                       their bounds.
   --nthreads <num>     Use specified number of threads for rendering.
   --outfile <filename> Write the final image to the given filename.
+  --parallelinclude    Tokenize and convert the numeric data of Include'd
+                       files on all cores before parsing the scene.
+  --pagegeometry <dir> Write triangle meshes to a binary cache in the given
+                       directory and load them on demand while rendering.
+  --ptexbudget <MB>    Maximum memory for the Ptex texture cache, unless a
+                       Ptex texture's "budget" parameter sets it.
+                       Default: 4096.
   --quick              Automatically reduce a number of quality settings to
                        render more quickly.
   --quiet              Suppress all text output other than error messages.
+  --server             Keep the scene resident after rendering it and read
+                       further jobs from standard input. Each job is a block
+                       of Camera, Film, Sampler, Integrator, PixelFilter and
+                       transformation statements followed by a line holding
+                       just "Render"; a line holding "Quit" exits. With the
+                       "twolevel" accelerator, "InstanceTransform <id>" in a
+                       job moves the object instance with that metadata ID
+                       to the current transformation.
+  --texturebudget <MB> Maximum memory for the tiles of tiled (.txp) image
+                       textures that are resident at once. Default: 1024.
 
 Logging options:
   --logdir <dir>       Specify directory that log files should be written to.
@@ -68,6 +95,9 @@ Reformatting options:
   --toply              Print a reformatted version of the input file(s) to
                        standard output and convert all triangle meshes to
                        PLY files. Does not render an image.
+  --tobinary           Write the input file, with all included files inlined,
+                       to standard output in pbrt's binary scene format.
+                       Does not render an image.
 )");
     exit(msg ? 1 : 0);
 }
@@ -100,6 +130,37 @@ int main(int argc, char *argv[]) {
             options.cropWindow[1][1] = atof(argv[++i]);
         } else if (!strncmp(argv[i], "--outfile=", 10)) {
             options.imageFile = &argv[i][10];
+        } else if (!strcmp(argv[i], "--pagegeometry") ||
+                   !strcmp(argv[i], "-pagegeometry")) {
+            if (i + 1 == argc)
+                usage("missing value after --pagegeometry argument");
+            options.geometryCacheDir = argv[++i];
+        } else if (!strncmp(argv[i], "--pagegeometry=", 15)) {
+            options.geometryCacheDir = &argv[i][15];
+        } else if (!strcmp(argv[i], "--geometrybudget") ||
+                   !strcmp(argv[i], "-geometrybudget")) {
+            if (i + 1 == argc)
+                usage("missing value after --geometrybudget argument");
+            options.geometryBudgetMB = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--geometrybudget=", 17)) {
+            options.geometryBudgetMB = atoi(&argv[i][17]);
+        } else if (!strcmp(argv[i], "--texturebudget") ||
+                   !strcmp(argv[i], "-texturebudget")) {
+            if (i + 1 == argc)
+                usage("missing value after --texturebudget argument");
+            options.textureBudgetMB = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--texturebudget=", 16)) {
+            options.textureBudgetMB = atoi(&argv[i][16]);
+        } else if (!strcmp(argv[i], "--ptexbudget") ||
+                   !strcmp(argv[i], "-ptexbudget")) {
+            if (i + 1 == argc)
+                usage("missing value after --ptexbudget argument");
+            options.ptexBudgetMB = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--ptexbudget=", 13)) {
+            options.ptexBudgetMB = atoi(&argv[i][13]);
+        } else if (!strcmp(argv[i], "--lazyshapes") ||
+                   !strcmp(argv[i], "-lazyshapes")) {
+            options.lazyShapes = true;
         } else if (!strcmp(argv[i], "--logdir") || !strcmp(argv[i], "-logdir")) {
             if (i + 1 == argc)
                 usage("missing value after --logdir argument");
@@ -113,14 +174,22 @@ int main(int argc, char *argv[]) {
             FLAGS_minloglevel = atoi(argv[++i]);
         } else if (!strncmp(argv[i], "--minloglevel=", 14)) {
             FLAGS_minloglevel = atoi(&argv[i][14]);
+        } else if (!strcmp(argv[i], "--parallelinclude") ||
+                   !strcmp(argv[i], "-parallelinclude")) {
+            options.parallelInclude = true;
         } else if (!strcmp(argv[i], "--quick") || !strcmp(argv[i], "-quick")) {
             options.quickRender = true;
         } else if (!strcmp(argv[i], "--quiet") || !strcmp(argv[i], "-quiet")) {
             options.quiet = true;
+        } else if (!strcmp(argv[i], "--server") || !strcmp(argv[i], "-server")) {
+            options.server = true;
         } else if (!strcmp(argv[i], "--cat") || !strcmp(argv[i], "-cat")) {
             options.cat = true;
         } else if (!strcmp(argv[i], "--toply") || !strcmp(argv[i], "-toply")) {
             options.toPly = true;
+        } else if (!strcmp(argv[i], "--tobinary") ||
+                   !strcmp(argv[i], "-tobinary")) {
+            options.toBinary = true;
         } else if (!strcmp(argv[i], "--v") || !strcmp(argv[i], "-v")) {
             if (i + 1 == argc)
                 usage("missing value after --v argument");
@@ -138,6 +207,21 @@ int main(int argc, char *argv[]) {
             filenames.push_back(argv[i]);
     }
 
+    if (options.toBinary) {
+        // Convert the scene without going through the pbrt API
+        if (filenames.size() > 1)
+            usage("--tobinary only takes a single scene file");
+#ifdef PBRT_IS_WINDOWS
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        std::string filename = filenames.empty() ? "-" : filenames[0];
+        return ConvertSceneToBinary(filename, stdout) ? 0 : 1;
+    }
+    if (options.server && (options.cat || options.toPly))
+        usage("--server can't be combined with --cat or --toply");
+    if (options.server && filenames.empty())
+        usage("--server requires a scene file; jobs are read from stdin");
+
     // Print welcome banner
     if (!options.quiet && !options.cat && !options.toPly) {
         if (sizeof(void *) == 4)
@@ -168,6 +252,24 @@ int main(int argc, char *argv[]) {
         for (const std::string &f : filenames)
             pbrtParseFile(f);
     }
+    if (options.server) {
+        // Render jobs from standard input against the resident scene
+        std::string job, line;
+        int jobIndex = 0;
+        while (std::getline(std::cin, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line == "Quit")
+                break;
+            else if (line == "Render") {
+                pbrtParseString(job);
+                pbrtRenderResidentScene();
+                job.clear();
+                printf("pbrt: job %d done\n", ++jobIndex);
+                fflush(stdout);
+            } else
+                job += line + "\n";
+        }
+    }
     pbrtCleanup();
     return 0;
 }
@@ -35,6 +35,8 @@
 #include "shapes/triangle.h"
 #include "textures/constant.h"
 #include "paramset.h"
+#include "fileutil.h"
+#include "stats.h"
 #include "ext/rply.h"
 
 #include <iostream>
@@ -154,11 +156,348 @@ int rply_face_callback(p_ply_argument argument) {
     return 1;
 }
 
+// Memory-mapped loading of binary little-endian PLY files. rply invokes a
+// callback for every scalar in the file, which dominates load time for
+// large meshes; for the common fixed layouts (float vertex properties and
+// "list uchar int" faces) we instead map the file and read the vertex and
+// face blocks directly. Anything else is left to rply.
+STAT_COUNTER("Scene/PLY files loaded via memory map", nMappedPLYFiles);
+
+struct MappedPLYMesh {
+    std::vector<Point3f> p;
+    std::vector<Normal3f> n;
+    std::vector<Point2f> uv;
+    std::vector<int> indices, faceIndices;
+};
+
+static int plyTypeSize(const std::string &type) {
+    if (type == "char" || type == "uchar" || type == "int8" ||
+        type == "uint8")
+        return 1;
+    if (type == "short" || type == "ushort" || type == "int16" ||
+        type == "uint16")
+        return 2;
+    if (type == "int" || type == "uint" || type == "int32" ||
+        type == "uint32" || type == "float" || type == "float32")
+        return 4;
+    if (type == "double" || type == "float64") return 8;
+    return 0;
+}
+
+static bool isPLYFloat(const std::string &type) {
+    return type == "float" || type == "float32";
+}
+
+static bool isPLYInt32(const std::string &type) {
+    return type == "int" || type == "uint" || type == "int32" ||
+           type == "uint32";
+}
+
+// Layout of a binary little-endian PLY file that the memory-mapped loader
+// can read directly. Property offsets are in bytes within a vertex record
+// and are -1 if the property isn't present.
+struct MappedPLYLayout {
+    long vertexCount, faceCount;
+    int vertexStride;
+    int px, py, pz, nx, ny, nz, u, v;
+    bool haveFaceIndices;
+    const char *vertexData;
+};
+
+// Parses the ASCII header at the start of a PLY file. Returns false if the
+// file isn't in a layout handled by the memory-mapped loader, in which case
+// the caller should fall back to rply.
+static bool ParseMappedPLYHeader(const char *data, const char *end,
+                                 MappedPLYLayout *layout) {
+    // The vertex and index data are read as-is, so the host has to be
+    // little-endian.
+    const uint32_t one = 1;
+    uint8_t firstByte;
+    memcpy(&firstByte, &one, 1);
+    if (firstByte != 1) return false;
+
+    struct VertexProperty {
+        std::string name;
+        int offset;
+        bool isFloat;
+    };
+    std::vector<VertexProperty> vertexProps;
+    int vertexStride = 0;
+    long vertexCount = -1, faceCount = -1;
+    bool vertexFirst = false, haveFaceList = false, haveFaceIndices = false;
+    bool binaryLE = false;
+    std::string currentElement;
+    const char *pos = data;
+    if (end - data < 4 || strncmp(data, "ply", 3) != 0) return false;
+    while (true) {
+        const char *eol =
+            (const char *)memchr(pos, '\n', size_t(end - pos));
+        if (!eol) return false;
+        std::string line(pos, eol);
+        pos = eol + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::vector<std::string> words;
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t space = line.find(' ', start);
+            if (space == std::string::npos) space = line.size();
+            if (space > start) words.push_back(line.substr(start, space - start));
+            start = space + 1;
+        }
+        if (words.empty()) continue;
+
+        if (words[0] == "end_header")
+            break;
+        else if (words[0] == "ply" || words[0] == "comment" ||
+                 words[0] == "obj_info")
+            continue;
+        else if (words[0] == "format") {
+            if (words.size() != 3 || words[1] != "binary_little_endian" ||
+                words[2] != "1.0")
+                return false;
+            binaryLE = true;
+        } else if (words[0] == "element") {
+            if (words.size() != 3) return false;
+            currentElement = words[1];
+            long count = atol(words[2].c_str());
+            if (currentElement == "vertex") {
+                vertexCount = count;
+                vertexFirst = (faceCount == -1);
+            } else if (currentElement == "face")
+                faceCount = count;
+            else
+                return false;
+        } else if (words[0] == "property") {
+            if (currentElement == "vertex") {
+                if (words.size() != 3) return false;
+                int size = plyTypeSize(words[1]);
+                if (size == 0) return false;
+                vertexProps.push_back(
+                    {words[2], vertexStride, isPLYFloat(words[1])});
+                vertexStride += size;
+            } else if (currentElement == "face") {
+                if (words.size() == 5 && words[1] == "list" &&
+                    words[4] == "vertex_indices" && !haveFaceList &&
+                    !haveFaceIndices &&
+                    (words[2] == "uchar" || words[2] == "uint8") &&
+                    isPLYInt32(words[3]))
+                    haveFaceList = true;
+                else if (words.size() == 3 && words[2] == "face_indices" &&
+                         haveFaceList && isPLYInt32(words[1]))
+                    haveFaceIndices = true;
+                else
+                    return false;
+            } else
+                return false;
+        } else
+            return false;
+    }
+    if (!binaryLE || !vertexFirst || vertexCount <= 0 || faceCount <= 0 ||
+        !haveFaceList)
+        return false;
+
+    // Find the vertex properties that we use; all of them must be floats.
+    auto findProperty = [&](const char *name) {
+        for (const VertexProperty &prop : vertexProps)
+            if (prop.name == name) return prop.isFloat ? prop.offset : -2;
+        return -1;
+    };
+    int px = findProperty("x"), py = findProperty("y"), pz = findProperty("z");
+    int nx = findProperty("nx"), ny = findProperty("ny"),
+        nz = findProperty("nz");
+    int u = -1, v = -1;
+    const char *uvNames[][2] = {
+        {"u", "v"}, {"s", "t"}, {"texture_u", "texture_v"},
+        {"texture_s", "texture_t"}};
+    for (const auto &uvName : uvNames) {
+        u = findProperty(uvName[0]);
+        v = findProperty(uvName[1]);
+        if (u != -1 && v != -1) break;
+    }
+    if (px < 0 || py < 0 || pz < 0 || nx == -2 || ny == -2 || nz == -2 ||
+        u == -2 || v == -2)
+        return false;
+
+    *layout = {vertexCount, faceCount, vertexStride, px, py, pz, nx, ny, nz,
+               u, v, haveFaceIndices, pos};
+    return true;
+}
+
+// Returns false if the file isn't in a layout handled here, in which case
+// the caller should fall back to rply. Otherwise returns true and sets
+// *error if the file turned out to be malformed.
+static bool LoadMappedPLY(const std::string &filename, MappedPLYMesh *mesh,
+                          bool *error) {
+    std::unique_ptr<MappedFile> file = MappedFile::Open(filename);
+    if (!file) {
+        *error = true;
+        return true;
+    }
+    const char *end = file->Data() + file->Size();
+    MappedPLYLayout layout;
+    if (!ParseMappedPLYHeader(file->Data(), end, &layout)) return false;
+    long vertexCount = layout.vertexCount, faceCount = layout.faceCount;
+    int vertexStride = layout.vertexStride;
+    int px = layout.px, py = layout.py, pz = layout.pz;
+    int nx = layout.nx, ny = layout.ny, nz = layout.nz, u = layout.u,
+        v = layout.v;
+    bool haveFaceIndices = layout.haveFaceIndices;
+    bool hasNormals = nx >= 0 && ny >= 0 && nz >= 0;
+    bool hasUV = u >= 0 && v >= 0;
+    const char *pos = layout.vertexData;
+
+    if (size_t(end - pos) < size_t(vertexCount) * vertexStride) {
+        Error("%s: PLY file is truncated in the vertex data.",
+              filename.c_str());
+        *error = true;
+        return true;
+    }
+
+    // Read the vertex block.
+    auto readFloat = [](const char *p) {
+        float f;
+        memcpy(&f, p, sizeof(float));
+        return f;
+    };
+    mesh->p.resize(vertexCount);
+    static_assert(sizeof(Point3f) == 3 * sizeof(Float) &&
+                      std::is_standard_layout<Point3f>::value,
+                  "Point3f must be three packed Floats for the bulk copy");
+    if (std::is_same<Float, float>::value && vertexStride == 3 * sizeof(float) &&
+        px == 0 && py == 4 && pz == 8)
+        memcpy(&mesh->p[0].x, pos, vertexCount * vertexStride);
+    else
+        for (long i = 0; i < vertexCount; ++i) {
+            const char *vp = pos + i * vertexStride;
+            mesh->p[i] = Point3f(readFloat(vp + px), readFloat(vp + py),
+                                 readFloat(vp + pz));
+        }
+    if (hasNormals) {
+        mesh->n.resize(vertexCount);
+        for (long i = 0; i < vertexCount; ++i) {
+            const char *vp = pos + i * vertexStride;
+            mesh->n[i] = Normal3f(readFloat(vp + nx), readFloat(vp + ny),
+                                  readFloat(vp + nz));
+        }
+    }
+    if (hasUV) {
+        mesh->uv.resize(vertexCount);
+        for (long i = 0; i < vertexCount; ++i) {
+            const char *vp = pos + i * vertexStride;
+            mesh->uv[i] = Point2f(readFloat(vp + u), readFloat(vp + v));
+        }
+    }
+    pos += vertexCount * vertexStride;
+
+    // Read the faces; each one is a one-byte count followed by that many
+    // 32-bit indices and an optional face index.
+    mesh->indices.reserve(3 * faceCount);
+    if (haveFaceIndices) mesh->faceIndices.reserve(faceCount);
+    for (long f = 0; f < faceCount; ++f) {
+        if (pos == end) {
+            Error("%s: PLY file is truncated in the face data.",
+                  filename.c_str());
+            *error = true;
+            return true;
+        }
+        int length = (uint8_t)*pos++;
+        size_t recordSize = 4 * (length + (haveFaceIndices ? 1 : 0));
+        if (size_t(end - pos) < recordSize) {
+            Error("%s: PLY file is truncated in the face data.",
+                  filename.c_str());
+            *error = true;
+            return true;
+        }
+        int face[4];
+        if (length == 3 || length == 4) {
+            memcpy(face, pos, 4 * length);
+            for (int i = 0; i < length; ++i)
+                if (face[i] < 0 || face[i] >= vertexCount) {
+                    Error(
+                        "plymesh: Vertex reference %i is out of bounds! "
+                        "Valid range is [0..%i)",
+                        face[i], int(vertexCount));
+                    *error = true;
+                    return true;
+                }
+            mesh->indices.insert(mesh->indices.end(), face, face + 3);
+            if (length == 4) {
+                if (haveFaceIndices) {
+                    Error("%s: face_indices not yet supported for quads",
+                          filename.c_str());
+                    *error = true;
+                    return true;
+                }
+                mesh->indices.push_back(face[3]);
+                mesh->indices.push_back(face[0]);
+                mesh->indices.push_back(face[2]);
+            }
+            if (haveFaceIndices) {
+                int faceIndex;
+                memcpy(&faceIndex, pos + 4 * length, sizeof(int));
+                mesh->faceIndices.push_back(faceIndex);
+            }
+        } else
+            Warning("plymesh: Ignoring face with %i vertices (only triangles "
+                    "and quads are supported!)",
+                    length);
+        pos += recordSize;
+    }
+
+    ++nMappedPLYFiles;
+    return true;
+}
+
+static void LookupAlphaTextures(
+    const ParamSet &params,
+    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures,
+    std::shared_ptr<Texture<Float>> *alphaTex,
+    std::shared_ptr<Texture<Float>> *shadowAlphaTex) {
+    std::string alphaTexName = params.FindTexture("alpha");
+    if (alphaTexName != "") {
+        if (floatTextures->find(alphaTexName) != floatTextures->end())
+            *alphaTex = (*floatTextures)[alphaTexName];
+        else
+            Error("Couldn't find float texture \"%s\" for \"alpha\" parameter",
+                  alphaTexName.c_str());
+    } else if (params.FindOneFloat("alpha", 1.f) == 0.f) {
+        alphaTex->reset(new ConstantTexture<Float>(0.f));
+    }
+
+    std::string shadowAlphaTexName = params.FindTexture("shadowalpha");
+    if (shadowAlphaTexName != "") {
+        if (floatTextures->find(shadowAlphaTexName) != floatTextures->end())
+            *shadowAlphaTex = (*floatTextures)[shadowAlphaTexName];
+        else
+            Error(
+                "Couldn't find float texture \"%s\" for \"shadowalpha\" "
+                "parameter",
+                shadowAlphaTexName.c_str());
+    } else if (params.FindOneFloat("shadowalpha", 1.f) == 0.f)
+        shadowAlphaTex->reset(new ConstantTexture<Float>(0.f));
+}
+
 std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
     const Transform *o2w, const Transform *w2o, bool reverseOrientation,
     const ParamSet &params,
     std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures) {
     const std::string filename = params.FindOneFilename("filename", "");
+
+    MappedPLYMesh mapped;
+    bool mappedError = false;
+    if (LoadMappedPLY(filename, &mapped, &mappedError)) {
+        if (mappedError) return std::vector<std::shared_ptr<Shape>>();
+        std::shared_ptr<Texture<Float>> alphaTex, shadowAlphaTex;
+        LookupAlphaTextures(params, floatTextures, &alphaTex, &shadowAlphaTex);
+        return CreateTriangleMesh(
+            o2w, w2o, reverseOrientation, mapped.indices.size() / 3,
+            mapped.indices.data(), mapped.p.size(), mapped.p.data(), nullptr,
+            mapped.n.empty() ? nullptr : mapped.n.data(),
+            mapped.uv.empty() ? nullptr : mapped.uv.data(), alphaTex,
+            shadowAlphaTex,
+            mapped.faceIndices.empty() ? nullptr : mapped.faceIndices.data());
+    }
+
     p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
     if (!ply) {
         Error("Couldn't open PLY file \"%s\"", filename.c_str());
@@ -256,31 +595,8 @@ std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
 
     if (context.error) return std::vector<std::shared_ptr<Shape>>();
 
-    // Look up an alpha texture, if applicable
-    std::shared_ptr<Texture<Float>> alphaTex;
-    std::string alphaTexName = params.FindTexture("alpha");
-    if (alphaTexName != "") {
-        if (floatTextures->find(alphaTexName) != floatTextures->end())
-            alphaTex = (*floatTextures)[alphaTexName];
-        else
-            Error("Couldn't find float texture \"%s\" for \"alpha\" parameter",
-                  alphaTexName.c_str());
-    } else if (params.FindOneFloat("alpha", 1.f) == 0.f) {
-        alphaTex.reset(new ConstantTexture<Float>(0.f));
-    }
-
-    std::shared_ptr<Texture<Float>> shadowAlphaTex;
-    std::string shadowAlphaTexName = params.FindTexture("shadowalpha");
-    if (shadowAlphaTexName != "") {
-        if (floatTextures->find(shadowAlphaTexName) != floatTextures->end())
-            shadowAlphaTex = (*floatTextures)[shadowAlphaTexName];
-        else
-            Error(
-                "Couldn't find float texture \"%s\" for \"shadowalpha\" "
-                "parameter",
-                shadowAlphaTexName.c_str());
-    } else if (params.FindOneFloat("shadowalpha", 1.f) == 0.f)
-        shadowAlphaTex.reset(new ConstantTexture<Float>(0.f));
+    std::shared_ptr<Texture<Float>> alphaTex, shadowAlphaTex;
+    LookupAlphaTextures(params, floatTextures, &alphaTex, &shadowAlphaTex);
 
     return CreateTriangleMesh(o2w, w2o, reverseOrientation,
                               context.indexCtr / 3, context.indices,
@@ -289,4 +605,52 @@ std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
                               context.faceIndices);
 }
 
+bool PLYMeshBounds(const std::string &filename, Bounds3f *bounds) {
+    *bounds = Bounds3f();
+    std::unique_ptr<MappedFile> file = MappedFile::Open(filename);
+    if (!file) return false;
+    const char *end = file->Data() + file->Size();
+    MappedPLYLayout layout;
+    if (ParseMappedPLYHeader(file->Data(), end, &layout)) {
+        if (size_t(end - layout.vertexData) <
+            size_t(layout.vertexCount) * layout.vertexStride)
+            return false;
+        for (long i = 0; i < layout.vertexCount; ++i) {
+            const char *vp = layout.vertexData + i * layout.vertexStride;
+            float p[3];
+            memcpy(&p[0], vp + layout.px, sizeof(float));
+            memcpy(&p[1], vp + layout.py, sizeof(float));
+            memcpy(&p[2], vp + layout.pz, sizeof(float));
+            *bounds = Union(*bounds, Point3f(p[0], p[1], p[2]));
+        }
+        return true;
+    }
+
+    // Otherwise read just the vertex positions using rply.
+    p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
+    if (!ply) return false;
+    if (!ply_read_header(ply)) {
+        ply_close(ply);
+        return false;
+    }
+    // rply_vertex_callback() looks up its output buffer through the user
+    // data pointer, so the buffer can be allocated once the vertex count is
+    // known.
+    Float *buffers[1] = {nullptr};
+    long vertexCount = ply_set_read_cb(ply, "vertex", "x", rply_vertex_callback,
+                                       buffers, 0x030);
+    std::unique_ptr<Point3f[]> p(new Point3f[vertexCount]);
+    buffers[0] = (Float *)p.get();
+    bool ok = vertexCount > 0 &&
+              ply_set_read_cb(ply, "vertex", "y", rply_vertex_callback,
+                              buffers, 0x031) &&
+              ply_set_read_cb(ply, "vertex", "z", rply_vertex_callback,
+                              buffers, 0x032) &&
+              ply_read(ply);
+    ply_close(ply);
+    if (!ok) return false;
+    for (long i = 0; i < vertexCount; ++i) *bounds = Union(*bounds, p[i]);
+    return true;
+}
+
 }  // namespace pbrt
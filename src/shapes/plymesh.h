@@ -49,6 +49,10 @@ std::vector<std::shared_ptr<Shape>> CreatePLYMesh(
     std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures =
         nullptr);
 
+// Computes the object-space bounds of a PLY file's vertices without
+// creating the mesh. Returns false if the file couldn't be read.
+bool PLYMeshBounds(const std::string &filename, Bounds3f *bounds);
+
 }  // namespace pbrt
 
 #endif  // PBRT_SHAPES_PLYMESH_H
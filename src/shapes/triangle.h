@@ -85,6 +85,7 @@ class Triangle : public Shape {
                    bool testAlphaTexture = true) const;
     bool IntersectP(const Ray &ray, bool testAlphaTexture = true) const;
     Float Area() const;
+    const std::shared_ptr<TriangleMesh> &GetMesh() const { return mesh; }
 
     using Shape::Sample;  // Bring in the other Sample() overload.
     Interaction Sample(const Point2f &u, Float *pdf) const;
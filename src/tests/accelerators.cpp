@@ -0,0 +1,417 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+
+#include "accelerators/bvh.h"
+#include "accelerators/kdtreeaccel.h"
+#include "accelerators/lazy.h"
+#include "accelerators/pagedmesh.h"
+#include "accelerators/twolevel.h"
+#include "interaction.h"
+#include "materials/matte.h"
+#include "parallel.h"
+#include "rng.h"
+#include "shapes/sphere.h"
+#include "shapes/triangle.h"
+#include "stats.h"
+#include "textures/constant.h"
+
+using namespace pbrt;
+
+static std::shared_ptr<Primitive> MakeUnitSphere() {
+    static Transform id;
+    std::shared_ptr<Shape> sphere =
+        std::make_shared<Sphere>(&id, &id, false, 1, -1, 1, 360);
+    std::shared_ptr<Texture<Spectrum>> Kd =
+        std::make_shared<ConstantTexture<Spectrum>>(Spectrum(0.5));
+    std::shared_ptr<Texture<Float>> sigma =
+        std::make_shared<ConstantTexture<Float>>(0.);
+    std::shared_ptr<Material> material =
+        std::make_shared<MatteMaterial>(Kd, sigma, nullptr);
+    return std::make_shared<GeometricPrimitive>(sphere, material, nullptr,
+                                                MediumInterface());
+}
+
+static bool HitsAlongX(const Primitive &prim, Float x) {
+    // Shoot a ray down the z axis at the given x offset
+    Ray ray(Point3f(x, 0, 10), Vector3f(0, 0, -1));
+    SurfaceInteraction isect;
+    return prim.Intersect(ray, &isect);
+}
+
+TEST(TwoLevelAccel, RefitAfterInstanceMove) {
+    std::shared_ptr<Primitive> sphere = MakeUnitSphere();
+
+    std::vector<Transform> xforms;
+    for (int i = 0; i < 8; ++i) xforms.push_back(Translate(Vector3f(4 * i, 0, 0)));
+    Transform moved = Translate(Vector3f(-20, 0, 0));
+
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (int i = 0; i < 8; ++i)
+        prims.push_back(std::make_shared<TransformedPrimitive>(
+            sphere, AnimatedTransform(&xforms[i], 0, &xforms[i], 1), i + 1));
+    ParamSet ps;
+    std::shared_ptr<TwoLevelAccel> accel =
+        CreateTwoLevelAccelerator(std::move(prims), ps);
+    ASSERT_EQ(8, accel->NumInstances());
+
+    EXPECT_TRUE(HitsAlongX(*accel, 28));
+    EXPECT_FALSE(HitsAlongX(*accel, -20));
+
+    // Move the last instance; after a refit it should be found at its new
+    // location and no longer at the old one.
+    EXPECT_FALSE(accel->SetInstanceTransform(
+        9, AnimatedTransform(&moved, 0, &moved, 1)));
+    EXPECT_TRUE(accel->SetInstanceTransform(
+        8, AnimatedTransform(&moved, 0, &moved, 1)));
+    accel->Refit();
+    EXPECT_FALSE(HitsAlongX(*accel, 28));
+    EXPECT_TRUE(HitsAlongX(*accel, -20));
+    EXPECT_TRUE(HitsAlongX(*accel, 12));
+    EXPECT_EQ(-21, accel->WorldBound().pMin.x);
+}
+
+TEST(TwoLevelAccel, StaticGeometry) {
+    std::shared_ptr<Primitive> sphere = MakeUnitSphere();
+    Transform xform = Translate(Vector3f(5, 0, 0));
+
+    std::vector<std::shared_ptr<Primitive>> prims;
+    prims.push_back(MakeUnitSphere());
+    prims.push_back(std::make_shared<TransformedPrimitive>(
+        sphere, AnimatedTransform(&xform, 0, &xform, 1), 1));
+    ParamSet ps;
+    std::shared_ptr<TwoLevelAccel> accel =
+        CreateTwoLevelAccelerator(std::move(prims), ps);
+    EXPECT_EQ(1, accel->NumInstances());
+    EXPECT_TRUE(HitsAlongX(*accel, 0));
+    EXPECT_TRUE(HitsAlongX(*accel, 5));
+    EXPECT_FALSE(HitsAlongX(*accel, 2.5));
+}
+
+TEST(BVHAccel, IntersectBatchMatchesIntersect) {
+    // A jittered grid of instanced spheres, hit by rays from random
+    // origins in random directions.
+    RNG rng;
+    std::shared_ptr<Primitive> sphere = MakeUnitSphere();
+    std::vector<Transform> xforms;
+    for (int z = 0; z < 4; ++z)
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x)
+                xforms.push_back(Translate(Vector3f(
+                    3 * x + rng.UniformFloat(), 3 * y + rng.UniformFloat(),
+                    3 * z + rng.UniformFloat())));
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (size_t i = 0; i < xforms.size(); ++i)
+        prims.push_back(std::make_shared<TransformedPrimitive>(
+            sphere, AnimatedTransform(&xforms[i], 0, &xforms[i], 1), i + 1));
+    BVHAccel bvh(prims, 2);
+
+    const int nRays = 1000;
+    std::vector<Ray> rays, batchRays;
+    for (int i = 0; i < nRays; ++i) {
+        Point3f o(-5 + 20 * rng.UniformFloat(), -5 + 20 * rng.UniformFloat(),
+                  -5 + 20 * rng.UniformFloat());
+        Vector3f d(-1 + 2 * rng.UniformFloat(), -1 + 2 * rng.UniformFloat(),
+                   -1 + 2 * rng.UniformFloat());
+        rays.push_back(Ray(o, d));
+    }
+    batchRays = rays;
+
+    std::vector<SurfaceInteraction> isects(nRays), batchIsects(nRays);
+    std::vector<const Ray *> rayPtrs;
+    std::vector<SurfaceInteraction *> isectPtrs;
+    for (int i = 0; i < nRays; ++i) {
+        rayPtrs.push_back(&batchRays[i]);
+        isectPtrs.push_back(&batchIsects[i]);
+    }
+    std::unique_ptr<bool[]> hits(new bool[nRays]);
+    bvh.IntersectBatch(nRays, &rayPtrs[0], &isectPtrs[0], hits.get());
+
+    int nHits = 0;
+    for (int i = 0; i < nRays; ++i) {
+        bool hit = bvh.Intersect(rays[i], &isects[i]);
+        EXPECT_EQ(hit, hits[i]);
+        if (hit && hits[i]) {
+            ++nHits;
+            EXPECT_EQ(rays[i].tMax, batchRays[i].tMax);
+            EXPECT_EQ(isects[i].instanceId, batchIsects[i].instanceId);
+        }
+    }
+    EXPECT_GT(nHits, 0);
+}
+
+TEST(BVHAccel, CompressedNodesMatchUncompressed) {
+    RNG rng(7);
+    std::shared_ptr<Primitive> sphere = MakeUnitSphere();
+    std::vector<Transform> xforms;
+    for (int i = 0; i < 200; ++i)
+        xforms.push_back(Translate(Vector3f(100 * rng.UniformFloat(),
+                                            100 * rng.UniformFloat(),
+                                            100 * rng.UniformFloat())) *
+                         Scale(.1, .1, .1));
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (size_t i = 0; i < xforms.size(); ++i)
+        prims.push_back(std::make_shared<TransformedPrimitive>(
+            sphere, AnimatedTransform(&xforms[i], 0, &xforms[i], 1), i + 1));
+    BVHAccel bvh(prims, 1), compressed(prims, 1, BVHAccel::SplitMethod::SAH,
+                                       true);
+    EXPECT_EQ(bvh.WorldBound(), compressed.WorldBound());
+
+    auto check = [&](const char *when) {
+        RNG rayRng(11);
+        int nHits = 0;
+        for (int i = 0; i < 2000; ++i) {
+            // Aim each ray at one of the spheres so most of them hit
+            const Transform &target = xforms[rayRng.UniformUInt32(200)];
+            Point3f o(-10 + 120 * rayRng.UniformFloat(),
+                      -10 + 120 * rayRng.UniformFloat(),
+                      -10 + 120 * rayRng.UniformFloat());
+            Ray r0(o, target(Point3f(0, 0, 0)) - o), r1 = r0;
+            SurfaceInteraction i0, i1;
+            bool hit = bvh.Intersect(r0, &i0);
+            EXPECT_EQ(hit, compressed.Intersect(r1, &i1)) << when;
+            EXPECT_EQ(bvh.IntersectP(r0), compressed.IntersectP(r0)) << when;
+            if (hit) {
+                ++nHits;
+                EXPECT_EQ(r0.tMax, r1.tMax) << when;
+                EXPECT_EQ(i0.instanceId, i1.instanceId) << when;
+            }
+        }
+        EXPECT_GT(nHits, 1000) << when;
+    };
+    check("after build");
+
+    // Move every sphere and refit both hierarchies
+    for (size_t i = 0; i < xforms.size(); ++i) {
+        xforms[i] = Translate(Vector3f(0, 10, 0)) * xforms[i];
+        std::static_pointer_cast<TransformedPrimitive>(prims[i])
+            ->SetPrimitiveToWorld(
+                AnimatedTransform(&xforms[i], 0, &xforms[i], 1));
+    }
+    bvh.Refit();
+    compressed.Refit();
+    EXPECT_EQ(bvh.WorldBound(), compressed.WorldBound());
+    check("after refit");
+}
+
+// Returns instances of a small sphere scattered randomly over
+// [0,100]^3 with the given transformations, which are filled in.
+static std::vector<std::shared_ptr<Primitive>> RandomSpheres(
+    RNG &rng, std::vector<Transform> *xforms, int n) {
+    std::shared_ptr<Primitive> sphere = MakeUnitSphere();
+    for (int i = 0; i < n; ++i)
+        xforms->push_back(Translate(Vector3f(100 * rng.UniformFloat(),
+                                             100 * rng.UniformFloat(),
+                                             100 * rng.UniformFloat())) *
+                          Scale(.2, .2, .2));
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (int i = 0; i < n; ++i)
+        prims.push_back(std::make_shared<TransformedPrimitive>(
+            sphere, AnimatedTransform(&(*xforms)[i], 0, &(*xforms)[i], 1),
+            i + 1));
+    return prims;
+}
+
+TEST(KdTreeAccel, BinnedMatchesSweep) {
+    // Enough primitives that the binned builder hands subtrees to the
+    // worker threads.
+    ParallelInit();
+    RNG rng(3);
+    std::vector<Transform> xforms;
+    // Reserve up front so that the instances' pointers stay valid
+    xforms.reserve(6000);
+    std::vector<std::shared_ptr<Primitive>> prims =
+        RandomSpheres(rng, &xforms, 6000);
+    KdTreeAccel sweep(prims);
+    KdTreeAccel binned(prims, 80, 1, 0.5, 1, -1,
+                       KdTreeAccel::BuildMethod::Binned);
+    ParallelCleanup();
+    EXPECT_EQ(sweep.WorldBound(), binned.WorldBound());
+
+    int nHits = 0;
+    for (int i = 0; i < 2000; ++i) {
+        const Transform &target = xforms[rng.UniformUInt32(xforms.size())];
+        Point3f o(-10 + 120 * rng.UniformFloat(),
+                  -10 + 120 * rng.UniformFloat(),
+                  -10 + 120 * rng.UniformFloat());
+        Ray r0(o, target(Point3f(0, 0, 0)) - o), r1 = r0;
+        SurfaceInteraction i0, i1;
+        bool hit = sweep.Intersect(r0, &i0);
+        EXPECT_EQ(hit, binned.Intersect(r1, &i1));
+        EXPECT_EQ(sweep.IntersectP(r0), binned.IntersectP(r0));
+        if (hit) {
+            ++nHits;
+            EXPECT_EQ(r0.tMax, r1.tMax);
+            EXPECT_EQ(i0.instanceId, i1.instanceId);
+        }
+    }
+    EXPECT_GT(nHits, 1000);
+}
+
+// Returns the number of subtrees that the binned kd-tree builder handed to
+// the worker threads while building over _n_ primitives.
+// Returns the current value of the statistics counter with the given title
+// and clears all of them.
+static int64_t StatCount(const char *title) {
+    ReportThreadStats();
+    FILE *f = tmpfile();
+    PrintStats(f);
+    rewind(f);
+    char line[1024];
+    int64_t count = 0;
+    while (fgets(line, sizeof(line), f))
+        if (strstr(line, title)) count = atoll(strrchr(line, ' '));
+    fclose(f);
+    ClearStats();
+    return count;
+}
+
+static int64_t ParallelKdSubtrees(int n) {
+    // Flush and discard counts from earlier builds
+    ReportThreadStats();
+    ClearStats();
+    RNG rng(5);
+    std::vector<Transform> xforms;
+    xforms.reserve(n);
+    KdTreeAccel kdtree(RandomSpheres(rng, &xforms, n), 80, 1, 0.5, 1, -1,
+                       KdTreeAccel::BuildMethod::Binned);
+    return StatCount("Subtrees built in parallel");
+}
+
+TEST(KdTreeAccel, BinnedSubtreeTasks) {
+    ParallelInit();
+    // Small scenes are built serially, without any tasks for the (mostly
+    // empty or tiny) subtrees.
+    EXPECT_EQ(0, ParallelKdSubtrees(1000));
+    // In larger ones, only subtrees of a useful size become tasks.
+    int64_t nTasks = ParallelKdSubtrees(8000);
+    EXPECT_GT(nTasks, 0);
+    EXPECT_LT(nTasks, 2 * 8000 / 256);
+    ParallelCleanup();
+}
+
+TEST(PagedMesh, LoadOnDemandAndEvict) {
+    // Four unit quads side by side along x, each its own mesh.
+    std::shared_ptr<Material> material =
+        std::make_shared<MatteMaterial>(
+            std::make_shared<ConstantTexture<Spectrum>>(Spectrum(0.5)),
+            std::make_shared<ConstantTexture<Float>>(0.), nullptr);
+    std::vector<Transform> xforms, inverses;
+    for (int i = 0; i < 4; ++i) {
+        xforms.push_back(Translate(Vector3f(2 * i, 0, 0)));
+        inverses.push_back(Inverse(xforms[i]));
+    }
+    int indices[6] = {0, 1, 2, 0, 2, 3};
+    Point3f P[4] = {Point3f(-.5, -.5, 0), Point3f(.5, -.5, 0),
+                    Point3f(.5, .5, 0), Point3f(-.5, .5, 0)};
+    Point2f uv[4] = {Point2f(0, 0), Point2f(1, 0), Point2f(1, 1),
+                     Point2f(0, 1)};
+
+    // A one-byte budget only ever leaves the last mesh loaded resident.
+    std::shared_ptr<MeshPageCache> cache =
+        std::make_shared<MeshPageCache>(".", 1);
+    std::vector<std::shared_ptr<Primitive>> paged, eager;
+    for (int i = 0; i < 4; ++i) {
+        Transform *w2o = &inverses[i];
+        TriangleMesh mesh(xforms[i], 2, indices, 4, P, nullptr, nullptr, uv,
+                          nullptr, nullptr, nullptr);
+        std::shared_ptr<Primitive> prim = CreatePagedMesh(
+            cache, mesh, &xforms[i], w2o, false, material, MediumInterface());
+        ASSERT_TRUE(prim != nullptr);
+        paged.push_back(prim);
+        for (auto &tri : CreateTriangleMesh(&xforms[i], w2o, false, 2, indices,
+                                            4, P, nullptr, nullptr, uv,
+                                            nullptr, nullptr))
+            eager.push_back(std::make_shared<GeometricPrimitive>(
+                tri, material, nullptr, MediumInterface()));
+    }
+    BVHAccel pagedBVH(paged), eagerBVH(eager);
+    EXPECT_EQ(eagerBVH.WorldBound(), pagedBVH.WorldBound());
+    for (const auto &prim : paged)
+        EXPECT_FALSE(
+            std::static_pointer_cast<PagedMeshPrimitive>(prim)->IsResident());
+
+    RNG rng;
+    for (int i = 0; i < 200; ++i) {
+        Point3f o(-1 + 8 * rng.UniformFloat(), -1 + 2 * rng.UniformFloat(), 5);
+        Ray r0(o, Vector3f(0, 0, -1)), r1 = r0;
+        SurfaceInteraction i0, i1;
+        bool hit = eagerBVH.Intersect(r0, &i0);
+        EXPECT_EQ(hit, pagedBVH.Intersect(r1, &i1));
+        EXPECT_EQ(hit, pagedBVH.IntersectP(Ray(o, Vector3f(0, 0, -1))));
+        if (hit) {
+            EXPECT_EQ(r0.tMax, r1.tMax);
+            EXPECT_EQ(i0.uv, i1.uv);
+            EXPECT_EQ(i0.n, i1.n);
+        }
+    }
+
+    // Only the most recently used mesh can be resident.
+    int nResident = 0;
+    for (const auto &prim : paged)
+        nResident +=
+            std::static_pointer_cast<PagedMeshPrimitive>(prim)->IsResident();
+    EXPECT_EQ(1, nResident);
+}
+
+TEST(LazyPrimitive, CreatedOnceOnFirstHit) {
+    std::atomic<int> nCreated{0};
+    LazyPrimitive lazy(Bounds3f(Point3f(-1, -1, -1), Point3f(1, 1, 1)), [&]() {
+        ++nCreated;
+        return MakeUnitSphere();
+    });
+
+    // Rays that miss the bounds don't create the sphere.
+    EXPECT_FALSE(HitsAlongX(lazy, 5));
+    EXPECT_FALSE(lazy.IsCreated());
+    EXPECT_EQ(0, nCreated);
+
+    // Many threads reaching it at once create it exactly once.
+    ParallelInit();
+    std::atomic<int> nHits{0};
+    ParallelFor([&](int64_t i) {
+        if (HitsAlongX(lazy, 0.5f * (i % 2))) ++nHits;
+    }, 256, 1);
+    ParallelCleanup();
+    EXPECT_EQ(256, nHits);
+    EXPECT_EQ(1, nCreated);
+    EXPECT_TRUE(lazy.IsCreated());
+    EXPECT_FALSE(HitsAlongX(lazy, 1.5f));
+}
+
+TEST(PagedMesh, ThreadKeepsRecentMeshes) {
+    std::shared_ptr<Material> material =
+        std::make_shared<MatteMaterial>(
+            std::make_shared<ConstantTexture<Spectrum>>(Spectrum(0.5)),
+            std::make_shared<ConstantTexture<Float>>(0.), nullptr);
+    Transform xforms[2] = {Translate(Vector3f(0, 0, 0)),
+                           Translate(Vector3f(2, 0, 0))};
+    Transform inverses[2] = {Inverse(xforms[0]), Inverse(xforms[1])};
+    int indices[6] = {0, 1, 2, 0, 2, 3};
+    Point3f P[4] = {Point3f(-.5, -.5, 0), Point3f(.5, -.5, 0),
+                    Point3f(.5, .5, 0), Point3f(-.5, .5, 0)};
+
+    // With a one-byte budget, alternating between the two meshes evicts
+    // each one in turn...
+    std::shared_ptr<MeshPageCache> cache =
+        std::make_shared<MeshPageCache>(".", 1);
+    std::vector<std::shared_ptr<Primitive>> paged;
+    for (int i = 0; i < 2; ++i) {
+        TriangleMesh mesh(xforms[i], 2, indices, 4, P, nullptr, nullptr,
+                          nullptr, nullptr, nullptr, nullptr);
+        paged.push_back(CreatePagedMesh(cache, mesh, &xforms[i], &inverses[i],
+                                        false, material, MediumInterface()));
+        ASSERT_TRUE(paged.back() != nullptr);
+    }
+    // Flush and discard counts from creating the meshes
+    ReportThreadStats();
+    ClearStats();
+    for (int i = 0; i < 20; ++i) {
+        Ray r(Point3f(2 * (i & 1), 0, 5), Vector3f(0, 0, -1));
+        SurfaceInteraction isect;
+        EXPECT_TRUE(paged[i & 1]->Intersect(r, &isect));
+        EXPECT_EQ(5, r.tMax);
+    }
+    // ...but this thread keeps using the copies it already has.
+    EXPECT_EQ(2, StatCount("Mesh loads"));
+}
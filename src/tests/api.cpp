@@ -0,0 +1,431 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "api.h"
+#include "imageio.h"
+#include "spectrum.h"
+#include "stats.h"
+
+using namespace pbrt;
+
+// Camera and film statements for a small test render written to _filename_.
+static std::string testCamera(const std::string &filename) {
+    return "LookAt 0 0 5  0 0 0  0 1 0\n"
+           "Camera \"perspective\" \"float fov\" 40\n"
+           "Film \"image\" \"integer xresolution\" 24 "
+           "\"integer yresolution\" 24 \"bool spectralFlag\" \"false\" "
+           "\"string filename\" \"" +
+           filename +
+           "\"\n"
+           "Sampler \"halton\" \"integer pixelsamples\" 4\n"
+           "Integrator \"directlighting\"\n";
+}
+
+// A transformed shape and an object instance, so that the scene holds
+// transforms from the transform cache.
+static const char *testWorld = R"(
+WorldBegin
+LightSource "point" "point from" [0 2 5] "rgb I" [30 30 30]
+AttributeBegin
+  Translate 0.7 0 0
+  Scale 1 1.5 1
+  Shape "sphere" "float radius" 0.8
+AttributeEnd
+ObjectBegin "box"
+  Shape "trianglemesh" "integer indices" [0 1 2 0 2 3]
+      "point P" [-1 -1 0  1 -1 0  1 1 0  -1 1 0]
+ObjectEnd
+AttributeBegin
+  Translate -1 0.5 -1
+  Rotate 30 0 0 1
+  ObjectInstance "box"
+AttributeEnd
+WorldEnd
+)";
+
+static void expectSameImage(const std::string &a, const std::string &b) {
+    Point2i resA, resB;
+    std::unique_ptr<RGBSpectrum[]> imgA = ReadImage(a, &resA);
+    std::unique_ptr<RGBSpectrum[]> imgB = ReadImage(b, &resB);
+    ASSERT_TRUE(imgA && imgB);
+    ASSERT_EQ(resA, resB);
+    Float sum = 0;
+    for (int i = 0; i < resA.x * resA.y; ++i) {
+        EXPECT_EQ(imgA[i], imgB[i]) << a << " vs " << b << ", pixel " << i;
+        sum += imgA[i].y();
+    }
+    // Make sure that something was actually rendered.
+    EXPECT_GT(sum, 0);
+}
+
+TEST(API, ServerRendersResidentSceneAgain) {
+    Options opt;
+    opt.quiet = true;
+    opt.server = true;
+    pbrtInit(opt);
+    pbrtParseString(testCamera("server1.pfm") + testWorld);
+
+    // A second job against the resident scene, as read from stdin by
+    // pbrt --server; its camera transform is looked up in the transform
+    // cache after the scene was built.
+    pbrtParseString(testCamera("server2.pfm"));
+    pbrtRenderResidentScene();
+    pbrtCleanup();
+
+    expectSameImage("server1.pfm", "server2.pfm");
+    EXPECT_EQ(0, remove("server1.pfm"));
+    EXPECT_EQ(0, remove("server2.pfm"));
+}
+
+// A sphere and an instance of a quad placed by _instanceTransform_, built
+// with the two-level accelerator.
+static std::string instanceWorld(const std::string &instanceTransform) {
+    return "Accelerator \"twolevel\"\n"
+           "WorldBegin\n"
+           "LightSource \"point\" \"point from\" [0 2 5] "
+           "\"rgb I\" [30 30 30]\n"
+           "Shape \"sphere\" \"float radius\" 0.5\n"
+           "ObjectBegin \"box\"\n"
+           "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+           "\"point P\" [-1 -1 0  1 -1 0  1 1 0  -1 1 0]\n"
+           "ObjectEnd\n"
+           "AttributeBegin\n" +
+           instanceTransform +
+           "\nObjectInstance \"box\"\n"
+           "AttributeEnd\n"
+           "WorldEnd\n";
+}
+
+TEST(API, ServerMovesInstances) {
+    Options opt;
+    opt.quiet = true;
+    opt.server = true;
+    pbrtInit(opt);
+    pbrtParseString(testCamera("moved1.pfm") +
+                    instanceWorld("Translate -1 0.5 -1"));
+    // Move the quad up and to the side, past the scene's original bounds
+    pbrtParseString("Translate 1.5 -0.5 -0.5\n"
+                    "InstanceTransform 1\n"
+                    "Identity\n" +
+                    testCamera("moved2.pfm"));
+    pbrtRenderResidentScene();
+    pbrtCleanup();
+
+    // The same scene built with the quad in its new place
+    opt.server = false;
+    pbrtInit(opt);
+    pbrtParseString(testCamera("moved3.pfm") +
+                    instanceWorld("Translate 1.5 -0.5 -0.5"));
+    pbrtCleanup();
+
+    expectSameImage("moved2.pfm", "moved3.pfm");
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> before = ReadImage("moved1.pfm", &res);
+    std::unique_ptr<RGBSpectrum[]> after = ReadImage("moved2.pfm", &res);
+    ASSERT_TRUE(before && after);
+    int nDiffering = 0;
+    for (int i = 0; i < res.x * res.y; ++i)
+        nDiffering += before[i] != after[i];
+    EXPECT_GT(nDiffering, 0);
+    EXPECT_EQ(0, remove("moved1.pfm"));
+    EXPECT_EQ(0, remove("moved2.pfm"));
+    EXPECT_EQ(0, remove("moved3.pfm"));
+}
+
+// Returns the value of the statistics counter with the given title, as
+// printed by PrintStats(), or zero if it wasn't printed.
+static int64_t statCounter(const std::string &title) {
+    ReportThreadStats();
+    FILE *f = tmpfile();
+    PrintStats(f);
+    rewind(f);
+    char line[1024];
+    int64_t value = 0;
+    while (fgets(line, sizeof(line), f))
+        if (strstr(line, title.c_str())) value = atoll(strrchr(line, ' '));
+    fclose(f);
+    return value;
+}
+
+TEST(API, RepeatedMeshesShareStorage) {
+    ClearStats();
+    Options opt;
+    opt.quiet = true;
+    pbrtInit(opt);
+    const char *quad =
+        "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+        "\"point P\" [-1 -1 0  1 -1 0  1 1 0  -1 1 0]\n";
+    // Same indices, but one vertex differs
+    const char *otherQuad =
+        "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+        "\"point P\" [-1 -1 0  1 -1 0  1 1 0  -1 1.5 0]\n";
+    pbrtParseString(testCamera("meshes.pfm") +
+                    "WorldBegin\n"
+                    "LightSource \"point\" \"point from\" [0 0 5] "
+                    "\"rgb I\" [30 30 30]\n" +
+                    // Repeated with the same transformation: shared
+                    quad + quad +
+                    // Different geometry: not shared
+                    otherQuad +
+                    // Same geometry, different transformation: not shared
+                    "Translate 0 0 -1\n" + quad + "WorldEnd\n");
+    EXPECT_EQ(1, statCounter("Repeated triangle meshes shared"));
+    pbrtCleanup();
+    EXPECT_EQ(0, remove("meshes.pfm"));
+    ClearStats();
+}
+
+// Reads a uint32 binary metadata image, as written for the ID AOVs.
+static std::vector<uint32_t> readIdImage(const std::string &filename,
+                                         Point2i *res) {
+    std::vector<uint32_t> ids;
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return ids;
+    char magic[4];
+    uint32_t header[5];
+    if (fread(magic, 1, 4, f) == 4 && memcmp(magic, "PBMD", 4) == 0 &&
+        fread(header, sizeof(uint32_t), 5, f) == 5 && header[3] == 1 &&
+        header[4] == 0) {
+        *res = Point2i(header[1], header[2]);
+        ids.resize(res->x * res->y);
+        if (fread(ids.data(), sizeof(uint32_t), ids.size(), f) != ids.size())
+            ids.clear();
+    }
+    fclose(f);
+    return ids;
+}
+
+// Renders a quad facing the camera at distance 5 with the given integrator
+// and the depth and material ID AOVs, and checks them.
+static void checkAOVs(const std::string &integrator) {
+    ClearStats();
+    Options opt;
+    opt.quiet = true;
+    pbrtInit(opt);
+    pbrtParseString(
+        "LookAt 0 0 5  0 0 0  0 1 0\n"
+        "Camera \"perspective\" \"float fov\" 20\n"
+        "Film \"image\" \"integer xresolution\" 8 \"integer yresolution\" 8 "
+        "\"bool spectralFlag\" \"false\" \"string filename\" \"aov.pfm\" "
+        "\"string aovs\" [\"depth\" \"materialId\"]\n"
+        "Sampler \"halton\" \"integer pixelsamples\" 4\n"
+        "Integrator \"" + integrator + "\"\n"
+        "WorldBegin\n"
+        "LightSource \"point\" \"point from\" [0 0 5] \"rgb I\" [30 30 30]\n"
+        "Material \"matte\"\n"
+        "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+        "\"point P\" [-5 -5 0  5 -5 0  5 5 0  -5 5 0]\n"
+        "WorldEnd\n");
+    // Each camera ray should be intersected once for both the image and
+    // the AOVs.
+    if (integrator == "directlighting") {
+        int64_t cameraRays = statCounter("Camera rays traced");
+        EXPECT_EQ(8 * 8 * 4, cameraRays);
+        EXPECT_EQ(cameraRays, statCounter("Regular ray intersection tests"));
+    }
+    pbrtCleanup();
+
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> depth = ReadImage("aov_depth.pfm", &res);
+    ASSERT_TRUE(depth.get() != nullptr);
+    ASSERT_EQ(Point2i(8, 8), res);
+    for (int i = 0; i < res.x * res.y; ++i) {
+        Float rgb[3];
+        depth[i].ToRGB(rgb);
+        EXPECT_GE(rgb[0], 5.f) << integrator << ", pixel " << i;
+        // The field of view's corners are at a distance of about 5.15
+        EXPECT_LT(rgb[0], 5.2f) << integrator << ", pixel " << i;
+    }
+
+    std::vector<uint32_t> ids = readIdImage("aov_materialId.bin", &res);
+    ASSERT_EQ(8 * 8, ids.size());
+    ASSERT_EQ(Point2i(8, 8), res);
+    EXPECT_NE(0, ids[0]);
+    for (uint32_t id : ids) EXPECT_EQ(ids[0], id) << integrator;
+
+    EXPECT_EQ(0, remove("aov.pfm"));
+    EXPECT_EQ(0, remove("aov_depth.pfm"));
+    EXPECT_EQ(0, remove("aov_materialId.bin"));
+    ClearStats();
+}
+
+TEST(API, AOVs) {
+    for (const char *integrator :
+         {"directlighting", "path", "volpath", "whitted", "ambientocclusion"})
+        checkAOVs(integrator);
+}
+
+TEST(API, SpectralPathAOVs) {
+    checkAOVs("spectralpath");
+}
+
+// A medium boundary in front of the quad: every integrator should report
+// the boundary, not the surface behind it, in the AOVs.
+TEST(API, AOVsAtMediumBoundaries) {
+    for (const char *integrator :
+         {"directlighting", "path", "volpath", "whitted", "ambientocclusion",
+          "spectralpath", "wavefrontpath"}) {
+        Options opt;
+        opt.quiet = true;
+        pbrtInit(opt);
+        pbrtParseString(
+            std::string("LookAt 0 0 5  0 0 0  0 1 0\n"
+            "Camera \"perspective\" \"float fov\" 20\n"
+            "Film \"image\" \"integer xresolution\" 8 "
+            "\"integer yresolution\" 8 \"bool spectralFlag\" \"false\" "
+            "\"string filename\" \"aov.pfm\" \"string aovs\" [\"depth\"]\n"
+            "Sampler \"halton\" \"integer pixelsamples\" 4\n"
+            "Integrator \"") + integrator + "\"\n"
+            "WorldBegin\n"
+            "LightSource \"point\" \"point from\" [0 0 5] "
+            "\"rgb I\" [30 30 30]\n"
+            "Material \"matte\"\n"
+            "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+            "\"point P\" [-5 -5 0  5 -5 0  5 5 0  -5 5 0]\n"
+            "Material \"none\"\n"
+            "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+            "\"point P\" [-5 -5 2  5 -5 2  5 5 2  -5 5 2]\n"
+            "WorldEnd\n");
+        pbrtCleanup();
+
+        Point2i res;
+        std::unique_ptr<RGBSpectrum[]> depth =
+            ReadImage("aov_depth.pfm", &res);
+        ASSERT_TRUE(depth.get() != nullptr);
+        ASSERT_EQ(Point2i(8, 8), res);
+        for (int i = 0; i < res.x * res.y; ++i) {
+            Float rgb[3];
+            depth[i].ToRGB(rgb);
+            EXPECT_GE(rgb[0], 3.f) << integrator << ", pixel " << i;
+            EXPECT_LT(rgb[0], 3.1f) << integrator << ", pixel " << i;
+        }
+        EXPECT_EQ(0, remove("aov.pfm"));
+        EXPECT_EQ(0, remove("aov_depth.pfm"));
+    }
+    ClearStats();
+}
+
+static bool fileExists(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (f) fclose(f);
+    return f != nullptr;
+}
+
+// Camera, film and integrator statements for a tiny metadata render;
+// _film_ is added to the film's parameters.
+static std::string metadataCamera(const std::string &film) {
+    return "LookAt 0 0 5  0 0 0  0 1 0\n"
+           "Camera \"perspective\" \"float fov\" 20\n"
+           "Film \"image\" \"integer xresolution\" 4 "
+           "\"integer yresolution\" 4 \"bool spectralFlag\" \"false\" " +
+           film +
+           "\n"
+           "Integrator \"metadata\" \"string strategy\" \"material\" "
+           "\"string format\" \"binary\"\n";
+}
+
+static const char *metadataWorld = R"(
+WorldBegin
+MakeNamedMaterial "red" "string type" "matte"
+NamedMaterial "red"
+Shape "sphere"
+WorldEnd
+)";
+
+TEST(API, CamerasGetTheirOwnOutputFiles) {
+    Options opt;
+    opt.quiet = true;
+    opt.imageFile = "multi.pfm";
+    pbrtInit(opt);
+    pbrtParseString(metadataCamera("") + metadataCamera("") + metadataWorld);
+    pbrtCleanup();
+
+    // Cameras without a filename add their index to the --outfile one, and
+    // each camera writes its own ID table.
+    for (const char *f :
+         {"multi_camera0.bin", "multi_camera0_materials.bin",
+          "multi_camera1.bin", "multi_camera1_materials.bin"}) {
+        EXPECT_TRUE(fileExists(f)) << f;
+        remove(f);
+    }
+    EXPECT_FALSE(fileExists("multi.bin"));
+}
+
+TEST(API, CamerasWithTheSameOutputFile) {
+    ClearStats();
+    Options opt;
+    opt.quiet = true;
+    pbrtInit(opt);
+    pbrtParseString(testCamera("same.pfm") + testCamera("same.pfm") +
+                    testWorld);
+    // Only the first camera is rendered
+    EXPECT_EQ(24 * 24 * 4, statCounter("Camera rays traced"));
+    pbrtCleanup();
+    EXPECT_EQ(0, remove("same.pfm"));
+    ClearStats();
+}
+
+TEST(API, MetadataTableFollowsFilmFilename) {
+    Options opt;
+    opt.quiet = true;
+    opt.imageFile = "cli.pfm";
+    pbrtInit(opt);
+    // The scene's filename takes precedence over --outfile for the film,
+    // and so for the ID table as well.
+    pbrtParseString(metadataCamera("\"string filename\" \"scene.pfm\"") +
+                    metadataWorld);
+    pbrtCleanup();
+    EXPECT_FALSE(fileExists("cli_materials.bin"));
+    for (const char *f : {"scene.bin", "scene_materials.bin"}) {
+        EXPECT_TRUE(fileExists(f)) << f;
+        remove(f);
+    }
+}
+
+// Renders two quads whose shape parameters override their material's and
+// returns the material ID image.
+static std::vector<uint32_t> renderPerShapeMaterials(bool lazyShapes) {
+    Options opt;
+    opt.quiet = true;
+    opt.lazyShapes = lazyShapes;
+    pbrtInit(opt);
+    pbrtParseString(
+        "LookAt 0 0 5  0 0 0  0 1 0\n"
+        "Camera \"perspective\" \"float fov\" 20\n"
+        "Film \"image\" \"integer xresolution\" 8 \"integer yresolution\" 8 "
+        "\"bool spectralFlag\" \"false\" \"string filename\" \"lazy.pfm\" "
+        "\"string aovs\" \"materialId\"\n"
+        "Sampler \"halton\" \"integer pixelsamples\" 1\n"
+        "Integrator \"directlighting\"\n"
+        "WorldBegin\n"
+        "LightSource \"point\" \"point from\" [0 0 5] \"rgb I\" [30 30 30]\n"
+        "Material \"matte\"\n"
+        "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+        "\"point P\" [-5 -5 0  0 -5 0  0 5 0  -5 5 0] \"rgb Kd\" [1 0 0]\n"
+        "Shape \"trianglemesh\" \"integer indices\" [0 1 2 0 2 3] "
+        "\"point P\" [0 -5 0  5 -5 0  5 5 0  0 5 0] \"rgb Kd\" [0 1 0]\n"
+        "WorldEnd\n");
+    pbrtCleanup();
+    Point2i res;
+    std::vector<uint32_t> ids = readIdImage("lazy_materialId.bin", &res);
+    EXPECT_EQ(0, remove("lazy.pfm"));
+    EXPECT_EQ(0, remove("lazy_materialId.bin"));
+    return ids;
+}
+
+TEST(API, LazyShapesKeepMaterialIds) {
+    for (bool lazyShapes : {false, true}) {
+        std::vector<uint32_t> ids = renderPerShapeMaterials(lazyShapes);
+        ASSERT_EQ(8 * 8, ids.size());
+        // Each quad gets its own material, numbered in scene file order,
+        // even when the shapes are created while rendering. The first quad,
+        // at negative x, is on the right side of the image.
+        uint32_t first = ids[7], second = ids[0];
+        EXPECT_LT(first, second) << lazyShapes;
+        // Check the pixels that aren't next to the seam between the quads
+        for (int y = 0; y < 8; ++y)
+            for (int x : {0, 1, 2, 5, 6, 7})
+                EXPECT_EQ(x < 4 ? second : first, ids[y * 8 + x])
+                    << lazyShapes;
+    }
+}
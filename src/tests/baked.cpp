@@ -0,0 +1,172 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "imageio.h"
+#include "interaction.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "rng.h"
+#include "textures/baked.h"
+#include "textures/bilerp.h"
+#include "textures/checkerboard.h"
+#include "textures/constant.h"
+#include "textures/fbm.h"
+#include "textures/imagemap.h"
+#include "textures/mix.h"
+#include "textures/scale.h"
+
+using namespace pbrt;
+
+static std::shared_ptr<Texture<Float>> constant(Float v) {
+    return std::make_shared<ConstantTexture<Float>>(v);
+}
+
+static std::unique_ptr<TextureMapping2D> uvMapping() {
+    return std::unique_ptr<TextureMapping2D>(new UVMapping2D(4, 4));
+}
+
+static FBmTexture<Float> *fbm() {
+    return new FBmTexture<Float>(
+        std::unique_ptr<TextureMapping3D>(new IdentityMapping3D(Transform())),
+        4, .5f);
+}
+
+// Bakes _tex_ with the given "bake" mode through CreateBakedFloatTexture().
+static Texture<Float> *bake(Texture<Float> *tex, const std::string &mode) {
+    ParamSet params;
+    std::unique_ptr<std::string[]> value(new std::string[1]);
+    value[0] = mode;
+    params.AddString("bake", std::move(value), 1);
+    ParamSet materialParams;
+    std::map<std::string, std::shared_ptr<Texture<Float>>> floatTextures;
+    std::map<std::string, std::shared_ptr<Texture<Spectrum>>> spectrumTextures;
+    TextureParams tp(params, materialParams, floatTextures, spectrumTextures);
+    return CreateBakedFloatTexture("test", tex, Transform(), tp);
+}
+
+TEST(BakedTexture, Domains) {
+    std::shared_ptr<Texture<Float>> uvChecks =
+        std::make_shared<Checkerboard2DTexture<Float>>(
+            uvMapping(), constant(0), constant(1), AAMethod::None);
+    EXPECT_EQ(TextureDomain::UV, uvChecks->Domain());
+
+    Checkerboard2DTexture<Float> sphericalChecks(
+        std::unique_ptr<TextureMapping2D>(new SphericalMapping2D(Transform())),
+        constant(0), constant(1), AAMethod::None);
+    EXPECT_EQ(TextureDomain::Position, sphericalChecks.Domain());
+
+    std::shared_ptr<Texture<Float>> solid(fbm());
+    EXPECT_EQ(TextureDomain::Position, solid->Domain());
+
+    // A 2D texture with a solid sub-texture depends on both
+    MixTexture<Float> mix(uvChecks, solid, constant(.5f));
+    EXPECT_EQ(TextureDomain::Other, mix.Domain());
+    Checkerboard2DTexture<Float> checksOfSolid(uvMapping(), constant(0), solid,
+                                               AAMethod::None);
+    EXPECT_EQ(TextureDomain::Other, checksOfSolid.Domain());
+}
+
+TEST(BakedTexture, ChooseBakeFromDomain) {
+    ParallelInit();
+    // (u,v) textures are baked over (u,v), even if a grid was requested
+    Texture<Float> *uvTex = bake(
+        new BilerpTexture<Float>(uvMapping(), 0.f, 1.f, 2.f, 3.f), "grid");
+    EXPECT_TRUE(dynamic_cast<UVBakedTexture<Float> *>(uvTex) != nullptr);
+    delete uvTex;
+
+    // Solid textures go into a grid, even if (u,v) baking was requested
+    Texture<Float> *solidTex = bake(fbm(), "uv");
+    EXPECT_TRUE(dynamic_cast<GridBakedTexture<Float> *>(solidTex) != nullptr);
+    delete solidTex;
+
+    // Neither works for a texture that depends on (u,v) and position
+    Texture<Float> *mix =
+        new MixTexture<Float>(constant(0), std::shared_ptr<Texture<Float>>(fbm()),
+                              std::make_shared<BilerpTexture<Float>>(
+                                  uvMapping(), 0.f, 1.f, 0.f, 1.f));
+    EXPECT_EQ(mix, bake(mix, "uv"));
+    delete mix;
+    ParallelCleanup();
+}
+
+TEST(BakedTexture, UVBakeMatches) {
+    ParallelInit();
+    std::unique_ptr<Texture<Float>> bilerp(
+        new BilerpTexture<Float>(std::unique_ptr<TextureMapping2D>(
+                                     new UVMapping2D()),
+                                 0.f, 1.f, 2.f, 3.f));
+    std::unique_ptr<Texture<Float>> baked(bake(
+        new BilerpTexture<Float>(std::unique_ptr<TextureMapping2D>(
+                                     new UVMapping2D()),
+                                 0.f, 1.f, 2.f, 3.f),
+        "uv"));
+    RNG rng;
+    SurfaceInteraction si;
+    for (int i = 0; i < 100; ++i) {
+        // Stay away from the edges, where the baked texture wraps around
+        si.uv = Point2f(.1f + .8f * rng.UniformFloat(),
+                        .1f + .8f * rng.UniformFloat());
+        EXPECT_NEAR(bilerp->Evaluate(si), baked->Evaluate(si), 1e-2f) << si.uv;
+    }
+    ParallelCleanup();
+}
+
+TEST(BakedTexture, GridPastBudget) {
+    std::unique_ptr<Texture<Float>> reference(fbm());
+    // The budget only has room for a single brick
+    GridBakedTexture<Float> grid(std::unique_ptr<Texture<Float>>(fbm()),
+                                 Transform(), 1.f / 16, 1);
+    SurfaceInteraction si;
+    si.p = Point3f(.1f, .2f, .3f);
+    EXPECT_NEAR(reference->Evaluate(si), grid.Evaluate(si), 5e-2f);
+
+    // Other bricks, including ones far from the origin whose lattice
+    // coordinates are large, are evaluated directly.
+    RNG rng;
+    for (int i = 0; i < 100; ++i) {
+        Float scale = i < 50 ? 10 : 1e6f;
+        si.p = Point3f(scale * (1 + rng.UniformFloat()),
+                       scale * (1 + rng.UniformFloat()),
+                       -scale * (1 + rng.UniformFloat()));
+        EXPECT_EQ(reference->Evaluate(si), grid.Evaluate(si)) << si.p;
+    }
+}
+
+TEST(BakedTexture, WrappedImageStillLoading) {
+    // An image large enough that its MIP map is likely still being built
+    // in the background when the texture wrapping it is baked
+    Point2i res(1024, 1024);
+    std::vector<Float> pixels(3 * res.x * res.y);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                pixels[3 * (y * res.x + x) + c] = Float(x) / (res.x - 1);
+    WriteImage("bake_image.pfm", &pixels[0], Bounds2i(Point2i(0, 0), res),
+               res);
+
+    // Make sure that there are background threads to load it
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+    ParamSet params;
+    std::unique_ptr<std::string[]> filename(new std::string[1]);
+    filename[0] = "bake_image.pfm";
+    params.AddString("filename", std::move(filename), 1);
+    ParamSet materialParams;
+    std::map<std::string, std::shared_ptr<Texture<Float>>> floatTextures;
+    std::map<std::string, std::shared_ptr<Texture<Spectrum>>> spectrumTextures;
+    TextureParams tp(params, materialParams, floatTextures, spectrumTextures);
+    std::shared_ptr<Texture<Float>> image(
+        CreateImageFloatTexture(Transform(), tp));
+    std::unique_ptr<Texture<Float>> baked(
+        bake(new ScaleTexture<Float, Float>(image, constant(2)), "uv"));
+    EXPECT_TRUE(dynamic_cast<UVBakedTexture<Float> *>(baked.get()) != nullptr);
+
+    SurfaceInteraction si;
+    si.uv = Point2f(.25f, .5f);
+    EXPECT_NEAR(.5f, baked->Evaluate(si), 1e-2f);
+    ImageTexture<Float, Float>::ClearCache();
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+    EXPECT_EQ(0, remove("bake_image.pfm"));
+}
@@ -4,6 +4,8 @@
 #include "fileutil.h"
 #include "spectrum.h"
 #include "imageio.h"
+#include "parallel.h"
+#include "rng.h"
 
 using namespace pbrt;
 
@@ -87,3 +89,38 @@ TEST(ImageIO, RoundTripPFM) { TestRoundTrip("out.pfm", false); }
 TEST(ImageIO, RoundTripTGA) { TestRoundTrip("out.tga", true); }
 
 TEST(ImageIO, RoundTripPNG) { TestRoundTrip("out.png", true); }
+
+// Large enough that the PNG writer compresses several bands of scanlines
+// in parallel; 8-bit values should survive the round trip exactly.
+TEST(ImageIO, RoundTripPNGParallel) {
+    ParallelInit();
+    Point2i res(317, 1021);
+    std::vector<Float> pixels(3 * res.x * res.y);
+    RNG rng;
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            int offset = 3 * (y * res.x + x);
+            pixels[offset] = Float(x) / Float(res.x - 1);
+            pixels[offset + 1] = rng.UniformFloat();
+            pixels[offset + 2] = (x / 8 + y / 8) % 2 ? 1 : 0;
+        }
+
+    const char *filename = "parallel.png";
+    WriteImage(filename, &pixels[0], Bounds2i({0, 0}, res), res);
+    Point2i readRes;
+    auto readPixels = ReadImage(filename, &readRes);
+    ParallelCleanup();
+    ASSERT_TRUE(readPixels.get() != nullptr);
+    EXPECT_EQ(readRes, res);
+
+    for (int i = 0; i < res.x * res.y; ++i) {
+        Float rgb[3];
+        readPixels[i].ToRGB(rgb);
+        for (int c = 0; c < 3; ++c) {
+            int wrote = Clamp(255.f * GammaCorrect(pixels[3 * i + c]) + 0.5f,
+                              0.f, 255.f);
+            EXPECT_EQ(wrote, int(std::round(255.f * rgb[c]))) << i;
+        }
+    }
+    EXPECT_EQ(0, remove(filename));
+}
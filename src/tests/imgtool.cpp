@@ -0,0 +1,105 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "imageio.h"
+#include "spectrum.h"
+#include <fstream>
+#include <sstream>
+
+using namespace pbrt;
+
+// These run the imgtool executable, whose path is provided by the build.
+#ifdef PBRT_IMGTOOL
+
+static void writeTestImage(const std::string &filename, Float value) {
+    Point2i res(8, 4);
+    std::vector<Float> pixels(3 * res.x * res.y, value);
+    WriteImage(filename, &pixels[0], Bounds2i(Point2i(0, 0), res), res);
+}
+
+static std::string readFile(const std::string &filename) {
+    std::ifstream in(filename);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// Runs "imgtool batch" with the given manifest contents and returns its
+// exit status; its stdout and stderr are returned in _out_ and _err_.
+static int runBatch(const std::string &manifest, std::string *out,
+                    std::string *err) {
+    std::ofstream("batch.txt") << manifest;
+    std::string command = std::string("\"") + PBRT_IMGTOOL +
+                          "\" batch --nthreads 4 batch.txt "
+                          "> batch_out.txt 2> batch_err.txt";
+    int status = system(command.c_str());
+    *out = readFile("batch_out.txt");
+    *err = readFile("batch_err.txt");
+    remove("batch.txt");
+    remove("batch_out.txt");
+    remove("batch_err.txt");
+    return status;
+}
+
+static bool fileExists(const std::string &filename) {
+    return std::ifstream(filename).good();
+}
+
+TEST(Imgtool, BatchChecksArgumentsFirst) {
+    writeTestImage("batch_a.pfm", .5f);
+    std::string out, err;
+    int status = runBatch(
+        "convert --scale 2 batch_a.pfm batch_b.pfm\n"
+        "# comment\n"
+        "convert --scale 0 batch_a.pfm batch_c.pfm\n"
+        "diff batch_a.pfm\n",
+        &out, &err);
+    EXPECT_NE(0, status);
+    // Neither the bad lines nor the good one are run...
+    EXPECT_FALSE(fileExists("batch_b.pfm"));
+    EXPECT_FALSE(fileExists("batch_c.pfm"));
+    // ...and both bad ones are reported, without the usage message.
+    EXPECT_NE(std::string::npos, err.find("batch.txt:3: ")) << err;
+    EXPECT_NE(std::string::npos, err.find("batch.txt:4: ")) << err;
+    EXPECT_EQ(std::string::npos, err.find("usage:")) << err;
+    remove("batch_a.pfm");
+    remove("batch_b.pfm");
+}
+
+TEST(Imgtool, BatchOutputIsPerJob) {
+    writeTestImage("batch_a.pfm", .25f);
+    writeTestImage("batch_b.pfm", .75f);
+    std::string manifest;
+    for (int i = 0; i < 16; ++i)
+        manifest += i & 1 ? "info batch_b.pfm\n" : "info batch_a.pfm\n";
+    manifest += "convert --scale 2 batch_a.pfm batch_c.pfm\n";
+    std::string out, err;
+    EXPECT_EQ(0, runBatch(manifest, &out, &err)) << err;
+
+    // Each info command prints six lines that all start with its filename;
+    // they shouldn't be interleaved with the other commands' lines.
+    std::istringstream lines(out);
+    std::string line, filename;
+    int nLines = 0;
+    while (std::getline(lines, line)) {
+        std::string lineFilename = line.substr(0, line.find(':'));
+        if (nLines % 6 == 0)
+            filename = lineFilename;
+        else
+            EXPECT_EQ(filename, lineFilename) << out;
+        ++nLines;
+    }
+    EXPECT_EQ(16 * 6, nLines);
+
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> converted = ReadImage("batch_c.pfm", &res);
+    ASSERT_TRUE(converted.get() != nullptr);
+    Float rgb[3];
+    converted[0].ToRGB(rgb);
+    EXPECT_EQ(.5f, rgb[0]);
+    remove("batch_a.pfm");
+    remove("batch_b.pfm");
+    remove("batch_c.pfm");
+}
+
+#endif  // PBRT_IMGTOOL
@@ -0,0 +1,108 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "rng.h"
+
+using namespace pbrt;
+
+TEST(MIPMap, AnisotropicProbesApproximateEWA) {
+    ParallelInit();
+    // A smooth texture, where the two filters should closely agree.
+    Point2i res(64, 64);
+    std::vector<Float> image(res.x * res.y);
+    for (int t = 0; t < res.y; ++t)
+        for (int s = 0; s < res.x; ++s)
+            image[t * res.x + s] = 1 + .5f * std::sin(2 * Pi * s / res.x) *
+                                           std::cos(2 * Pi * t / res.y);
+    MIPMap<Float> mipmap(res, image.data());
+
+    RNG rng;
+    for (int i = 0; i < 200; ++i) {
+        Point2f st(rng.UniformFloat(), rng.UniformFloat());
+        // Footprints with up to 8:1 anisotropy in random directions
+        Float angle = 2 * Pi * rng.UniformFloat();
+        Float major = .05f * rng.UniformFloat() + .001f;
+        Float minor = major * (.125f + .875f * rng.UniformFloat());
+        Vector2f dst0(major * std::cos(angle), major * std::sin(angle));
+        Vector2f dst1(-minor * std::sin(angle), minor * std::cos(angle));
+        Float ewa = mipmap.Lookup(st, dst0, dst1);
+        Float probes = mipmap.LookupProbes(st, dst0, dst1);
+        EXPECT_NEAR(ewa, probes, .05f) << st << " " << dst0 << " " << dst1;
+    }
+
+    // Constant textures are reproduced exactly.
+    std::vector<Float> constant(res.x * res.y, .75f);
+    MIPMap<Float> flat(res, constant.data());
+    EXPECT_FLOAT_EQ(.75f, flat.LookupProbes(Point2f(.3f, .6f), Vector2f(.1f, 0),
+                                            Vector2f(0, .01f)));
+    ParallelCleanup();
+}
+
+TEST(MIPMap, HalfConversion) {
+    for (float f : {0.f, 1.f, -2.5f, .5f, 65504.f, 6.103515625e-05f,
+                    5.9604645e-08f, 1.f / 3.f})
+        EXPECT_NEAR(f, HalfToFloat(FloatToHalf(f)), std::abs(f) / 1024) << f;
+    EXPECT_EQ(Infinity, HalfToFloat(FloatToHalf(1e6f)));
+    // Exactly halfway between two halfs rounds to the even one.
+    EXPECT_EQ(1.f, HalfToFloat(FloatToHalf(1.f + 1.f / 2048)));
+}
+
+TEST(MIPMap, CompactTexelFormats) {
+    ParallelInit();
+    // A smooth RGB texture whose values go past one, so that the 8-bit
+    // formats need to normalize it.
+    Point2i res(64, 32);
+    std::vector<RGBSpectrum> image(res.x * res.y);
+    for (int t = 0; t < res.y; ++t)
+        for (int s = 0; s < res.x; ++s) {
+            Float rgb[3] = {2 * Float(s) / res.x, Float(t) / res.y,
+                            .5f + .25f * std::sin(2 * Pi * s / res.x)};
+            image[t * res.x + s] = RGBSpectrum::FromRGB(rgb);
+        }
+    MIPMap<RGBSpectrum> reference(res, image.data());
+
+    struct {
+        TexelFormat format;
+        Float tolerance;
+    } formats[] = {{TexelFormat::SRGB8, .01f},
+                   {TexelFormat::Half, .001f},
+                   {TexelFormat::BC1, .1f}};
+    for (const auto &f : formats) {
+        MIPMap<RGBSpectrum> compact(res, image.data());
+        compact.Compact(f.format);
+        ASSERT_EQ(reference.Levels(), compact.Levels());
+        // Once a 4x4 block covers most of the texture, its colors no longer
+        // lie along a line, which BC1 can't represent; only its finest
+        // level is checked.
+        int nLevels = f.format == TexelFormat::BC1 ? 1 : reference.Levels();
+        for (int level = 0; level < nLevels; ++level)
+            for (int t = 0; t < std::max(1, res.y >> level); ++t)
+                for (int s = 0; s < std::max(1, res.x >> level); ++s) {
+                    RGBSpectrum a = reference.Texel(level, s, t);
+                    RGBSpectrum b = compact.Texel(level, s, t);
+                    for (int c = 0; c < 3; ++c)
+                        EXPECT_NEAR(a[c], b[c], f.tolerance * 2)
+                            << int(f.format) << " " << level << " " << s
+                            << " " << t << " " << c;
+                }
+    }
+
+    // 8-bit sRGB sources are stored exactly, and one-channel textures
+    // use the BC4 layout.
+    std::vector<Float> bytes(res.x * res.y), gradient(res.x * res.y);
+    for (int i = 0; i < res.x * res.y; ++i) {
+        bytes[i] = InverseGammaCorrect((i * 37 % 256) / 255.f);
+        gradient[i] = Float(i % res.x) / res.x;
+    }
+    MIPMap<Float> srgb(res, bytes.data());
+    srgb.Compact(TexelFormat::SRGB8);
+    for (int i = 0; i < res.x * res.y; ++i)
+        EXPECT_NEAR(bytes[i], srgb.Texel(0, i % res.x, i / res.x), 1e-6f);
+    MIPMap<Float> bc4(res, gradient.data());
+    bc4.Compact(TexelFormat::BC1);
+    for (int i = 0; i < res.x * res.y; ++i)
+        EXPECT_NEAR(gradient[i], bc4.Texel(0, i % res.x, i / res.x), .02f);
+    ParallelCleanup();
+}
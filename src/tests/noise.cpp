@@ -0,0 +1,56 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "rng.h"
+#include "texture.h"
+
+using namespace pbrt;
+
+// Straightforward octave-at-a-time FBm, to compare the batched one against.
+static Float referenceFBm(const Point3f &p, const Vector3f &dpdx,
+                          const Vector3f &dpdy, Float omega, int maxOctaves) {
+    Float len2 = std::max(dpdx.LengthSquared(), dpdy.LengthSquared());
+    Float n = Clamp(-1 - .5f * Log2(len2), 0, maxOctaves);
+    int nInt = std::floor(n);
+    Float sum = 0, lambda = 1, o = 1;
+    for (int i = 0; i < nInt; ++i) {
+        sum += o * Noise(lambda * p);
+        lambda *= 1.99f;
+        o *= omega;
+    }
+    Float v = Clamp((n - nInt - .3f) / (.7f - .3f), 0, 1);
+    sum += o * v * v * (-2 * v + 3) * Noise(lambda * p);
+    return sum;
+}
+
+TEST(Noise, Batch) {
+    RNG rng;
+    std::vector<Point3f> p;
+    std::vector<Vector3f> dpdx, dpdy;
+    for (int i = 0; i < 1000; ++i) {
+        p.push_back(Point3f(-100 + 200 * rng.UniformFloat(),
+                            -100 + 200 * rng.UniformFloat(),
+                            -100 + 200 * rng.UniformFloat()));
+        // Footprints that give anywhere from zero to all of the octaves
+        Float len = std::pow(2.f, -12 * rng.UniformFloat());
+        dpdx.push_back(Vector3f(len, 0, 0));
+        dpdy.push_back(Vector3f(0, len * rng.UniformFloat(), 0));
+    }
+
+    std::vector<Float> noise(p.size()), fbm(p.size());
+    Noise(&p[0], p.size(), &noise[0]);
+    FBm(&p[0], &dpdx[0], &dpdy[0], p.size(), .5f, 8, &fbm[0]);
+    for (size_t i = 0; i < p.size(); ++i) {
+        EXPECT_EQ(Noise(p[i]), noise[i]) << p[i];
+        EXPECT_EQ(referenceFBm(p[i], dpdx[i], dpdy[i], .5f, 8), fbm[i])
+            << p[i];
+        EXPECT_EQ(FBm(p[i], dpdx[i], dpdy[i], .5f, 8), fbm[i]) << p[i];
+    }
+
+    // Turbulence sums the same octaves, so the batch and single-point
+    // versions should agree exactly too
+    std::vector<Float> turb(p.size());
+    Turbulence(&p[0], &dpdx[0], &dpdy[0], p.size(), .6f, 10, &turb[0]);
+    for (size_t i = 0; i < p.size(); ++i)
+        EXPECT_EQ(Turbulence(p[i], dpdx[i], dpdy[i], .6f, 10), turb[i]);
+}
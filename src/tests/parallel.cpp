@@ -2,7 +2,11 @@
 #include "tests/gtest/gtest.h"
 #include "pbrt.h"
 #include "parallel.h"
+#include "parser.h"
 #include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
 
 using namespace pbrt;
 
@@ -37,3 +41,104 @@ TEST(Parallel, DoNothing) {
 
     ParallelCleanup();
 }
+
+TEST(Parallel, AsyncTasksWithNestedLoops) {
+    ParallelInit();
+
+    // Each task runs its own ParallelFor() concurrently with the others
+    // and with one on the main thread.
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 8; ++i)
+        results.push_back(RunAsync([i]() {
+            std::atomic<int> counter{0};
+            ParallelFor([&](int64_t) { ++counter; }, 100 * (i + 1), 7);
+            return int(counter);
+        }));
+    std::atomic<int> counter{0};
+    ParallelFor([&](int64_t) { ++counter; }, 1000, 3);
+    EXPECT_EQ(1000, counter);
+
+    for (int i = 0; i < 8; ++i) EXPECT_EQ(100 * (i + 1), results[i].get());
+
+    ParallelCleanup();
+}
+
+TEST(Parallel, AsyncThreadIndices) {
+    ParallelInit();
+
+    // Background task threads have their own _ThreadIndex_ values, so
+    // that per-thread state indexed by it is never shared between threads
+    // running at the same time, even when the tasks start loops.
+    std::unique_ptr<std::atomic<int>[]> inUse(
+        new std::atomic<int>[MaxThreadIndex()]);
+    for (int i = 0; i < MaxThreadIndex(); ++i) inUse[i] = 0;
+    std::atomic<int> nShared{0};
+    auto useSlot = [&]() {
+        EXPECT_GE(ThreadIndex, 0);
+        EXPECT_LT(ThreadIndex, MaxThreadIndex());
+        if (inUse[ThreadIndex]++ != 0) ++nShared;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        --inUse[ThreadIndex];
+    };
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 8; ++i)
+        results.push_back(RunAsync([&]() {
+            int index = ThreadIndex;
+            ParallelFor([&](int64_t) { useSlot(); }, 50);
+            return index;
+        }));
+    ParallelFor([&](int64_t) { useSlot(); }, 200);
+
+    for (std::future<int> &result : results) {
+        int index = result.get();
+        if (NumWorkerThreads() > 1)
+            EXPECT_GE(index, NumWorkerThreads());
+        else
+            EXPECT_EQ(0, index);
+    }
+    EXPECT_EQ(0, nShared);
+
+    ParallelCleanup();
+}
+
+TEST(Parallel, AsyncErrorsUseStartLocation) {
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+    Loc loc("async.pbrt");
+    loc.line = 3;
+    loc.column = 1;
+    Loc *oldLoc = parserLoc;
+    parserLoc = &loc;
+
+    // Errors from the task and from the loop it starts should refer to
+    // where the task was started, even though the parser has moved on.
+    testing::internal::CaptureStderr();
+    std::promise<void> parsed;
+    std::shared_future<void> parsedFuture = parsed.get_future().share();
+    std::future<void> task = RunAsync([parsedFuture]() {
+        parsedFuture.wait();
+        Error("task failed");
+        ParallelFor([](int64_t i) { Error("iteration %d failed", (int)i); },
+                    64, 1);
+    });
+    loc.line = 42;
+    parsed.set_value();
+    task.get();
+    std::string err = testing::internal::GetCapturedStderr();
+    parserLoc = oldLoc;
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+
+    EXPECT_NE(std::string::npos, err.find("async.pbrt:3:1: Error: task failed"))
+        << err;
+    int nAtStart = 0;
+    for (size_t pos = 0;
+         (pos = err.find("async.pbrt:3:1: Error: iteration", pos)) !=
+         std::string::npos;
+         ++pos)
+        ++nAtStart;
+    EXPECT_EQ(64, nAtStart) << err;
+    EXPECT_EQ(std::string::npos, err.find(":42:")) << err;
+}
@@ -2,6 +2,8 @@
 #include "tests/gtest/gtest.h"
 #include "pbrt.h"
 #include "parser.h"
+#include "rng.h"
+#include "stringprint.h"
 
 #include <fstream>
 #include <initializer_list>
@@ -130,3 +132,164 @@ Integrator "deep" "float density" [ 2 2.66612 -5e-51]
     EXPECT_EQ(0, remove(filename.c_str()));
 }
 
+
+TEST(Parser, BinaryRoundTrip) {
+    std::string filename = inTestDir("test.pbrt"), incFilename = inTestDir("inc.pbrt");
+    std::string binFilename = inTestDir("test.pbrtb");
+    {
+        std::ofstream out(filename);
+        out << R"(WorldBegin # hello
+Shape "trianglemesh" "integer indices" [ 0 1 2 ] "point P" [0 0 0 1 0 0 0.5 1 0.1]
+Include "inc.pbrt"
+Translate 1 2.5 -3
+)";
+        std::ofstream inc(incFilename);
+        inc << R"(Texture "t" "color" "imagemap" "string filename" [ "a.png" ])";
+    }
+
+    FILE *f = fopen(binFilename.c_str(), "wb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(ConvertSceneToBinary(filename, f));
+    fclose(f);
+
+    auto err = [](const char *err) {
+        EXPECT_TRUE(false) << "Unexpected error: " << err;
+    };
+    {
+        auto t = Tokenizer::CreateFromFile(binFilename, err);
+        ASSERT_TRUE(t.get() != nullptr);
+        EXPECT_TRUE(t->IsBinary());
+
+        auto expectText = [&](const char *s) {
+            Token tok = t->Next();
+            EXPECT_EQ(Token::Numeric::None, tok.numeric);
+            EXPECT_EQ(std::string(s), std::string(tok.data(), tok.size()));
+        };
+        expectText("WorldBegin");
+        expectText("Shape");
+        expectText("\"trianglemesh\"");
+        expectText("\"integer indices\"");
+        Token tok = t->Next();
+        ASSERT_EQ(Token::Numeric::Int32Array, tok.numeric);
+        ASSERT_EQ(3, tok.arraySize);
+        EXPECT_EQ(2, ((const int32_t *)tok.array)[2]);
+        expectText("\"point P\"");
+        tok = t->Next();
+        ASSERT_EQ(Token::Numeric::Float32Array, tok.numeric);
+        ASSERT_EQ(9, tok.arraySize);
+        EXPECT_EQ(0.1f, ((const float *)tok.array)[8]);
+        expectText("Texture");
+        expectText("\"t\"");
+        expectText("\"color\"");
+        expectText("\"imagemap\"");
+        expectText("\"string filename\"");
+        expectText("[");
+        expectText("\"a.png\"");
+        expectText("]");
+        expectText("Translate");
+        for (double v : {1., 2.5, -3.}) {
+            tok = t->Next();
+            EXPECT_EQ(Token::Numeric::Number, tok.numeric);
+            EXPECT_EQ(v, tok.number);
+        }
+        EXPECT_TRUE(t->Next().empty());
+    }
+
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_EQ(0, remove(incFilename.c_str()));
+    EXPECT_EQ(0, remove(binFilename.c_str()));
+}
+
+TEST(Parser, BinaryConversionBadNumber) {
+    // Malformed numbers make the conversion fail rather than exit, both as
+    // a single value and inside an array.
+    for (const char *scene : {"Translate 1 - 3\n",
+                              "Shape \"sphere\" \"float radius\" [ 1 .x ]\n"}) {
+        std::string filename = inTestDir("bad.pbrt");
+        {
+            std::ofstream out(filename);
+            out << scene;
+        }
+        FILE *f = tmpfile();
+        ASSERT_TRUE(f != nullptr);
+        EXPECT_FALSE(ConvertSceneToBinary(filename, f)) << scene;
+        fclose(f);
+        EXPECT_EQ(0, remove(filename.c_str()));
+    }
+}
+
+// Returns the value that the parser computed for numbers before the fast
+// paths were added.
+static double referenceNumber(const std::string &s) {
+    bool isInteger = true;
+    for (char ch : s)
+        if (!(ch >= '0' && ch <= '9')) isInteger = false;
+    if (isInteger) return double(strtol(s.c_str(), nullptr, 10));
+    if (sizeof(Float) == sizeof(float)) return strtof(s.c_str(), nullptr);
+    return strtod(s.c_str(), nullptr);
+}
+
+static std::string randomNumbers(int n, std::vector<std::string> *strs) {
+    RNG rng;
+    std::string array;
+    for (int i = 0; i < n; ++i) {
+        double v = (rng.UniformFloat() - .5) *
+                   std::pow(10., int(rng.UniformUInt32(12)) - 6);
+        const char *formats[] = {"%g", "%.3f", "%.9g", "%e", "%.17g", "%d"};
+        int format = rng.UniformUInt32(6);
+        std::string s = format == 5 ? StringPrintf("%d", int(rng.UniformUInt32(100000)))
+                                    : StringPrintf(formats[format], v);
+        strs->push_back(s);
+        array += s + ((i % 8) == 7 ? "\n" : " ");
+    }
+    return array + "]";
+}
+
+TEST(Parser, ScanNumberArray) {
+    std::vector<std::string> strs;
+    std::string array = randomNumbers(10000, &strs);
+    auto err = [](const char *err) {
+        EXPECT_TRUE(false) << "Unexpected error: " << err;
+    };
+
+    auto t = Tokenizer::CreateFromString("[ " + array + " \"next\"", err);
+    EXPECT_EQ("[", std::string(t->Next().data(), 1));
+    std::vector<double> values;
+    ASSERT_TRUE(t->ScanNumberArray(&values));
+    ASSERT_EQ(strs.size(), values.size());
+    for (size_t i = 0; i < strs.size(); ++i)
+        EXPECT_EQ(referenceNumber(strs[i]), values[i]) << strs[i];
+    string_view next = t->Next();
+    EXPECT_EQ("\"next\"", std::string(next.data(), next.size()));
+
+    // Anything other than numbers makes it decline without consuming
+    // input.
+    t = Tokenizer::CreateFromString("[ 1 2 \"three\" ]", err);
+    t->Next();
+    EXPECT_FALSE(t->ScanNumberArray(&values));
+    next = t->Next();
+    EXPECT_EQ("1", std::string(next.data(), next.size()));
+}
+
+TEST(Parser, BulkNumbersMatchPerToken) {
+    std::vector<std::string> strs;
+    std::string array = randomNumbers(20000, &strs);
+    auto err = [](const char *err) {
+        EXPECT_TRUE(false) << "Unexpected error: " << err;
+    };
+
+    // Token at a time with strtof()/strtod(), as the parser used to.
+    auto t = Tokenizer::CreateFromString(array, err);
+    std::vector<double> tokenValues;
+    while (true) {
+        string_view tok = t->Next();
+        if (tok == "]") break;
+        tokenValues.push_back(
+            referenceNumber(std::string(tok.data(), tok.size())));
+    }
+
+    t = Tokenizer::CreateFromString(array, err);
+    std::vector<double> bulkValues;
+    ASSERT_TRUE(t->ScanNumberArray(&bulkValues));
+    EXPECT_TRUE(tokenValues == bulkValues);
+}
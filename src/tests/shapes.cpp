@@ -13,6 +13,8 @@
 #include "shapes/paraboloid.h"
 #include "shapes/sphere.h"
 #include "shapes/triangle.h"
+#include "shapes/plymesh.h"
+#include "paramset.h"
 
 using namespace pbrt;
 
@@ -557,3 +559,108 @@ TEST(Triangle, BadCases) {
     SurfaceInteraction isect;
     EXPECT_FALSE(mesh[0]->Intersect(ray, &thit, &isect));
 }
+
+static std::vector<std::shared_ptr<Shape>> LoadPLY(const std::string &filename) {
+    ParamSet params;
+    std::unique_ptr<std::string[]> fn(new std::string[1]);
+    fn[0] = filename;
+    params.AddString("filename", std::move(fn), 1);
+    std::map<std::string, std::shared_ptr<Texture<Float>>> floatTextures;
+    static Transform identity;
+    return CreatePLYMesh(&identity, &identity, false, params, &floatTextures);
+}
+
+TEST(PLYMesh, MappedMatchesRply) {
+    // A small grid with normals and uvs, written as binary (handled by the
+    // memory-mapped path) and as ASCII (handled by rply).
+    const int res = 8, nv = res * res;
+    std::vector<Point3f> P;
+    std::vector<Normal3f> N;
+    std::vector<Point2f> UV;
+    for (int y = 0; y < res; ++y)
+        for (int x = 0; x < res; ++x) {
+            P.push_back(Point3f(x * .25f, y * .5f, .125f * x * y));
+            N.push_back(Normal3f(0, 0, 1));
+            UV.push_back(Point2f(x / Float(res), y / Float(res)));
+        }
+    std::vector<int> indices;
+    for (int y = 0; y < res - 1; ++y)
+        for (int x = 0; x < res - 1; ++x) {
+            int v = y * res + x;
+            indices.insert(indices.end(), {v, v + 1, v + res + 1, v,
+                                           v + res + 1, v + res});
+        }
+    int nTris = indices.size() / 3;
+
+    const char *binaryFn = "mapped_test.ply", *asciiFn = "rply_test.ply";
+    ASSERT_TRUE(WritePlyFile(binaryFn, nTris, indices.data(), nv, P.data(),
+                             nullptr, N.data(), UV.data(), nullptr));
+    FILE *f = fopen(asciiFn, "w");
+    ASSERT_TRUE(f != nullptr);
+    fprintf(f, "ply\nformat ascii 1.0\nelement vertex %d\n"
+               "property float x\nproperty float y\nproperty float z\n"
+               "property float nx\nproperty float ny\nproperty float nz\n"
+               "property float u\nproperty float v\n"
+               "element face %d\nproperty list uchar int vertex_indices\n"
+               "end_header\n", nv, nTris);
+    for (int i = 0; i < nv; ++i)
+        fprintf(f, "%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", P[i].x,
+                P[i].y, P[i].z, N[i].x, N[i].y, N[i].z, UV[i].x, UV[i].y);
+    for (int i = 0; i < nTris; ++i)
+        fprintf(f, "3 %d %d %d\n", indices[3 * i], indices[3 * i + 1],
+                indices[3 * i + 2]);
+    fclose(f);
+
+    std::vector<std::shared_ptr<Shape>> mapped = LoadPLY(binaryFn);
+    std::vector<std::shared_ptr<Shape>> rply = LoadPLY(asciiFn);
+    ASSERT_EQ(nTris, mapped.size());
+    ASSERT_EQ(nTris, rply.size());
+    const TriangleMesh *m0 =
+        std::static_pointer_cast<Triangle>(mapped[0])->GetMesh().get();
+    const TriangleMesh *m1 =
+        std::static_pointer_cast<Triangle>(rply[0])->GetMesh().get();
+    ASSERT_TRUE(m0->n && m0->uv);
+    EXPECT_EQ(m1->vertexIndices, m0->vertexIndices);
+    for (int i = 0; i < nv; ++i) {
+        EXPECT_EQ(m1->p[i], m0->p[i]);
+        EXPECT_EQ(m1->n[i], m0->n[i]);
+        EXPECT_EQ(m1->uv[i], m0->uv[i]);
+    }
+    EXPECT_EQ(0, remove(binaryFn));
+    EXPECT_EQ(0, remove(asciiFn));
+}
+
+TEST(PLYMesh, MappedQuadsAndExtraProperties) {
+    // Vertex records interleave an unused color property, and the single
+    // face is a quad that should be split into two triangles.
+    const char *fn = "mapped_quad.ply";
+    FILE *f = fopen(fn, "wb");
+    ASSERT_TRUE(f != nullptr);
+    fprintf(f, "ply\nformat binary_little_endian 1.0\n"
+               "comment written by pbrt_test\nelement vertex 4\n"
+               "property float x\nproperty uchar red\nproperty float y\n"
+               "property float z\nelement face 1\n"
+               "property list uchar int vertex_indices\nend_header\n");
+    const float pos[4][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+    for (int i = 0; i < 4; ++i) {
+        uint8_t red = 255;
+        fwrite(&pos[i][0], sizeof(float), 1, f);
+        fwrite(&red, 1, 1, f);
+        fwrite(&pos[i][1], sizeof(float), 2, f);
+    }
+    uint8_t count = 4;
+    const int quad[4] = {0, 1, 2, 3};
+    fwrite(&count, 1, 1, f);
+    fwrite(quad, sizeof(int), 4, f);
+    fclose(f);
+
+    std::vector<std::shared_ptr<Shape>> tris = LoadPLY(fn);
+    ASSERT_EQ(2, tris.size());
+    const TriangleMesh *mesh =
+        std::static_pointer_cast<Triangle>(tris[0])->GetMesh().get();
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 0, 2}), mesh->vertexIndices);
+    EXPECT_EQ(Point3f(1, 1, 0), mesh->p[2]);
+    EXPECT_EQ(Point3f(0, 1, 0), mesh->p[3]);
+    EXPECT_TRUE(mesh->n == nullptr);
+    EXPECT_EQ(0, remove(fn));
+}
@@ -0,0 +1,91 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "rng.h"
+#include "texcache.h"
+
+using namespace pbrt;
+
+TEST(TextureTileCache, PagedMIPMapMatchesInMemory) {
+    ParallelInit();
+    // A non-power-of-two image, so that resampling is exercised as well.
+    Point2i res(37, 23);
+    std::vector<RGBSpectrum> image(res.x * res.y);
+    RNG rng;
+    for (RGBSpectrum &texel : image)
+        for (int c = 0; c < 3; ++c) texel[c] = rng.UniformFloat();
+    MIPMap<RGBSpectrum> mipmap(res, image.data());
+
+    std::vector<Point2i> levelResolution;
+    int sRes = mipmap.Width(), tRes = mipmap.Height();
+    for (int level = 0; level < mipmap.Levels(); ++level) {
+        levelResolution.push_back(Point2i(sRes, tRes));
+        sRes = std::max(1, sRes / 2);
+        tRes = std::max(1, tRes / 2);
+    }
+    const char *filename = "paged.txp";
+    ASSERT_TRUE(WriteTiledMIPFile(filename, 8, levelResolution,
+                                  [&](int level, int s, int t) {
+                                      return mipmap.Texel(level, s, t);
+                                  }));
+    std::shared_ptr<TiledMIPFile> file = TiledMIPFile::Open(filename);
+    ASSERT_TRUE(file != nullptr);
+
+    // Room for only two 8x8 tiles, so lookups keep evicting.
+    size_t tileBytes = 8 * 8 * sizeof(RGBSpectrum);
+    std::shared_ptr<TextureTileCache> cache =
+        std::make_shared<TextureTileCache>(2 * tileBytes);
+    MIPMap<RGBSpectrum> paged(
+        std::unique_ptr<PagedTexels<RGBSpectrum>>(new PagedTexels<RGBSpectrum>(
+            file, cache, [](const RGBSpectrum &rgb) { return rgb; })));
+    EXPECT_EQ(mipmap.Levels(), paged.Levels());
+
+    for (int i = 0; i < 500; ++i) {
+        Point2f st(2 * rng.UniformFloat() - .5f, 2 * rng.UniformFloat() - .5f);
+        Float width = .2f * rng.UniformFloat();
+        EXPECT_EQ(mipmap.Lookup(st, width), paged.Lookup(st, width));
+        Vector2f dst0(.05f * rng.UniformFloat(), .01f * rng.UniformFloat());
+        Vector2f dst1(-.01f * rng.UniformFloat(), .02f * rng.UniformFloat());
+        EXPECT_EQ(mipmap.Lookup(st, dst0, dst1), paged.Lookup(st, dst0, dst1));
+        EXPECT_LE(cache->ResidentBytes(), 2 * tileBytes);
+    }
+    ParallelCleanup();
+    remove(filename);
+}
+
+TEST(TiledMIPFile, PrecomputedPyramidMatchesBuilt) {
+    ParallelInit();
+    Point2i res(20, 9);
+    std::vector<Float> image(res.x * res.y);
+    RNG rng;
+    for (Float &texel : image) texel = rng.UniformFloat();
+    MIPMap<Float> mipmap(res, image.data(), false, false, 8.f,
+                         ImageWrap::Clamp);
+
+    std::vector<Point2i> levelResolution;
+    int sRes = mipmap.Width(), tRes = mipmap.Height();
+    for (int level = 0; level < mipmap.Levels(); ++level) {
+        levelResolution.push_back(Point2i(sRes, tRes));
+        sRes = std::max(1, sRes / 2);
+        tRes = std::max(1, tRes / 2);
+    }
+    const char *filename = "precomputed.txp";
+    ASSERT_TRUE(WriteTiledMIPFile(filename, 16, levelResolution,
+                                  [&](int level, int s, int t) {
+                                      return RGBSpectrum(
+                                          mipmap.Texel(level, s, t));
+                                  }));
+    std::shared_ptr<TiledMIPFile> file = TiledMIPFile::Open(filename);
+    ASSERT_TRUE(file != nullptr);
+    MIPMap<Float> loaded(*file, [](const RGBSpectrum &rgb) { return rgb[0]; },
+                         false, false, 8.f, ImageWrap::Clamp);
+    ASSERT_EQ(mipmap.Levels(), loaded.Levels());
+    for (int level = 0; level < mipmap.Levels(); ++level)
+        for (int t = 0; t < levelResolution[level].y; ++t)
+            for (int s = 0; s < levelResolution[level].x; ++s)
+                EXPECT_EQ(mipmap.Texel(level, s, t), loaded.Texel(level, s, t));
+    ParallelCleanup();
+    remove(filename);
+}
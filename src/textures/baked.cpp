@@ -0,0 +1,281 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// textures/baked.cpp*
+#include "textures/baked.h"
+#include "textures/imagemap.h"
+#include "interaction.h"
+#include "parallel.h"
+#include "rng.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_COUNTER("Texture/Baked texture samples", nBakeSamples);
+STAT_COUNTER("Texture/Baked grid lookups past budget", nUnbakedLookups);
+STAT_MEMORY_COUNTER("Memory/Baked texture grids", bakedGridMemory);
+STAT_FLOAT_DISTRIBUTION("Texture/Baked texture error at check points",
+                        bakeError);
+
+// Baked Texture Local Definitions
+static Float difference(Float a, Float b) { return std::abs(a - b); }
+
+static Float difference(const Spectrum &a, const Spectrum &b) {
+    Spectrum d = a - b;
+    return std::sqrt((d * d).MaxComponentValue());
+}
+
+static uint32_t hash(const Point3i &p) {
+    // Multiply unsigned values so that the products wrap around rather
+    // than overflow
+    return (uint32_t(p.x) * 73856093u) ^ (uint32_t(p.y) * 19349663u) ^
+           (uint32_t(p.z) * 83492791u);
+}
+
+// UVBakedTexture Method Definitions
+template <typename T>
+UVBakedTexture<T>::UVBakedTexture(std::unique_ptr<Texture<T>> tex,
+                                  int resolution) {
+    ProfilePhase _(Prof::TextureBaking);
+    std::unique_ptr<T[]> texels(new T[resolution * resolution]);
+    ParallelFor([&](int64_t t) {
+        SurfaceInteraction si;
+        for (int s = 0; s < resolution; ++s) {
+            si.uv = Point2f((s + .5f) / resolution, (t + .5f) / resolution);
+            texels[t * resolution + s] = tex->Evaluate(si);
+        }
+    }, resolution);
+    nBakeSamples += resolution * resolution;
+    mipmap.reset(new MIPMap<T>(Point2i(resolution, resolution), texels.get()));
+
+    // Compare the texture to bilinear lookups at a few random points
+    RNG rng;
+    SurfaceInteraction si;
+    for (int i = 0; i < 64; ++i) {
+        si.uv = Point2f(rng.UniformFloat(), rng.UniformFloat());
+        ReportValue(bakeError,
+                    difference(tex->Evaluate(si), mipmap->Lookup(si.uv)));
+    }
+}
+
+// GridBakedTexture Method Definitions
+template <typename T>
+GridBakedTexture<T>::GridBakedTexture(std::unique_ptr<Texture<T>> tex,
+                                      const Transform &tex2world,
+                                      Float spacing, size_t budgetBytes)
+    : tex(std::move(tex)),
+      worldToTexture(tex2world),
+      textureToWorld(Inverse(tex2world)),
+      spacing(spacing),
+      maxBricks(Clamp(budgetBytes / sizeof(Brick), 1, 1 << 24)),
+      tableMask(RoundUpPow2(2 * maxBricks) - 1),
+      table(new std::atomic<Brick *>[tableMask + 1]) {
+    for (int i = 0; i <= tableMask; ++i) table[i] = nullptr;
+}
+
+template <typename T>
+GridBakedTexture<T>::~GridBakedTexture() {
+    for (int i = 0; i <= tableMask; ++i) delete table[i].load();
+}
+
+template <typename T>
+T GridBakedTexture<T>::Evaluate(const SurfaceInteraction &si) const {
+    // Find the brick that _si_'s lattice cell is in
+    Point3f p = worldToTexture(si.p) / spacing;
+    if (MaxComponent(Abs(Vector3f(p))) > 1e8f) return tex->Evaluate(si);
+    Point3i origin(BrickCells * (int)std::floor(p.x / BrickCells),
+                   BrickCells * (int)std::floor(p.y / BrickCells),
+                   BrickCells * (int)std::floor(p.z / BrickCells));
+    const Brick *brick = findBrick(origin);
+    if (!brick) {
+        ++nUnbakedLookups;
+        return tex->Evaluate(si);
+    }
+    return interpolate(*brick, p - Vector3f(Point3f(origin)));
+}
+
+template <typename T>
+T GridBakedTexture<T>::interpolate(const Brick &brick, const Point3f &p) {
+    int x = Clamp((int)p.x, 0, BrickCells - 1);
+    int y = Clamp((int)p.y, 0, BrickCells - 1);
+    int z = Clamp((int)p.z, 0, BrickCells - 1);
+    Float dx = p.x - x, dy = p.y - y, dz = p.z - z;
+    auto v = [&](int i, int j, int k) {
+        return brick.values[((z + k) * BrickPoints + y + j) * BrickPoints +
+                            x + i];
+    };
+    return (1 - dz) * ((1 - dy) * ((1 - dx) * v(0, 0, 0) + dx * v(1, 0, 0)) +
+                       dy * ((1 - dx) * v(0, 1, 0) + dx * v(1, 1, 0))) +
+           dz * ((1 - dy) * ((1 - dx) * v(0, 0, 1) + dx * v(1, 0, 1)) +
+                 dy * ((1 - dx) * v(0, 1, 1) + dx * v(1, 1, 1)));
+}
+
+template <typename T>
+const typename GridBakedTexture<T>::Brick *GridBakedTexture<T>::findBrick(
+    const Point3i &origin) const {
+    int index = hash(origin) & tableMask;
+    Brick *baked = nullptr;
+    for (int probe = 0; probe <= tableMask; ++probe) {
+        Brick *entry = table[index].load(std::memory_order_acquire);
+        if (!entry) {
+            // Bake the brick, if the budget allows, and try to claim this
+            // entry for it; another thread may get there first
+            if (!baked) {
+                if (full.load(std::memory_order_relaxed)) return nullptr;
+                if (nBricks++ >= maxBricks) {
+                    --nBricks;
+                    full.store(true, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                baked = bake(origin);
+            }
+            if (table[index].compare_exchange_strong(
+                    entry, baked, std::memory_order_acq_rel))
+                return baked;
+        }
+        if (entry->origin == origin) {
+            if (baked) {
+                delete baked;
+                --nBricks;
+            }
+            return entry;
+        }
+        index = (index + 1) & tableMask;
+    }
+    // The table has room for twice the budget's bricks, so this is only
+    // reached if all of them are in use
+    delete baked;
+    return nullptr;
+}
+
+template <typename T>
+typename GridBakedTexture<T>::Brick *GridBakedTexture<T>::bake(
+    const Point3i &origin) const {
+    ProfilePhase _(Prof::TextureBaking);
+    Brick *brick = new Brick;
+    brick->origin = origin;
+    SurfaceInteraction si;
+    for (int z = 0; z < BrickPoints; ++z)
+        for (int y = 0; y < BrickPoints; ++y)
+            for (int x = 0; x < BrickPoints; ++x) {
+                Point3f p(origin.x + x, origin.y + y, origin.z + z);
+                si.p = textureToWorld(p * spacing);
+                brick->values[(z * BrickPoints + y) * BrickPoints + x] =
+                    tex->Evaluate(si);
+            }
+    nBakeSamples += BrickPoints * BrickPoints * BrickPoints;
+    bakedGridMemory += sizeof(Brick);
+
+    // Compare the texture to the interpolated brick at a random point
+    RNG rng(hash(origin));
+    Point3f p(BrickCells * rng.UniformFloat(), BrickCells * rng.UniformFloat(),
+              BrickCells * rng.UniformFloat());
+    si.p = textureToWorld((Point3f(origin) + Vector3f(p)) * spacing);
+    ReportValue(bakeError,
+                difference(tex->Evaluate(si), interpolate(*brick, p)));
+    return brick;
+}
+
+template <typename T>
+static Texture<T> *createBakedTexture(const std::string &name, Texture<T> *tex,
+                                      const Transform &tex2world,
+                                      const TextureParams &tp) {
+    std::unique_ptr<Texture<T>> texture(tex);
+    std::string bake = tp.FindString("bake", "");
+    if (bake != "uv" && bake != "grid") {
+        Error("Bake mode \"%s\" unknown. Texture will not be baked.",
+              bake.c_str());
+        return texture.release();
+    }
+
+    // Each way of baking evaluates the texture with only part of the
+    // shading point filled in, so pick the one that matches what it
+    // depends on.
+    TextureDomain domain = texture->Domain();
+    if (domain == TextureDomain::Constant) return texture.release();
+    if (domain == TextureDomain::Other) {
+        Warning("\"%s\" texture doesn't depend on just (u,v) or just the "
+                "position. Texture will not be baked.", name.c_str());
+        return texture.release();
+    }
+    if (bake == "uv" && domain == TextureDomain::Position) {
+        Warning("\"%s\" texture varies over texture space and can't be "
+                "baked over (u,v). Baking it into a grid instead.",
+                name.c_str());
+        bake = "grid";
+    } else if (bake == "grid" && domain == TextureDomain::UV) {
+        Warning("\"%s\" texture varies over (u,v) and can't be baked into "
+                "a grid. Baking it over (u,v) instead.", name.c_str());
+        bake = "uv";
+    }
+
+    // Image textures wrapped by _texture_ may still be loading in the
+    // background; they need their MIP maps before they can be evaluated.
+    ImageTexture<Float, Float>::FinishLoading();
+    ImageTexture<RGBSpectrum, Spectrum>::FinishLoading();
+    if (bake == "uv") {
+        int resolution = tp.FindInt("bakeresolution", 512);
+        return new UVBakedTexture<T>(std::move(texture),
+                                     RoundUpPow2(std::max(1, resolution)));
+    } else {
+        Float spacing = tp.FindFloat("bakespacing", 1.f / 64);
+        int budgetMB = tp.FindInt("bakebudget", 256);
+        if (spacing <= 0) {
+            Error("\"bakespacing\" must be positive. Using 1/64.");
+            spacing = 1.f / 64;
+        }
+        return new GridBakedTexture<T>(std::move(texture), tex2world, spacing,
+                                       size_t(std::max(1, budgetMB)) << 20);
+    }
+}
+
+Texture<Float> *CreateBakedFloatTexture(const std::string &name,
+                                        Texture<Float> *tex,
+                                        const Transform &tex2world,
+                                        const TextureParams &tp) {
+    return createBakedTexture(name, tex, tex2world, tp);
+}
+
+Texture<Spectrum> *CreateBakedSpectrumTexture(const std::string &name,
+                                              Texture<Spectrum> *tex,
+                                              const Transform &tex2world,
+                                              const TextureParams &tp) {
+    return createBakedTexture(name, tex, tex2world, tp);
+}
+
+template class UVBakedTexture<Float>;
+template class UVBakedTexture<Spectrum>;
+template class GridBakedTexture<Float>;
+template class GridBakedTexture<Spectrum>;
+
+}  // namespace pbrt
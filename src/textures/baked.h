@@ -0,0 +1,136 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_TEXTURES_BAKED_H
+#define PBRT_TEXTURES_BAKED_H
+
+// textures/baked.h*
+#include "pbrt.h"
+#include "texture.h"
+#include "mipmap.h"
+#include "paramset.h"
+#include <atomic>
+
+namespace pbrt {
+
+// UVBakedTexture Declarations
+
+// Samples a texture once over $(u,v) \in [0,1]^2$ and then looks it up
+// from a MIPMap, so that expensive procedural textures are only evaluated
+// while baking. The baked texture repeats outside of $[0,1]^2$. Only the
+// $(u,v)$ of the shading point is available while baking, so this is only
+// used for textures whose domain is _TextureDomain::UV_.
+template <typename T>
+class UVBakedTexture : public Texture<T> {
+  public:
+    // UVBakedTexture Public Methods
+    UVBakedTexture(std::unique_ptr<Texture<T>> tex, int resolution);
+    T Evaluate(const SurfaceInteraction &si) const {
+        Vector2f dstdx, dstdy;
+        Point2f st = mapping.Map(si, &dstdx, &dstdy);
+        return mipmap->Lookup(st, dstdx, dstdy);
+    }
+    TextureDomain Domain() const { return TextureDomain::UV; }
+
+  private:
+    // UVBakedTexture Private Data
+    UVMapping2D mapping;
+    std::unique_ptr<MIPMap<T>> mipmap;
+};
+
+// GridBakedTexture Declarations
+
+// Caches a texture that's defined over 3D texture space on a lattice with
+// the given spacing, which is filled in a brick of cells at a time as
+// shading points reach it; lookups interpolate trilinearly. Once the
+// memory budget is used up, points outside the baked bricks evaluate the
+// texture directly. Only the position of the shading point is available
+// while baking, so this is only used for textures whose domain is
+// _TextureDomain::Position_.
+template <typename T>
+class GridBakedTexture : public Texture<T> {
+  public:
+    // GridBakedTexture Public Methods
+    GridBakedTexture(std::unique_ptr<Texture<T>> tex,
+                     const Transform &tex2world, Float spacing,
+                     size_t budgetBytes);
+    ~GridBakedTexture();
+    T Evaluate(const SurfaceInteraction &si) const;
+    TextureDomain Domain() const { return TextureDomain::Position; }
+
+  private:
+    // GridBakedTexture Private Declarations
+    static PBRT_CONSTEXPR int BrickCells = 8;
+    static PBRT_CONSTEXPR int BrickPoints = BrickCells + 1;
+    struct Brick {
+        Point3i origin;
+        T values[BrickPoints * BrickPoints * BrickPoints];
+    };
+
+    // GridBakedTexture Private Methods
+    const Brick *findBrick(const Point3i &origin) const;
+    Brick *bake(const Point3i &origin) const;
+    // _p_ is in lattice cells, relative to the brick's origin
+    static T interpolate(const Brick &brick, const Point3f &p);
+
+    // GridBakedTexture Private Data
+    std::unique_ptr<Texture<T>> tex;
+    const Transform worldToTexture, textureToWorld;
+    const Float spacing;
+    const int maxBricks;
+    // Open-addressed hash table of the baked bricks; entries are only
+    // ever set once, so lookups don't need a lock
+    const int tableMask;
+    std::unique_ptr<std::atomic<Brick *>[]> table;
+    mutable std::atomic<int> nBricks{0};
+    // Set once the budget is used up, so that lookups of unbaked bricks
+    // stop touching _nBricks_
+    mutable std::atomic<bool> full{false};
+};
+
+Texture<Float> *CreateBakedFloatTexture(const std::string &name,
+                                        Texture<Float> *tex,
+                                        const Transform &tex2world,
+                                        const TextureParams &tp);
+Texture<Spectrum> *CreateBakedSpectrumTexture(const std::string &name,
+                                              Texture<Spectrum> *tex,
+                                              const Transform &tex2world,
+                                              const TextureParams &tp);
+
+}  // namespace pbrt
+
+#endif  // PBRT_TEXTURES_BAKED_H
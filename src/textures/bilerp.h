@@ -59,6 +59,7 @@ class BilerpTexture : public Texture<T> {
         return (1 - st[0]) * (1 - st[1]) * v00 + (1 - st[0]) * (st[1]) * v01 +
                (st[0]) * (1 - st[1]) * v10 + (st[0]) * (st[1]) * v11;
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     // BilerpTexture Private Data
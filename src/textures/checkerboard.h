@@ -99,6 +99,10 @@ class Checkerboard2DTexture : public Texture<T> {
                    area2 * tex2->Evaluate(si);
         }
     }
+    TextureDomain Domain() const {
+        return Combine(mapping->Domain(),
+                       Combine(tex1->Domain(), tex2->Domain()));
+    }
 
   private:
     // Checkerboard2DTexture Private Data
@@ -126,6 +130,10 @@ class Checkerboard3DTexture : public Texture<T> {
         else
             return tex2->Evaluate(si);
     }
+    TextureDomain Domain() const {
+        return Combine(mapping->Domain(),
+                       Combine(tex1->Domain(), tex2->Domain()));
+    }
 
   private:
     // Checkerboard3DTexture Private Data
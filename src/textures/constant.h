@@ -52,6 +52,7 @@ class ConstantTexture : public Texture<T> {
     // ConstantTexture Public Methods
     ConstantTexture(const T &value) : value(value) {}
     T Evaluate(const SurfaceInteraction &) const { return value; }
+    TextureDomain Domain() const { return TextureDomain::Constant; }
 
   private:
     T value;
@@ -76,6 +76,10 @@ class DotsTexture : public Texture<T> {
         }
         return outsideDot->Evaluate(si);
     }
+    TextureDomain Domain() const {
+        return Combine(mapping->Domain(),
+                       Combine(outsideDot->Domain(), insideDot->Domain()));
+    }
 
   private:
     // DotsTexture Private Data
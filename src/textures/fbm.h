@@ -58,6 +58,7 @@ class FBmTexture : public Texture<T> {
         Point3f P = mapping->Map(si, &dpdx, &dpdy);
         return FBm(P, dpdx, dpdy, omega, octaves);
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     std::unique_ptr<TextureMapping3D> mapping;
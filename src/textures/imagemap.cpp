@@ -35,31 +35,115 @@
 #include "textures/imagemap.h"
 #include "imageio.h"
 #include "stats.h"
+#include "parallel.h"
+#include <algorithm>
 
 namespace pbrt {
 
+// All paged textures share a single cache so that the memory budget
+// applies to the scene as a whole
+static std::shared_ptr<TextureTileCache> GetTextureTileCache() {
+    static std::shared_ptr<TextureTileCache> cache =
+        std::make_shared<TextureTileCache>(size_t(PbrtOptions.textureBudgetMB)
+                                           << 20);
+    return cache;
+}
+
 // ImageTexture Method Definitions
 template <typename Tmemory, typename Treturn>
 ImageTexture<Tmemory, Treturn>::ImageTexture(
     std::unique_ptr<TextureMapping2D> mapping, const std::string &filename,
     bool doTrilinear, bool noFiltering, Float maxAniso, ImageWrap wrapMode, Float scale,
-    bool gamma, bool useSPD)
-    : mapping(std::move(mapping)), spdFlag(useSPD) {
-    mipmap =
-        GetTexture(filename, doTrilinear, noFiltering, maxAniso, wrapMode, scale, gamma);
+    bool gamma, bool useSPD, bool pageTiles, bool anisotropicProbes,
+    TexelFormat texelFormat)
+    : mapping(std::move(mapping)),
+      spdFlag(useSPD),
+      anisotropicProbes(anisotropicProbes) {
+    pendingMIPMap = GetTexture(filename, doTrilinear, noFiltering, maxAniso,
+                               wrapMode, scale, gamma, pageTiles, texelFormat);
+    // Textures that are still loading are hooked up in _FinishLoading()_
+    if (pendingMIPMap.wait_for(std::chrono::seconds(0)) ==
+        std::future_status::ready) {
+        mipmap = pendingMIPMap.get().get();
+        pendingMIPMap = {};
+    } else
+        pendingTextures.push_back(this);
+}
+
+template <typename Tmemory, typename Treturn>
+ImageTexture<Tmemory, Treturn>::~ImageTexture() {
+    if (pendingMIPMap.valid())
+        pendingTextures.erase(std::find(pendingTextures.begin(),
+                                        pendingTextures.end(), this));
 }
 
 template <typename Tmemory, typename Treturn>
-MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
-    const std::string &filename, bool doTrilinear, bool noFiltering, Float maxAniso,
-    ImageWrap wrap, Float scale, bool gamma) {
+void ImageTexture<Tmemory, Treturn>::FinishLoading() {
+    for (ImageTexture *tex : pendingTextures) {
+        tex->mipmap = tex->pendingMIPMap.get().get();
+        tex->pendingMIPMap = {};
+    }
+    pendingTextures.clear();
+}
+
+template <typename Tmemory, typename Treturn>
+std::shared_future<std::unique_ptr<MIPMap<Tmemory>>>
+ImageTexture<Tmemory, Treturn>::GetTexture(const std::string &filename,
+                                           bool doTrilinear, bool noFiltering,
+                                           Float maxAniso, ImageWrap wrap,
+                                           Float scale, bool gamma,
+                                           bool pageTiles,
+                                           TexelFormat texelFormat) {
     // Return _MIPMap_ from texture cache if present
-    TexInfo texInfo(filename, doTrilinear, noFiltering, maxAniso, wrap, scale, gamma);
-    if (textures.find(texInfo) != textures.end())
-        return textures[texInfo].get();
+    TexInfo texInfo(filename, doTrilinear, noFiltering, maxAniso, wrap, scale,
+                    gamma, pageTiles, texelFormat);
+    auto iter = textures.find(texInfo);
+    if (iter != textures.end()) return iter->second;
 
+    // Start loading the _MIPMap_ for _filename_ in the background so that
+    // parsing can continue
+    std::shared_future<std::unique_ptr<MIPMap<Tmemory>>> mipmap =
+        RunAsync([texInfo]() { return LoadMIPMap(texInfo); }).share();
+    textures[texInfo] = mipmap;
+    return mipmap;
+}
+
+template <typename Tmemory, typename Treturn>
+std::unique_ptr<MIPMap<Tmemory>> ImageTexture<Tmemory, Treturn>::LoadMIPMap(
+    const TexInfo &texInfo) {
+    const std::string &filename = texInfo.filename;
+    bool doTrilinear = texInfo.doTrilinear, noFiltering = texInfo.noFiltering;
+    Float maxAniso = texInfo.maxAniso, scale = texInfo.scale;
+    ImageWrap wrap = texInfo.wrapMode;
+    bool gamma = texInfo.gamma;
     // Create _MIPMap_ for _filename_
     ProfilePhase _(Prof::TextureLoading);
+    if (HasExtension(filename, ".txp")) {
+        // Tiled files hold a precomputed pyramid; their tiles are either
+        // paged in on demand or all converted up front
+        std::shared_ptr<TiledMIPFile> file = TiledMIPFile::Open(filename);
+        if (file) {
+            auto convert = [scale, gamma](const RGBSpectrum &rgb) {
+                Tmemory value;
+                convertIn(rgb, &value, scale, gamma);
+                return value;
+            };
+            MIPMap<Tmemory> *mipmap;
+            if (texInfo.pageTiles)
+                mipmap = new MIPMap<Tmemory>(
+                    std::unique_ptr<PagedTexels<Tmemory>>(
+                        new PagedTexels<Tmemory>(std::move(file),
+                                                 GetTextureTileCache(),
+                                                 convert)),
+                    doTrilinear, noFiltering, maxAniso, wrap);
+            else {
+                mipmap = new MIPMap<Tmemory>(*file, convert, doTrilinear,
+                                             noFiltering, maxAniso, wrap);
+                mipmap->Compact(texInfo.texelFormat);
+            }
+            return std::unique_ptr<MIPMap<Tmemory>>(mipmap);
+        }
+    }
     Point2i resolution;
     std::unique_ptr<RGBSpectrum[]> texels = ReadImage(filename, &resolution);
     if (!texels) {
@@ -89,18 +173,37 @@ MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
             convertIn(texels[i], &convertedTexels[i], scale, gamma);
         mipmap = new MIPMap<Tmemory>(resolution, convertedTexels.get(),
                                      doTrilinear, noFiltering, maxAniso, wrap);
+        mipmap->Compact(texInfo.texelFormat);
     } else {
         // Create one-valued _MIPMap_
         Tmemory oneVal = scale;
         mipmap = new MIPMap<Tmemory>(Point2i(1, 1), &oneVal);
     }
-    textures[texInfo].reset(mipmap);
-    return mipmap;
+    return std::unique_ptr<MIPMap<Tmemory>>(mipmap);
+}
+
+// Returns the texel format named by the "texelformat" parameter. Textures
+// are stored at full precision unless a compact format is requested;
+// "auto" keeps 8-bit images at 8 bits per channel, as sRGB when they're
+// gamma corrected and as half floats otherwise.
+static TexelFormat GetTexelFormat(const TextureParams &tp,
+                                  const std::string &filename, bool gamma) {
+    std::string name = tp.FindString("texelformat", "float");
+    TexelFormat format = TexelFormat::Float;
+    if (name == "auto") {
+        if (HasExtension(filename, ".png") || HasExtension(filename, ".tga"))
+            format = gamma ? TexelFormat::SRGB8 : TexelFormat::Half;
+    } else if (!ParseTexelFormat(name, &format))
+        Error("Texel format \"%s\" unknown. Using \"float\".", name.c_str());
+    return format;
 }
 
 template <typename Tmemory, typename Treturn>
-std::map<TexInfo, std::unique_ptr<MIPMap<Tmemory>>>
+std::map<TexInfo, std::shared_future<std::unique_ptr<MIPMap<Tmemory>>>>
     ImageTexture<Tmemory, Treturn>::textures;
+template <typename Tmemory, typename Treturn>
+std::vector<ImageTexture<Tmemory, Treturn> *>
+    ImageTexture<Tmemory, Treturn>::pendingTextures;
 ImageTexture<Float, Float> *CreateImageFloatTexture(const Transform &tex2world,
                                                     const TextureParams &tp) {
     // Initialize 2D texture mapping _map_ from _tp_
@@ -141,9 +244,13 @@ ImageTexture<Float, Float> *CreateImageFloatTexture(const Transform &tex2world,
     bool gamma = tp.FindBool("gamma", HasExtension(filename, ".tga") ||
                                           HasExtension(filename, ".png"));
     bool useSPD = tp.FindBool("useSPD",false);
+    bool pageTiles = tp.FindBool("pagetiles", true);
+    bool probes = tp.FindBool("anisotropicprobes", false);
+    TexelFormat texelFormat = GetTexelFormat(tp, filename, gamma);
     
     return new ImageTexture<Float, Float>(std::move(map), filename, trilerp, noFiltering,
-                                          maxAniso, wrapMode, scale, gamma,useSPD);
+                                          maxAniso, wrapMode, scale, gamma,useSPD,
+                                          pageTiles, probes, texelFormat);
 }
 
 ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(
@@ -186,8 +293,12 @@ ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(
     bool gamma = tp.FindBool("gamma", HasExtension(filename, ".tga") ||
                                           HasExtension(filename, ".png"));
     bool useSPD = tp.FindBool("useSPD",false);
+    bool pageTiles = tp.FindBool("pagetiles", true);
+    bool probes = tp.FindBool("anisotropicprobes", false);
+    TexelFormat texelFormat = GetTexelFormat(tp, filename, gamma);
     return new ImageTexture<RGBSpectrum, Spectrum>(
-        std::move(map), filename, trilerp, noFilt, maxAniso, wrapMode, scale, gamma, useSPD);
+        std::move(map), filename, trilerp, noFilt, maxAniso, wrapMode, scale, gamma, useSPD,
+        pageTiles, probes, texelFormat);
 }
 
 template class ImageTexture<Float, Float>;
@@ -43,6 +43,7 @@
 #include "texture.h"
 #include "mipmap.h"
 #include "paramset.h"
+#include <future>
 #include <map>
 
 namespace pbrt {
@@ -50,14 +51,16 @@ namespace pbrt {
 // TexInfo Declarations
 struct TexInfo {
     TexInfo(const std::string &f, bool dt, bool nf, Float ma, ImageWrap wm, Float sc,
-            bool gamma)
+            bool gamma, bool pageTiles, TexelFormat texelFormat)
         : filename(f),
           doTrilinear(dt),
           noFiltering(nf),
           maxAniso(ma),
           wrapMode(wm),
           scale(sc),
-          gamma(gamma) {}
+          gamma(gamma),
+          pageTiles(pageTiles),
+          texelFormat(texelFormat) {}
     std::string filename;
     bool doTrilinear;
     bool noFiltering;
@@ -65,12 +68,17 @@ struct TexInfo {
     ImageWrap wrapMode;
     Float scale;
     bool gamma;
+    bool pageTiles;
+    TexelFormat texelFormat;
     bool operator<(const TexInfo &t2) const {
         if (filename != t2.filename) return filename < t2.filename;
         if (doTrilinear != t2.doTrilinear) return doTrilinear < t2.doTrilinear;
         if (maxAniso != t2.maxAniso) return maxAniso < t2.maxAniso;
         if (scale != t2.scale) return scale < t2.scale;
         if (gamma != t2.gamma) return !gamma;
+        if (pageTiles != t2.pageTiles) return pageTiles < t2.pageTiles;
+        if (texelFormat != t2.texelFormat)
+            return texelFormat < t2.texelFormat;
         return wrapMode < t2.wrapMode;
     }
 };
@@ -82,14 +90,22 @@ class ImageTexture : public Texture<Treturn> {
     // ImageTexture Public Methods
     ImageTexture(std::unique_ptr<TextureMapping2D> m,
                  const std::string &filename, bool doTri, bool noFilt, Float maxAniso,
-                 ImageWrap wm, Float scale, bool gamma, bool useSPD);
+                 ImageWrap wm, Float scale, bool gamma, bool useSPD,
+                 bool pageTiles = true, bool anisotropicProbes = false,
+                 TexelFormat texelFormat = TexelFormat::Float);
+    ~ImageTexture();
+    static void FinishLoading();
     static void ClearCache() {
+        for (auto &tex : textures) tex.second.wait();
         textures.erase(textures.begin(), textures.end());
     }
     Treturn Evaluate(const SurfaceInteraction &si) const {
+        DCHECK(mipmap != nullptr);
         Vector2f dstdx, dstdy;
         Point2f st = mapping->Map(si, &dstdx, &dstdy);
-        Tmemory mem = mipmap->Lookup(st, dstdx, dstdy);
+        Tmemory mem = anisotropicProbes
+                          ? mipmap->LookupProbes(st, dstdx, dstdy)
+                          : mipmap->Lookup(st, dstdx, dstdy);
         Treturn ret;
         if(spdFlag){
             convertOutDisp(mem, &ret);
@@ -98,12 +114,15 @@ class ImageTexture : public Texture<Treturn> {
         }
         return ret;
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     // ImageTexture Private Methods
-    static MIPMap<Tmemory> *GetTexture(const std::string &filename,
-                                       bool doTrilinear, bool noFiltering, Float maxAniso,
-                                       ImageWrap wm, Float scale, bool gamma);
+    static std::shared_future<std::unique_ptr<MIPMap<Tmemory>>> GetTexture(
+        const std::string &filename, bool doTrilinear, bool noFiltering,
+        Float maxAniso, ImageWrap wm, Float scale, bool gamma, bool pageTiles,
+        TexelFormat texelFormat);
+    static std::unique_ptr<MIPMap<Tmemory>> LoadMIPMap(const TexInfo &texInfo);
     static void convertIn(const RGBSpectrum &from, RGBSpectrum *to, Float scale,
                           bool gamma) {
         for (int i = 0; i < RGBSpectrum::nSamples; ++i)
@@ -131,9 +150,15 @@ class ImageTexture : public Texture<Treturn> {
     
     // ImageTexture Private Data
     std::unique_ptr<TextureMapping2D> mapping;
-    MIPMap<Tmemory> *mipmap;
-    static std::map<TexInfo, std::unique_ptr<MIPMap<Tmemory>>> textures;
+    MIPMap<Tmemory> *mipmap = nullptr;
+    // Set while _mipmap_ is still being loaded in the background
+    std::shared_future<std::unique_ptr<MIPMap<Tmemory>>> pendingMIPMap;
+    static std::map<TexInfo,
+                    std::shared_future<std::unique_ptr<MIPMap<Tmemory>>>>
+        textures;
+    static std::vector<ImageTexture *> pendingTextures;
     bool spdFlag; // Added by TL
+    const bool anisotropicProbes;
 };
 
 extern template class ImageTexture<Float, Float>;
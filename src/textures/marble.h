@@ -87,6 +87,7 @@ class MarbleTexture : public Texture<Spectrum> {
         // Extra scale of 1.5 to increase variation among colors
         return 1.5f * ((1.f - t) * s0 + t * s1);
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     // MarbleTexture Private Data
@@ -59,6 +59,10 @@ class MixTexture : public Texture<T> {
         Float amt = amount->Evaluate(si);
         return (1 - amt) * t1 + amt * t2;
     }
+    TextureDomain Domain() const {
+        return Combine(Combine(tex1->Domain(), tex2->Domain()),
+                       amount->Domain());
+    }
 
   private:
     std::shared_ptr<Texture<T>> tex1, tex2;
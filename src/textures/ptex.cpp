@@ -36,6 +36,7 @@
 #include "error.h"
 #include "interaction.h"
 #include "paramset.h"
+#include "parallel.h"
 #include "stats.h"
 
 #include <Ptexture.h>
@@ -48,32 +49,74 @@ namespace {
 // being created/destroyed concurrently by multiple threads.
 int nActiveTextures;
 Ptex::PtexCache *cache;
+// Memory budget that _cache_ was created with, in bytes
+size_t cacheBudget;
 
 STAT_COUNTER("Texture/Ptex lookups", nLookups);
 STAT_COUNTER("Texture/Ptex files accessed", nFilesAccessed);
 STAT_COUNTER("Texture/Ptex block reads", nBlockReads);
+STAT_COUNTER("Texture/Ptex faces prefetched", nPrefetchedFaces);
 STAT_MEMORY_COUNTER("Memory/Ptex peak memory used", peakMemoryUsed);
 
 struct : public PtexErrorHandler {
     void reportError(const char *error) override { Error("%s", error); }
 } errorHandler;
 
+// Reads the data of the given faces into the cache before rendering
+// starts. With no faces given, faces are read in ID order until half of
+// the cache's budget is used.
+void prefetch(Ptex::PtexTexture *texture, std::vector<int> faces) {
+    if (faces.empty()) {
+        size_t budget = cacheBudget / 2;
+        size_t texelBytes =
+            Ptex::DataSize(texture->dataType()) * texture->numChannels();
+        size_t bytes = 0;
+        for (int face = 0; face < texture->numFaces(); ++face) {
+            const Ptex::FaceInfo &info = texture->getFaceInfo(face);
+            bytes += size_t(info.res.u()) * info.res.v() * texelBytes;
+            if (bytes > budget) break;
+            faces.push_back(face);
+        }
+    }
+    ParallelFor([&](int64_t i) {
+        if (faces[i] < 0 || faces[i] >= texture->numFaces()) return;
+        Ptex::PtexFaceData *data = texture->getData(faces[i]);
+        if (data) data->release();
+    }, faces.size(), 16);
+    nPrefetchedFaces += faces.size();
+}
+
 }  // anonymous namespace
 
+template <typename T>
+struct PtexTexture<T>::ThreadFilter {
+    Ptex::PtexTexture *texture = nullptr;
+    Ptex::PtexFilter *filter = nullptr;
+};
+
 // PtexTexture Method Definitions
 template <typename T>
-PtexTexture<T>::PtexTexture(const std::string &filename, Float gamma)
-    : filename(filename), gamma(gamma) {
+PtexTexture<T>::PtexTexture(const std::string &filename, Float gamma,
+                            int budgetMB, bool prefetchAll,
+                            const std::vector<int> &prefetchFaces)
+    : filename(filename),
+      gamma(gamma),
+      threadFilters(new ThreadFilter[MaxThreadIndex()]) {
     if (!cache) {
         CHECK_EQ(nActiveTextures, 0);
         int maxFiles = 100;
-        size_t maxMem = 1ull << 32;  // 4GB
+        cacheBudget =
+            size_t(budgetMB > 0 ? budgetMB : PbrtOptions.ptexBudgetMB) << 20;
         bool premultiply = true;
 
-        cache = Ptex::PtexCache::create(maxFiles, maxMem, premultiply, nullptr,
-                                        &errorHandler);
+        cache = Ptex::PtexCache::create(maxFiles, cacheBudget, premultiply,
+                                        nullptr, &errorHandler);
         // TODO? cache->setSearchPath(...);
-    }
+    } else if (budgetMB > 0 && size_t(budgetMB) << 20 != cacheBudget)
+        // All of the Ptex textures share a single cache
+        Warning("%s: Ptex cache already has a budget of %d MB. Ignoring "
+                "\"budget\" %d.", filename.c_str(), int(cacheBudget >> 20),
+                budgetMB);
     ++nActiveTextures;
 
     // Issue an error if the texture doesn't exist or has an unsupported
@@ -90,6 +133,8 @@ PtexTexture<T>::PtexTexture(const std::string &filename, Float gamma)
         else {
             valid = true;
             LOG(INFO) << filename << ": added ptex texture";
+            if (prefetchAll || !prefetchFaces.empty())
+                prefetch(texture, prefetchFaces);
         }
         texture->release();
     }
@@ -97,6 +142,11 @@ PtexTexture<T>::PtexTexture(const std::string &filename, Float gamma)
 
 template <typename T>
 PtexTexture<T>::~PtexTexture() {
+    for (int i = 0; i < MaxThreadIndex(); ++i)
+        if (threadFilters[i].filter) {
+            threadFilters[i].filter->release();
+            threadFilters[i].texture->release();
+        }
     if (--nActiveTextures == 0) {
         LOG(INFO) << "Releasing ptex cache";
         Ptex::PtexCache::Stats stats;
@@ -140,20 +190,25 @@ T PtexTexture<T>::Evaluate(const SurfaceInteraction &si) const {
     if (!valid) return T{};
 
     ++nLookups;
-    Ptex::String error;
-    Ptex::PtexTexture *texture = cache->get(filename.c_str(), error);
-    CHECK(texture != nullptr);
-    // TODO: make the filter an option?
-    Ptex::PtexFilter::Options opts(Ptex::PtexFilter::FilterType::f_bspline);
-    Ptex::PtexFilter *filter = Ptex::PtexFilter::getFilter(texture, opts);
-    int nc = texture->numChannels();
+    // Reuse this thread's filter, so that lookups neither allocate nor
+    // take the cache's lock
+    DCHECK_LT(ThreadIndex, MaxThreadIndex());
+    ThreadFilter &tf = threadFilters[ThreadIndex];
+    if (!tf.filter) {
+        Ptex::String error;
+        tf.texture = cache->get(filename.c_str(), error);
+        CHECK(tf.texture != nullptr);
+        // TODO: make the filter an option?
+        Ptex::PtexFilter::Options opts(
+            Ptex::PtexFilter::FilterType::f_bspline);
+        tf.filter = Ptex::PtexFilter::getFilter(tf.texture, opts);
+    }
+    int nc = tf.texture->numChannels();
 
     float result[3];
     int firstChan = 0;
-    filter->eval(result, firstChan, nc, si.faceIndex, si.uv[0],
-                 si.uv[1], si.dudx, si.dvdx, si.dudy, si.dvdy);
-    filter->release();
-    texture->release();
+    tf.filter->eval(result, firstChan, nc, si.faceIndex, si.uv[0],
+                    si.uv[1], si.dudx, si.dvdx, si.dudy, si.dvdy);
 
     if (gamma != 1)
         for (int i = 0; i < nc; ++i)
@@ -164,18 +219,31 @@ T PtexTexture<T>::Evaluate(const SurfaceInteraction &si) const {
     return fromResult<T>(nc, result);
 }
 
+// Returns the faces listed by the "prefetchfaces" parameter
+static std::vector<int> findPrefetchFaces(const TextureParams &tp) {
+    int n;
+    const int *faces = tp.GetGeomParams().FindInt("prefetchfaces", &n);
+    return faces ? std::vector<int>(faces, faces + n) : std::vector<int>();
+}
+
 PtexTexture<Float> *CreatePtexFloatTexture(const Transform &tex2world,
                                            const TextureParams &tp) {
     std::string filename = tp.FindFilename("filename");
     Float gamma = tp.FindFloat("gamma", 2.2);
-    return new PtexTexture<Float>(filename, gamma);
+    int budgetMB = tp.FindInt("budget", 0);
+    bool prefetch = tp.FindBool("prefetch", false);
+    return new PtexTexture<Float>(filename, gamma, budgetMB, prefetch,
+                                  findPrefetchFaces(tp));
 }
 
 PtexTexture<Spectrum> *CreatePtexSpectrumTexture(const Transform &tex2world,
                                                  const TextureParams &tp) {
     std::string filename = tp.FindFilename("filename");
     Float gamma = tp.FindFloat("gamma", 2.2);
-    return new PtexTexture<Spectrum>(filename, gamma);
+    int budgetMB = tp.FindInt("budget", 0);
+    bool prefetch = tp.FindBool("prefetch", false);
+    return new PtexTexture<Spectrum>(filename, gamma, budgetMB, prefetch,
+                                     findPrefetchFaces(tp));
 }
 
 }  // namespace pbrt
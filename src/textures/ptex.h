@@ -42,7 +42,9 @@
 #include "pbrt.h"
 #include "texture.h"
 
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace pbrt {
 
@@ -51,14 +53,22 @@ template <typename T>
 class PtexTexture : public Texture<T> {
   public:
     // PtexTexture Public Methods
-    PtexTexture(const std::string &filename, Float gamma);
+    // _budgetMB_ sizes the Ptex cache, which is shared by all Ptex
+    // textures and created by the first one; zero uses --ptexbudget.
+    PtexTexture(const std::string &filename, Float gamma, int budgetMB,
+                bool prefetch = false,
+                const std::vector<int> &prefetchFaces = {});
     ~PtexTexture();
     T Evaluate(const SurfaceInteraction &) const;
 
   private:
+    struct ThreadFilter;
     bool valid;
     const std::string filename;
     const Float gamma;
+    // Indexed by _ThreadIndex_; each thread creates its own filter (and
+    // texture handle) on first use
+    std::unique_ptr<ThreadFilter[]> threadFilters;
 };
 
 PtexTexture<Float> *CreatePtexFloatTexture(const Transform &tex2world,
@@ -56,6 +56,9 @@ class ScaleTexture : public Texture<T2> {
     T2 Evaluate(const SurfaceInteraction &si) const {
         return tex1->Evaluate(si) * tex2->Evaluate(si);
     }
+    TextureDomain Domain() const {
+        return Combine(tex1->Domain(), tex2->Domain());
+    }
 
   private:
     // ScaleTexture Private Data
@@ -58,6 +58,7 @@ class UVTexture : public Texture<Spectrum> {
                         0};
         return Spectrum::FromRGB(rgb);
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     std::unique_ptr<TextureMapping2D> mapping;
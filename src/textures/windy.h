@@ -59,6 +59,7 @@ class WindyTexture : public Texture<T> {
         Float waveHeight = FBm(P, dpdx, dpdy, .5, 6);
         return std::abs(windStrength) * waveHeight;
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     std::unique_ptr<TextureMapping3D> mapping;
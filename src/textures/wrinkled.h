@@ -58,6 +58,7 @@ class WrinkledTexture : public Texture<T> {
         Point3f p = mapping->Map(si, &dpdx, &dpdy);
         return Turbulence(p, dpdx, dpdy, omega, octaves);
     }
+    TextureDomain Domain() const { return mapping->Domain(); }
 
   private:
     // WrinkledTexture Private Data
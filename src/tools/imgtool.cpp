@@ -9,11 +9,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
 #include "fileutil.h"
 #include "imageio.h"
 #include "pbrt.h"
 #include "spectrum.h"
 #include "parallel.h"
+#include "mipmap.h"
+#include "texcache.h"
 extern "C" {
 #include "ext/ArHosekSkyModel.h"
 }
@@ -21,21 +27,28 @@ extern "C" {
 
 using namespace pbrt;
 
-static void usage(const char *msg = nullptr, ...) {
+static void vusage(const char *msg, va_list args) {
     if (msg) {
-        va_list args;
-        va_start(args, msg);
         fprintf(stderr, "imgtool: ");
         vfprintf(stderr, msg, args);
         fprintf(stderr, "\n");
     }
     fprintf(stderr, R"(usage: imgtool <command> [options] <filenames...>
 
-commands: assemble, cat, convert, diff, info, makesky
+commands: assemble, batch, cat, convert, diff, info, makesky, maketiled
 
 assemble option:
     --outfile          Output image filename.
 
+batch options:
+    --nthreads <n>     Number of threads to use. Default: the number of cores
+    <manifest>         File that lists one "convert", "diff" or "info" command
+                       per line, followed by its options and filenames. Blank
+                       lines and lines starting with '#' are ignored. All of
+                       the commands are checked before any is run; they then
+                       run concurrently, and each one's output is printed
+                       when it finishes.
+
 cat option:
     --sort             Sort output by pixel luminance.
 
@@ -80,10 +93,63 @@ makesky options:
                        (Horizontal resolution is twice this value.)
                        Default: 2048
 
+maketiled options:
+    --gamma            Treat the input as gamma-encoded and linearize it.
+                       Default: on for 8-bit formats (PNG, TGA).
+    --nogamma          Treat the input as linear.
+    --tilesize <n>     Width and height of the stored tiles. Default: 64
+    --wrap <mode>      Wrap mode used when resampling non-power-of-two images
+                       ("repeat", "black" or "clamp"). Default: repeat
+
 )");
     exit(1);
 }
 
+static void usage(const char *msg = nullptr, ...) {
+    va_list args;
+    va_start(args, msg);
+    vusage(msg, args);
+    va_end(args);
+}
+
+// Where the commands that can be used in a batch write their output. Run
+// on their own, they write to stdout and stderr and exit on a usage error.
+// In a batch, each job writes to its own files, which are printed once it
+// finishes, and a usage error is printed there and fails just that job.
+struct CommandIO {
+    FILE *out = stdout, *err = stderr;
+    bool batch = false;
+    // Only check the command's arguments; don't run it.
+    bool checkOnly = false;
+};
+
+// Reports a problem with a command's arguments; returns the status for the
+// command to return if it doesn't exit.
+static int usageError(const CommandIO &io, const char *msg, ...) {
+    va_list args;
+    va_start(args, msg);
+    if (!io.batch) vusage(msg, args);
+    vfprintf(io.err, msg, args);
+    fprintf(io.err, "\n");
+    va_end(args);
+    return 1;
+}
+
+// Starts the worker threads for the lifetime of a command, unless they're
+// already running because the command is part of a batch.
+class ParallelScope {
+  public:
+    ParallelScope() : started(!ParallelInitialized()) {
+        if (started) ParallelInit();
+    }
+    ~ParallelScope() {
+        if (started) ParallelCleanup();
+    }
+
+  private:
+    bool started;
+};
+
 int makesky(int argc, char *argv[]) {
     const char *outfile = "sky.exr";
     float albedo = 0.5;
@@ -187,6 +253,79 @@ int makesky(int argc, char *argv[]) {
     return 0;
 }
 
+int maketiled(int argc, char *argv[]) {
+    int tileSize = 64;
+    ImageWrap wrapMode = ImageWrap::Repeat;
+    int gamma = -1;
+    int i;
+    for (i = 0; i < argc; ++i) {
+        if (argv[i][0] != '-') break;
+        if (!strcmp(argv[i], "--gamma") || !strcmp(argv[i], "-gamma"))
+            gamma = 1;
+        else if (!strcmp(argv[i], "--nogamma") || !strcmp(argv[i], "-nogamma"))
+            gamma = 0;
+        else if (!strcmp(argv[i], "--tilesize") ||
+                 !strcmp(argv[i], "-tilesize")) {
+            if (i + 1 == argc) usage("missing value after %s flag", argv[i]);
+            tileSize = atoi(argv[++i]);
+            if (tileSize < 1) usage("--tilesize must be >= 1");
+        } else if (!strcmp(argv[i], "--wrap") || !strcmp(argv[i], "-wrap")) {
+            if (i + 1 == argc) usage("missing value after %s flag", argv[i]);
+            ++i;
+            if (!strcmp(argv[i], "repeat"))
+                wrapMode = ImageWrap::Repeat;
+            else if (!strcmp(argv[i], "black"))
+                wrapMode = ImageWrap::Black;
+            else if (!strcmp(argv[i], "clamp"))
+                wrapMode = ImageWrap::Clamp;
+            else
+                usage("unknown wrap mode \"%s\"", argv[i]);
+        } else
+            usage("unknown \"maketiled\" option");
+    }
+    if (i + 1 >= argc) usage("missing filenames for \"maketiled\"");
+    if (i + 2 < argc) usage("excess filenames provided to \"maketiled\"");
+    const char *inFilename = argv[i], *outFilename = argv[i + 1];
+    if (gamma == -1)
+        gamma = HasExtension(inFilename, ".png") ||
+                HasExtension(inFilename, ".tga");
+
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> image = ReadImage(inFilename, &res);
+    if (!image) {
+        fprintf(stderr, "%s: unable to read image\n", inFilename);
+        return 1;
+    }
+
+    // Flip the image in y and linearize it, as _ImageTexture_ does, so that
+    // the stored pyramid matches the one built when rendering
+    std::unique_ptr<RGBSpectrum[]> texels(new RGBSpectrum[res.x * res.y]);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            RGBSpectrum v = image[(res.y - 1 - y) * res.x + x];
+            if (gamma)
+                for (int c = 0; c < 3; ++c) v[c] = InverseGammaCorrect(v[c]);
+            texels[y * res.x + x] = v;
+        }
+
+    ParallelInit();
+    MIPMap<RGBSpectrum> mipmap(res, texels.get(), false, false, 8.f,
+                               wrapMode);
+    std::vector<Point2i> levelResolution;
+    int sRes = mipmap.Width(), tRes = mipmap.Height();
+    for (int level = 0; level < mipmap.Levels(); ++level) {
+        levelResolution.push_back(Point2i(sRes, tRes));
+        sRes = std::max(1, sRes / 2);
+        tRes = std::max(1, tRes / 2);
+    }
+    bool ok = WriteTiledMIPFile(outFilename, tileSize, levelResolution,
+                                [&](int level, int s, int t) {
+                                    return mipmap.Texel(level, s, t);
+                                });
+    ParallelCleanup();
+    return ok ? 0 : 1;
+}
+
 int assemble(int argc, char *argv[]) {
     if (argc == 0) usage("no filenames provided to \"assemble\"?");
     const char *outfile = nullptr;
@@ -330,7 +469,7 @@ int cat(int argc, char *argv[]) {
     return 0;
 }
 
-int diff(int argc, char *argv[]) {
+int diff(int argc, char *argv[], const CommandIO &io = CommandIO()) {
     float tol = 0.;
     const char *outfile = nullptr;
 
@@ -340,45 +479,51 @@ int diff(int argc, char *argv[]) {
         if (!strcmp(argv[i], "--outfile") || !strcmp(argv[i], "-outfile") ||
             !strcmp(argv[i], "-o")) {
             if (i + 1 == argc)
-                usage("missing filename after %s option", argv[i]);
+                return usageError(io, "missing filename after %s option",
+                                  argv[i]);
             outfile = argv[++i];
         } else if (!strncmp(argv[i], "--outfile=", 10)) {
             outfile = &argv[i][10];
         } else if (!strcmp(argv[i], "--difftol") ||
                    !strcmp(argv[i], "-difftol") || !strcmp(argv[i], "-d")) {
             if (i + 1 == argc)
-                usage("missing filename after %s option", argv[i]);
+                return usageError(io, "missing value after %s option",
+                                  argv[i]);
             ++i;
             if (!isdigit(argv[i][0]) && argv[i][0] != '.')
-                usage("argument after %s doesn't look like a number", argv[i]);
+                return usageError(
+                    io, "argument after %s doesn't look like a number",
+                    argv[i - 1]);
             tol = atof(argv[i]);
         } else if (!strncmp(argv[i], "--difftol=", 10))
             tol = atof(&argv[i][10]);
         else
-            usage("unknown \"diff\" option");
+            return usageError(io, "unknown \"diff\" option \"%s\"", argv[i]);
     }
 
     if (i >= argc)
-        usage("missing filenames for \"diff\"");
+        return usageError(io, "missing filenames for \"diff\"");
     else if (i + 1 >= argc)
-        usage("missing second filename for \"diff\"");
+        return usageError(io, "missing second filename for \"diff\"");
     else if (i + 2 < argc)
-        usage("excess filenames provided to \"diff\"");
+        return usageError(io, "excess filenames provided to \"diff\"");
+    if (io.checkOnly) return 0;
 
+    ParallelScope parallel;
     const char *filename[2] = {argv[i], argv[i + 1]};
     Point2i res[2];
     std::unique_ptr<RGBSpectrum[]> imgs[2] = {ReadImage(filename[0], &res[0]),
                                               ReadImage(filename[1], &res[1])};
     if (!imgs[0]) {
-        fprintf(stderr, "%s: unable to read image\n", filename[0]);
+        fprintf(io.err, "%s: unable to read image\n", filename[0]);
         return 1;
     }
     if (!imgs[1]) {
-        fprintf(stderr, "%s: unable to read image\n", filename[1]);
+        fprintf(io.err, "%s: unable to read image\n", filename[1]);
         return 1;
     }
     if (res[0] != res[1]) {
-        fprintf(stderr,
+        fprintf(io.err,
                 "imgtool: image resolutions don't match \"%s\": (%d, %d) "
                 "\"%s\": (%d, %d)\n",
                 filename[0], res[0].x, res[0].y, filename[1], res[1].x,
@@ -389,30 +534,49 @@ int diff(int argc, char *argv[]) {
     std::unique_ptr<RGBSpectrum[]> diffImage;
     if (outfile) diffImage.reset(new RGBSpectrum[res[0].x * res[0].y]);
 
-    double sum[2] = {0., 0.};
-    int smallDiff = 0, bigDiff = 0;
-    double mse = 0.f;
-    for (int i = 0; i < res[0].x * res[0].y; ++i) {
-        Float rgb[2][3];
-        imgs[0][i].ToRGB(rgb[0]);
-        imgs[1][i].ToRGB(rgb[1]);
-
-        Float diffRGB[3];
-        for (int c = 0; c < 3; ++c) {
-            Float c0 = rgb[0][c], c1 = rgb[1][c];
-            diffRGB[c] = std::abs(c0 - c1);
+    // Accumulate difference statistics for each row in parallel, then sum
+    // them in order so that the results don't depend on the thread count.
+    struct DiffStats {
+        double sum[2] = {0., 0.};
+        int smallDiff = 0, bigDiff = 0;
+        double mse = 0.;
+    };
+    std::vector<DiffStats> rowStats(res[0].y);
+    ParallelFor([&](int64_t y) {
+        DiffStats &stats = rowStats[y];
+        for (int i = y * res[0].x; i < (y + 1) * res[0].x; ++i) {
+            Float rgb[2][3];
+            imgs[0][i].ToRGB(rgb[0]);
+            imgs[1][i].ToRGB(rgb[1]);
+
+            Float diffRGB[3];
+            for (int c = 0; c < 3; ++c) {
+                Float c0 = rgb[0][c], c1 = rgb[1][c];
+                diffRGB[c] = std::abs(c0 - c1);
 
-            if (c0 == 0 && c1 == 0) continue;
+                if (c0 == 0 && c1 == 0) continue;
 
-            sum[0] += c0;
-            sum[1] += c1;
+                stats.sum[0] += c0;
+                stats.sum[1] += c1;
 
-            float d = std::abs(c0 - c1) / c0;
-            mse += (c0 - c1) * (c0 - c1);
-            if (d > .005) ++smallDiff;
-            if (d > .05) ++bigDiff;
+                float d = std::abs(c0 - c1) / c0;
+                stats.mse += (c0 - c1) * (c0 - c1);
+                if (d > .005) ++stats.smallDiff;
+                if (d > .05) ++stats.bigDiff;
+            }
+            if (diffImage) diffImage[i] = RGBSpectrum::FromRGB(diffRGB);
         }
-        if (diffImage) diffImage[i] = RGBSpectrum::FromRGB(diffRGB);
+    }, res[0].y, 16);
+
+    double sum[2] = {0., 0.};
+    int smallDiff = 0, bigDiff = 0;
+    double mse = 0.f;
+    for (const DiffStats &stats : rowStats) {
+        sum[0] += stats.sum[0];
+        sum[1] += stats.sum[1];
+        smallDiff += stats.smallDiff;
+        bigDiff += stats.bigDiff;
+        mse += stats.mse;
     }
 
     double avg[2] = {sum[0] / (3. * res[0].x * res[0].y),
@@ -420,8 +584,8 @@ int diff(int argc, char *argv[]) {
     double avgDelta = (avg[0] - avg[1]) / std::min(avg[0], avg[1]);
     if ((tol == 0. && (bigDiff > 0 || smallDiff > 0)) ||
         (tol > 0. && 100.f * std::abs(avgDelta) > tol)) {
-        printf(
-            "%s %s\n\tImages differ: %d big (%.2f%%), %d small (%.2f%%)\n"
+        fprintf(
+            io.out, "%s %s\n\tImages differ: %d big (%.2f%%), %d small (%.2f%%)\n"
             "\tavg 1 = %g, avg2 = %g (%f%% delta)\n"
             "\tMSE = %g, RMS = %.3f%%\n",
             filename[0], filename[1], bigDiff,
@@ -440,74 +604,110 @@ int diff(int argc, char *argv[]) {
     return 0;
 }
 
-int info(int argc, char *argv[]) {
+int info(int argc, char *argv[], const CommandIO &io = CommandIO()) {
+    if (io.checkOnly) return 0;
+    ParallelScope parallel;
     int err = 0;
     for (int i = 0; i < argc; ++i) {
         Point2i res;
         std::unique_ptr<RGBSpectrum[]> image = ReadImage(argv[i], &res);
         if (!image) {
-            fprintf(stderr, "%s: unable to load image.\n", argv[i]);
+            fprintf(io.err, "%s: unable to load image.\n", argv[i]);
             err = 1;
             continue;
         }
 
-        printf("%s: resolution %d, %d\n", argv[i], res.x, res.y);
-        Float min[3] = {Infinity, Infinity, Infinity};
-        Float max[3] = {-Infinity, -Infinity, -Infinity};
-        double sum[3] = {0., 0., 0.};
-        double logYSum = 0.;
-        int nNaN = 0, nInf = 0, nValid[3] = { 0, 0, 0 };
-        for (int i = 0; i < res.x * res.y; ++i) {
-            Float y = image[i].y();
-            if (!std::isnan(y) && !std::isinf(y))
-                logYSum += std::log(Float(1e-6) + y);
+        fprintf(io.out, "%s: resolution %d, %d\n", argv[i], res.x, res.y);
+        // Gather statistics for each row in parallel and then combine
+        // them in order.
+        struct InfoStats {
+            Float min[3] = {Infinity, Infinity, Infinity};
+            Float max[3] = {-Infinity, -Infinity, -Infinity};
+            double sum[3] = {0., 0., 0.};
+            double logYSum = 0.;
+            int nNaN = 0, nInf = 0, nValid[3] = {0, 0, 0};
+        };
+        std::vector<InfoStats> rowStats(res.y);
+        ParallelFor([&](int64_t py) {
+            InfoStats &stats = rowStats[py];
+            for (int i = py * res.x; i < (py + 1) * res.x; ++i) {
+                Float y = image[i].y();
+                if (!std::isnan(y) && !std::isinf(y))
+                    stats.logYSum += std::log(Float(1e-6) + y);
 
-            Float rgb[3];
-            image[i].ToRGB(rgb);
-            for (int c = 0; c < 3; ++c) {
-                if (std::isnan(rgb[c]))
-                    ++nNaN;
-                else if (std::isinf(rgb[c]))
-                    ++nInf;
-                else {
-                    min[c] = std::min(min[c], rgb[c]);
-                    max[c] = std::max(max[c], rgb[c]);
-                    sum[c] += rgb[c];
-                    ++nValid[c];
+                Float rgb[3];
+                image[i].ToRGB(rgb);
+                for (int c = 0; c < 3; ++c) {
+                    if (std::isnan(rgb[c]))
+                        ++stats.nNaN;
+                    else if (std::isinf(rgb[c]))
+                        ++stats.nInf;
+                    else {
+                        stats.min[c] = std::min(stats.min[c], rgb[c]);
+                        stats.max[c] = std::max(stats.max[c], rgb[c]);
+                        stats.sum[c] += rgb[c];
+                        ++stats.nValid[c];
+                    }
                 }
             }
+        }, res.y, 16);
+
+        InfoStats total;
+        for (const InfoStats &stats : rowStats) {
+            for (int c = 0; c < 3; ++c) {
+                total.min[c] = std::min(total.min[c], stats.min[c]);
+                total.max[c] = std::max(total.max[c], stats.max[c]);
+                total.sum[c] += stats.sum[c];
+                total.nValid[c] += stats.nValid[c];
+            }
+            total.logYSum += stats.logYSum;
+            total.nNaN += stats.nNaN;
+            total.nInf += stats.nInf;
         }
-        printf("%s: %d infinite pixel components, %d NaN, (%d, %d, %d) valid.\n",
-               argv[i], nInf, nNaN, nValid[0], nValid[1], nValid[2]);
-        printf("%s: log average luminance %f\n", argv[i],
-               std::exp(logYSum / (res.x * res.y)));
-        printf("%s: min rgb (%f, %f, %f)\n", argv[i], min[0], min[1], min[2]);
-        printf("%s: max rgb (%f, %f, %f)\n", argv[i], max[0], max[1], max[2]);
-        printf("%s: avg rgb (%f, %f, %f)\n", argv[i], sum[0] / nValid[0],
-               sum[1] / nValid[1], sum[2] / nValid[2]);
+        const Float *min = total.min, *max = total.max;
+        const double *sum = total.sum;
+        double logYSum = total.logYSum;
+        int nNaN = total.nNaN, nInf = total.nInf;
+        const int *nValid = total.nValid;
+        fprintf(io.out,
+                "%s: %d infinite pixel components, %d NaN, (%d, %d, %d) "
+                "valid.\n",
+                argv[i], nInf, nNaN, nValid[0], nValid[1], nValid[2]);
+        fprintf(io.out, "%s: log average luminance %f\n", argv[i],
+                std::exp(logYSum / (res.x * res.y)));
+        fprintf(io.out, "%s: min rgb (%f, %f, %f)\n", argv[i], min[0], min[1],
+                min[2]);
+        fprintf(io.out, "%s: max rgb (%f, %f, %f)\n", argv[i], max[0], max[1],
+                max[2]);
+        fprintf(io.out, "%s: avg rgb (%f, %f, %f)\n", argv[i],
+                sum[0] / nValid[0], sum[1] / nValid[1], sum[2] / nValid[2]);
     }
     return err;
 }
 
 std::unique_ptr<RGBSpectrum[]> bloom(std::unique_ptr<RGBSpectrum[]> image,
                                      const Point2i &res, Float level, int width,
-                                     Float scale, int iters) {
+                                     Float scale, int iters, FILE *err) {
     std::vector<std::unique_ptr<RGBSpectrum[]>> blurred;
 
     // First, threshold the source image
-    int nSurvivors = 0;
+    std::atomic<int> nSurvivors{0};
     std::unique_ptr<RGBSpectrum[]> thresholded(new RGBSpectrum[res.x * res.y]);
-    for (int i = 0; i < res.x * res.y; ++i) {
-        Float rgb[3];
-        image[i].ToRGB(rgb);
-        if (rgb[0] > level || rgb[1] > level || rgb[2] > level) {
-            ++nSurvivors;
-            thresholded[i] = image[i];
-        } else
-            thresholded[i] = 0.f;
-    }
+    ParallelFor([&](int64_t y) {
+        int rowSurvivors = 0;
+        for (int i = y * res.x; i < (y + 1) * res.x; ++i) {
+            Float rgb[3];
+            image[i].ToRGB(rgb);
+            if (rgb[0] > level || rgb[1] > level || rgb[2] > level) {
+                ++rowSurvivors;
+                thresholded[i] = image[i];
+            } else
+                thresholded[i] = 0.f;
+        }
+        nSurvivors += rowSurvivors;
+    }, res.y, 16);
     if (nSurvivors == 0) {
-        fprintf(stderr,
+        fprintf(err,
                 "imgtool: warning: no pixels were above bloom threshold %f\n",
                 level);
         return image;
@@ -517,7 +717,7 @@ std::unique_ptr<RGBSpectrum[]> bloom(std::unique_ptr<RGBSpectrum[]> image,
     if ((width % 2) == 0) {
         ++width;
         fprintf(
-            stderr,
+            err,
             "imgtool: bloom width must be an odd value. Rounding up to %d.\n",
             width);
     }
@@ -548,41 +748,45 @@ std::unique_ptr<RGBSpectrum[]> bloom(std::unique_ptr<RGBSpectrum[]> image,
     std::unique_ptr<RGBSpectrum[]> blurx(new RGBSpectrum[res.x * res.y]);
     for (int iter = 0; iter < iters; ++iter) {
         // Separable blur; first blur in x into blurx
-        for (int y = 0; y < res.y; ++y) {
+        ParallelFor([&](int64_t y) {
             for (int x = 0; x < res.x; ++x) {
                 RGBSpectrum result = 0;
                 for (int r = -radius; r <= radius; ++r)
-                    result +=
-                        wts[r + radius] * getTexel(blurred.back(), {x + r, y});
+                    result += wts[r + radius] *
+                              getTexel(blurred.back(), {x + r, int(y)});
                 blurx[y * res.x + x] = result;
             }
-        }
+        }, res.y, 8);
 
         // Now blur in y from blur x to the result
         std::unique_ptr<RGBSpectrum[]> blury(new RGBSpectrum[res.x * res.y]);
-        for (int y = 0; y < res.y; ++y) {
+        ParallelFor([&](int64_t y) {
             for (int x = 0; x < res.x; ++x) {
                 RGBSpectrum result = 0;
                 for (int r = -radius; r <= radius; ++r)
-                    result += wts[r + radius] * getTexel(blurx, {x, y + r});
+                    result +=
+                        wts[r + radius] * getTexel(blurx, {x, int(y) + r});
                 blury[y * res.x + x] = result;
             }
-        }
+        }, res.y, 8);
         blurred.push_back(std::move(blury));
     }
 
     // Finally, add all of the blurred images, scaled, to the original.
-    for (int i = 0; i < res.x * res.y; ++i) {
-        RGBSpectrum blurredSum = 0.f;
-        // Skip the thresholded image, since it's already present in the
-        // original; just add pixels from the blurred ones.
-        for (size_t j = 1; j < blurred.size(); ++j) blurredSum += blurred[j][i];
-        image[i] += (scale / iters) * blurredSum;
-    }
+    ParallelFor([&](int64_t y) {
+        for (int i = y * res.x; i < (y + 1) * res.x; ++i) {
+            RGBSpectrum blurredSum = 0.f;
+            // Skip the thresholded image, since it's already present in the
+            // original; just add pixels from the blurred ones.
+            for (size_t j = 1; j < blurred.size(); ++j)
+                blurredSum += blurred[j][i];
+            image[i] += (scale / iters) * blurredSum;
+        }
+    }, res.y, 16);
     return image;
 }
 
-int convert(int argc, char *argv[]) {
+int convert(int argc, char *argv[], const CommandIO &io = CommandIO()) {
     float scale = 1.f;
     int repeat = 1;
     bool flipy = false;
@@ -596,7 +800,8 @@ int convert(int argc, char *argv[]) {
     bool preserveColors = false;
 
     int i;
-    auto parseArg = [&]() -> std::pair<std::string, double> {
+    // Returns false if the flag's value is missing.
+    auto parseArg = [&](std::pair<std::string, double> *arg) -> bool {
         const char *ptr = argv[i];
         // Skip over a leading dash or two.
         CHECK_EQ(*ptr, '-');
@@ -607,13 +812,12 @@ int convert(int argc, char *argv[]) {
         std::string flag;
         while (*ptr && *ptr != '=') flag += *ptr++;
 
-        if (!*ptr && i + 1 == argc)
-            usage("missing value after %s flag", argv[i]);
+        if (!*ptr && i + 1 == argc) return false;
         const char *value = (*ptr == '=') ? (ptr + 1) : argv[++i];
-        return {flag, atof(value)};
+        *arg = {flag, atof(value)};
+        return true;
     };
 
-    std::pair<std::string, double> arg;
     for (i = 0; i < argc; ++i) {
         if (argv[i][0] != '-') break;
         if (!strcmp(argv[i], "--flipy") || !strcmp(argv[i], "-flipy"))
@@ -623,18 +827,23 @@ int convert(int argc, char *argv[]) {
         else if (!strcmp(argv[i], "--preservecolors") || !strcmp(argv[i], "-preservecolors"))
             preserveColors = !preserveColors;
         else {
-            std::pair<std::string, double> arg = parseArg();
+            std::pair<std::string, double> arg;
+            if (!parseArg(&arg))
+                return usageError(io, "missing value after %s flag", argv[i]);
             if (std::get<0>(arg) == "maxluminance") {
                 maxY = std::get<1>(arg);
                 if (maxY <= 0)
-                    usage("--maxluminance value must be greater than zero");
+                    return usageError(
+                        io, "--maxluminance value must be greater than zero");
             } else if (std::get<0>(arg) == "repeatpix") {
                 repeat = int(std::get<1>(arg));
                 if (repeat <= 0)
-                    usage("--repeatpix value must be greater than zero");
+                    return usageError(
+                        io, "--repeatpix value must be greater than zero");
             } else if (std::get<0>(arg) == "scale") {
                 scale = std::get<1>(arg);
-                if (scale == 0) usage("--scale value must be non-zero");
+                if (scale == 0)
+                    return usageError(io, "--scale value must be non-zero");
             } else if (std::get<0>(arg) == "bloomlevel")
                 bloomLevel = std::get<1>(arg);
             else if (std::get<0>(arg) == "bloomwidth")
@@ -646,30 +855,35 @@ int convert(int argc, char *argv[]) {
             else if (std::get<0>(arg) == "despike")
                 despikeLimit = std::get<1>(arg);
             else
-                usage();
+                return usageError(io, "unknown \"convert\" option \"--%s\"",
+                                  std::get<0>(arg).c_str());
         }
     }
 
-    if (i + 1 >= argc)
-        usage("missing second filename for \"convert\"");
-    else if (i >= argc)
-        usage("missing filenames for \"convert\"");
+    if (i >= argc)
+        return usageError(io, "missing filenames for \"convert\"");
+    else if (i + 1 >= argc)
+        return usageError(io, "missing second filename for \"convert\"");
+    if (io.checkOnly) return 0;
 
+    ParallelScope parallel;
     const char *inFilename = argv[i], *outFilename = argv[i + 1];
     Point2i res;
     std::unique_ptr<RGBSpectrum[]> image(ReadImage(inFilename, &res));
     if (!image) {
-        fprintf(stderr, "%s: unable to read image\n", inFilename);
+        fprintf(io.err, "%s: unable to read image\n", inFilename);
         return 1;
     }
 
-    for (int i = 0; i < res.x * res.y; ++i) image[i] *= scale;
+    ParallelFor([&](int64_t y) {
+        for (int i = y * res.x; i < (y + 1) * res.x; ++i) image[i] *= scale;
+    }, res.y, 32);
 
     if (despikeLimit < Infinity) {
         std::unique_ptr<RGBSpectrum[]> filteredImg(
             new RGBSpectrum[res.x * res.y]);
-        int despikeCount = 0;
-        for (int y = 0; y < res.y; ++y) {
+        std::atomic<int> despikeCount{0};
+        ParallelFor([&](int64_t y) {
             for (int x = 0; x < res.x; ++x) {
                 if (image[y * res.x + x].y() < despikeLimit) {
                     filteredImg[y * res.x + x] = image[y * res.x + x];
@@ -698,49 +912,54 @@ int convert(int argc, char *argv[]) {
                     });
                 filteredImg[y * res.x + x] = neighbors[mid];
             }
-        }
+        }, res.y, 16);
         std::swap(image, filteredImg);
-        fprintf(stderr, "%s: despiked %d pixels\n", inFilename, despikeCount);
+        fprintf(io.err, "%s: despiked %d pixels\n", inFilename,
+                despikeCount.load());
     }
 
     if (bloomLevel < Infinity)
         image = bloom(std::move(image), res, bloomLevel, bloomWidth, bloomScale,
-                      bloomIters);
+                      bloomIters, io.err);
 
     if (tonemap) {
-        for (int i = 0; i < res.x * res.y; ++i) {
-            Float y = image[i].y();
-            // Reinhard et al. photographic tone mapping operator.
-            Float scale = (1 + y / (maxY * maxY)) / (1 + y);
-            image[i] *= scale;
-        }
+        ParallelFor([&](int64_t py) {
+            for (int i = py * res.x; i < (py + 1) * res.x; ++i) {
+                Float y = image[i].y();
+                // Reinhard et al. photographic tone mapping operator.
+                Float scale = (1 + y / (maxY * maxY)) / (1 + y);
+                image[i] *= scale;
+            }
+        }, res.y, 32);
     }
 
     if (preserveColors) {
-        for (int i = 0; i < res.x * res.y; ++i) {
-            Float rgb[3];
-            image[i].ToRGB(rgb);
-            Float m = std::max(rgb[0], std::max(rgb[1], rgb[2]));
-            if (m > 1) {
-                rgb[0] /= m;
-                rgb[1] /= m;
-                rgb[2] /= m;
-                image[i] = RGBSpectrum::FromRGB(rgb);
+        ParallelFor([&](int64_t y) {
+            for (int i = y * res.x; i < (y + 1) * res.x; ++i) {
+                Float rgb[3];
+                image[i].ToRGB(rgb);
+                Float m = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+                if (m > 1) {
+                    rgb[0] /= m;
+                    rgb[1] /= m;
+                    rgb[2] /= m;
+                    image[i] = RGBSpectrum::FromRGB(rgb);
+                }
             }
-        }
+        }, res.y, 32);
     }
 
     if (repeat > 1) {
         std::unique_ptr<RGBSpectrum[]> rscale(
             new RGBSpectrum[repeat * res.x * repeat * res.y]);
-        RGBSpectrum *rsp = rscale.get();
-        for (int y = 0; y < repeat * res.y; ++y) {
+        ParallelFor([&](int64_t y) {
+            RGBSpectrum *rsp = &rscale[y * repeat * res.x];
             int yy = y / repeat;
             for (int x = 0; x < repeat * res.x; ++x) {
                 int xx = x / repeat;
                 *rsp++ = image[yy * res.x + xx];
             }
-        }
+        }, repeat * res.y, 32);
         res.x *= repeat;
         res.y *= repeat;
         image = std::move(rscale);
@@ -761,6 +980,129 @@ int convert(int argc, char *argv[]) {
     return 0;
 }
 
+// Appends what was written to the temporary file _from_ to _to_; does
+// nothing if they're the same file.
+static void copyOutput(FILE *from, FILE *to) {
+    if (from == to) return;
+    rewind(from);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), from)) > 0) fwrite(buf, 1, n, to);
+}
+
+int batch(int argc, char *argv[]) {
+    int i;
+    for (i = 0; i < argc; ++i) {
+        if (argv[i][0] != '-') break;
+        if (!strcmp(argv[i], "--nthreads") || !strcmp(argv[i], "-nthreads")) {
+            if (i + 1 == argc)
+                usage("missing value after %s flag", argv[i]);
+            PbrtOptions.nThreads = atoi(argv[++i]);
+        } else if (!strncmp(argv[i], "--nthreads=", 11))
+            PbrtOptions.nThreads = atoi(&argv[i][11]);
+        else
+            usage("unknown \"batch\" option");
+    }
+    if (i >= argc)
+        usage("missing manifest filename for \"batch\"");
+    else if (i + 1 < argc)
+        usage("excess filenames provided to \"batch\"");
+
+    // Read the manifest, splitting each command line into arguments
+    std::ifstream manifest(argv[i]);
+    if (!manifest) {
+        fprintf(stderr, "%s: unable to open manifest\n", argv[i]);
+        return 1;
+    }
+    struct Job {
+        int lineNumber;
+        std::vector<std::string> args;
+    };
+    std::vector<Job> jobs;
+    std::string line;
+    for (int lineNumber = 1; std::getline(manifest, line); ++lineNumber) {
+        std::istringstream words(line);
+        Job job{lineNumber, {}};
+        std::string word;
+        while (words >> word) job.args.push_back(word);
+        if (job.args.empty() || job.args[0][0] == '#') continue;
+        const std::string &cmd = job.args[0];
+        if (cmd != "convert" && cmd != "diff" && cmd != "info") {
+            fprintf(stderr, "%s:%d: \"%s\" can't be used in a batch\n",
+                    argv[i], lineNumber, cmd.c_str());
+            return 1;
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    auto run = [](Job &job, const CommandIO &io) {
+        std::vector<char *> jobArgv;
+        for (size_t a = 1; a < job.args.size(); ++a)
+            jobArgv.push_back(&job.args[a][0]);
+        jobArgv.push_back(nullptr);
+        int jobArgc = jobArgv.size() - 1;
+
+        if (job.args[0] == "convert")
+            return convert(jobArgc, &jobArgv[0], io);
+        else if (job.args[0] == "diff")
+            return diff(jobArgc, &jobArgv[0], io);
+        else
+            return info(jobArgc, &jobArgv[0], io);
+    };
+
+    // Check all of the jobs' arguments before running any of them.
+    int nInvalid = 0;
+    for (Job &job : jobs) {
+        CommandIO io;
+        io.batch = io.checkOnly = true;
+        io.err = tmpfile();
+        if (!io.err) io.err = stderr;
+        if (run(job, io) != 0) {
+            fprintf(stderr, "%s:%d: ", argv[i], job.lineNumber);
+            copyOutput(io.err, stderr);
+            ++nInvalid;
+        }
+        if (io.err != stderr) fclose(io.err);
+    }
+    if (nInvalid > 0) return 1;
+
+    // Run the jobs concurrently; each one also parallelizes its per-pixel
+    // work over the same worker threads. Each job's output is collected
+    // and printed when it finishes, so that jobs' output isn't interleaved.
+    ParallelInit();
+    std::atomic<int> nFailed{0};
+    std::mutex outputMutex;
+    ParallelFor([&](int64_t j) {
+        Job &job = jobs[j];
+        CommandIO io;
+        io.batch = true;
+        io.out = tmpfile();
+        io.err = tmpfile();
+        if (!io.out) io.out = stdout;
+        if (!io.err) io.err = stderr;
+        int status = run(job, io);
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+        copyOutput(io.out, stdout);
+        copyOutput(io.err, stderr);
+        if (status != 0) {
+            fprintf(stderr, "%s:%d: \"%s\" returned status %d\n", argv[i],
+                    job.lineNumber, job.args[0].c_str(), status);
+            ++nFailed;
+        }
+        fflush(stdout);
+        fflush(stderr);
+        if (io.out != stdout) fclose(io.out);
+        if (io.err != stderr) fclose(io.err);
+    }, jobs.size());
+    ParallelCleanup();
+
+    if (nFailed > 0)
+        fprintf(stderr, "imgtool: %d of %d batch commands returned nonzero "
+                "status\n", nFailed.load(), int(jobs.size()));
+    return nFailed > 0 ? 1 : 0;
+}
+
 int main(int argc, char *argv[]) {
     google::InitGoogleLogging(argv[0]);
     FLAGS_stderrthreshold = 1; // Warning and above.
@@ -769,6 +1111,8 @@ int main(int argc, char *argv[]) {
 
     if (!strcmp(argv[1], "assemble"))
         return assemble(argc - 2, argv + 2);
+    else if (!strcmp(argv[1], "batch"))
+        return batch(argc - 2, argv + 2);
     else if (!strcmp(argv[1], "cat"))
         return cat(argc - 2, argv + 2);
     else if (!strcmp(argv[1], "convert"))
@@ -779,6 +1123,8 @@ int main(int argc, char *argv[]) {
         return info(argc - 2, argv + 2);
     else if (!strcmp(argv[1], "makesky"))
         return makesky(argc - 2, argv + 2);
+    else if (!strcmp(argv[1], "maketiled"))
+        return maketiled(argc - 2, argv + 2);
     else
         usage("unknown command \"%s\"", argv[1]);
 